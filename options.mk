@@ -15,4 +15,5 @@ LDFLAGS=-L/usr/pkg/lib -Wl,-rpath,/usr/pkg/lib\
 	-lncursesw\
 	-lgnupanelw\
 	-lpthread\
-	-lssl
+	-lssl\
+	-lz
@@ -0,0 +1,26 @@
+#ifndef ATOMIC_PTR_H
+#define ATOMIC_PTR_H
+
+/*
+ * A pointer published by one thread and read by others. The store
+ * releases: what was written to the object before it is published is
+ * seen by a reader whose load (an acquire) sees the pointer.
+ */
+
+#if defined(UNIX)
+#include <stdatomic.h>
+
+#define ATOMIC_PTR(type)	type *_Atomic
+#define atomic_ptr_load(p)	atomic_load_explicit(p, memory_order_acquire)
+#define atomic_ptr_store(p, v)	atomic_store_explicit(p, v, memory_order_release)
+#elif defined(WIN32)
+#include <windows.h>
+
+/* Volatile accesses have acquire/release semantics with /volatile:ms */
+#define ATOMIC_PTR(type)	type *volatile
+#define atomic_ptr_load(p)	(*(p))
+#define atomic_ptr_store(p, v)	\
+	((void) InterlockedExchangePointer((PVOID volatile *) (p), (v)))
+#endif
+
+#endif
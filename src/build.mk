@@ -2,16 +2,19 @@ SRC_DIR:=src/
 TGTS+=swirc
 
 OBJS+=$(SRC_DIR)assertAPI.o\
+	$(SRC_DIR)colorPairs.o\
 	$(SRC_DIR)config.o\
 	$(SRC_DIR)curses-funcs.o\
 	$(SRC_DIR)cursesInit.o\
 	$(SRC_DIR)dataClassify.o\
 	$(SRC_DIR)errHand.o\
 	$(SRC_DIR)filePred.o\
+	$(SRC_DIR)happyEyeballs.o\
 	$(SRC_DIR)interpreter.o\
 	$(SRC_DIR)io-loop.o\
 	$(SRC_DIR)irc.o\
 	$(SRC_DIR)libUtils.o\
+	$(SRC_DIR)lineScan.o\
 	$(SRC_DIR)main.o\
 	$(SRC_DIR)nestHome.o\
 	$(SRC_DIR)net-unix.o\
@@ -21,6 +24,8 @@ OBJS+=$(SRC_DIR)assertAPI.o\
 	$(SRC_DIR)pthrMutex.o\
 	$(SRC_DIR)readline.o\
 	$(SRC_DIR)readlineAPI.o\
+	$(SRC_DIR)resolver.o\
+	$(SRC_DIR)scrollback.o\
 	$(SRC_DIR)sig-unix.o\
 	$(SRC_DIR)statusbar.o\
 	$(SRC_DIR)strHand.o\
@@ -29,7 +34,9 @@ OBJS+=$(SRC_DIR)assertAPI.o\
 	$(SRC_DIR)strdup_printf.o\
 	$(SRC_DIR)term-unix.o\
 	$(SRC_DIR)terminal.o\
+	$(SRC_DIR)textDecode.o\
 	$(SRC_DIR)textBuffer.o\
+	$(SRC_DIR)textIndex.o\
 	$(SRC_DIR)theme.o\
 	$(SRC_DIR)titlebar.o\
 	$(SRC_DIR)wcscat.o\
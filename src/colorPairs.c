@@ -0,0 +1,447 @@
+/* Colour-pair manager
+   Copyright (C) 2018 Markus Uhlin. All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   - Neither the name of the author nor the names of its contributors may be
+     used to endorse or promote products derived from this software without
+     specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+   BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+#include "common.h"
+
+#include <string.h>
+
+#include "assertAPI.h"
+#include "colorPairs.h"
+#include "curses-funcs.h"
+#include "errHand.h"
+#include "libUtils.h"
+#include "mutex.h"
+
+#define PAIR_HASH_SIZE 1024 /* power of two */
+
+/*
+ * Pairs are looked up through a hash table of (fg, bg). Static pairs
+ * (those set up by curses_init()) are never touched. The dynamic ones
+ * are kept on an LRU list, and when COLOR_PAIRS is exhausted the
+ * least recently used is redefined.
+ */
+struct pair_slot {
+    short int	fg;
+    short int	bg;
+    short int	hash_next; /* next pair in the bucket, or 0 */
+    short int	lru_prev;  /* more recently used, or 0 */
+    short int	lru_next;  /* less recently used, or 0 */
+    bool	pinned;
+};
+
+#if defined(UNIX)
+static pthread_mutex_t	pairs_mutex;
+#elif defined(WIN32)
+static HANDLE		pairs_mutex;
+#endif
+
+static struct pair_slot		*slot      = NULL; /* by pair number */
+static short int		 bucket[PAIR_HASH_SIZE];
+static short int		 npairs    = 0;    /* highest usable */
+static short int		 next_free = 1;
+static short int		 lru_head  = 0;
+static short int		 lru_tail  = 0;
+static INIT_PAIR_FN		 init_pair_fn = NULL;
+static struct color_pairs_stats	 stats     = { 0, 0, 0 };
+
+/*
+ * The mIRC colors 16-98 as indexes in the xterm 256-color palette.
+ * See https://modern.ircdocs.horse/formatting.html#colors-16-98
+ */
+static const unsigned char mirc_ext_xterm[83] = {
+     52,  94, 100,  58,  22,  29,  23,  24,  17,  54,  53,  89, /* 16-27 */
+     88, 130, 142,  64,  28,  35,  30,  25,  18,  91,  90, 125, /* 28-39 */
+    124, 166, 184, 106,  34,  49,  37,  33,  19, 129, 127, 161, /* 40-51 */
+    196, 208, 226, 154,  46,  86,  51,  75,  21, 171, 201, 198, /* 52-63 */
+    203, 215, 227, 191,  83, 122,  87, 111,  63, 177, 207, 205, /* 64-75 */
+    217, 223, 229, 193, 157, 158, 159, 153, 147, 183, 219, 212, /* 76-87 */
+     16, 233, 235, 237, 239, 241, 244, 247, 250, 254, 231,      /* 88-98 */
+};
+
+/*
+ * The colors of an 8-color terminal, dim and bright, used to find the
+ * nearest match when 256 colors aren't available
+ */
+static const unsigned long int basic_rgb[16] = {
+    0x000000, 0xcd0000, 0x00cd00, 0xcdcd00,
+    0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5,
+    0x7f7f7f, 0xff0000, 0x00ff00, 0xffff00,
+    0x5c5cff, 0xff00ff, 0x00ffff, 0xffffff,
+};
+
+static const unsigned char cube_level[6] = { 0, 95, 135, 175, 215, 255 };
+
+/* Palette of the terminal: mIRC colors 16-98, mapped at init time */
+static short int	mirc_ext_color[83];
+static bool		mirc_ext_bright[83];
+static int		term_colors = 8;
+
+static SW_INLINE unsigned int
+hash(short int fg, short int bg)
+{
+    const unsigned int key = ((unsigned int) (fg + 1) << 9) ^
+	(unsigned int) (bg + 1);
+
+    return ((key * 2654435761U) >> 16) & (PAIR_HASH_SIZE - 1);
+}
+
+static unsigned long int
+xterm_to_rgb(int index)
+{
+    if (index < 16) {
+	return basic_rgb[index];
+    } else if (index < 232) {
+	const int i = index - 16;
+
+	return (cube_level[i / 36] << 16) | (cube_level[i / 6 % 6] << 8) |
+	    cube_level[i % 6];
+    } else {
+	const unsigned long int level = 8 + (index - 232) * 10;
+
+	return (level << 16) | (level << 8) | level;
+    }
+}
+
+static unsigned long int
+rgb_distance(unsigned long int a, unsigned long int b)
+{
+    const long int dr = (long int) ((a >> 16) & 0xff) - ((b >> 16) & 0xff);
+    const long int dg = (long int) ((a >> 8) & 0xff) - ((b >> 8) & 0xff);
+    const long int db = (long int) (a & 0xff) - (b & 0xff);
+
+    return (unsigned long int) (dr * dr + dg * dg + db * db);
+}
+
+static int
+nearest_cube_level(int value)
+{
+    int i;
+
+    for (i = 0; i < 5; i++) {
+	if (value < (cube_level[i] + cube_level[i + 1]) / 2)
+	    break;
+    }
+
+    return i;
+}
+
+/**
+ * Nearest color in the xterm 256-color palette (colors 16-255)
+ */
+static int
+rgb_to_xterm(unsigned long int rgb)
+{
+    const int r = nearest_cube_level((rgb >> 16) & 0xff);
+    const int g = nearest_cube_level((rgb >> 8) & 0xff);
+    const int b = nearest_cube_level(rgb & 0xff);
+    const int cube = 16 + 36 * r + 6 * g + b;
+    const int avg = (int) ((((rgb >> 16) & 0xff) + ((rgb >> 8) & 0xff) +
+	(rgb & 0xff)) / 3);
+    const int gray = 232 + (avg > 238 ? 23 : (avg < 8 ? 0 : (avg - 3) / 10));
+
+    return (rgb_distance(rgb, xterm_to_rgb(gray)) <
+	rgb_distance(rgb, xterm_to_rgb(cube)) ? gray : cube);
+}
+
+/**
+ * Nearest basic color. If 'bright' is set the color should be
+ * displayed in bold.
+ */
+static short int
+rgb_to_basic(unsigned long int rgb, bool *bright)
+{
+    int best = 0;
+
+    for (int i = 1; i < 16; i++) {
+	if (rgb_distance(rgb, basic_rgb[i]) <
+	    rgb_distance(rgb, basic_rgb[best]))
+	    best = i;
+    }
+
+    *bright = (best >= 8);
+    return (short int) (best % 8);
+}
+
+static void
+lru_unlink(short int pair)
+{
+    struct pair_slot *sp = &slot[pair];
+
+    if (sp->lru_prev)
+	slot[sp->lru_prev].lru_next = sp->lru_next;
+    else
+	lru_head = sp->lru_next;
+    if (sp->lru_next)
+	slot[sp->lru_next].lru_prev = sp->lru_prev;
+    else
+	lru_tail = sp->lru_prev;
+    sp->lru_prev = sp->lru_next = 0;
+}
+
+static void
+lru_push_front(short int pair)
+{
+    struct pair_slot *sp = &slot[pair];
+
+    sp->lru_prev = 0;
+    sp->lru_next = lru_head;
+    if (lru_head)
+	slot[lru_head].lru_prev = pair;
+    lru_head = pair;
+    if (!lru_tail)
+	lru_tail = pair;
+}
+
+static void
+hash_insert(short int pair)
+{
+    const unsigned int h = hash(slot[pair].fg, slot[pair].bg);
+
+    slot[pair].hash_next = bucket[h];
+    bucket[h] = pair;
+}
+
+static void
+hash_remove(short int pair)
+{
+    short int *pp = &bucket[hash(slot[pair].fg, slot[pair].bg)];
+
+    while (*pp && *pp != pair)
+	pp = &slot[*pp].hash_next;
+    if (*pp)
+	*pp = slot[pair].hash_next;
+    slot[pair].hash_next = 0;
+}
+
+static short int
+lookup(short int fg, short int bg)
+{
+    short int pair;
+
+    if (slot == NULL)
+	return -1;
+    for (pair = bucket[hash(fg, bg)]; pair; pair = slot[pair].hash_next) {
+	if (slot[pair].fg == fg && slot[pair].bg == bg)
+	    return pair;
+    }
+    return -1;
+}
+
+/**
+ * Initialize the manager. Called by curses_init() once the static
+ * pairs are set up.
+ *
+ * @param static_pairs Pairs 1 to 'static_pairs' are static
+ * @param max_pairs    COLOR_PAIRS
+ * @param colors       COLORS
+ * @param fn           Function used to define pairs (init_pair)
+ * @return Void
+ */
+void
+color_pairs_init(short int static_pairs, int max_pairs, int colors,
+		 INIT_PAIR_FN fn)
+{
+    short int fg, bg;
+
+    color_pairs_deinit();
+    mutex_new(&pairs_mutex);
+
+    npairs = (short int) (max_pairs - 1 > COLOR_PAIRS_MAX ? COLOR_PAIRS_MAX :
+	max_pairs - 1);
+    if (npairs < static_pairs)
+	npairs = static_pairs;
+    slot = xcalloc((size_t) npairs + 1, sizeof *slot);
+    BZERO(bucket, sizeof bucket);
+    next_free = static_pairs + 1;
+    lru_head = lru_tail = 0;
+    init_pair_fn = fn;
+    BZERO(&stats, sizeof stats);
+
+    for (short int pair = 1; pair <= static_pairs; pair++) {
+	if (pair_content(pair, &fg, &bg) == ERR)
+	    continue;
+	slot[pair].fg = fg;
+	slot[pair].bg = bg;
+	slot[pair].pinned = true;
+	if (lookup(fg, bg) == -1)
+	    hash_insert(pair);
+    }
+
+    term_colors = colors;
+    for (size_t i = 0; i < ARRAY_SIZE(mirc_ext_xterm); i++) {
+	if (term_colors >= 256) {
+	    mirc_ext_color[i] = mirc_ext_xterm[i];
+	    mirc_ext_bright[i] = false;
+	} else {
+	    mirc_ext_color[i] = rgb_to_basic(xterm_to_rgb(mirc_ext_xterm[i]),
+		&mirc_ext_bright[i]);
+	}
+    }
+}
+
+void
+color_pairs_deinit(void)
+{
+    if (slot == NULL)
+	return;
+    free(slot);
+    slot = NULL;
+    npairs = 0;
+    mutex_destroy(&pairs_mutex);
+}
+
+/**
+ * Map an extended mIRC color (16-98) to a color of the terminal
+ *
+ * @param num    Color number
+ * @param bright If non-NULL: set to true if the color should be
+ *               displayed in bold (8-color terminals)
+ * @return The color
+ */
+short int
+color_from_mirc(int num, bool *bright)
+{
+    sw_assert(num >= 16 && num <= 98);
+
+    if (bright)
+	*bright = mirc_ext_bright[num - 16];
+    return mirc_ext_color[num - 16];
+}
+
+/**
+ * Map a color given as 0xRRGGBB to a color of the terminal
+ *
+ * @see color_from_mirc()
+ */
+short int
+color_from_rgb(unsigned long int rgb, bool *bright)
+{
+    bool b = false;
+    short int color;
+
+    if (term_colors >= 256)
+	color = (short int) rgb_to_xterm(rgb);
+    else
+	color = rgb_to_basic(rgb, &b);
+    if (bright)
+	*bright = b;
+    return color;
+}
+
+/**
+ * Search for a color pair with given foreground/background.
+ *
+ * @param fg Foreground
+ * @param bg Background
+ * @return A color pair number, or -1 if not found.
+ */
+short int
+color_pair_find(short int fg, short int bg)
+{
+    short int pair;
+
+    if (slot == NULL)
+	return -1;
+    mutex_lock(&pairs_mutex);
+    pair = lookup(fg, bg);
+    mutex_unlock(&pairs_mutex);
+    return pair;
+}
+
+/**
+ * Get a color pair with given foreground/background, defining one if
+ * needed
+ *
+ * @param fg Foreground
+ * @param bg Background
+ * @return A color pair number, or -1 on error.
+ */
+short int
+color_pair_get(short int fg, short int bg)
+{
+    short int pair;
+
+    if (slot == NULL)
+	return -1;
+
+    mutex_lock(&pairs_mutex);
+
+    if ((pair = lookup(fg, bg)) != -1) {
+	if (!slot[pair].pinned && pair != lru_head) {
+	    lru_unlink(pair);
+	    lru_push_front(pair);
+	}
+	stats.hits++;
+	mutex_unlock(&pairs_mutex);
+	return pair;
+    }
+
+    if (next_free <= npairs) {
+	pair = next_free;
+    } else if (lru_tail) {
+	pair = lru_tail;
+	lru_unlink(pair);
+	hash_remove(pair);
+	stats.recycled++;
+    } else {
+	mutex_unlock(&pairs_mutex);
+	return -1;
+    }
+
+    if (init_pair_fn(pair, fg, bg) == ERR) {
+	if (pair == next_free) {
+	    /* The terminal has fewer pairs than it claims: don't try
+	     * further ones. */
+	    npairs = pair - 1;
+	} else {
+	    /* still defined as before */
+	    hash_insert(pair);
+	    lru_push_front(pair);
+	}
+	mutex_unlock(&pairs_mutex);
+	return -1;
+    }
+
+    if (pair == next_free)
+	next_free++;
+    slot[pair].fg = fg;
+    slot[pair].bg = bg;
+    hash_insert(pair);
+    lru_push_front(pair);
+    stats.allocs++;
+
+    mutex_unlock(&pairs_mutex);
+    return pair;
+}
+
+void
+color_pairs_stats(struct color_pairs_stats *out)
+{
+    *out = stats;
+}
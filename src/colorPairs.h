@@ -0,0 +1,23 @@
+#ifndef COLOR_PAIRS_H
+#define COLOR_PAIRS_H
+
+/* The most pairs managed, static ones included */
+#define COLOR_PAIRS_MAX 4096
+
+struct color_pairs_stats {
+    unsigned long int hits;
+    unsigned long int allocs;
+    unsigned long int recycled;
+};
+
+typedef int (*INIT_PAIR_FN)(short int, short int, short int);
+
+short int	color_from_mirc    (int num, bool *bright);
+short int	color_from_rgb     (unsigned long int rgb, bool *bright);
+short int	color_pair_find    (short int fg, short int bg);
+short int	color_pair_get     (short int fg, short int bg);
+void		color_pairs_deinit (void);
+void		color_pairs_init   (short int static_pairs, int max_pairs, int colors, INIT_PAIR_FN);
+void		color_pairs_stats  (struct color_pairs_stats *);
+
+#endif
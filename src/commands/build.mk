@@ -12,6 +12,7 @@ OBJS=$(COMMANDS_DIR)connect.o\
 	$(COMMANDS_DIR)invite.o\
 	$(COMMANDS_DIR)services.o\
 	$(COMMANDS_DIR)theme.o\
-	$(COMMANDS_DIR)sasl.o
+	$(COMMANDS_DIR)sasl.o\
+	$(COMMANDS_DIR)lastlog.o
 
 CFLAGS+=-I $(COMMANDS_DIR)
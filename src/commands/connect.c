@@ -169,6 +169,7 @@ do_connect(const char *server, const char *port)
 	.username = "",
 	.rl_name  = "",
 	.nickname = "",
+	.tls      = false,
     };
 
     if (g_cmdline_opts->username) {
@@ -216,6 +217,7 @@ do_connect(const char *server, const char *port)
 	if (!is_ssl_enabled() && Strings_match(conn_ctx.port, SSL_PORT))
 	    set_ssl_on();
 
+	conn_ctx.tls = is_ssl_enabled();
 	net_connect(&conn_ctx);
 
 	if (conn_ctx.password) {
@@ -294,8 +296,7 @@ cmd_connect(const char *data)
     char *server, *port;
     char *state = "";
     int feeds_written = 0;
-
-    set_ssl_off();
+    bool tls = false;
 
     if (Strings_match(dcopy, "") || is_whiteSpace(dcopy)) {
 	print_and_free("/connect: missing arguments", dcopy);
@@ -306,13 +307,13 @@ cmd_connect(const char *data)
 	token = strtok_r(dcopy, "\n:", &state);
 	sw_assert(token != NULL);
 	if (Strings_match(token, "-tls") || Strings_match(token, "-ssl"))
-	    set_ssl_on();
+	    tls = true;
 
 	server = strtok_r(NULL, "\n:", &state);
 	sw_assert(server != NULL);
 
 	if ((port = strtok_r(NULL, "\n:", &state)) == NULL)
-	    port = is_ssl_enabled() ? SSL_PORT : "6667";
+	    port = tls ? SSL_PORT : "6667";
     } else if (feeds_written == 0) {
 	server = strtok_r(dcopy, "\n:", &state);
 	sw_assert(server != NULL);
@@ -339,6 +340,12 @@ cmd_connect(const char *data)
 	print_and_free("/connect: bogus port number", dcopy);
 	return;
     } else {
+	/* not before: a connection in progress must keep its mode */
+	if (tls)
+	    set_ssl_on();
+	else
+	    set_ssl_off();
+
 	if (Strings_match_ignore_case(server, "efnet"))
 	    do_connect(get_server(efnet_servers,
 		ARRAY_SIZE(efnet_servers), "EFnet servers"), port);
@@ -366,6 +373,13 @@ cmd_disconnect(const char *data)
 {
     const bool has_message = !Strings_match(data, "");
 
+    if (g_connection_in_progress) {
+	net_connect_cancel();
+    } else if (!g_on_air) {
+	print_and_free("/disconnect: not connected", NULL);
+	return;
+    }
+
     if (g_on_air) {
 	if (has_message)
 	    net_send("QUIT :%s", data);
@@ -0,0 +1,304 @@
+/* commands/lastlog.c  --  search the scrollback of windows
+   Copyright (C) 2018 Markus Uhlin. All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   - Neither the name of the author nor the names of its contributors may be
+     used to endorse or promote products derived from this software without
+     specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+   BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+#include "common.h"
+
+#include <string.h>
+
+#include "../errHand.h"
+#include "../libUtils.h"
+#include "../printtext.h"
+#include "../strHand.h"
+#include "../textBuffer.h"
+#include "../textIndex.h"
+#include "../window.h"
+
+#if defined(UNIX)
+#include "../pthrMutex.h"
+#elif defined(WIN32)
+#include "../vcMutex.h"
+#endif
+
+#include "lastlog.h"
+
+#define LASTLOG_MAX_LINES 100 /* per window */
+#define LASTLOG_THREADS   4
+
+struct lastlog_job {
+    PIRC_WINDOW	  window;
+    int		 *nums;		/* candidate lines, ascending */
+    int		  n;		/* -1: no index, scan all lines */
+    char	**match;	/* newest first */
+    int		  nmatch;
+};
+
+static struct printtext_context ptext_ctx = {
+    .window	= NULL,
+    .spec_type	= TYPE_SPEC1_FAILURE,
+    .include_ts = true,
+};
+
+static struct lastlog_job *jobs = NULL;
+static int njobs = 0;
+static int next_job = 0;
+static const char *pattern = NULL;
+
+#if defined(UNIX)
+static pthread_mutex_t jobs_mutex = PTHREAD_MUTEX_INITIALIZER;
+#elif defined(WIN32)
+static HANDLE jobs_mutex;
+#endif
+
+/*
+ * Look up the candidate lines of the jobs in the trigram indexes.
+ * The indexes aren't changed while printtext is locked, so several
+ * workers can read them at once.
+ */
+static void
+candidates(void)
+{
+    for (;;) {
+	struct lastlog_job *job;
+
+	mutex_lock(&jobs_mutex);
+	job = (next_job < njobs ? &jobs[next_job++] : NULL);
+	mutex_unlock(&jobs_mutex);
+
+	if (job == NULL)
+	    break;
+	else if (job->window->buf->index == NULL)
+	    job->n = -1;
+	else
+	    job->n = textIndex_candidates(job->window->buf->index, pattern,
+		&job->nums);
+    }
+}
+
+#if defined(UNIX)
+static void *
+candidates_fn(void *arg)
+{
+    (void) arg;
+    candidates();
+    return NULL;
+}
+
+/*
+ * Fan the index lookups out over a few threads. Searching a single
+ * window isn't worth a thread.
+ */
+static void
+fan_out(void)
+{
+    pthread_t id[LASTLOG_THREADS];
+    int nthreads = (njobs < LASTLOG_THREADS ? njobs : LASTLOG_THREADS);
+
+    if (nthreads <= 1) {
+	candidates();
+	return;
+    }
+
+    for (int i = 0; i < nthreads; i++) {
+	if ((errno = pthread_create(&id[i], NULL, candidates_fn, NULL)) != 0)
+	    err_sys("pthread_create");
+    }
+    for (int i = 0; i < nthreads; i++) {
+	if ((errno = pthread_join(id[i], NULL)) != 0)
+	    err_sys("pthread_join");
+    }
+}
+#elif defined(WIN32)
+static void
+fan_out(void)
+{
+    candidates();
+}
+#endif
+
+static bool
+line_matches(PTEXTBUF buf, int num, char **norm, size_t *normsize,
+	     const char **text)
+{
+    PTEXTBUF_ELMT element;
+    TEXTBUF_ELMT scratch;
+    size_t size;
+
+    if ((element = textBuf_get_line(buf, num, &scratch)) == NULL ||
+	!element->indexed)
+	return false;
+    if ((size = strlen(element->text) + 1) > *normsize) {
+	free_not_null(*norm);
+	*norm = xmalloc(size);
+	*normsize = size;
+    }
+
+    textIndex_normalize(element->text, *norm);
+    *text = element->text;
+    return (strstr(*norm, pattern) != NULL);
+}
+
+/*
+ * Check the candidates of a job, newest first, as the index only
+ * knows which trigrams the lines have
+ */
+static void
+verify(struct lastlog_job *job)
+{
+    PTEXTBUF buf = job->window->buf;
+    char *norm = NULL;
+    const char *text;
+    size_t normsize = 0;
+    const int first = (job->n < 0 ? buf->trimmed : 0);
+    const int last = (job->n < 0 ? textBuf_end_num(buf) - 1 : job->n - 1);
+
+    job->match = xcalloc(LASTLOG_MAX_LINES, sizeof *job->match);
+    job->nmatch = 0;
+
+    for (int i = last; i >= first && job->nmatch < LASTLOG_MAX_LINES; i--) {
+	const int num = (job->n < 0 ? i : job->nums[i]);
+
+	if (line_matches(buf, num, &norm, &normsize, &text))
+	    job->match[job->nmatch++] = sw_strdup(text);
+    }
+
+    free_not_null(norm);
+}
+
+/*
+ * The matches are printed unindexed, or the next search would find
+ * them too
+ */
+static void
+print_matches(const struct lastlog_job *job, bool label)
+{
+    struct printtext_context ctx = {
+	.window	    = g_active_window,
+	.spec_type  = TYPE_SPEC_NONE,
+	.include_ts = false,
+	.unindexed  = true,
+    };
+
+    if (job->nmatch == 0)
+	return;
+    if (label)
+	printtext(&ctx, "%c%s%c:", BOLD, job->window->label, BOLD);
+    for (int i = job->nmatch - 1; i >= 0; i--)
+	printtext(&ctx, "%s", job->match[i]);
+}
+
+static void
+free_jobs(void)
+{
+    for (struct lastlog_job *job = &jobs[0]; job < &jobs[njobs]; job++) {
+	for (int i = 0; i < job->nmatch; i++)
+	    free(job->match[i]);
+	free_not_null(job->match);
+	free_not_null(job->nums);
+    }
+
+    free_not_null(jobs);
+    jobs = NULL;
+    njobs = next_job = 0;
+}
+
+/*
+ * usage: /lastlog [-window | -all] <pattern>
+ *
+ * Case-insensitive search of the lines in memory of the active window
+ * (-window, the default) or of all windows (-all). Text decoration is
+ * ignored.
+ */
+void
+cmd_lastlog(const char *data)
+{
+    bool all = false;
+    char *norm;
+    const char *cp = data;
+    int total = 0;
+
+    ptext_ctx.window = g_active_window;
+
+    if (!strncmp(cp, "-all", 4) && (cp[4] == ' ' || cp[4] == '\0')) {
+	all = true;
+	cp += 4;
+    } else if (!strncmp(cp, "-window", 7) &&
+	       (cp[7] == ' ' || cp[7] == '\0')) {
+	cp += 7;
+    }
+
+    while (*cp == ' ')
+	cp++;
+    if (Strings_match(cp, "")) {
+	printtext(&ptext_ctx, "/lastlog: missing arguments");
+	return;
+    }
+
+    norm = sw_strdup(cp);
+    textIndex_normalize(cp, norm);
+    pattern = norm;
+
+    printtext_lock();
+#if defined(WIN32)
+    mutex_new(&jobs_mutex);
+#endif
+
+    jobs = xcalloc(all ? g_ntotal_windows : 1, sizeof *jobs);
+
+    if (!all) {
+	jobs[njobs++].window = g_active_window;
+    } else {
+	for (int refnum = 1; refnum <= g_ntotal_windows; refnum++) {
+	    PIRC_WINDOW window;
+
+	    if ((window = window_by_refnum(refnum)) != NULL)
+		jobs[njobs++].window = window;
+	}
+    }
+
+    fan_out();
+
+    for (int i = 0; i < njobs; i++) {
+	verify(&jobs[i]);
+	total += jobs[i].nmatch;
+    }
+
+#if defined(WIN32)
+    mutex_destroy(&jobs_mutex);
+#endif
+    printtext_unlock();
+
+    for (int i = 0; i < njobs; i++)
+	print_matches(&jobs[i], all);
+    if (total == 0)
+	printtext(&ptext_ctx, "/lastlog: no matches");
+
+    free_jobs();
+    pattern = NULL;
+    free(norm);
+}
@@ -0,0 +1,6 @@
+#ifndef CMD_LASTLOG_H
+#define CMD_LASTLOG_H
+
+void cmd_lastlog(const char *data);
+
+#endif
@@ -40,6 +40,12 @@
 
 #include "misc.h"
 
+#if defined(UNIX)
+#define PRINT_SZ	"%zu"
+#elif defined(WIN32)
+#define PRINT_SZ	"%Iu"
+#endif
+
 static struct printtext_context ptext_ctx = {
     .window	= NULL,
     .spec_type	= TYPE_SPEC1_FAILURE,
@@ -52,6 +58,9 @@ cmd_quit(const char *data)
 {
     const bool has_message = !Strings_match(data, "");
 
+    /* don't leave a connect thread printing into windows torn down */
+    net_connect_cancel();
+
     if (g_on_air) {
 	if (has_message)
 	    (void) net_send("QUIT :%s", data);
@@ -364,3 +373,69 @@ cmd_close(const char *data)
 	destroy_chat_window(g_active_window->label);
     }
 }
+
+/* usage: /scrollback */
+void
+cmd_scrollback(const char *data)
+{
+    struct printtext_context ctx = {
+	.window	    = g_active_window,
+	.spec_type  = TYPE_SPEC1,
+	.include_ts = true,
+    };
+
+    ptext_ctx.window = g_active_window;
+
+    if (!Strings_match(data, "")) {
+	printtext(&ptext_ctx, "/scrollback: implicit trailing data");
+	return;
+    }
+
+    printtext(&ctx, "Scrollback in memory: " PRINT_SZ " bytes "
+	"(budget %d MB)", window_scrollback_bytes(),
+	config_current()->scrollback_budget);
+
+    for (int refnum = 1; refnum <= g_ntotal_windows; refnum++) {
+	PIRC_WINDOW window;
+
+	if ((window = window_by_refnum(refnum)) == NULL)
+	    continue;
+	printtext(&ctx, "%d %c%s%c: " PRINT_SZ " bytes, %d lines, "
+	    "%d evicted", refnum, BOLD, window->label, BOLD,
+	    textBuf_bytes(window->buf), textBuf_size(window->buf),
+	    window->evicted);
+    }
+}
+
+/* usage: /perf */
+void
+cmd_perf(const char *data)
+{
+    struct printtext_context ctx = {
+	.window	    = g_active_window,
+	.spec_type  = TYPE_SPEC1,
+	.include_ts = true,
+    };
+    struct term_refresh_stats refresh;
+    unsigned long int full, resumed;
+
+    ptext_ctx.window = g_active_window;
+
+    if (!Strings_match(data, "")) {
+	printtext(&ptext_ctx, "/perf: implicit trailing data");
+	return;
+    }
+
+    printtext_lock();
+    term_get_refresh_stats(&refresh);
+    printtext_unlock();
+
+    printtext(&ctx, "Screen: %lu frames, %lu updates coalesced "
+	"(frame rate %d)", refresh.frames, refresh.coalesced,
+	config_current()->frame_rate);
+
+    net_ssl_handshake_stats(&full, &resumed);
+    printtext(&ctx, "TLS: %lu full handshakes, %lu resumed "
+	"(session cache %s)", full, resumed,
+	config_current()->ssl_session_cache ? "on" : "off");
+}
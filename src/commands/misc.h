@@ -18,5 +18,7 @@ void cmd_cycle   (const char *);
 void cmd_version (const char *);
 void cmd_time    (const char *);
 void cmd_close   (const char *);
+void cmd_scrollback(const char *);
+void cmd_perf    (const char *);
 
 #endif
@@ -317,8 +317,8 @@ install_theme(const char *name)
 static void
 list_remote()
 {
-#define B1 Theme("notice_inner_b1")
-#define B2 Theme("notice_inner_b2")
+#define B1 theme_current()->notice_inner_b1
+#define B2 theme_current()->notice_inner_b2
     PTHEME_INFO ar_p = NULL;
     struct printtext_context ctx = {
 	.window	    = g_active_window,
@@ -357,9 +357,7 @@ set_theme(const char *name)
 	printtext(&ctx, "non-existent");
 	return;
     }
-    theme_deinit();
-    theme_init();
-    theme_readit(buf, "r");
+    theme_reload(buf);
     (void) config_item_undef("theme");
     (void) config_item_install("theme", name);
     BZERO(buf, sizeof buf);
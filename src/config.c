@@ -28,6 +28,7 @@
    POSSIBILITY OF SUCH DAMAGE. */
 
 #include "common.h"
+#include "atomicPtr.h"
 #include "config.h"
 #include "errHand.h"
 #include "interpreter.h"
@@ -48,6 +49,50 @@
 
 static PCONF_HTBL_ENTRY hash_table[300];
 
+/*
+ * Published snapshots. The newest is the current one, and is read
+ * without a lock. The older ones are kept until config_deinit(), since
+ * any thread may still be reading one; a snapshot is about a hundred
+ * bytes, and one is published per change of settings. Only the main
+ * thread publishes.
+ */
+struct published_snapshot {
+    struct config_snapshot	 values;
+    struct published_snapshot	*older;
+};
+
+static ATOMIC_PTR(struct published_snapshot) current_snapshot = NULL;
+
+static bool reading_config = false;
+
+/* Used before the config has been read */
+static const struct config_snapshot default_snapshot = {
+    .encoding			= TEXT_ENC_ISO8859_1,
+    .cmd_hist_size		= 50,
+    .connection_timeout		= 45,
+    .dns_cache_ttl		= 300,
+    .flood_burst		= 5,
+    .flood_interval		= 2000,
+    .frame_rate			= 30,
+    .max_chat_windows		= 60,
+    .scrollback_budget		= 32,
+    .textbuffer_size_absolute	= 1000,
+    .disable_beeps		= false,
+    .hostname_checking		= true,
+    .kick_close_window		= true,
+    .recode			= false,
+    .sasl			= false,
+    .scrollback_compress	= true,
+    .scrollback_index		= true,
+    .scrollback_spill		= true,
+    .show_ping_pong		= true,
+    .skip_motd			= false,
+    .ssl_ktls			= true,
+    .ssl_session_cache		= true,
+    .ssl_verify_peer		= true,
+    .startup_greeting		= true,
+};
+
 static struct tagConfDefValues {
     char		*setting_name;
     enum setting_type	 type;
@@ -59,8 +104,13 @@ static struct tagConfDefValues {
     { "cmd_hist_size",             TYPE_INTEGER, "50" },
     { "connection_timeout",        TYPE_INTEGER, "45" },
     { "disable_beeps",             TYPE_BOOLEAN, "no" },
+    { "dns_cache_ttl",             TYPE_INTEGER, "300" },
     { "encoding",                  TYPE_STRING,  "iso-8859-1" },
+    { "flood_burst",               TYPE_INTEGER, "5" },
+    { "flood_interval",            TYPE_INTEGER, "2000" },
+    { "frame_rate",                TYPE_INTEGER, "30" },
     { "hostname_checking",         TYPE_BOOLEAN, "yes" },
+    { "hosts_file",                TYPE_STRING,  "" },
     { "kick_close_window",         TYPE_BOOLEAN, "yes" },
     { "max_chat_windows",          TYPE_INTEGER, "60" },
     { "nickname",                  TYPE_STRING,  "warezkid" },
@@ -73,8 +123,14 @@ static struct tagConfDefValues {
     { "sasl_mechanism",            TYPE_STRING,  "PLAIN" },
     { "sasl_password",             TYPE_STRING,  "" },
     { "sasl_username",             TYPE_STRING,  "" },
+    { "scrollback_budget",         TYPE_INTEGER, "32" },
+    { "scrollback_compress",       TYPE_BOOLEAN, "yes" },
+    { "scrollback_index",          TYPE_BOOLEAN, "yes" },
+    { "scrollback_spill",          TYPE_BOOLEAN, "yes" },
     { "show_ping_pong",            TYPE_BOOLEAN, "no" },
     { "skip_motd",                 TYPE_BOOLEAN, "no" },
+    { "ssl_ktls",                  TYPE_BOOLEAN, "yes" },
+    { "ssl_session_cache",         TYPE_BOOLEAN, "yes" },
     { "ssl_verify_peer",           TYPE_BOOLEAN, "YES" },
     { "startup_greeting",          TYPE_BOOLEAN, "yes" },
     { "textbuffer_size_absolute",  TYPE_INTEGER, "1500" },
@@ -139,6 +195,7 @@ config_deinit(void)
 {
     PCONF_HTBL_ENTRY *entry_p;
     PCONF_HTBL_ENTRY p, tmp;
+    struct published_snapshot *snap, *older;
 
     ENTRY_FOREACH(entry_p) {
 	for (p = *entry_p; p != NULL; p = tmp) {
@@ -146,6 +203,14 @@ config_deinit(void)
 	    hUndef(p);
 	}
     }
+
+    snap = atomic_ptr_load(&current_snapshot);
+    atomic_ptr_store(&current_snapshot, NULL);
+
+    for (; snap != NULL; snap = older) {
+	older = snap->older;
+	free(snap);
+    }
 }
 
 /*lint -sem(get_hash_table_entry, r_null) */
@@ -193,6 +258,73 @@ hInstall(const char *name, const char *value)
     hash_table[hashval] = item;
 }
 
+static int
+integer_setting(char *name, long int lo, long int hi, long int fallback)
+{
+    struct integer_unparse_context unparse_ctx = {
+	.setting_name	  = name,
+	.lo_limit	  = lo,
+	.hi_limit	  = hi,
+	.fallback_default = fallback,
+    };
+
+    return ((int) config_integer_unparse(&unparse_ctx));
+}
+
+/*
+ * Parse the settings into a new snapshot and make it the current one
+ */
+static void
+publish_snapshot(void)
+{
+    struct published_snapshot *snap = xcalloc(sizeof *snap, 1);
+    struct config_snapshot *v = &snap->values;
+
+    v->encoding = text_encoding_by_name(Config("encoding"));
+    v->cmd_hist_size = integer_setting("cmd_hist_size", 0, 300, 50);
+    v->connection_timeout =
+	integer_setting("connection_timeout", 1, 300, 45); /* 5 min */
+    v->dns_cache_ttl = integer_setting("dns_cache_ttl", 0, 86400, 300);
+    v->flood_burst = integer_setting("flood_burst", 1, 100, 5);
+    v->flood_interval = integer_setting("flood_interval", 0, 60000, 2000);
+    v->frame_rate = integer_setting("frame_rate", 1, 1000, 30);
+    v->max_chat_windows = integer_setting("max_chat_windows", 10, 200, 60);
+    v->scrollback_budget =
+	integer_setting("scrollback_budget", 1, 4096, 32); /* MB */
+    v->textbuffer_size_absolute =
+	integer_setting("textbuffer_size_absolute", 350, 100000, 1000);
+
+    v->disable_beeps	 = config_bool_unparse("disable_beeps", false);
+    v->hostname_checking = config_bool_unparse("hostname_checking", true);
+    v->kick_close_window = config_bool_unparse("kick_close_window", true);
+    v->recode		 = config_bool_unparse("recode", false);
+    v->sasl		 = config_bool_unparse("sasl", false);
+    v->scrollback_compress =
+	config_bool_unparse("scrollback_compress", true);
+    v->scrollback_index	 = config_bool_unparse("scrollback_index", true);
+    v->scrollback_spill	 = config_bool_unparse("scrollback_spill", true);
+    v->show_ping_pong	 = config_bool_unparse("show_ping_pong", true);
+    v->skip_motd	 = config_bool_unparse("skip_motd", false);
+    v->ssl_ktls		 = config_bool_unparse("ssl_ktls", true);
+    v->ssl_session_cache = config_bool_unparse("ssl_session_cache", true);
+    v->ssl_verify_peer	 = config_bool_unparse("ssl_verify_peer", true);
+    v->startup_greeting	 = config_bool_unparse("startup_greeting", true);
+
+    snap->older = atomic_ptr_load(&current_snapshot);
+    atomic_ptr_store(&current_snapshot, snap);
+}
+
+/*
+ * Get the current snapshot of the settings read on hot paths
+ */
+const struct config_snapshot *
+config_current(void)
+{
+    const struct published_snapshot *snap = atomic_ptr_load(&current_snapshot);
+
+    return (snap != NULL ? &snap->values : &default_snapshot);
+}
+
 int
 config_item_install(const char *name, const char *value)
 {
@@ -204,6 +336,9 @@ config_item_install(const char *name, const char *value)
 	hInstall(name, value);
     }
 
+    if (!reading_config)
+	publish_snapshot();
+
     return (0);
 }
 
@@ -371,6 +506,8 @@ config_readit(const char *path, const char *mode)
     char      buf[3200] = "";
     long int  line_num  = 0;
 
+    reading_config = true;
+
     while (BZERO(buf, sizeof buf), fgets(buf, sizeof buf, fp) != NULL) {
 	const char		*ccp = &buf[0];
 	char			*line;
@@ -395,6 +532,8 @@ config_readit(const char *path, const char *mode)
     if (feof(fp)) {
 	fclose_ensure_success(fp);
 	init_missing_to_defs();
+	reading_config = false;
+	publish_snapshot();
     } else if (ferror(fp)) {
 	err_quit("fgets returned NULL and the error indicator is set");
     } else {
@@ -2,6 +2,7 @@
 #define CONFIG_H
 
 #include "int_unparse.h"
+#include "textDecode.h"
 
 typedef struct tagCONF_HTBL_ENTRY {
     char *name;
@@ -9,6 +10,39 @@ typedef struct tagCONF_HTBL_ENTRY {
     struct tagCONF_HTBL_ENTRY *next;
 } CONF_HTBL_ENTRY, *PCONF_HTBL_ENTRY;
 
+/*
+ * The settings that are read on hot paths, parsed and range-checked.
+ * A new snapshot is published after the config has been read and
+ * whenever a setting is installed. Published snapshots are never
+ * modified, and stay valid until config_deinit().
+ */
+struct config_snapshot {
+    enum text_encoding	encoding;
+    int			cmd_hist_size;
+    int			connection_timeout;
+    int			dns_cache_ttl;
+    int			flood_burst;
+    int			flood_interval;
+    int			frame_rate;
+    int			max_chat_windows;
+    int			scrollback_budget;
+    int			textbuffer_size_absolute;
+    bool		disable_beeps;
+    bool		hostname_checking;
+    bool		kick_close_window;
+    bool		recode;
+    bool		sasl;
+    bool		scrollback_compress;
+    bool		scrollback_index;
+    bool		scrollback_spill;
+    bool		show_ping_pong;
+    bool		skip_motd;
+    bool		ssl_ktls;
+    bool		ssl_session_cache;
+    bool		ssl_verify_peer;
+    bool		startup_greeting;
+};
+
 /*lint -sem(Config_mod, r_null) */
 
 bool		 config_bool_unparse    (const char *setting_name, bool fallback_default);
@@ -23,4 +57,6 @@ void		 config_do_save         (const char *path, const char *mode);
 void		 config_init            (void);
 void		 config_readit          (const char *path, const char *mode);
 
+const struct config_snapshot *config_current(void);
+
 #endif
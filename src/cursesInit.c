@@ -29,6 +29,7 @@
 
 #include "common.h"
 
+#include "colorPairs.h"
 #include "curses-funcs.h"
 #include "cursesInit.h"
 #include "errHand.h"
@@ -68,7 +69,7 @@ init_color_pairs()
     }
 
     /* Initialize a color on the default background of the terminal */
-    if (theme_bool_unparse("term_use_default_colors", true)) {
+    if (theme_current()->term_use_default_colors) {
 	short int *psi;
 
 	for (psi = &colors[0]; psi < &colors[numColors]; psi++) {
@@ -118,11 +119,11 @@ curses_init(void)
     g_endwin_fn   = endwin;
     g_doupdate_fn = doupdate;
 
-    if (!theme_bool_unparse("term_enable_colors", true) || !has_colors() ||
+    if (!theme_current()->term_enable_colors || !has_colors() ||
 	start_color() == ERR) {
 	g_no_colors = true;
     } else {
-	if (theme_bool_unparse("term_use_default_colors", true) &&
+	if (theme_current()->term_use_default_colors &&
 	    use_default_colors() != OK) {
 	    err_msg("use_default_colors() ran unsuccessful!\n"
 		"Troubleshooting: set option term_use_default_colors to NO.");
@@ -142,6 +143,8 @@ curses_init(void)
 
     if (!g_no_colors && (g_initialized_pairs = init_color_pairs()) < 0) {
 	return ERR;
+    } else if (!g_no_colors) {
+	color_pairs_init(g_initialized_pairs, COLOR_PAIRS, COLORS, init_pair);
     }
 
     return OK;
@@ -179,7 +179,7 @@ event_kick(struct irc_message_compo *compo)
 	reason++;
 
     if (Strings_match_ignore_case(victim, g_my_nickname)) {
-	if (config_bool_unparse("kick_close_window", true)) {
+	if (config_current()->kick_close_window) {
 	    switch (destroy_chat_window(channel)) {
 	    case EINVAL:
 	    case ENOENT:
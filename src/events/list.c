@@ -53,30 +53,24 @@ event_liststart(struct irc_message_compo *compo)
 void
 event_list(struct irc_message_compo *compo)
 {
-    char *state = "";
-    char *channel, *num_visible, *topic;
+    const struct irc_slice *channel, *num_visible;
     struct printtext_context ctx = {
 	.window	    = g_status_window,
 	.spec_type  = TYPE_SPEC3,
 	.include_ts = true,
     };
 
-    channel = num_visible = topic = NULL;
-
-    if (Strfeed(compo->params, 3) != 3)
-	return;
-
-    (void) strtok_r(compo->params, "\n", &state); /* my nick (not used) */
-    if ((channel = strtok_r(NULL, "\n", &state)) == NULL ||
-	(num_visible = strtok_r(NULL, "\n", &state)) == NULL ||
-	(topic = strtok_r(NULL, "\n", &state)) == NULL)
+    if (compo->num_params < 4)
 	return;
 
-    if (*topic == ':')
-	topic++;
+    /* param[0]: my nick (not used) */
+    channel     = &compo->param[1];
+    num_visible = &compo->param[2];
 
-    printtext(&ctx, "%s%s%c%s%s%s: %s",
-	      COLOR1, channel, NORMAL,
-	      Theme("notice_inner_b1"), num_visible, Theme("notice_inner_b2"),
-	      topic);
+    printtext(&ctx, "%s%.*s%c%s%.*s%s: %s",
+	      COLOR1, (int) channel->len, channel->str, NORMAL,
+	      theme_current()->notice_inner_b1,
+	      (int) num_visible->len, num_visible->str,
+	      theme_current()->notice_inner_b2,
+	      compo->param[3].str);
 }
@@ -864,24 +864,19 @@ void
 event_names(struct irc_message_compo *compo)
 {
     PIRC_WINDOW win;
-    char *chan_type, *channel, *names;
-    char *names_copy, *cp, *token;
-    char *state1, *state2;
-
-    state1 = state2 = "";
-
-    if (Strfeed(compo->params, 3) != 3) {
+    char channel[IRC_MAX_MESSAGE];
+    char token[IRC_MAX_MESSAGE];
+    const char *names, *end;
+
+    /*
+     * param[0]: recipient, param[1]: channel type
+     */
+    if (compo->num_params < 4) {
 	goto bad;
     }
 
-    (void) strtok_r(compo->params, "\n", &state1); /* recipient */
-    chan_type = strtok_r(NULL, "\n", &state1);
-    channel   = strtok_r(NULL, "\n", &state1);
-    names     = strtok_r(NULL, "\n", &state1);
-
-    if (chan_type == NULL || channel == NULL || names == NULL) {
-	goto bad;
-    }
+    (void) irc_slice_copy(&compo->param[2], channel, sizeof channel);
+    names = compo->param[3].str;
 
     if (isEmpty(names_channel) && sw_strcpy(names_channel, channel,
 	sizeof names_channel) != 0) {
@@ -896,17 +891,23 @@ event_names(struct irc_message_compo *compo)
 	err_log(0, "warning: server sent event 353 (RPL_NAMREPLY): "
 	    "already received names for channel %s", channel);
 	return;
-    } else {
-	names_copy = sw_strdup(*names == ':' ? &names[1] : &names[0]);
     }
 
-    for (cp = &names_copy[0];; cp = NULL) {
+    for (; *names; names = end) {
 	struct hInstall_context ctx;
+	struct irc_slice slice;
 
-	if ((token = strtok_r(cp, " ", &state2)) == NULL) {
-	    break;
+	if (*names == ' ') {
+	    end = &names[1];
+	    continue;
+	} else if ((end = strchr(names, ' ')) == NULL) {
+	    end = &names[strlen(names)];
 	}
 
+	slice.str = names;
+	slice.len = end - names;
+	(void) irc_slice_copy(&slice, token, sizeof token);
+
 	ctx.channel    = channel;
 	ctx.nick       =
 	    ((*token == '~' || *token == '&' || *token == '@' ||
@@ -922,7 +923,6 @@ event_names(struct irc_message_compo *compo)
 	hInstall(&ctx);
     }
 
-    free(names_copy);
     return;
 
   bad:
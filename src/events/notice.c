@@ -38,10 +38,10 @@
 
 #include "notice.h"
 
-#define INNER_B1	Theme("notice_inner_b1")
-#define INNER_B2	Theme("notice_inner_b2")
-#define NCOLOR1		Theme("notice_color1")
-#define NCOLOR2		Theme("notice_color2")
+#define INNER_B1	theme_current()->notice_inner_b1
+#define INNER_B2	theme_current()->notice_inner_b2
+#define NCOLOR1		theme_current()->notice_color1
+#define NCOLOR2		theme_current()->notice_color2
 
 struct notice_context {
     char *srv_name;
@@ -199,9 +199,9 @@ event_notice(struct irc_message_compo *compo)
 	ptext_ctx.spec_type  = TYPE_SPEC_NONE;
 	ptext_ctx.include_ts = true;
 	printtext(&ptext_ctx, "%s%s%s%c%s%s%s%c%s %s",
-	    Theme("notice_lb"),
-	    NCOLOR1, nick, NORMAL, Theme("notice_sep"), NCOLOR2, dest, NORMAL,
-	    Theme("notice_rb"),
+	    theme_current()->notice_lb,
+	    NCOLOR1, nick, NORMAL, theme_current()->notice_sep, NCOLOR2, dest, NORMAL,
+	    theme_current()->notice_rb,
 	    msg);
     } else {
 	if (Strings_match_ignore_case(dest, g_my_nickname))
@@ -215,10 +215,10 @@ event_notice(struct irc_message_compo *compo)
 	ptext_ctx.include_ts = true;
 
 	printtext(&ptext_ctx, "%s%s%s%c%s%s%s@%s%c%s%s %s",
-		  Theme("notice_lb"),
+		  theme_current()->notice_lb,
 		  NCOLOR1, nick, NORMAL,
 		  INNER_B1, NCOLOR2, user, host, NORMAL, INNER_B2,
-		  Theme("notice_rb"),
+		  theme_current()->notice_rb,
 		  msg);
     }
 
@@ -24,7 +24,7 @@ event_ping(struct irc_message_compo *compo)
 	return;
     } else if ((n_sent = net_send("PONG %s", cp)) == -1) {
 	g_on_air = false;
-    } else if (n_sent > 0 && config_bool_unparse("show_ping_pong", true)) {
+    } else if (n_sent > 0 && config_current()->show_ping_pong) {
 	struct printtext_context ctx = {
 	    .window     = g_status_window,
 	    .spec_type  = TYPE_SPEC_NONE,
@@ -43,11 +43,11 @@
 #include "privmsg.h"
 
 struct special_msg_context {
-    char *nick;
-    char *user;
-    char *host;
-    char *dest;
-    char *msg;
+    const char *nick;
+    const char *user;
+    const char *host;
+    const char *dest;
+    const char *msg;
 };
 
 static void
@@ -129,37 +129,29 @@ broadcast_window_activity(PIRC_WINDOW src)
 void
 event_privmsg(struct irc_message_compo *compo)
 {
-    char	*dest, *msg;
-    char	*nick, *user, *host;
-    char	*params = &compo->params[0];
-    char	*prefix = compo->prefix ? &compo->prefix[0] : NULL;
-    char	*state1, *state2;
+    char	 dest[IRC_MAX_MESSAGE];
+    char	 nick[IRC_MAX_MESSAGE];
+    char	 user[IRC_MAX_MESSAGE];
+    char	 host[IRC_MAX_MESSAGE];
+    const char	*msg;
     struct printtext_context ctx = {
 	.window	    = NULL,
 	.spec_type  = TYPE_SPEC_NONE,
 	.include_ts = true,
     };
 
-    state1 = state2 = "";
-
-    if (!prefix)
-	return;
-    if (*prefix == ':')
-	prefix++;
-    if ((nick = strtok_r(prefix, "!@", &state1)) == NULL)
+    if (!compo->prefix || compo->nick.len == 0 || compo->num_params < 2)
 	return;
-    user = strtok_r(NULL, "!@", &state1);
-    host = strtok_r(NULL, "!@", &state1);
-    if (!user || !host) {
-	user = "<no user>";
-	host = "<no host>";
+    (void) irc_slice_copy(&compo->nick, nick, sizeof nick);
+    if (compo->user.len == 0 || compo->host.len == 0) {
+	(void) sw_strcpy(user, "<no user>", sizeof user);
+	(void) sw_strcpy(host, "<no host>", sizeof host);
+    } else {
+	(void) irc_slice_copy(&compo->user, user, sizeof user);
+	(void) irc_slice_copy(&compo->host, host, sizeof host);
     }
-    if (Strfeed(params, 1) != 1 ||
-	(dest = strtok_r(params, "\n", &state2)) == NULL ||
-	(msg = strtok_r(NULL, "\n", &state2)) == NULL)
-	return;
-    if (*msg == ':')
-	msg++;
+    (void) irc_slice_copy(&compo->param[0], dest, sizeof dest);
+    msg = compo->param[1].str; /* the rest of the line */
     if (*msg == '\001') {
 	struct special_msg_context msg_ctx = {
 	    .nick = nick,
@@ -190,7 +182,7 @@ event_privmsg(struct irc_message_compo *compo)
 	}
 
 	printtext(&ctx, "%s%s%s%c%s %s",
-	    Theme("nick_s1"), COLOR2, nick, NORMAL, Theme("nick_s2"), msg);
+	    theme_current()->nick_s1, COLOR2, nick, NORMAL, theme_current()->nick_s2, msg);
 
 	if (ctx.window != g_active_window)
 	    broadcast_window_activity(ctx.window);
@@ -221,13 +213,13 @@ event_privmsg(struct irc_message_compo *compo)
 	    !strncasecmp(msg, s3, strlen(s3)) ||
 	    Strings_match_ignore_case(msg, g_my_nickname)) {
 	    printtext(&ctx, "%s%c%s%s%c%s %s",
-		Theme("nick_s1"), c, COLOR4, nick, NORMAL, Theme("nick_s2"),
+		theme_current()->nick_s1, c, COLOR4, nick, NORMAL, theme_current()->nick_s2,
 		msg);
 	    if (ctx.window != g_active_window)
 		broadcast_window_activity(ctx.window);
 	} else {
 	    printtext(&ctx, "%s%c%s%s%c%s %s",
-		Theme("nick_s1"), c, COLOR2, nick, NORMAL, Theme("nick_s2"),
+		theme_current()->nick_s1, c, COLOR2, nick, NORMAL, theme_current()->nick_s2,
 		msg);
 	}
 
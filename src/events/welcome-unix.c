@@ -10,32 +10,52 @@
 
 #include "welcome-unix.h"
 
+#define POLL_MS 100
+
 static pthread_mutex_t foo_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t welcome_cond;
+static bool welcome_signaled = false;
 
-bool
-event_welcome_is_signaled(void)
+static struct timespec
+time_in(long int ms)
 {
-    bool is_signaled = false; /* initial state */
-    struct integer_unparse_context unparse_ctx;
     struct timespec ts;
     struct timeval tv;
 
-    unparse_ctx.setting_name     = "connection_timeout";
-    unparse_ctx.lo_limit         = 0;
-    unparse_ctx.hi_limit         = 300; /* 5 min */
-    unparse_ctx.fallback_default = 45;
-
     if (gettimeofday(&tv, NULL) != 0) {
 	err_sys("gettimeofday error");
     }
 
-    ts.tv_sec  = tv.tv_sec + config_integer_unparse(&unparse_ctx);
-    ts.tv_nsec = tv.tv_usec;
+    ts.tv_sec  = tv.tv_sec + ms / 1000;
+    ts.tv_nsec = tv.tv_usec * 1000L + (ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+	ts.tv_sec++;
+	ts.tv_nsec -= 1000000000L;
+    }
+
+    return ts;
+}
+
+/*
+ * Wait for the welcome for at most 'connection_timeout' seconds. The
+ * wait is given up once '*cancel' is set, which is checked every
+ * POLL_MS milliseconds.
+ */
+bool
+event_welcome_is_signaled(const volatile bool *cancel)
+{
+    bool is_signaled = false; /* initial state */
+    long int left = config_current()->connection_timeout * 1000L;
 
     mutex_lock(&foo_mutex);
-    if (pthread_cond_timedwait(&welcome_cond, &foo_mutex, &ts) == 0)
-	is_signaled = true;
+    while (!welcome_signaled && !(cancel && *cancel) && left > 0) {
+	const long int slice = (left < POLL_MS ? left : POLL_MS);
+	const struct timespec ts = time_in(slice);
+
+	(void) pthread_cond_timedwait(&welcome_cond, &foo_mutex, &ts);
+	left -= slice;
+    }
+    is_signaled = welcome_signaled && !(cancel && *cancel);
     mutex_unlock(&foo_mutex);
 
     return (is_signaled);
@@ -46,6 +66,9 @@ event_welcome_cond_init(void)
 {
     if ((errno = pthread_cond_init(&welcome_cond, NULL)) != 0)
 	err_sys("pthread_cond_init error");
+    mutex_lock(&foo_mutex);
+    welcome_signaled = false;
+    mutex_unlock(&foo_mutex);
 }
 
 void
@@ -59,6 +82,9 @@ event_welcome_cond_destroy(void)
 void
 event_welcome_signalit(void)
 {
+    mutex_lock(&foo_mutex);
+    welcome_signaled = true;
     if ((errno = pthread_cond_broadcast(&welcome_cond)) != 0)
 	err_sys("pthread_cond_broadcast error");
+    mutex_unlock(&foo_mutex);
 }
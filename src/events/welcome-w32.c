@@ -9,20 +9,29 @@
 
 #include "welcome-w32.h"
 
+#define POLL_MS 100
+
 static HANDLE welcome_cond;
 
+/*
+ * Wait for the welcome for at most 'connection_timeout' seconds. The
+ * wait is given up once '*cancel' is set, which is checked every
+ * POLL_MS milliseconds.
+ */
 bool
-event_welcome_is_signaled(void)
+event_welcome_is_signaled(const volatile bool *cancel)
 {
-    struct integer_unparse_context unparse_ctx = {
-	.setting_name     = "connection_timeout",
-	.lo_limit         = 0,
-	.hi_limit         = 300, /* 5 min */
-	.fallback_default = 45,
-    };
-
-    return WaitForSingleObject(welcome_cond,
-	config_integer_unparse(&unparse_ctx) * 1000) == WAIT_OBJECT_0;
+    long int left = config_current()->connection_timeout * 1000L;
+
+    while (!(cancel && *cancel) && left > 0) {
+	const long int slice = (left < POLL_MS ? left : POLL_MS);
+
+	if (WaitForSingleObject(welcome_cond, slice) == WAIT_OBJECT_0)
+	    return !(cancel && *cancel);
+	left -= slice;
+    }
+
+    return false;
 }
 
 void
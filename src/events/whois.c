@@ -677,40 +677,36 @@ event_whois_modes(struct irc_message_compo *compo)
 void
 event_whoReply(struct irc_message_compo *compo)
 {
-    char	*state	  = "";
-    char	*channel  = NULL;
-    char	*user	  = NULL;
-    char	*host	  = NULL;
-    char	*server	  = NULL;
-    char	*nick	  = NULL;
-    char	*symbol	  = NULL;
-    char	*hopcount = NULL;
-    char	*rl_name  = NULL;
+    const struct irc_slice *channel, *user, *host, *nick, *symbol;
+    const char *hopcount, *rl_name;
     struct printtext_context ctx = {
 	.window	    = g_status_window,
 	.spec_type  = TYPE_SPEC1,
 	.include_ts = true,
     };
 
-    if (Strfeed(compo->params, 8) != 8)
+    /*
+     * param[0]: my nick, param[4]: server (unused),
+     * param[7]: "<hopcount> <real name>"
+     */
+    if (compo->num_params < 8)
 	goto err;
-    (void) strtok_r(compo->params, "\n", &state); /* my nick */
-    if ((channel     = strtok_r(NULL, "\n", &state)) == NULL
-	|| (user     = strtok_r(NULL, "\n", &state)) == NULL
-	|| (host     = strtok_r(NULL, "\n", &state)) == NULL
-	|| (server   = strtok_r(NULL, "\n", &state)) == NULL /* unused */
-	|| (nick     = strtok_r(NULL, "\n", &state)) == NULL
-	|| (symbol   = strtok_r(NULL, "\n", &state)) == NULL
-	|| (hopcount = strtok_r(NULL, "\n", &state)) == NULL
-	|| (rl_name  = strtok_r(NULL, "\n", &state)) == NULL)
+    channel  = &compo->param[1];
+    user     = &compo->param[2];
+    host     = &compo->param[3];
+    nick     = &compo->param[5];
+    symbol   = &compo->param[6];
+    hopcount = compo->param[7].str;
+    if ((rl_name = strchr(hopcount, ' ')) == NULL)
 	goto err;
-    if (*hopcount == ':')
-	hopcount++;
-    printtext(&ctx, "%s%s%s%c%s: %s%s%c %s %s %s@%s %s%s%s%c%s",
-	      LEFT_BRKT, COLOR1, channel, NORMAL, RIGHT_BRKT,
-	      COLOR2, nick, NORMAL,
-	      symbol, hopcount, user, host,
-	      LEFT_BRKT, COLOR2, rl_name, NORMAL, RIGHT_BRKT);
+    printtext(&ctx, "%s%s%.*s%c%s: %s%.*s%c %.*s %.*s %.*s@%.*s %s%s%s%c%s",
+	      LEFT_BRKT, COLOR1, (int) channel->len, channel->str, NORMAL,
+	      RIGHT_BRKT,
+	      COLOR2, (int) nick->len, nick->str, NORMAL,
+	      (int) symbol->len, symbol->str,
+	      (int) (rl_name - hopcount), hopcount,
+	      (int) user->len, user->str, (int) host->len, host->str,
+	      LEFT_BRKT, COLOR2, &rl_name[1], NORMAL, RIGHT_BRKT);
     return;
 
 err:
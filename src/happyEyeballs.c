@@ -0,0 +1,360 @@
+/* Race connection attempts to several addresses (RFC 8305)
+   Copyright (C) 2018 Markus Uhlin. All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   - Neither the name of the author nor the names of its contributors may be
+     used to endorse or promote products derived from this software without
+     specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+   BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+#include "common.h"
+
+#ifdef UNIX
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h> /* close() */
+#endif
+
+#include <string.h>
+
+#include "errHand.h"
+#include "happyEyeballs.h"
+
+/*
+ * An attempt runs from a non-blocking connect() until the socket
+ * becomes writable (or signals an error). A new attempt is started
+ * every HE_ATTEMPT_DELAY ms, or at once when an attempt fails, and the
+ * first socket that connects wins. The candidates alternate between
+ * address families so that a broken IPv6 path costs HE_ATTEMPT_DELAY
+ * and not a full TCP timeout.
+ */
+
+static void
+close_socket(HE_SOCKET sock)
+{
+#if defined(UNIX)
+    (void) close(sock);
+#elif defined(WIN32)
+    (void) closesocket(sock);
+#endif
+}
+
+static int
+last_socket_error(void)
+{
+#if defined(UNIX)
+    return errno;
+#elif defined(WIN32)
+    return WSAGetLastError();
+#endif
+}
+
+static bool
+set_blocking(HE_SOCKET sock, bool blocking)
+{
+#if defined(UNIX)
+    int flags;
+
+    if ((flags = fcntl(sock, F_GETFL, 0)) == -1)
+	return false;
+    flags = (blocking ? flags & ~O_NONBLOCK : flags | O_NONBLOCK);
+    return (fcntl(sock, F_SETFL, flags) != -1);
+#elif defined(WIN32)
+    u_long nonblocking = !blocking;
+
+    return (ioctlsocket(sock, FIONBIO, &nonblocking) == 0);
+#endif
+}
+
+static bool
+connect_in_progress(int error)
+{
+#if defined(UNIX)
+    return (error == EINPROGRESS || error == EINTR);
+#elif defined(WIN32)
+    return (error == WSAEWOULDBLOCK || error == WSAEINPROGRESS);
+#endif
+}
+
+static const struct addrinfo *
+bind_addr_for(const struct happy_eyeballs *he, int family)
+{
+    const struct addrinfo *ai;
+
+    for (ai = he->bind_addrs; ai; ai = ai->ai_next) {
+	if (ai->ai_family == family)
+	    return ai;
+    }
+
+    return NULL;
+}
+
+/*
+ * Order the candidates: the family of the first address goes first and
+ * the families alternate from there on (RFC 8305, section 4).
+ */
+static void
+interleave_candidates(struct happy_eyeballs *he, const struct addrinfo *res)
+{
+    const struct addrinfo *first[HE_MAX_CANDIDATES];
+    const struct addrinfo *second[HE_MAX_CANDIDATES];
+    const struct addrinfo *ai;
+    int n_first = 0, n_second = 0;
+    int i = 0, j = 0;
+
+    for (ai = res; ai; ai = ai->ai_next) {
+	if (ai->ai_family != AF_INET && ai->ai_family != AF_INET6)
+	    continue;
+	if (he->bind_addrs && bind_addr_for(he, ai->ai_family) == NULL)
+	    continue;
+	if (ai->ai_family == res->ai_family) {
+	    if (n_first < HE_MAX_CANDIDATES)
+		first[n_first++] = ai;
+	} else {
+	    if (n_second < HE_MAX_CANDIDATES)
+		second[n_second++] = ai;
+	}
+    }
+
+    he->n_candidates = 0;
+
+    while ((i < n_first || j < n_second) &&
+	   he->n_candidates < HE_MAX_CANDIDATES) {
+	if (i < n_first)
+	    he->candidate[he->n_candidates++] = first[i++];
+	if (j < n_second && he->n_candidates < HE_MAX_CANDIDATES)
+	    he->candidate[he->n_candidates++] = second[j++];
+    }
+}
+
+/**
+ * Initialize a race
+ *
+ * @param he         Race context
+ * @param res        Addresses to connect to (as returned by
+ *                   getaddrinfo()). Must outlive the race.
+ * @param bind_addrs Local addresses to bind to, or NULL. Candidates of a
+ *                   family without a local address are dropped.
+ * @param timeout    Milliseconds the race may take in total
+ */
+void
+he_init(struct happy_eyeballs *he, const struct addrinfo *res,
+	const struct addrinfo *bind_addrs, long int timeout)
+{
+    if (he == NULL)
+	err_exit(EINVAL, "he_init");
+
+    BZERO(he, sizeof *he);
+    he->state		= HE_STATE_START;
+    he->n_candidates	= 0;
+    he->next_candidate	= 0;
+    he->n_attempts	= 0;
+    he->bind_addrs	= bind_addrs;
+    he->next_attempt_at = 0;
+    he->deadline	= net_monotonic_ms() + (timeout > 0 ? timeout : 0);
+    he->sock		= HE_INVALID_SOCKET;
+    he->winner		= NULL;
+    he->error		= 0;
+    he->cancel		= NULL;
+
+    if (res)
+	interleave_candidates(he, res);
+}
+
+/*
+ * Start a connection attempt to the next candidate. Candidates that
+ * fail straight away are skipped.
+ */
+static void
+start_attempt(struct happy_eyeballs *he)
+{
+    while (he->next_candidate < he->n_candidates) {
+	const struct addrinfo *ai = he->candidate[he->next_candidate++];
+	const struct addrinfo *local = NULL;
+	HE_SOCKET sock;
+
+	if ((sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol))
+	    == HE_INVALID_SOCKET) {
+	    he->error = last_socket_error();
+	    continue;
+	} else if (!set_blocking(sock, false)) {
+	    he->error = last_socket_error();
+	    close_socket(sock);
+	    continue;
+	}
+
+	if (he->bind_addrs && (local = bind_addr_for(he, ai->ai_family)) &&
+	    bind(sock, local->ai_addr, local->ai_addrlen) != 0) {
+	    he->error = last_socket_error();
+	    close_socket(sock);
+	    continue;
+	}
+
+	if (connect(sock, ai->ai_addr, ai->ai_addrlen) != 0 &&
+	    !connect_in_progress(last_socket_error())) {
+	    he->error = last_socket_error();
+	    close_socket(sock);
+	    continue;
+	}
+
+	he->attempt[he->n_attempts].sock = sock;
+	he->attempt[he->n_attempts].ai = ai;
+	he->n_attempts++;
+	break;
+    }
+
+    he->next_attempt_at = net_monotonic_ms() + HE_ATTEMPT_DELAY;
+}
+
+static void
+drop_attempt(struct happy_eyeballs *he, int i)
+{
+    close_socket(he->attempt[i].sock);
+    he->attempt[i] = he->attempt[--he->n_attempts];
+}
+
+/*
+ * Finish an attempt whose socket reported readiness
+ */
+static bool
+finish_attempt(struct happy_eyeballs *he, int i)
+{
+    int error = 0;
+    socklen_t len = sizeof error;
+
+    if (getsockopt(he->attempt[i].sock, SOL_SOCKET, SO_ERROR,
+	(void *) &error, &len) != 0)
+	error = last_socket_error();
+
+    if (error != 0 || !set_blocking(he->attempt[i].sock, true)) {
+	he->error = (error ? error : last_socket_error());
+	drop_attempt(he, i);
+	he->next_attempt_at = 0; /* try the next candidate at once */
+	return false;
+    }
+
+    he->sock   = he->attempt[i].sock;
+    he->winner = he->attempt[i].ai;
+    he->attempt[i] = he->attempt[--he->n_attempts];
+    he_abort(he);
+    he->state  = HE_STATE_CONNECTED;
+    return true;
+}
+
+/**
+ * Drive the race. Waits for at most 'max_wait' ms for something to
+ * happen. The race fails with ECANCELED once '*he->cancel' is set.
+ *
+ * @return The new state. The connected socket (HE_STATE_CONNECTED) is
+ *         in blocking mode and found in he->sock.
+ */
+enum he_state
+he_step(struct happy_eyeballs *he, long int max_wait)
+{
+    fd_set writeset, exceptset;
+    struct timeval tv;
+    unsigned long long now, wake_up;
+    int i, maxfd = 0;
+
+    if (he->state == HE_STATE_START)
+	he->state = HE_STATE_CONNECTING;
+    if (he->state != HE_STATE_CONNECTING)
+	return he->state;
+
+    if (he->cancel && *he->cancel) {
+	he_abort(he);
+#if defined(UNIX)
+	he->error = ECANCELED;
+#elif defined(WIN32)
+	he->error = WSAECANCELLED;
+#endif
+	return (he->state = HE_STATE_FAILED);
+    }
+
+    if ((now = net_monotonic_ms()) >= he->deadline) {
+	he_abort(he);
+#if defined(UNIX)
+	he->error = ETIMEDOUT;
+#elif defined(WIN32)
+	he->error = WSAETIMEDOUT;
+#endif
+	return (he->state = HE_STATE_FAILED);
+    }
+
+    if (he->next_candidate < he->n_candidates &&
+	(now >= he->next_attempt_at || he->n_attempts == 0))
+	start_attempt(he);
+    if (he->n_attempts == 0 && he->next_candidate >= he->n_candidates)
+	return (he->state = HE_STATE_FAILED);
+
+    wake_up = now + (max_wait > 0 ? max_wait : 0);
+    if (he->next_candidate < he->n_candidates && he->next_attempt_at < wake_up)
+	wake_up = he->next_attempt_at;
+    if (he->deadline < wake_up)
+	wake_up = he->deadline;
+    wake_up = (wake_up > now ? wake_up - now : 0);
+    tv.tv_sec  = (long int) (wake_up / 1000);
+    tv.tv_usec = (long int) (wake_up % 1000) * 1000;
+
+    FD_ZERO(&writeset);
+    FD_ZERO(&exceptset);
+
+    for (i = 0; i < he->n_attempts; i++) {
+	FD_SET(he->attempt[i].sock, &writeset);
+	FD_SET(he->attempt[i].sock, &exceptset);
+	if ((int) he->attempt[i].sock > maxfd)
+	    maxfd = (int) he->attempt[i].sock;
+    }
+
+    if (select(maxfd + 1, NULL, &writeset, &exceptset, &tv) < 0) {
+	if (last_socket_error() == EINTR)
+	    return he->state;
+	he->error = last_socket_error();
+	he_abort(he);
+	return (he->state = HE_STATE_FAILED);
+    }
+
+    for (i = he->n_attempts - 1; i >= 0; i--) {
+	if (FD_ISSET(he->attempt[i].sock, &writeset) ||
+	    FD_ISSET(he->attempt[i].sock, &exceptset)) {
+	    if (finish_attempt(he, i))
+		break;
+	}
+    }
+
+    return he->state;
+}
+
+/**
+ * Close all outstanding attempts (not the winner)
+ */
+void
+he_abort(struct happy_eyeballs *he)
+{
+    while (he->n_attempts > 0)
+	drop_attempt(he, he->n_attempts - 1);
+}
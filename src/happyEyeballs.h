@@ -0,0 +1,50 @@
+#ifndef HAPPY_EYEBALLS_H
+#define HAPPY_EYEBALLS_H
+
+#include "network.h"
+
+#if defined(UNIX)
+typedef int HE_SOCKET;
+#define HE_INVALID_SOCKET -1
+#elif defined(WIN32)
+typedef SOCKET HE_SOCKET;
+#define HE_INVALID_SOCKET INVALID_SOCKET
+#endif
+
+#define HE_ATTEMPT_DELAY	250	/* ms (RFC 8305, section 5) */
+#define HE_MAX_CANDIDATES	32
+
+enum he_state {
+    HE_STATE_START,
+    HE_STATE_CONNECTING,
+    HE_STATE_CONNECTED,
+    HE_STATE_FAILED
+};
+
+struct he_attempt {
+    HE_SOCKET			 sock;
+    const struct addrinfo	*ai;
+};
+
+struct happy_eyeballs {
+    enum he_state		 state;
+    const struct addrinfo	*candidate[HE_MAX_CANDIDATES];
+    int				 n_candidates;
+    int				 next_candidate;
+    struct he_attempt		 attempt[HE_MAX_CANDIDATES];
+    int				 n_attempts;
+    const struct addrinfo	*bind_addrs;	/* Local addresses or NULL */
+    unsigned long long		 next_attempt_at;
+    unsigned long long		 deadline;
+    HE_SOCKET			 sock;		/* The winner */
+    const struct addrinfo	*winner;
+    int				 error;		/* Of the last failure */
+    const volatile bool		*cancel;	/* Give up when set, or NULL */
+};
+
+enum he_state	he_step(struct happy_eyeballs *, long int max_wait);
+void		he_abort(struct happy_eyeballs *);
+void		he_init(struct happy_eyeballs *, const struct addrinfo *res,
+			const struct addrinfo *bind_addrs, long int timeout);
+
+#endif
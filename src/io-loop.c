@@ -53,6 +53,7 @@
 #include "commands/invite.h"
 #include "commands/jp.h"
 #include "commands/kick.h"
+#include "commands/lastlog.h"
 #include "commands/me.h"
 #include "commands/misc.h"
 #include "commands/msg.h"
@@ -90,7 +91,7 @@ static struct cmds_tag {
     { "connect",    cmd_connect,    false, "/connect [-tls] <server[:port]>" },
     { "cs",         cmd_chanserv,   true,  "alias for /chanserv" },
     { "cycle",      cmd_cycle,      true,  "/cycle [channel]" },
-    { "disconnect", cmd_disconnect, true,  "/disconnect [message]" },
+    { "disconnect", cmd_disconnect, false, "/disconnect [message]" },
     { "exlist",     cmd_exlist,     true,  "/exlist [channel]" },
     { "help",       cmd_help,       false, "/help [command]" },
     { "ilist",      cmd_ilist,      true,  "/ilist [channel]" },
@@ -98,6 +99,8 @@ static struct cmds_tag {
     { "join",       cmd_join,       true,  "/join <channel> [key]" },
     { "kick",       cmd_kick,       true,  "/kick "
       "<nick1[,nick2][,nick3][...]> [reason]" },
+    { "lastlog",    cmd_lastlog,    false, "/lastlog "
+      "[-window | -all] <pattern>" },
     { "list",       cmd_list,       true,  "/list "
       "[<max_users[,>min_users][,pattern][...]]" },
     { "me",         cmd_me,         true,  "/me <message>" },
@@ -110,6 +113,7 @@ static struct cmds_tag {
     { "notice",     cmd_notice,     true,  "/notice <recipient> <message>" },
     { "ns",         cmd_nickserv,   true,  "alias for /nickserv" },
     { "part",       cmd_part,       true,  "/part [channel] [message]" },
+    { "perf",       cmd_perf,       false, "/perf" },
     { "query",      cmd_query,      false, "/query [nick]" },
     { "quit",       cmd_quit,       false, "/quit [message]" },
     { "resize",     cmd_resize,     false, "/resize" },
@@ -122,6 +126,8 @@ static struct cmds_tag {
       "\npassword <pass>"
       "\nset [on | off]" },
     { "say",        cmd_say,        true,  "/say <message>" },
+    { "scrollback", cmd_scrollback, false, "/scrollback" },
+    { "search",     cmd_lastlog,    false, "alias for /lastlog" },
     { "theme",      cmd_theme,      false, "/theme "
       "[install | list-remote | set] [name]" },
     { "time",       cmd_time,       true,  "/time <target>" },
@@ -400,20 +406,15 @@ handle_cmds(const char *data)
 static void
 add_to_history(const char *string)
 {
-    struct integer_unparse_context unparse_ctx = {
-	.setting_name     = "cmd_hist_size",
-	.fallback_default = 50,
-	.lo_limit         = 0,
-	.hi_limit         = 300,
-    };
+    const int hist_size = config_current()->cmd_hist_size;
     const int tbszp1 = textBuf_size(history) + 1;
 
-    if (config_integer_unparse(&unparse_ctx) == 0 ||
+    if (hist_size == 0 ||
 	!strncasecmp(string, "/nickserv -- identify", 21) ||
 	!strncasecmp(string, "/ns -- identify", 15))
 	return;
 
-    if (tbszp1 > config_integer_unparse(&unparse_ctx)) {
+    if (tbszp1 > hist_size) {
 	/* Buffer full. Remove head... */
 
 	if ((errno = textBuf_remove(history, textBuf_head(history))) != 0)
@@ -435,7 +436,7 @@ enter_io_loop(void)
 {
     new_window_title(g_status_window_label, g_swircWebAddr);
 
-    if (config_bool_unparse("startup_greeting", true)) {
+    if (config_current()->startup_greeting) {
 	swirc_greeting();
     }
 
@@ -475,7 +476,7 @@ enter_io_loop(void)
 		    .include_ts = true,
 		};
 
-		if (config_bool_unparse("recode", false)) {
+		if (config_current()->recode) {
 		    ptext_ctx.spec_type = TYPE_SPEC1_FAILURE;
 		    printtext(&ptext_ctx, "Can't recode user input "
 			"before transmit (yet unsupported)");
@@ -494,8 +495,8 @@ enter_io_loop(void)
     textBuf_destroy(history);
 }
 
-#define S1 Theme("nick_s1")
-#define S2 Theme("nick_s2")
+#define S1 theme_current()->nick_s1
+#define S2 theme_current()->nick_s2
 
 void
 transmit_user_input(const char *win_label, const char *input)
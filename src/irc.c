@@ -35,7 +35,9 @@
 #include "errHand.h"
 #include "irc.h"
 #include "libUtils.h"
+#include "lineScan.h"
 #include "main.h"
+#include "mutex.h"
 #include "network.h"
 #include "printtext.h"
 #include "readline.h"		/* readline_top_panel() */
@@ -62,6 +64,12 @@
 /* Set to 1 for extended info. Intended for debugging only */
 #define UNKNOWN_EVENT_DISPLAY_EXTENDED_INFO 1
 
+#if defined(UNIX)
+#define PRINT_SZ	"%zu"
+#elif defined(WIN32)
+#define PRINT_SZ	"%Iu"
+#endif
+
 /* Objects with external linkage
    ============================= */
 
@@ -225,6 +233,69 @@ static struct numeric_events_tag {
     { "907", "ERR_SASLALREADY",         NO_WINDOW,      0, handle_sasl_auth_fail },
 };
 
+/* Dispatch tables. They're built from the arrays above once and
+   replace the linear searches on the per-message path. Numerics are
+   indexed by their integer value, normal events by the first letter
+   of the command (normal_events[] must be kept sorted). */
+#define NUMERIC_TABLE_SIZE 1000
+
+static struct numeric_events_tag *numeric_table[NUMERIC_TABLE_SIZE];
+
+static struct {
+    unsigned char first;
+    unsigned char count;
+} normal_index['Z' - 'A' + 1];
+
+#if defined(UNIX)
+static pthread_once_t	dispatch_init_done = PTHREAD_ONCE_INIT;
+#elif defined(WIN32)
+static init_once_t	dispatch_init_done = ONCE_INITIALIZER;
+#endif
+
+static SW_INLINE int
+numeric_value(const char *command)
+{
+    if (!sw_isdigit(command[0]) || !sw_isdigit(command[1]) ||
+	!sw_isdigit(command[2]) || command[3] != '\0')
+	return -1;
+    return ((command[0] - '0') * 100 + (command[1] - '0') * 10 +
+	    (command[2] - '0'));
+}
+
+static void
+dispatch_tables_init(void)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(numeric_events); i++) {
+	const int value = numeric_value(numeric_events[i].numeric_event);
+
+	sw_assert(value >= 0 && value < NUMERIC_TABLE_SIZE);
+	sw_assert(numeric_table[value] == NULL);
+	numeric_table[value] = &numeric_events[i];
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(normal_events); i++) {
+	const char c = normal_events[i].normal_event[0];
+
+	sw_assert(c >= 'A' && c <= 'Z');
+	sw_assert(i == 0 || strcmp(normal_events[i - 1].normal_event,
+	    normal_events[i].normal_event) < 0);
+	if (normal_index[c - 'A'].count++ == 0)
+	    normal_index[c - 'A'].first = (unsigned char) i;
+    }
+}
+
+static void
+dispatch_tables_init_once(void)
+{
+#if defined(UNIX)
+    if ((errno = pthread_once(&dispatch_init_done, dispatch_tables_init)) != 0)
+	err_sys("pthread_once");
+#elif defined(WIN32)
+    if ((errno = init_once(&dispatch_init_done, dispatch_tables_init)) != 0)
+	err_sys("init_once");
+#endif
+}
+
 /**
  * Initialize irc module
  */
@@ -238,6 +309,7 @@ irc_init(void)
     else
 	err_quit("fatal: in irc_init: no nickname");
     event_names_init();
+    dispatch_tables_init_once();
 }
 
 /**
@@ -265,111 +337,244 @@ void
 irc_extract_msg(struct irc_message_compo *compo, PIRC_WINDOW to_window,
 		int ext_bits, bool is_error)
 {
-    int i = 0;
-    char *cp = NULL, *savp = "";
+    const char *text = NULL;
 
-    if (Strfeed(compo->params, ext_bits) != ext_bits) {
+    if (compo->num_params <= ext_bits) {
 	struct printtext_context ptext_ctx = {
 	    .window     = g_status_window,
 	    .spec_type  = TYPE_SPEC1_FAILURE,
 	    .include_ts = true,
 	};
 
-	printtext(&ptext_ctx, "In irc_extract_msg: Strfeed(..., %d) != %d",
-		  ext_bits, ext_bits);
+	printtext(&ptext_ctx, "In irc_extract_msg: %s: too few params "
+		  "(%d <= %d)", compo->command, compo->num_params, ext_bits);
 	return;
     }
 
-    for (i = 0, cp = &compo->params[0];; i++, cp = NULL) {
-	char *token = NULL;
+    /*
+     * The slice isn't null-terminated unless it's the last one, but
+     * since the line is left intact the rest of it is printed.
+     */
+    text = compo->param[ext_bits].str;
 
-	if ((token = strtok_r(cp, "\n", &savp)) == NULL) {
-	    break;
-	} else if (i == ext_bits) {
-	    if (*token == ':') {
-		token++;
-	    }
-
-	    if (*token) {
-		struct printtext_context ptext_ctx = {
-		    .window     = to_window,
-		    .spec_type  = is_error ? TYPE_SPEC1_FAILURE : TYPE_SPEC1,
-		    .include_ts = true,
-		};
+    if (*text) {
+	struct printtext_context ptext_ctx = {
+	    .window     = to_window,
+	    .spec_type  = is_error ? TYPE_SPEC1_FAILURE : TYPE_SPEC1,
+	    .include_ts = true,
+	};
 
-		printtext(&ptext_ctx, "%s", token);
-		return;
-	    }
-	} else {
-	    ;
-	}
+	printtext(&ptext_ctx, "%s", text);
     }
 }
 
 /**
- * Sort message components - into prefix, command and params.
+ * Split the prefix into nick, user and host. A server prefix only
+ * yields the nick (which then is the server name).
+ */
+static void
+split_prefix(struct irc_message_compo *compo, const char *prefix,
+	     const char *end)
+{
+    const char *p = prefix;
+
+    compo->nick.str = prefix;
+    while (p < end && *p != '!' && *p != '@')
+	p++;
+    compo->nick.len = p - prefix;
+
+    if (p < end && *p == '!') {
+	compo->user.str = ++p;
+	while (p < end && *p != '@')
+	    p++;
+	compo->user.len = p - compo->user.str;
+    }
+
+    if (p < end && *p == '@') {
+	compo->host.str = ++p;
+	compo->host.len = end - p;
+    }
+}
+
+/*
+ * The worker of irc_parse_message(). 'len' and 'trailing' come from
+ * line_scan(): the middle parameters end where the trailing one
+ * starts, so they're split with memchr() and the length of the
+ * trailing parameter is known without scanning it.
  */
-static struct irc_message_compo *
-SortMsgCompo(char *protocol_message, bool message_has_prefix)
+static int
+parse_message(char *line, size_t len, size_t trailing,
+	      struct irc_message_compo *compo)
 {
-    char *cp = NULL, *savp = "";
-    short int loop_run = 0;
-    struct irc_message_compo *compo = xcalloc(sizeof *compo, 1);
+    char *p = line;
+    char *end = &line[len];
+    char *middle_end = (trailing == LINE_SCAN_NONE ? end : &line[trailing]);
+
+    BZERO(compo, sizeof *compo);
+
+    if (*p == ':') {
+	compo->prefix = p;
+
+	while (*p && *p != ' ')
+	    p++;
+	if (*p == '\0' || p == &line[1])
+	    return -1;
+	split_prefix(compo, &line[1], p);
+	*p++ = '\0';
+	while (*p == ' ')
+	    p++;
+    }
 
-    compo->prefix  = NULL;
-    compo->command = NULL;
-    compo->params  = NULL;
+    if (*p == '\0')
+	return -1;
 
-    for (loop_run = 0, cp = &protocol_message[0];; loop_run++, cp = NULL) {
-	char *token = NULL;
+    compo->command = p;
+    while (*p && *p != ' ')
+	p++;
+    if (*p) {
+	*p++ = '\0';
+	while (*p == ' ')
+	    p++;
+    }
 
-	if ((token = strtok_r(cp, "\n", &savp)) == NULL) {
-	    break;
-	}
+    compo->params = p;
 
-	switch (loop_run) {
-	case 0:
-	    if (message_has_prefix) {
-		compo->prefix = sw_strdup(token);
-	    } else {
-		compo->command = sw_strdup(token);
-	    }
-	    break; /* loop_run 0 */
-	case 1:
-	    if (message_has_prefix) {
-		compo->command = sw_strdup(token);
-	    } else {
-		compo->params = sw_strdup(token);
+    if (middle_end < p) /* a bogus " :" before the params */
+	middle_end = end;
+
+    while (p < end && compo->num_params < IRC_MAX_PARAMS) {
+	struct irc_slice *sp = &compo->param[compo->num_params++];
+
+	if (*p == ':' || compo->num_params == IRC_MAX_PARAMS) {
+	    if (*p == ':') {
+		compo->has_trailing = true;
+		p++;
 	    }
-	    break; /* loop_run 1 */
-	case 2:
-	    compo->params = sw_strdup(token);
-	    break; /* loop_run 2 */
-	default:
-	    sw_assert_not_reached();
-	}
 
-	if (compo->command != NULL && compo->params != NULL) {
+	    sp->str = p;
+	    sp->len = end - p;
 	    break;
 	}
+
+	/*
+	 * Spaces are skipped below, so 'p' is before 'middle_end' here
+	 */
+	sp->str = p;
+	if ((p = memchr(p, ' ', middle_end - p)) == NULL)
+	    p = middle_end;
+	sp->len = p - sp->str;
+
+	while (*p == ' ')
+	    p++;
     }
 
-    sw_assert(compo->command != NULL && compo->params != NULL);
-    return (compo);
+    return 0;
 }
 
 /**
- * Free message components
+ * Parse a protocol message in a single pass.
+ *
+ * The line is parsed in place: the prefix and the command are
+ * null-terminated where they end but the parameters are left intact
+ * so that compo->params still holds them unsplit. Nothing is
+ * allocated.
+ *
+ * @param line  A line without the terminating CR-LF
+ * @param compo Receives the message components
+ * @return 0 on success, or -1 if the line is malformed
  */
-static void
-FreeMsgCompo(struct irc_message_compo *compo)
+int
+irc_parse_message(char *line, struct irc_message_compo *compo)
+{
+    struct line_scan ls;
+
+    if (line == NULL || compo == NULL)
+	return -1;
+
+    line_scan(line, strlen(line), &ls);
+    return parse_message(line, ls.eol, ls.trailing, compo);
+}
+
+/**
+ * Copy a slice into a null-terminated buffer. The copy is truncated
+ * if it doesn't fit.
+ */
+char *
+irc_slice_copy(const struct irc_slice *slice, char *dest, size_t size)
+{
+    size_t len = 0;
+
+    if (slice == NULL || dest == NULL || size == 0)
+	err_exit(EINVAL, "irc_slice_copy");
+
+    len = (slice->len < size ? slice->len : size - 1);
+
+    if (len > 0)
+	memcpy(dest, slice->str, len);
+    dest[len] = '\0';
+    return dest;
+}
+
+static struct normal_events_tag *
+normal_event_lookup(const char *command)
+{
+    const char c = command[0];
+
+    if (c < 'A' || c > 'Z')
+	return NULL;
+
+    for (int i = normal_index[c - 'A'].first,
+	     n = normal_index[c - 'A'].count; n > 0; i++, n--) {
+	if (Strings_match(normal_events[i].normal_event, command))
+	    return &normal_events[i];
+    }
+
+    return NULL;
+}
+
+static SW_INLINE struct numeric_events_tag *
+numeric_event_lookup(int value)
+{
+    return (value >= 0 && value < NUMERIC_TABLE_SIZE ? numeric_table[value]
+	    : NULL);
+}
+
+/**
+ * Check whether there's a handler for a command
+ */
+bool
+irc_event_exists(const char *command)
+{
+    dispatch_tables_init_once();
+
+    return (normal_event_lookup(command) != NULL ||
+	    numeric_event_lookup(numeric_value(command)) != NULL);
+}
+
+#ifdef UNIT_TESTING
+/**
+ * The linear search which the dispatch tables replaced. It's only
+ * kept so that tests/bench_dispatch.c has something to compare
+ * against.
+ */
+bool
+irc_event_exists_linear(const char *command)
 {
-    free_not_null(compo->prefix);
-    free_not_null(compo->command);
-    free_not_null(compo->params);
+    if (is_alphabetic(command)) {
+	for (size_t i = 0; i < ARRAY_SIZE(normal_events); i++) {
+	    if (Strings_match(normal_events[i].normal_event, command))
+		return true;
+	}
+    } else if (is_numeric(command) && strlen(command) == 3) {
+	for (size_t i = 0; i < ARRAY_SIZE(numeric_events); i++) {
+	    if (Strings_match(numeric_events[i].numeric_event, command))
+		return true;
+	}
+    }
 
-    free(compo);
+    return false;
 }
+#endif
 
 /**
  * Search and route event
@@ -377,187 +582,135 @@ FreeMsgCompo(struct irc_message_compo *compo)
 static void
 irc_search_and_route_event(struct irc_message_compo *compo)
 {
+    struct normal_events_tag *normal = NULL;
+    struct numeric_events_tag *numeric = NULL;
+    int value = -1;
     struct printtext_context ptext_ctx = {
 	.window     = g_status_window,
 	.spec_type  = TYPE_SPEC1_WARN,
 	.include_ts = true,
     };
 
-    if (is_alphabetic(compo->command)) {
-	struct normal_events_tag *sp = NULL;
-	const size_t size = ARRAY_SIZE(normal_events);
-
-	for (sp = &normal_events[0]; sp < &normal_events[size]; sp++) {
-	    if (Strings_match(sp->normal_event, compo->command)) {
-		sp->event_handler(compo);
-		return;
-	    }
+    if ((normal = normal_event_lookup(compo->command)) != NULL) {
+	normal->event_handler(compo);
+	return;
+    } else if ((value = numeric_value(compo->command)) == -1) {
+	if (is_alphabetic(compo->command))
+	    printtext(&ptext_ctx, "Unknown normal event: %s", compo->command);
+	else {
+	    printtext(&ptext_ctx, "Erroneous event: %s", compo->command);
+	    return;
 	}
-
-	printtext(&ptext_ctx, "Unknown normal event: %s", compo->command);
-#if UNKNOWN_EVENT_DISPLAY_EXTENDED_INFO
-	printtext(&ptext_ctx, "params = %s", compo->params);
-	printtext(&ptext_ctx, "prefix = %s",
-		  compo->prefix ? compo->prefix : "none");
-#endif
-    } else if (is_numeric(compo->command) && strlen(compo->command) == 3) {
-	struct numeric_events_tag *sp = NULL;
-	const size_t size = ARRAY_SIZE(numeric_events);
-
-	for (sp = &numeric_events[0]; sp < &numeric_events[size]; sp++) {
-	    if (Strings_match(sp->numeric_event, compo->command)) {
-		if (sp->event_handler != NULL) {
-		    sp->event_handler(compo);
-		} else {
-		    if (sp->window == STATUS_WINDOW)
-			irc_extract_msg(compo, g_status_window, sp->ext_bits,
-			    !strncmp(sp->official_name, "ERR_", 4));
-		    else if (sp->window == ACTIVE_WINDOW)
-			irc_extract_msg(compo, g_active_window, sp->ext_bits,
-			    !strncmp(sp->official_name, "ERR_", 4));
-		    else
-			sw_assert_not_reached();
-		}
-
-		return;
-	    }
+    } else if ((numeric = numeric_event_lookup(value)) != NULL) {
+	if (numeric->event_handler != NULL) {
+	    numeric->event_handler(compo);
+	} else {
+	    const bool is_error = !strncmp(numeric->official_name, "ERR_", 4);
+
+	    if (numeric->window == STATUS_WINDOW)
+		irc_extract_msg(compo, g_status_window, numeric->ext_bits,
+		    is_error);
+	    else if (numeric->window == ACTIVE_WINDOW)
+		irc_extract_msg(compo, g_active_window, numeric->ext_bits,
+		    is_error);
+	    else
+		sw_assert_not_reached();
 	}
 
+	return;
+    } else {
 	printtext(&ptext_ctx, "Unknown numeric event: %s", compo->command);
+    }
+
 #if UNKNOWN_EVENT_DISPLAY_EXTENDED_INFO
-	printtext(&ptext_ctx, "params = %s", compo->params);
-	printtext(&ptext_ctx, "prefix = %s",
-		  compo->prefix ? compo->prefix : "none");
+    printtext(&ptext_ctx, "params = %s", compo->params);
+    printtext(&ptext_ctx, "prefix = %s",
+	      compo->prefix ? compo->prefix : "none");
 #endif
-    } else {
-	printtext(&ptext_ctx, "Erroneous event: %s", compo->command);
-    }
 }
 
 /**
  * Process protocol message
  */
 static void
-ProcessProtoMsg(const char *token)
+ProcessProtoMsg(char *token, const struct line_scan *ls)
 {
-    char *protocol_message = NULL;
-    int message_has_prefix = 0, requested_feeds = -1;
-    struct irc_message_compo *compo = NULL;
+    struct irc_message_compo compo;
 
-    message_has_prefix = *(protocol_message = sw_strdup(token)) == ':';
-    requested_feeds = message_has_prefix ? 2 : 1;
-
-    if (Strfeed(protocol_message, requested_feeds) != requested_feeds) {
+    if (parse_message(token, ls->eol, ls->trailing, &compo) != 0) {
 	struct printtext_context ptext_ctx = {
 	    .window     = g_status_window,
 	    .spec_type  = TYPE_SPEC1_FAILURE,
 	    .include_ts = true,
 	};
 
-	printtext(&ptext_ctx, "In ProcessProtoMsg: Strfeed(..., %d) != %d",
-		  requested_feeds, requested_feeds);
-	free(protocol_message);
+	printtext(&ptext_ctx, "In ProcessProtoMsg: malformed message");
 	return;
     }
 
-    compo = SortMsgCompo(protocol_message, message_has_prefix);
-    free(protocol_message);
-    irc_search_and_route_event(compo);
-    FreeMsgCompo(compo);
-}
-
-/**
- * If a received chunk of data aren't terminated with carriage return
- * plus line feed - this function gets the last message - so it can be
- * concatenated in a later stage.
- */
-static char *
-get_last_token(const char *buffer)
-{
-    const char *last_token = strrchr(buffer, '\n');
-
-    if (last_token == NULL) {
-	err_msg("get_last_token error. (this is a bug and shouldn't happen!)");
-	abort();
-    }
-
-    return (sw_strdup(++last_token));
+    irc_search_and_route_event(&compo);
 }
 
 /**
  * Handle and interpret irc events
+ *
+ * Frames the complete lines held by the receive buffer and processes
+ * them in place. What's left of a partial line is moved to the front
+ * of the buffer. A line that doesn't fit in the buffer is discarded
+ * up to and including its line feed.
  */
 void
-irc_handle_interpret_events(char *recvbuffer,
-			    char **message_concat,
-			    enum message_concat_state *state)
+irc_handle_interpret_events(struct irc_recvbuf *rb)
 {
-    bool terminated_recvchunk = false;
-    char *cp = NULL, *savp = "";
-    char *last_token = NULL;
-    const char separators[] = "\r\n";
-    long int loop_count = 0;
-
-    if (recvbuffer == NULL || (*state != CONCAT_BUFFER_IS_EMPTY &&
-			       *state != CONCAT_BUFFER_CONTAIN_DATA)) {
+    char *line = NULL, *end = NULL;
+    struct line_scan ls;
+
+    if (rb == NULL || rb->data == NULL || rb->len > rb->size)
 	err_exit(EINVAL, "irc_handle_interpret_events error");
-    } else if (Strings_match(recvbuffer, "") ||
-	       strpbrk(recvbuffer, separators) == NULL) {
-	return;
-    } else {
-	/*empty*/;
-    }
 
-    if (*state == CONCAT_BUFFER_CONTAIN_DATA &&
-	recvbuffer[0] == '\r' && recvbuffer[1] == '\n') {
-	ProcessProtoMsg(*message_concat);
-	free_and_null(&(*message_concat));
-	*state = CONCAT_BUFFER_IS_EMPTY;
+    line = &rb->data[0];
+    end  = &rb->data[rb->len];
+
+    if (rb->discarding) {
+	char *lf = NULL;
+
+	if ((lf = memchr(line, '\n', end - line)) == NULL) {
+	    rb->len = 0;
+	    return;
+	}
+
+	line = &lf[1];
+	rb->discarding = false;
     }
 
-    switch (recvbuffer[strlen(recvbuffer) - 1]) {
-    case '\r':
-    case '\n':
-	terminated_recvchunk = true;
-	break;
-    default:
-	terminated_recvchunk = false;
-	break;
+    /*
+     * A line ends at the first CR or LF. The rest of the CR-LF pair
+     * shows up as an empty line which is skipped.
+     */
+    while (line < end) {
+	line_scan(line, end - line, &ls);
+
+	if (ls.eol == (size_t) (end - line))
+	    break;
+
+	line[ls.eol] = '\0';
+	if (ls.eol > 0)
+	    ProcessProtoMsg(line, &ls);
+	line = &line[ls.eol + 1];
     }
 
-    if (!terminated_recvchunk) {
-	last_token = get_last_token(recvbuffer); /* Must be freed */
+    if (line == &rb->data[0] && rb->len == rb->size) {
+	err_log(0, "irc_handle_interpret_events: "
+	    "discarding a line longer than " PRINT_SZ " bytes", rb->size);
+	rb->len = 0;
+	rb->discarding = true;
+	return;
     }
 
-    for (cp = &recvbuffer[0], loop_count = 0;; cp = NULL, loop_count++) {
-	char *token = NULL;
-
-	if ((token = strtok_r(cp, separators, &savp)) == NULL) {
-	    break; /* No more tokens  --  end loop... */
-	} else if (last_token != NULL && *state == CONCAT_BUFFER_IS_EMPTY &&
-		   Strings_match(token, last_token)) {
-	    free_and_null(&(*message_concat));
-	    *message_concat = sw_strdup(last_token);
-	    free(last_token);
-	    *state = CONCAT_BUFFER_CONTAIN_DATA;
-	    /*
-	     * On the next call to this function the (incomplete) irc
-	     * message will be concatenated
-	     */
-	    return;
-	} else if (loop_count == 0 && *state == CONCAT_BUFFER_CONTAIN_DATA) {
-	    realloc_strcat(&(*message_concat), token);
-	    token = *message_concat;
-	    *state = CONCAT_BUFFER_IS_EMPTY;
-	    /*
-	     * The special token can now be passed to the handler
-	     */
-	} else {
-	    /*no action*/;
-	}
+    rb->len = end - line;
 
-	ProcessProtoMsg(token);
-    }
+    if (rb->len > 0 && line != &rb->data[0])
+	memmove(&rb->data[0], line, rb->len);
 }
 
 /**
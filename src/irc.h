@@ -3,10 +3,33 @@
 
 #include "window.h"
 
+/* RFC 2812: a message is at most 512 characters long (including the
+   CR-LF) and can hold at most 15 parameters */
+#define IRC_MAX_MESSAGE	512
+#define IRC_MAX_PARAMS	15
+
+/* A read-only view of a part of a received line. The view is NOT
+   null-terminated unless it happens to reach the end of the line. */
+struct irc_slice {
+    const char	*str;
+    size_t	 len;
+};
+
+/* All members point into the received line which is parsed in
+   place. Nothing is heap allocated and the members are only valid
+   during the call to the event handler. */
 struct irc_message_compo {
-    char *prefix;
+    char *prefix;		/* ":nick!user@host" or NULL */
     char *command;
-    char *params;
+    char *params;		/* The unsplit parameters */
+
+    struct irc_slice nick;	/* Or the server name */
+    struct irc_slice user;
+    struct irc_slice host;
+
+    struct irc_slice param[IRC_MAX_PARAMS];
+    int		     num_params;
+    bool	     has_trailing;
 };
 
 typedef void (*event_handler_fn)(struct irc_message_compo *);
@@ -17,21 +40,33 @@ enum to_window {
     NO_WINDOW
 };
 
-enum message_concat_state {
-    CONCAT_BUFFER_IS_EMPTY,
-    CONCAT_BUFFER_CONTAIN_DATA
+/* Receive buffer. Complete lines are framed in place and a partial
+   line is moved to the front of the buffer so that the next read
+   completes it. */
+struct irc_recvbuf {
+    char	*data;
+    size_t	 size;
+    size_t	 len;		/* Number of bytes held */
+    bool	 discarding;	/* Skipping an overlong line */
 };
 
 extern char	*g_server_hostname;
 extern char	*g_my_nickname;
 extern bool	 g_alt_nick_tested;
 
-void irc_deinit                     (void);
-void irc_extract_msg                (struct irc_message_compo *, PIRC_WINDOW, int ext_bits, bool is_error);
-void irc_handle_interpret_events    (char *recvbuffer, char **message_concat, enum message_concat_state *);
-void irc_init                       (void);
-void irc_set_my_nickname            (const char *nick);
-void irc_set_server_hostname        (const char *srv_host);
-void irc_unsuccessful_event_cleanup (void);
+void	 irc_deinit                     (void);
+bool	 irc_event_exists               (const char *command);
+void	 irc_extract_msg                (struct irc_message_compo *, PIRC_WINDOW, int ext_bits, bool is_error);
+void	 irc_handle_interpret_events    (struct irc_recvbuf *);
+void	 irc_init                       (void);
+int	 irc_parse_message              (char *line, struct irc_message_compo *);
+void	 irc_set_my_nickname            (const char *nick);
+void	 irc_set_server_hostname        (const char *srv_host);
+char	*irc_slice_copy                 (const struct irc_slice *, char *dest, size_t size);
+void	 irc_unsuccessful_event_cleanup (void);
+
+#ifdef UNIT_TESTING
+bool	 irc_event_exists_linear        (const char *command);
+#endif
 
 #endif
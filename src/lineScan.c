@@ -0,0 +1,285 @@
+/* Find line boundaries and trailing parameters in received data
+   Copyright (C) 2018 Markus Uhlin. All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   - Neither the name of the author nor the names of its contributors may be
+     used to endorse or promote products derived from this software without
+     specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+   BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+#include "common.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define HAVE_SSE2 1
+#include <immintrin.h>
+#if (defined(__clang__) || __GNUC__ >= 5)
+#define HAVE_AVX2 1
+#endif
+#endif
+
+#include "errHand.h"
+#include "lineScan.h"
+#include "mutex.h"
+
+typedef void (*LINE_SCAN_FN)(const char *, size_t, struct line_scan *);
+
+static void line_scan_scalar(const char *, size_t, struct line_scan *);
+
+static LINE_SCAN_FN	scan_fn	     = line_scan_scalar;
+static const char	*scan_fn_name = "scalar";
+
+#if defined(UNIX)
+static pthread_once_t	init_done = PTHREAD_ONCE_INIT;
+#elif defined(WIN32)
+static init_once_t	init_done = ONCE_INITIALIZER;
+#endif
+
+/*
+ * The scanners report the first CR or LF (whichever comes first) and
+ * the first " :" that precedes it. A prefix never contains " :" and a
+ * middle parameter can't start with a colon, so the first " :" is
+ * where the trailing parameter starts.
+ */
+
+static void
+line_scan_scalar(const char *buf, size_t len, struct line_scan *ls)
+{
+    ls->trailing = LINE_SCAN_NONE;
+
+    for (size_t i = 0; i < len; i++) {
+	switch (buf[i]) {
+	case '\r':
+	case '\n':
+	    ls->eol = i;
+	    return;
+	case ' ':
+	    if (ls->trailing == LINE_SCAN_NONE && i + 1 < len &&
+		buf[i + 1] == ':')
+		ls->trailing = i;
+	    break;
+	}
+    }
+
+    ls->eol = len;
+}
+
+#if HAVE_SSE2
+static SW_INLINE int
+first_bit(unsigned int mask)
+{
+    return __builtin_ctz(mask);
+}
+
+static void
+line_scan_sse2(const char *buf, size_t len, struct line_scan *ls)
+{
+    const __m128i cr    = _mm_set1_epi8('\r');
+    const __m128i lf    = _mm_set1_epi8('\n');
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i colon = _mm_set1_epi8(':');
+    size_t i = 0;
+
+    ls->trailing = LINE_SCAN_NONE;
+
+    /* The " :" test reads one byte ahead, hence the 17 */
+    for (; i + 17 <= len; i += 16) {
+	const __m128i v0 = _mm_loadu_si128((const __m128i *) &buf[i]);
+	const __m128i v1 = _mm_loadu_si128((const __m128i *) &buf[i + 1]);
+	const unsigned int eol = (unsigned int) _mm_movemask_epi8(
+	    _mm_or_si128(_mm_cmpeq_epi8(v0, cr), _mm_cmpeq_epi8(v0, lf)));
+	unsigned int tr = 0;
+
+	if (ls->trailing == LINE_SCAN_NONE) {
+	    tr = (unsigned int) _mm_movemask_epi8(
+		_mm_and_si128(_mm_cmpeq_epi8(v0, space),
+			      _mm_cmpeq_epi8(v1, colon)));
+	}
+
+	if (eol) {
+	    const int pos = first_bit(eol);
+
+	    /* Only a " :" before the line boundary counts */
+	    tr &= (1U << pos) - 1;
+	    if (tr)
+		ls->trailing = i + first_bit(tr);
+	    ls->eol = i + pos;
+	    return;
+	} else if (tr) {
+	    ls->trailing = i + first_bit(tr);
+	}
+    }
+
+    /* The tail */
+    if (i < len) {
+	const size_t trailing = ls->trailing;
+
+	line_scan_scalar(&buf[i], len - i, ls);
+	ls->eol += i;
+	if (trailing != LINE_SCAN_NONE)
+	    ls->trailing = trailing;
+	else if (ls->trailing != LINE_SCAN_NONE)
+	    ls->trailing += i;
+    } else {
+	ls->eol = len;
+    }
+}
+#endif /* HAVE_SSE2 */
+
+#if HAVE_AVX2
+__attribute__((target("avx2"))) static void
+line_scan_avx2(const char *buf, size_t len, struct line_scan *ls)
+{
+    const __m256i cr    = _mm256_set1_epi8('\r');
+    const __m256i lf    = _mm256_set1_epi8('\n');
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i colon = _mm256_set1_epi8(':');
+    size_t i = 0;
+
+    ls->trailing = LINE_SCAN_NONE;
+
+    for (; i + 33 <= len; i += 32) {
+	const __m256i v0 = _mm256_loadu_si256((const __m256i *) &buf[i]);
+	const __m256i v1 = _mm256_loadu_si256((const __m256i *) &buf[i + 1]);
+	const unsigned int eol = (unsigned int) _mm256_movemask_epi8(
+	    _mm256_or_si256(_mm256_cmpeq_epi8(v0, cr),
+			    _mm256_cmpeq_epi8(v0, lf)));
+	unsigned int tr = 0;
+
+	if (ls->trailing == LINE_SCAN_NONE) {
+	    tr = (unsigned int) _mm256_movemask_epi8(
+		_mm256_and_si256(_mm256_cmpeq_epi8(v0, space),
+				 _mm256_cmpeq_epi8(v1, colon)));
+	}
+
+	if (eol) {
+	    const int pos = first_bit(eol);
+
+	    tr &= (1U << pos) - 1;
+	    if (tr)
+		ls->trailing = i + first_bit(tr);
+	    ls->eol = i + pos;
+	    return;
+	} else if (tr) {
+	    ls->trailing = i + first_bit(tr);
+	}
+    }
+
+    if (i < len) {
+	const size_t trailing = ls->trailing;
+
+	line_scan_sse2(&buf[i], len - i, ls);
+	ls->eol += i;
+	if (trailing != LINE_SCAN_NONE)
+	    ls->trailing = trailing;
+	else if (ls->trailing != LINE_SCAN_NONE)
+	    ls->trailing += i;
+    } else {
+	ls->eol = len;
+    }
+}
+#endif /* HAVE_AVX2 */
+
+static bool
+set_impl(enum line_scan_impl impl)
+{
+    switch (impl) {
+    case LINE_SCAN_SCALAR:
+	scan_fn = line_scan_scalar;
+	scan_fn_name = "scalar";
+	return true;
+#if HAVE_SSE2
+    case LINE_SCAN_SSE2:
+	scan_fn = line_scan_sse2;
+	scan_fn_name = "sse2";
+	return true;
+#endif
+#if HAVE_AVX2
+    case LINE_SCAN_AVX2:
+	if (!__builtin_cpu_supports("avx2"))
+	    return false;
+	scan_fn = line_scan_avx2;
+	scan_fn_name = "avx2";
+	return true;
+#endif
+    default:
+	break;
+    }
+
+    return false;
+}
+
+static void
+select_impl(void)
+{
+    if (!set_impl(LINE_SCAN_AVX2))
+	(void) set_impl(LINE_SCAN_SSE2);
+}
+
+static void
+init_once_impl(void)
+{
+#if defined(UNIX)
+    if ((errno = pthread_once(&init_done, select_impl)) != 0)
+	err_sys("pthread_once");
+#elif defined(WIN32)
+    if ((errno = init_once(&init_done, select_impl)) != 0)
+	err_sys("init_once");
+#endif
+}
+
+/**
+ * Override the implementation selected at runtime (used by the
+ * benchmark)
+ *
+ * @return True if the CPU supports the implementation
+ */
+bool
+line_scan_set_impl(enum line_scan_impl impl)
+{
+    init_once_impl();
+    return set_impl(impl);
+}
+
+const char *
+line_scan_impl_name(void)
+{
+    init_once_impl();
+    return scan_fn_name;
+}
+
+/**
+ * Scan for the end of the line and the start of the trailing
+ * parameter
+ *
+ * @param buf Buffer to scan (needn't be null-terminated)
+ * @param len Buffer length
+ * @param ls  Result
+ * @return Void
+ */
+void
+line_scan(const char *buf, size_t len, struct line_scan *ls)
+{
+    init_once_impl();
+    scan_fn(buf, len, ls);
+}
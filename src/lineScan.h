@@ -0,0 +1,22 @@
+#ifndef LINE_SCAN_H
+#define LINE_SCAN_H
+
+#define LINE_SCAN_NONE ((size_t) -1)
+
+struct line_scan {
+    size_t eol;		/* Offset of the first CR or LF, or the length */
+    size_t trailing;	/* Offset of the first " :" before eol, or
+			   LINE_SCAN_NONE */
+};
+
+enum line_scan_impl {
+    LINE_SCAN_SCALAR,
+    LINE_SCAN_SSE2,
+    LINE_SCAN_AVX2
+};
+
+bool		 line_scan_set_impl (enum line_scan_impl);
+const char	*line_scan_impl_name(void);
+void		 line_scan          (const char *buf, size_t len, struct line_scan *);
+
+#endif
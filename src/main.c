@@ -44,6 +44,7 @@
 #endif
 
 #include "assertAPI.h"
+#include "colorPairs.h"
 #include "curses-funcs.h"
 #include "cursesInit.h"
 #include "errHand.h"
@@ -54,6 +55,7 @@
 #include "network.h"
 #include "options.h"
 #include "readline.h"
+#include "resolver.h"
 #include "sig.h"
 #include "statusbar.h"
 #include "strHand.h"
@@ -436,6 +438,7 @@ main(int argc, char *argv[])
     statusbar_init();
     windowSystem_init();
     readline_init();
+    term_refresh_init();
     net_ssl_init();
 
 #if defined(OpenBSD) && OpenBSD >= 201605 && RESTRICT_SYSOPS
@@ -448,11 +451,13 @@ main(int argc, char *argv[])
     enter_io_loop();
 
     /* XXX: Reverse order... */
+    resolver_flush();
     net_ssl_deinit();
     readline_deinit();
     windowSystem_deinit();
     statusbar_deinit();
     titlebar_deinit();
+    color_pairs_deinit();
     escape_curses();
     nestHome_deinit();
     term_deinit();
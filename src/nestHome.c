@@ -44,6 +44,7 @@
 #include "libUtils.h"
 #include "main.h"
 #include "nestHome.h"
+#include "scrollback.h"
 #include "strHand.h"
 #include "strdup_printf.h"
 #include "theme.h"
@@ -51,6 +52,8 @@
 char	*g_home_dir = NULL;
 char	*g_tmp_dir  = NULL;
 char	*g_log_dir  = NULL;
+char	*g_session_dir = NULL;
+char	*g_scrollback_dir = NULL;
 
 const char g_config_filesuffix[] = ".conf";
 const char g_theme_filesuffix[]  = ".the";
@@ -111,17 +114,24 @@ nestHome_init(void)
     g_home_dir  = Strdup_printf("%s/.swirc", hp);
     g_tmp_dir   = Strdup_printf("%s/.swirc/tmp", hp);
     g_log_dir   = Strdup_printf("%s/.swirc/log", hp);
+    g_session_dir = Strdup_printf("%s/.swirc/sessions", hp);
+    g_scrollback_dir = Strdup_printf("%s/.swirc/scrollback", hp);
     config_file = Strdup_printf("%s/.swirc/swirc%s", hp, g_config_filesuffix);
 #elif defined(WIN32)
     g_home_dir  = Strdup_printf("%s\\swirc", hp);
     g_tmp_dir   = Strdup_printf("%s\\swirc\\tmp", hp);
     g_log_dir   = Strdup_printf("%s\\swirc\\log", hp);
+    g_session_dir = Strdup_printf("%s\\swirc\\sessions", hp);
+    g_scrollback_dir = Strdup_printf("%s\\swirc\\scrollback", hp);
     config_file = Strdup_printf("%s\\swirc\\swirc%s", hp, g_config_filesuffix);
 #endif
 
     make_requested_dir(g_home_dir);
     make_requested_dir(g_tmp_dir);
     make_requested_dir(g_log_dir);
+    make_requested_dir(g_session_dir);
+    make_requested_dir(g_scrollback_dir);
+    scrollback_remove_stale(g_scrollback_dir);
 
     config_init();
     theme_init();
@@ -187,6 +197,8 @@ nestHome_deinit(void)
     free_and_null(&g_home_dir);
     free_and_null(&g_tmp_dir);
     free_and_null(&g_log_dir);
+    free_and_null(&g_session_dir);
+    free_and_null(&g_scrollback_dir);
 
     config_deinit();
     theme_deinit();
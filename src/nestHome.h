@@ -4,6 +4,8 @@
 extern char *g_home_dir;
 extern char *g_tmp_dir;
 extern char *g_log_dir;
+extern char *g_session_dir;
+extern char *g_scrollback_dir;
 
 extern const char g_config_filesuffix[];
 extern const char g_theme_filesuffix[];
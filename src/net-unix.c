@@ -37,13 +37,18 @@
 
 #include "assertAPI.h"
 #include "errHand.h"
-#include "libUtils.h"
 #include "network.h"
-#include "strdup_printf.h"
+#include "pthrMutex.h"
 
 int g_socket = -1;
 
-static pthread_t listenThread_id;
+static pthread_t	listenThread_id;
+static bool		listenThread_joinable = false;
+static pthread_mutex_t	listenThread_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t	connectThread_id;
+static bool		connectThread_joinable = false;
+static pthread_mutex_t	connectThread_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static void *
 listenThread_fn(void *arg)
@@ -53,33 +58,42 @@ listenThread_fn(void *arg)
     return (NULL);
 }
 
+static void *
+connectThread_fn(void *arg)
+{
+    net_connect_run(arg);
+    return (NULL);
+}
+
+static int
+write_plain(const char *buf, int len)
+{
+    ssize_t n_sent;
+
+    do {
+	errno = 0;
+	n_sent = send(g_socket, buf, len, 0);
+    } while (n_sent == -1 && errno == EINTR);
+
+    if (n_sent == -1)
+	return (errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1);
+    return ((int) n_sent);
+}
+
 int
 net_send_plain(const char *fmt, ...)
 {
-    char       *buffer;
-    int         n_sent;
+    int         ret;
     va_list     ap;
 
-    if (!fmt) {
+    if (!fmt)
 	err_exit(EINVAL, "net_send");
-    } else if (*fmt == '\0') {
-	return (0); /* nothing sent */
-    }
 
     va_start(ap, fmt);
-    buffer = Strdup_vprintf(fmt, ap);
+    ret = net_vsend_queued(write_plain, fmt, ap);
     va_end(ap);
 
-    realloc_strcat(&buffer, "\r\n");
-
-    errno = 0;
-    if ((n_sent = send(g_socket, buffer, strlen(buffer), 0)) == -1) {
-	free_and_null(&buffer);
-	return (errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1);
-    }
-
-    free_and_null(&buffer);
-    return (n_sent);
+    return (ret);
 }
 
 int
@@ -116,17 +130,61 @@ net_recv_plain(struct network_recv_context *ctx,
     /*NOTREACHED*/ return (-1);
 }
 
+void
+net_spawn_connectThread(struct network_connect_context *ctx)
+{
+    /* reap the thread of an earlier attempt */
+    net_connectThread_join();
+
+    mutex_lock(&connectThread_mutex);
+    if (errno = pthread_create(&connectThread_id, NULL, connectThread_fn,
+	ctx), errno != 0)
+	err_sys("pthread_create");
+    connectThread_joinable = true;
+    mutex_unlock(&connectThread_mutex);
+}
+
+/*
+ * Wait for the connect thread to finish
+ */
+void
+net_connectThread_join(void)
+{
+    mutex_lock(&connectThread_mutex);
+    if (connectThread_joinable) {
+	if ((errno = pthread_join(connectThread_id, NULL)) != 0)
+	    err_sys("pthread_join");
+	connectThread_joinable = false;
+    }
+    mutex_unlock(&connectThread_mutex);
+}
+
 void
 net_spawn_listenThread(void)
 {
+    /* reap the thread of an earlier connection that nobody joined */
+    net_listenThread_join();
+
+    mutex_lock(&listenThread_mutex);
     if (errno = pthread_create(&listenThread_id, NULL, listenThread_fn, NULL),
 	errno != 0)
 	err_sys("pthread_create");
+    listenThread_joinable = true;
+    mutex_unlock(&listenThread_mutex);
 }
 
+/*
+ * Both the UI thread (/disconnect) and the connect thread (welcome
+ * timeout) may join the listener, but only the first one does.
+ */
 void
 net_listenThread_join(void)
 {
-    if ((errno = pthread_join(listenThread_id, NULL)) != 0)
-	err_sys("pthread_join");
+    mutex_lock(&listenThread_mutex);
+    if (listenThread_joinable) {
+	if ((errno = pthread_join(listenThread_id, NULL)) != 0)
+	    err_sys("pthread_join");
+	listenThread_joinable = false;
+    }
+    mutex_unlock(&listenThread_mutex);
 }
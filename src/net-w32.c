@@ -34,13 +34,12 @@
 
 #include "assertAPI.h"
 #include "errHand.h"
-#include "libUtils.h"
 #include "network.h"
-#include "strdup_printf.h"
 
 SOCKET g_socket = INVALID_SOCKET;
 
 static uintptr_t listenThread_id;
+static uintptr_t connectThread_id;
 
 static void __cdecl
 listenThread_fn(void *arg)
@@ -49,6 +48,12 @@ listenThread_fn(void *arg)
     net_irc_listen();
 }
 
+static void __cdecl
+connectThread_fn(void *arg)
+{
+    net_connect_run(arg);
+}
+
 bool
 winsock_init(void)
 {
@@ -64,33 +69,30 @@ winsock_deinit(void)
     return (WSACleanup() == 0 ? true : false);
 }
 
+static int
+write_plain(const char *buf, int len)
+{
+    int n_sent;
+
+    if ((n_sent = send(g_socket, buf, len, 0)) == SOCKET_ERROR)
+	return (WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1);
+    return (n_sent);
+}
+
 int
 net_send_plain(const char *fmt, ...)
 {
-    char *buffer;
-    int n_sent;
+    int ret;
     va_list ap;
 
-    if (!fmt) {
+    if (!fmt)
 	err_exit(EINVAL, "net_send error");
-    } else if (*fmt == '\0') {
-	return (0); /* nothing sent */
-    }
 
     va_start(ap, fmt);
-    buffer = Strdup_vprintf(fmt, ap);
+    ret = net_vsend_queued(write_plain, fmt, ap);
     va_end(ap);
 
-    realloc_strcat(&buffer, "\r\n");
-
-    if ((n_sent = send(g_socket, buffer, size_to_int(strlen(buffer)), 0)) ==
-	SOCKET_ERROR) {
-	free_and_null(&buffer);
-	return (WSAGetLastError() == WSAEWOULDBLOCK ? 0 : -1);
-    }
-
-    free_and_null(&buffer);
-    return (n_sent);
+    return (ret);
 }
 
 int
@@ -125,6 +127,22 @@ net_recv_plain(struct network_recv_context *ctx,
     /*NOTREACHED*/ return (-1);
 }
 
+void
+net_spawn_connectThread(struct network_connect_context *ctx)
+{
+    static const uintptr_t UNSUCCESSFUL = (uintptr_t) -1L;
+
+    if ((connectThread_id = _beginthread(connectThread_fn, 0, ctx)) ==
+	UNSUCCESSFUL)
+	err_sys("_beginthread error");
+}
+
+void
+net_connectThread_join(void)
+{
+    (void) WaitForSingleObject((HANDLE) connectThread_id, 10000);
+}
+
 void
 net_spawn_listenThread(void)
 {
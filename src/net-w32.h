@@ -12,10 +12,14 @@ struct network_recv_context {
 
 extern SOCKET g_socket;
 
+struct network_connect_context;
+
 bool winsock_init           (void);
 bool winsock_deinit         (void);
 int  net_send_plain         (const char *fmt, ...);
 int  net_recv_plain         (struct network_recv_context *, char *recvbuf, int recvbuf_size);
+void net_spawn_connectThread(struct network_connect_context *);
+void net_connectThread_join (void);
 void net_spawn_listenThread (void);
 void net_listenThread_join  (void);
 
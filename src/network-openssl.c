@@ -18,21 +18,30 @@
 
 #ifdef UNIX
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include <openssl/err.h> /* ERR_clear_error() */
 #include <openssl/opensslv.h>
+#include <openssl/pem.h>
 #include <openssl/rand.h>
 #include <openssl/ssl.h>
 #include <openssl/x509.h>
 #include <openssl/x509_vfy.h>
 
-#include <limits.h>
+#include <time.h>
 
 #include "assertAPI.h"
 #include "config.h"
+#include "dataClassify.h"
 #include "errHand.h"
 #include "libUtils.h"
+#include "nestHome.h"
 #include "network.h"
 #include "printtext.h"
 #include "strHand.h"
@@ -41,6 +50,30 @@
 static SSL_CTX	*ssl_ctx = NULL;
 static SSL	*ssl	 = NULL;
 
+/* Session resumption
+   ==================
+   New sessions (TLS 1.2 session IDs or tickets, and TLS 1.3 tickets,
+   which arrive after the handshake) are written to a file per server
+   and port in the sessions directory, and offered on the next connect
+   to the same server. A handshake that fails while offering a session
+   removes the file. */
+static char		*session_file = NULL;
+static unsigned long int handshakes_full = 0;
+static unsigned long int handshakes_resumed = 0;
+
+/* Kernel TLS
+   ==========
+   With SSL_OP_ENABLE_KTLS (OpenSSL 3, Linux) the kernel takes over
+   the record encryption after the handshake, if it supports the
+   negotiated cipher. OpenSSL falls back to userspace crypto (per
+   direction) otherwise. With kTLS on the send side the send queue
+   writes plaintext to the socket itself. Receiving still goes through
+   SSL_read(), which reads the socket with recvmsg() and handles the
+   non-application records (tickets, key updates) that the kernel
+   passes up as control messages. */
+static bool ktls_send = false;
+static bool ktls_recv = false;
+
 static const char *suite_secure = "TLSv1.2+AEAD+ECDHE:TLSv1.2+AEAD+DHE";
 static const char *suite_compat = "HIGH:!aNULL";
 static const char *suite_legacy = "ALL:!ADH:!EXP:!LOW:!MD5:@STRENGTH";
@@ -90,6 +123,161 @@ set_ciphers(const char *list)
 		  xstrerror(EINVAL, strerrbuf, MAXERROR));
 }
 
+/*
+ * Path of the session file for a server. Characters that don't
+ * belong in a hostname are replaced.
+ */
+static char *
+get_session_file(const char *host, const char *port)
+{
+    char *name, *cp;
+    char *path;
+
+    if (g_session_dir == NULL || !config_current()->ssl_session_cache)
+	return NULL;
+
+    name = Strdup_printf("%s_%s.pem", host, port);
+    for (cp = name; *cp; cp++) {
+	if (!sw_isalnum(*cp) && *cp != '-' && *cp != '.' && *cp != '_')
+	    *cp = '_';
+    }
+#if defined(UNIX)
+    path = Strdup_printf("%s/%s", g_session_dir, name);
+#elif defined(WIN32)
+    path = Strdup_printf("%s\\%s", g_session_dir, name);
+#endif
+    free(name);
+    return path;
+}
+
+static SSL_SESSION *
+session_load(const char *path)
+{
+    BIO *bio;
+    SSL_SESSION *sess;
+
+    if ((bio = BIO_new_file(path, "r")) == NULL) {
+	ERR_clear_error();
+	return NULL;
+    }
+
+    sess = PEM_read_bio_SSL_SESSION(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+
+    if (sess == NULL) {
+	ERR_clear_error();
+	return NULL;
+    } else if ((long int) SSL_SESSION_get_time(sess) +
+	       SSL_SESSION_get_timeout(sess) <= (long int) time(NULL)) {
+	SSL_SESSION_free(sess);
+	(void) remove(path);
+	return NULL;
+    }
+
+    return sess;
+}
+
+static void
+session_save(const char *path, SSL_SESSION *sess)
+{
+    BIO *bio;
+#if defined(UNIX)
+    int fd;
+
+    /* The file holds key material */
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR))
+	== -1) {
+	err_log(errno, "session_save: open: %s", path);
+	return;
+    } else if (fchmod(fd, S_IRUSR | S_IWUSR) == -1) {
+	/* An existing file keeps its mode when it's truncated */
+	err_log(errno, "session_save: fchmod: %s", path);
+	(void) close(fd);
+	return;
+    } else if ((bio = BIO_new_fd(fd, BIO_CLOSE)) == NULL) {
+	(void) close(fd);
+	return;
+    }
+#elif defined(WIN32)
+    if ((bio = BIO_new_file(path, "w")) == NULL) {
+	ERR_clear_error();
+	return;
+    }
+#endif
+
+    if (!PEM_write_bio_SSL_SESSION(bio, sess)) {
+	err_log(0, "session_save: PEM_write_bio_SSL_SESSION: %s", path);
+	ERR_clear_error();
+    }
+    BIO_free(bio);
+}
+
+/*
+ * Called by OpenSSL when the server hands out a new session
+ */
+static int
+new_session_cb(SSL *s, SSL_SESSION *sess)
+{
+    (void) s;
+
+    if (session_file
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	&& SSL_SESSION_is_resumable(sess)
+#endif
+	)
+	session_save(session_file, sess);
+    return 0; /* no reference kept */
+}
+
+/*
+ * SNI carries names only
+ */
+static bool
+is_address_literal(const char *host)
+{
+    return (strchr(host, ':') != NULL ||
+	    strspn(host, "0123456789.") == strlen(host));
+}
+
+static void
+ktls_update(void)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    ktls_send = (ssl && BIO_get_ktls_send(SSL_get_wbio(ssl)));
+    ktls_recv = (ssl && BIO_get_ktls_recv(SSL_get_rbio(ssl)));
+#else
+    ktls_send = ktls_recv = false;
+#endif
+}
+
+/**
+ * @return Which directions the kernel encrypts/decrypts for the
+ *         current connection
+ */
+const char *
+net_ssl_ktls_mode(void)
+{
+    if (ktls_send && ktls_recv)
+	return "send+recv";
+    else if (ktls_send)
+	return "send";
+    else if (ktls_recv)
+	return "recv";
+    return "off";
+}
+
+/**
+ * Get the number of full and resumed handshakes since the start
+ */
+void
+net_ssl_handshake_stats(unsigned long int *full, unsigned long int *resumed)
+{
+    if (full)
+	*full = handshakes_full;
+    if (resumed)
+	*resumed = handshakes_resumed;
+}
+
 void
 net_ssl_init(void)
 {
@@ -127,7 +315,23 @@ net_ssl_init(void)
     }
 #endif
 
-    if (config_bool_unparse("ssl_verify_peer", true) &&
+    /*
+     * The send queue writes whatever is pending and moves what's left
+     * after a partial write to the front of its buffer
+     */
+    SSL_CTX_set_mode(ssl_ctx, SSL_MODE_ENABLE_PARTIAL_WRITE |
+	SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
+    SSL_CTX_set_session_cache_mode(ssl_ctx, SSL_SESS_CACHE_CLIENT |
+	SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ssl_ctx, new_session_cb);
+
+#ifdef SSL_OP_ENABLE_KTLS
+    if (config_current()->ssl_ktls)
+	SSL_CTX_set_options(ssl_ctx, SSL_OP_ENABLE_KTLS);
+#endif
+
+    if (config_current()->ssl_verify_peer &&
 	SSL_CTX_set_default_verify_paths(ssl_ctx)) {
 	SSL_CTX_set_verify(ssl_ctx, SSL_VERIFY_PEER, verify_callback);
 	SSL_CTX_set_verify_depth(ssl_ctx, 4);
@@ -167,6 +371,7 @@ net_ssl_deinit(void)
 	SSL_CTX_free(ssl_ctx);
 	ssl_ctx = NULL;
     }
+    free_and_null(&session_file);
 }
 
 void
@@ -177,10 +382,11 @@ net_ssl_close(void)
 	SSL_free(ssl);
 	ssl = NULL;
     }
+    ktls_send = ktls_recv = false;
 }
 
 int
-net_ssl_start(void)
+net_ssl_start(const char *host, const char *port)
 {
     struct printtext_context ptext_ctx = {
 	.window	    = g_status_window,
@@ -188,65 +394,112 @@ net_ssl_start(void)
 	.include_ts = true,
     };
     const int VALUE_HANDSHAKE_OK = 1;
+    SSL_SESSION *sess = NULL;
+
+    free_and_null(&session_file);
+    if (host && port && (session_file = get_session_file(host, port)))
+	sess = session_load(session_file);
 
     if ((ssl = SSL_new(ssl_ctx)) == NULL)
 	err_exit(ENOMEM, "net_ssl_start: Unable to create a new SSL object");
-    else if (!SSL_set_fd(ssl, g_socket))
+    if (host && !is_address_literal(host))
+	(void) SSL_set_tlsext_host_name(ssl, host);
+    if (sess) {
+	if (!SSL_set_session(ssl, sess))
+	    ERR_clear_error();
+	SSL_SESSION_free(sess);
+    }
+
+    if (!SSL_set_fd(ssl, g_socket)) {
 	printtext(&ptext_ctx, "net_ssl_start: "
 	    "Unable to associate the global socket fd with the SSL object");
-    else if (SSL_connect(ssl) != VALUE_HANDSHAKE_OK)
+    } else if (SSL_connect(ssl) != VALUE_HANDSHAKE_OK) {
 	printtext(&ptext_ctx, "net_ssl_start: Handshake NOT ok!");
-    else
+	if (sess && session_file)
+	    (void) remove(session_file);
+    } else {
+	if (SSL_session_reused(ssl))
+	    handshakes_resumed++;
+	else
+	    handshakes_full++;
+
+	ptext_ctx.spec_type = TYPE_SPEC1_SUCCESS;
+	printtext(&ptext_ctx, "%s handshake (%s)  --  "
+	    "resumed: %lu, full: %lu",
+	    SSL_session_reused(ssl) ? "Resumed" : "Full", SSL_get_version(ssl),
+	    handshakes_resumed, handshakes_full);
+
+	ktls_update();
+	printtext(&ptext_ctx, "Kernel TLS: %s", net_ssl_ktls_mode());
 	return (0);
+    }
 
     return (-1);
 }
 
-int
-net_ssl_send(const char *fmt, ...)
+#ifdef UNIX
+/*
+ * The kernel frames and encrypts what's written to the socket
+ */
+static int
+write_ktls(const char *buf, int len)
 {
-    char	*buf	= NULL;
-    int		 buflen = 0;
-    int		 n_sent = 0;
-    va_list	 ap;
+    ssize_t n_sent;
 
-    if (!ssl)
-	return -1;
+    do {
+	errno = 0;
+	n_sent = send(g_socket, buf, len, 0);
+    } while (n_sent == -1 && errno == EINTR);
 
-    va_start(ap, fmt);
-    buf = Strdup_vprintf(fmt, ap);
-    va_end(ap);
+    if (n_sent == -1)
+	return (errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1);
+    return ((int) n_sent);
+}
+#endif
 
-    /* message terminate */
-    realloc_strcat(&buf, "\r\n");
+static int
+write_ssl(const char *buf, int len)
+{
+    int n_sent = 0;
 
-    if (strlen(buf) > INT_MAX) {
-	free(buf);
+    if (!ssl)
 	return -1;
-    }
+#ifdef UNIX
+    else if (ktls_send)
+	return write_ktls(buf, len);
+#endif
 
-    buflen = (int) strlen(buf);
     ERR_clear_error();
 
-    if ((n_sent = SSL_write(ssl, buf, buflen)) > 0) {
-	free(buf);
+    if ((n_sent = SSL_write(ssl, buf, len)) > 0)
 	return n_sent;
-    }
-
-    free(buf);
 
     switch (SSL_get_error(ssl, n_sent)) {
     case SSL_ERROR_NONE:
-	return 0;
     case SSL_ERROR_WANT_READ:
     case SSL_ERROR_WANT_WRITE:
-	err_log(0, "net_ssl_send: operation did not complete");
 	return 0;
     }
 
     return -1;
 }
 
+int
+net_ssl_send(const char *fmt, ...)
+{
+    int		ret = 0;
+    va_list	ap;
+
+    if (!ssl)
+	return -1;
+
+    va_start(ap, fmt);
+    ret = net_vsend_queued(write_ssl, fmt, ap);
+    va_end(ap);
+
+    return ret;
+}
+
 int
 net_ssl_recv(struct network_recv_context *ctx, char *recvbuf, int recvbuf_size)
 {
@@ -309,3 +562,26 @@ net_ssl_check_hostname(const char *host, unsigned int flags)
     X509_free(cert);
     return ret;
 }
+
+#ifdef UNIT_TESTING
+/*
+ * The session file functions, for tests/test_network-openssl.c
+ */
+char *
+net_ssl_session_file(const char *host, const char *port)
+{
+    return get_session_file(host, port);
+}
+
+struct ssl_session_st *
+net_ssl_session_load(const char *path)
+{
+    return session_load(path);
+}
+
+void
+net_ssl_session_save(const char *path, struct ssl_session_st *sess)
+{
+    session_save(path, sess);
+}
+#endif
@@ -29,6 +29,8 @@
 
 #include "common.h"
 
+#include <openssl/crypto.h> /* OPENSSL_cleanse() */
+
 #ifdef UNIX
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -37,14 +39,22 @@
 #include <unistd.h> /* close() */
 #endif
 
+#include <limits.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "config.h"
 #include "errHand.h"
+#include "happyEyeballs.h"
 #include "irc.h"
 #include "libUtils.h"
+#include "main.h"
+#include "mutex.h"
 #include "network.h"
 #include "printtext.h"
+#include "resolver.h"
+#include "statusbar.h"
 #include "strHand.h"
 
 #include "commands/connect.h"
@@ -55,42 +65,580 @@ NET_SEND_FN net_send = net_send_plain;
 NET_RECV_FN net_recv = net_recv_plain;
 
 volatile bool g_connection_in_progress = false;
+
+static volatile bool connect_cancelled = false;
 volatile bool g_on_air = false;
 
-static const int RECVBUF_SIZE = 2048;
+static const size_t RECVBUF_SIZE = 65536;
+
+/* Send queue
+   ==========
+   Lines are formatted into one of three lanes and moved from there to
+   the output buffer, which the transport (plain or TLS) writes out as
+   one chunk. The lanes are served in priority order:
+     - SENDQ_LANE_URGENT: PONG, registration and capability/SASL
+       negotiation,
+     - SENDQ_LANE_NORMAL: everything that isn't listed elsewhere, and
+     - SENDQ_LANE_BULK: PRIVMSG and NOTICE (i.e. pastes).
+
+   A token bucket shaped like the classic server-side penalty rule
+   paces the lanes. Every line costs 'flood_interval' ms and may go as
+   long as the penalty clock is no more than 'flood_burst' lines ahead
+   of the real clock. Urgent lines are charged but never held back.
+
+   The output buffer is written:
+     - after every line that isn't sent within a batch,
+     - when the outermost batch ends,
+     - when the lanes hold SENDQ_FLUSH_THRESHOLD bytes or more (the
+       size of one TLS record), and
+     - by the listener for as long as anything is pending. */
+#define SENDQ_FLUSH_THRESHOLD	16384
+#define SENDQ_MIN_FREE		(IRC_MAX_MESSAGE + 1)
+
+/* how often the connect thread looks for a cancel (ms) */
+#define CONNECT_POLL_MS		100
+
+enum sendq_lane_type {
+    SENDQ_LANE_URGENT,
+    SENDQ_LANE_NORMAL,
+    SENDQ_LANE_BULK,
+    SENDQ_LANES
+};
+
+struct sendq_buf {
+    char	*buf;
+    size_t	 size;
+    size_t	 head;		/* Start of the unsent data */
+    size_t	 len;		/* End of the data */
+    int		 lines;
+};
+
+static struct {
+    struct sendq_buf	lane[SENDQ_LANES];
+    struct sendq_buf	out;
+    struct sendq_buf	line;		/* Formatting area */
+    int			batch_depth;
+    bool		stalled;	/* Reported a partial write */
+    NET_WRITE_FN	write_fn;
+    long int		flood_burst;
+    long int		flood_interval;	/* ms (0 = no throttling) */
+    unsigned long long	penalty;	/* Penalty clock (ms) */
+} sendq = {
+    .batch_depth    = 0,
+    .stalled	    = false,
+    .write_fn	    = NULL,
+    .flood_burst    = 5,
+    .flood_interval = 2000,
+    .penalty	    = 0,
+};
+
+static const struct {
+    const char		*cmd;
+    enum sendq_lane_type lane;
+} sendq_lane_map[] = {
+    { "AUTHENTICATE", SENDQ_LANE_URGENT },
+    { "CAP",          SENDQ_LANE_URGENT },
+    { "NICK",         SENDQ_LANE_URGENT },
+    { "NOTICE",       SENDQ_LANE_BULK   },
+    { "PASS",         SENDQ_LANE_URGENT },
+    { "PONG",         SENDQ_LANE_URGENT },
+    { "PRIVMSG",      SENDQ_LANE_BULK   },
+    { "QUIT",         SENDQ_LANE_URGENT }, /* the queue goes with it */
+    { "USER",         SENDQ_LANE_URGENT },
+};
+
+#if defined(UNIX)
+static pthread_once_t	sendq_init_done = PTHREAD_ONCE_INIT;
+static pthread_mutex_t	sendq_mutex;
+#elif defined(WIN32)
+static init_once_t	sendq_init_done = ONCE_INITIALIZER;
+static HANDLE		sendq_mutex;
+#endif
 
 bool
 is_sasl_enabled(void)
 {
-    return config_bool_unparse("sasl", false);
+    return config_current()->sasl;
 }
 
+/**
+ * Resolve a server and port
+ *
+ * @return An address list (free it with resolver_free()) or NULL
+ */
 struct addrinfo *
 net_addr_resolve(const char *host, const char *port)
 {
-    struct addrinfo hints = {
-	.ai_flags     = AI_CANONNAME,
-	.ai_family    = AF_INET,
-	.ai_socktype  = SOCK_STREAM,
-	.ai_protocol  = 0,
-	.ai_addrlen   = 0,
-	.ai_addr      = NULL,
-	.ai_canonname = NULL,
-	.ai_next      = NULL,
+    return resolver_lookup(host, port);
+}
+
+static void
+sendq_mutex_init(void)
+{
+    mutex_new(&sendq_mutex);
+}
+
+static void
+sendq_lock(void)
+{
+#if defined(UNIX)
+    if ((errno = pthread_once(&sendq_init_done, sendq_mutex_init)) != 0)
+	err_sys("pthread_once");
+#elif defined(WIN32)
+    if ((errno = init_once(&sendq_init_done, sendq_mutex_init)) != 0)
+	err_sys("init_once");
+#endif
+    mutex_lock(&sendq_mutex);
+}
+
+static void
+sendq_unlock(void)
+{
+    mutex_unlock(&sendq_mutex);
+}
+
+/**
+ * @return A monotonic clock in milliseconds
+ */
+unsigned long long
+net_monotonic_ms(void)
+{
+#if defined(UNIX)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+	err_sys("clock_gettime");
+    return (ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+#elif defined(WIN32)
+    return GetTickCount64();
+#endif
+}
+
+static size_t
+sendq_buf_pending(const struct sendq_buf *sb)
+{
+    return (sb->len - sb->head);
+}
+
+static void
+sendq_buf_clear(struct sendq_buf *sb)
+{
+    sb->head = sb->len = 0;
+    sb->lines = 0;
+}
+
+/*
+ * Make room for 'needed' more bytes at the end of the buffer. Sent
+ * data at the front is reclaimed before the buffer grows.
+ */
+static void
+sendq_buf_reserve(struct sendq_buf *sb, size_t needed)
+{
+    if (sb->size - sb->len >= needed)
+	return;
+    if (sb->head > 0) {
+	memmove(&sb->buf[0], &sb->buf[sb->head], sb->len - sb->head);
+	sb->len -= sb->head;
+	sb->head = 0;
+	if (sb->size - sb->len >= needed)
+	    return;
+    }
+    while (sb->size - sb->len < needed)
+	sb->size = (sb->size ? sb->size * 2 : SENDQ_FLUSH_THRESHOLD);
+    sb->buf = (sb->buf ? xrealloc(sb->buf, sb->size) : xmalloc(sb->size));
+}
+
+static void
+sendq_buf_append(struct sendq_buf *sb, const char *data, size_t len)
+{
+    sendq_buf_reserve(sb, len);
+    memcpy(&sb->buf[sb->len], data, len);
+    sb->len += len;
+}
+
+static void
+sendq_clear_locked(void)
+{
+    enum sendq_lane_type type;
+
+    for (type = 0; type < SENDQ_LANES; type++)
+	sendq_buf_clear(&sendq.lane[type]);
+    sendq_buf_clear(&sendq.out);
+}
+
+static size_t
+sendq_lanes_pending(void)
+{
+    size_t len = 0;
+    enum sendq_lane_type type;
+
+    for (type = 0; type < SENDQ_LANES; type++)
+	len += sendq_buf_pending(&sendq.lane[type]);
+    return len;
+}
+
+/*
+ * Pick a lane by the command of a formatted line
+ */
+static enum sendq_lane_type
+sendq_classify(const char *line, size_t len)
+{
+    const char *space = memchr(line, ' ', len);
+    const size_t cmdlen = (space ? (size_t) (space - line) : len);
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(sendq_lane_map); i++) {
+	if (strlen(sendq_lane_map[i].cmd) == cmdlen &&
+	    memcmp(sendq_lane_map[i].cmd, line, cmdlen) == 0)
+	    return sendq_lane_map[i].lane;
+    }
+
+    return SENDQ_LANE_NORMAL;
+}
+
+/*
+ * Whether the token bucket has room for another line at time 'now'
+ */
+static bool
+sendq_may_send(unsigned long long now)
+{
+    if (sendq.flood_interval == 0)
+	return true;
+    return (sendq.penalty + sendq.flood_interval <=
+	    now + sendq.flood_burst * sendq.flood_interval);
+}
+
+/*
+ * Move the first line of a lane to the output buffer
+ */
+static void
+sendq_move_line(struct sendq_buf *lane)
+{
+    const char *start = &lane->buf[lane->head];
+    const char *eol = memchr(start, '\n', sendq_buf_pending(lane));
+    const size_t len = (eol ? (size_t) (eol - start + 1) :
+			sendq_buf_pending(lane));
+
+    sendq_buf_append(&sendq.out, start, len);
+    lane->head += len;
+    lane->lines--;
+
+    if (lane->head == lane->len)
+	sendq_buf_clear(lane);
+}
+
+/*
+ * Move lines from the lanes to the output buffer, in priority order,
+ * for as long as the token bucket allows it.
+ */
+static void
+sendq_schedule_locked(void)
+{
+    const unsigned long long now = net_monotonic_ms();
+    enum sendq_lane_type type;
+
+    if (sendq.penalty < now)
+	sendq.penalty = now;
+
+    for (type = 0; type < SENDQ_LANES; type++) {
+	struct sendq_buf *lane = &sendq.lane[type];
+
+	while (lane->lines > 0) {
+	    if (type != SENDQ_LANE_URGENT && !sendq_may_send(now))
+		return;
+	    sendq_move_line(lane);
+	    sendq.penalty += sendq.flood_interval;
+	}
+    }
+}
+
+/*
+ * Schedule what the token bucket allows (unless a batch is open and
+ * 'force' is false) and write as much of the output buffer as the
+ * transport accepts.
+ *
+ * Returns -1 on error, or else the number of bytes that a partial
+ * write has left in the output buffer.
+ */
+static int
+sendq_flush_locked(bool force)
+{
+    struct sendq_buf *out = &sendq.out;
+
+    if (sendq.batch_depth == 0 || force)
+	sendq_schedule_locked();
+    if (sendq.write_fn == NULL) {
+	if (sendq_buf_pending(out) > 0) {
+	    sendq_clear_locked();
+	    return -1;
+	}
+	return 0;
+    }
+
+    while (out->head < out->len) {
+	const size_t remaining = out->len - out->head;
+	const int n = sendq.write_fn(&out->buf[out->head],
+	    remaining > INT_MAX ? INT_MAX : (int) remaining);
+
+	if (n < 0) {
+	    sendq_clear_locked(); /* the connection is lost anyway */
+	    return -1;
+	} else if (n == 0) {
+	    break;
+	}
+
+	out->head += n;
+    }
+
+    if (out->head == out->len)
+	sendq_buf_clear(out);
+    return size_to_int(sendq_buf_pending(out));
+}
+
+/*
+ * Tell the user about a partial write once (per stall)
+ */
+static void
+report_stall(int pending)
+{
+    struct printtext_context ptext_ctx = {
+	.window	    = g_status_window,
+	.spec_type  = TYPE_SPEC1_WARN,
+	.include_ts = true,
     };
-    struct addrinfo *res = NULL;
 
-    if (!host || !port || getaddrinfo(host, port, &hints, &res) != 0) {
-	return (NULL);
+    if (pending > 0)
+	printtext(&ptext_ctx, "Partial write: %d bytes left in the send queue",
+	    pending);
+}
+
+static int
+sendq_flush_and_report_locked(bool force)
+{
+    const int pending = sendq_flush_locked(force);
+
+    if (pending > 0 && !sendq.stalled) {
+	sendq.stalled = true;
+	return pending;
+    } else if (pending == 0) {
+	sendq.stalled = false;
     }
 
-    return (res);
+    return (pending < 0 ? -1 : 0);
+}
+
+/**
+ * Format a line into its lane and flush the send queue (unless a batch
+ * is open). Used by the transports' net_send functions.
+ *
+ * @return The length of the line (including the CR-LF), or -1 if the
+ *         flush failed
+ */
+int
+net_vsend_queued(NET_WRITE_FN write_fn, const char *fmt, va_list ap)
+{
+    int ret = 0, stalled = 0;
+    int n = -1;
+    struct sendq_buf *line = &sendq.line;
+    struct sendq_buf *lane;
+    va_list ap_copy;
+
+    if (write_fn == NULL || fmt == NULL)
+	err_exit(EINVAL, "net_vsend_queued");
+    else if (*fmt == '\0')
+	return 0; /* nothing sent */
+
+    sendq_lock();
+    sendq.write_fn = write_fn;
+    sendq_buf_clear(line);
+    sendq_buf_reserve(line, SENDQ_MIN_FREE);
+
+    va_copy(ap_copy, ap);
+    n = vsnprintf(&line->buf[0], line->size, fmt, ap_copy);
+    va_end(ap_copy);
+
+    if (n < 0) {
+	sendq_unlock();
+	err_log(EINVAL, "net_vsend_queued: vsnprintf");
+	return -1;
+    } else if ((size_t) n + 2 > line->size) {
+	sendq_buf_reserve(line, (size_t) n + 2);
+	va_copy(ap_copy, ap);
+	(void) vsnprintf(&line->buf[0], line->size, fmt, ap_copy);
+	va_end(ap_copy);
+    }
+
+    memcpy(&line->buf[n], "\r\n", 2);
+    ret = n + 2;
+
+    lane = &sendq.lane[sendq_classify(line->buf, (size_t) n)];
+    sendq_buf_append(lane, line->buf, (size_t) ret);
+    lane->lines++;
+
+    if (sendq.batch_depth == 0 ||
+	sendq_lanes_pending() >= SENDQ_FLUSH_THRESHOLD) {
+	if ((stalled = sendq_flush_and_report_locked(true)) == -1)
+	    ret = -1;
+    }
+
+    sendq_unlock();
+
+    if (stalled > 0)
+	report_stall(stalled);
+    return ret;
+}
+
+/**
+ * Open a batch: lines are held in the send queue until the outermost
+ * batch ends and are then written out together. Batches nest.
+ */
+void
+net_send_batch_begin(void)
+{
+    sendq_lock();
+    sendq.batch_depth++;
+    sendq_unlock();
+}
+
+/**
+ * End a batch
+ *
+ * @return 0 on success, or -1 if the flush failed
+ */
+int
+net_send_batch_end(void)
+{
+    int ret = 0, stalled = 0;
+
+    sendq_lock();
+    if (sendq.batch_depth > 0 && --sendq.batch_depth == 0)
+	ret = stalled = sendq_flush_and_report_locked(true);
+    sendq_unlock();
+
+    if (stalled > 0)
+	report_stall(stalled);
+    return (ret < 0 ? -1 : 0);
+}
+
+/**
+ * Flush the send queue (as far as the flood control allows it)
+ *
+ * @return 0 on success, or -1 on error
+ */
+int
+net_send_flush(void)
+{
+    int ret = 0, stalled = 0;
+
+    sendq_lock();
+    ret = stalled = sendq_flush_and_report_locked(false);
+    sendq_unlock();
+
+    if (stalled > 0)
+	report_stall(stalled);
+    return (ret < 0 ? -1 : 0);
+}
+
+/**
+ * Set up the flood control
+ *
+ * @param burst    Number of lines that may be sent back-to-back
+ * @param interval Cost of a line in milliseconds (0 turns the
+ *                 throttling off)
+ */
+void
+net_send_flood_control(long int burst, long int interval)
+{
+    sendq_lock();
+    sendq.flood_burst = (burst > 0 ? burst : 1);
+    sendq.flood_interval = (interval > 0 ? interval : 0);
+    sendq_unlock();
+}
+
+/**
+ * @return The number of bytes in the send queue
+ */
+size_t
+net_send_pending(void)
+{
+    size_t len = 0;
+
+    sendq_lock();
+    len = sendq_lanes_pending() + sendq_buf_pending(&sendq.out);
+    sendq_unlock();
+
+    return len;
+}
+
+/**
+ * @return The number of lines waiting for the flood control
+ */
+int
+net_send_queue_depth(void)
+{
+    int depth = 0;
+    enum sendq_lane_type type;
+
+    sendq_lock();
+    for (type = 0; type < SENDQ_LANES; type++)
+	depth += sendq.lane[type].lines;
+    sendq_unlock();
+
+    return depth;
+}
+
+/**
+ * @return The number of milliseconds until the flood control lets the
+ *         next waiting line go, or -1 if no line is waiting
+ */
+long int
+net_send_wait_time(void)
+{
+    long int ms = -1;
+
+    sendq_lock();
+    if (sendq.lane[SENDQ_LANE_URGENT].lines > 0) {
+	ms = 0;
+    } else if (sendq.lane[SENDQ_LANE_NORMAL].lines > 0 ||
+	       sendq.lane[SENDQ_LANE_BULK].lines > 0) {
+	const unsigned long long now = net_monotonic_ms();
+	const unsigned long long due = sendq.penalty + sendq.flood_interval -
+	    sendq.flood_burst * sendq.flood_interval;
+
+	ms = (sendq_may_send(now) ? 0 : (long int) (due - now));
+    }
+    sendq_unlock();
+
+    return ms;
+}
+
+/**
+ * Drop what's left in the send queue (on disconnect)
+ */
+void
+net_send_queue_reset(void)
+{
+    sendq_lock();
+    sendq_clear_locked();
+    sendq.batch_depth = 0;
+    sendq.stalled = false;
+    sendq.write_fn = NULL;
+    sendq.penalty = 0;
+    sendq_unlock();
 }
 
 static void
-select_send_and_recv_funcs()
+apply_flood_settings(void)
 {
-    if (is_ssl_enabled()) {
+    const struct config_snapshot *conf = config_current();
+
+    net_send_flood_control(conf->flood_burst, conf->flood_interval);
+}
+
+static void
+select_send_and_recv_funcs(bool tls)
+{
+    if (tls) {
 	net_send = net_ssl_send;
 	net_recv = net_ssl_recv;
     } else {
@@ -102,6 +650,8 @@ select_send_and_recv_funcs()
 static PTR_ARGS_NONNULL void
 send_reg_cmds(const struct network_connect_context *ctx)
 {
+    net_send_batch_begin();
+
     if (is_sasl_enabled()) {
 	struct printtext_context ptext_ctx = {
 	    .window	= g_status_window,
@@ -109,7 +659,7 @@ send_reg_cmds(const struct network_connect_context *ctx)
 	    .include_ts	= true,
 	};
 
-	if (Strings_match(get_sasl_mechanism(), "PLAIN") && !is_ssl_enabled()) {
+	if (Strings_match(get_sasl_mechanism(), "PLAIN") && !ctx->tls) {
 	    ptext_ctx.spec_type = TYPE_SPEC1_WARN;
 	    printtext(&ptext_ctx, "SASL mechanism matches PLAIN and TLS/SSL "
 		"is not enabled. Not requesting SASL authentication.");
@@ -125,21 +675,145 @@ send_reg_cmds(const struct network_connect_context *ctx)
 
     (void) net_send("NICK %s", ctx->nickname);
     (void) net_send("USER %s 8 * :%s", ctx->username, ctx->rl_name);
+
+    if (net_send_batch_end() == -1)
+	g_on_air = false;
+}
+
+static void
+close_socket(void)
+{
+#if defined(UNIX)
+    (void) close(g_socket);
+#elif defined(WIN32)
+    (void) closesocket(g_socket);
+    (void) winsock_deinit();
+#endif
+}
+
+/*
+ * Resolve the -h <hostname> to the local addresses to bind to
+ */
+static struct addrinfo *
+resolve_bind_hostname(void)
+{
+    struct addrinfo hints = {
+	.ai_flags     = AI_PASSIVE,
+	.ai_family    = AF_UNSPEC,
+	.ai_socktype  = SOCK_STREAM,
+	.ai_protocol  = 0,
+	.ai_addrlen   = 0,
+	.ai_addr      = NULL,
+	.ai_canonname = NULL,
+	.ai_next      = NULL,
+    };
+    struct addrinfo *res = NULL;
+
+    if (g_cmdline_opts->hostname == NULL ||
+	getaddrinfo(g_cmdline_opts->hostname, NULL, &hints, &res) != 0)
+	return (NULL);
+
+    return (res);
 }
 
+static const char *
+addr_to_string(const struct addrinfo *ai)
+{
+    static char buf[INET6_ADDRSTRLEN + 1];
+
+    if (getnameinfo(ai->ai_addr, ai->ai_addrlen, buf, sizeof buf, NULL, 0,
+		    NI_NUMERICHOST) != 0)
+	(void) sw_strcpy(buf, "?", sizeof buf);
+    return (&buf[0]);
+}
+
+static long int
+get_connection_timeout(void)
+{
+    return (config_current()->connection_timeout * 1000L);
+}
+
+static struct network_connect_context *
+connect_context_dup(const struct network_connect_context *ctx)
+{
+    struct network_connect_context *dup = xcalloc(sizeof *dup, 1);
+
+    dup->server	  = sw_strdup(ctx->server);
+    dup->port	  = sw_strdup(ctx->port);
+    dup->password = (ctx->password ? sw_strdup(ctx->password) : NULL);
+    dup->username = sw_strdup(ctx->username);
+    dup->rl_name  = sw_strdup(ctx->rl_name);
+    dup->nickname = sw_strdup(ctx->nickname);
+    dup->tls	  = ctx->tls;
+    return (dup);
+}
+
+static void
+connect_context_free(struct network_connect_context *ctx)
+{
+    if (ctx->password) {
+	OPENSSL_cleanse(ctx->password, strlen(ctx->password));
+	free(ctx->password);
+    }
+
+    free(ctx->server);
+    free(ctx->port);
+    free(ctx->username);
+    free(ctx->rl_name);
+    free(ctx->nickname);
+    free(ctx);
+}
+
+/**
+ * Start connecting to an IRC server. The connection is established by
+ * a thread of its own (net_connect_run()) and the function returns at
+ * once. g_connection_in_progress is set until the attempt has either
+ * succeeded or failed.
+ */
 void
 net_connect(const struct network_connect_context *ctx)
+{
+    if (ctx == NULL)
+	err_exit(EINVAL, "net_connect");
+    connect_cancelled = false;
+    g_connection_in_progress = true;
+    net_spawn_connectThread(connect_context_dup(ctx));
+}
+
+/**
+ * Cancel the connection attempt that's in progress (if any) and wait
+ * for the connect thread to finish. The attempt gives up where it
+ * polls for it: while racing the candidates and while waiting for the
+ * welcome. Resolving the server and the TLS handshake run to the end
+ * first.
+ */
+void
+net_connect_cancel(void)
+{
+    connect_cancelled = true;
+    net_connectThread_join();
+}
+
+/**
+ * The connection sequence: resolve the server, race the connection
+ * attempts, start TLS, register and wait for the welcome. Runs in the
+ * connect thread and frees 'ctx' when done.
+ */
+void
+net_connect_run(struct network_connect_context *ctx)
 {
     struct printtext_context ptext_ctx = {
 	.window     = g_status_window,
 	.spec_type  = TYPE_SPEC1,
 	.include_ts = true,
     };
-    struct addrinfo *res = NULL, *rp = NULL;
+    struct addrinfo *res = NULL, *bind_res = NULL;
+    struct happy_eyeballs he;
 
     if (ctx == NULL)
-	err_exit(EINVAL, "net_connect");
-    g_connection_in_progress = true;
+	err_exit(EINVAL, "net_connect_run");
+    net_send_queue_reset();
+    apply_flood_settings();
     printtext(&ptext_ctx, "Connecting to %s (%s)", ctx->server, ctx->port);
     ptext_ctx.spec_type  = TYPE_SPEC1_SUCCESS;
 
@@ -153,9 +827,15 @@ net_connect(const struct network_connect_context *ctx)
     }
 #endif
 
-    if ((res = net_addr_resolve(ctx->server, ctx->port)) == NULL) {
+    if ((res = net_addr_resolve(ctx->server, ctx->port)) == NULL ||
+	connect_cancelled) {
 	ptext_ctx.spec_type = TYPE_SPEC1_FAILURE;
-	printtext(&ptext_ctx, "Unable to get a list of IP addresses");
+	if (res) {
+	    printtext(&ptext_ctx, "Connection attempt cancelled");
+	    resolver_free(res);
+	} else {
+	    printtext(&ptext_ctx, "Unable to get a list of IP addresses");
+	}
 #ifdef WIN32
 	(void) winsock_deinit();
 #endif
@@ -164,47 +844,59 @@ net_connect(const struct network_connect_context *ctx)
 	printtext(&ptext_ctx, "Get a list of IP addresses complete");
     }
 
-    for (rp = res; rp; rp = rp->ai_next) {
-#ifdef UNIX
-#define INVALID_SOCKET -1
-#endif
-	if ((g_socket = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol))
-	    == INVALID_SOCKET) {
-	    continue;
-	} else if (connect(g_socket, rp->ai_addr, rp->ai_addrlen) == 0) {
-	    printtext(&ptext_ctx, "Connected!");
-	    g_on_air = true;
-	    break;
-	} else {
-#if defined(UNIX)
-	    (void) close(g_socket);
-#elif defined(WIN32)
-	    (void) closesocket(g_socket);
+    if (g_bind_hostname && (bind_res = resolve_bind_hostname()) == NULL) {
+	ptext_ctx.spec_type = TYPE_SPEC1_FAILURE;
+	printtext(&ptext_ctx, "Unable to resolve the hostname to bind to: %s",
+	    g_cmdline_opts->hostname);
+	resolver_free(res);
+#ifdef WIN32
+	(void) winsock_deinit();
 #endif
-	}
+	goto out;
+    }
+
+    he_init(&he, res, bind_res, get_connection_timeout());
+    he.cancel = &connect_cancelled;
+
+    while (he_step(&he, CONNECT_POLL_MS) == HE_STATE_CONNECTING)
+	/* keep racing */;
+
+    if (he.state == HE_STATE_CONNECTED) {
+	g_socket = he.sock;
+	printtext(&ptext_ctx, "Connected to %s!", addr_to_string(he.winner));
+	g_on_air = true;
     }
 
-    freeaddrinfo(res);
-    select_send_and_recv_funcs();
+    resolver_free(res);
+    if (bind_res)
+	freeaddrinfo(bind_res);
+    select_send_and_recv_funcs(ctx->tls);
 
-    if (!g_on_air || (is_ssl_enabled() && net_ssl_start() == -1)) {
+    if (!g_on_air) {
 	ptext_ctx.spec_type = TYPE_SPEC1_FAILURE;
-	printtext(&ptext_ctx, "Failed to establish a connection");
-	g_on_air = false;
+	printtext(&ptext_ctx, (connect_cancelled
+	    ? "Connection attempt cancelled"
+	    : "Failed to establish a connection"));
 #ifdef WIN32
 	(void) winsock_deinit();
 #endif
 	goto out;
+    } else if (ctx->tls &&
+	       net_ssl_start(ctx->server, ctx->port) == -1) {
+	ptext_ctx.spec_type = TYPE_SPEC1_FAILURE;
+	printtext(&ptext_ctx, "Failed to establish a connection");
+	g_on_air = false;
+	close_socket();
+	goto out;
     }
 
-    if (is_ssl_enabled() && config_bool_unparse("hostname_checking", true)) {
+    if (ctx->tls && config_current()->hostname_checking) {
 	if (net_ssl_check_hostname(ctx->server, 0) != OK) {
 	    ptext_ctx.spec_type = TYPE_SPEC1_FAILURE;
 	    printtext(&ptext_ctx, "Hostname checking failed!");
 	    g_on_air = false;
-#ifdef WIN32
-	    (void) winsock_deinit();
-#endif
+	    net_ssl_close();
+	    close_socket();
 	    goto out;
 	} else {
 	    printtext(&ptext_ctx, "Hostname checking OK!");
@@ -215,11 +907,15 @@ net_connect(const struct network_connect_context *ctx)
     net_spawn_listenThread();
     send_reg_cmds(ctx);
 
-    if (!event_welcome_is_signaled()) {
+    if (!event_welcome_is_signaled(&connect_cancelled)) {
 	event_welcome_cond_destroy();
 	ptext_ctx.spec_type = TYPE_SPEC1_FAILURE;
-	printtext(&ptext_ctx, "Event welcome not signaled! "
-	    "(connection_timeout=%s)", Config("connection_timeout"));
+	if (connect_cancelled)
+	    printtext(&ptext_ctx, "Connection attempt cancelled");
+	else
+	    printtext(&ptext_ctx, "Event welcome not signaled! "
+		"(connection_timeout=%d)",
+		config_current()->connection_timeout);
 	printtext(&ptext_ctx, "Disconnecting...");
 	g_on_air = false;
 	net_listenThread_join(); /* wait for thread termination */
@@ -229,16 +925,22 @@ net_connect(const struct network_connect_context *ctx)
     event_welcome_cond_destroy();
 
   out:
+    connect_context_free(ctx);
     g_connection_in_progress = false;
 }
 
 void
 net_irc_listen(void)
 {
-    char *message_concat = NULL;
-    char *recvbuf = xcalloc(RECVBUF_SIZE, 1);
-    enum message_concat_state state = CONCAT_BUFFER_IS_EMPTY;
+    struct irc_recvbuf rb = {
+	.data	    = xmalloc(RECVBUF_SIZE),
+	.size	    = RECVBUF_SIZE,
+	.len	    = 0,
+	.discarding = false,
+    };
     int bytes_received = -1;
+    int depth = 0, prev_depth = 0;
+    long int wait_ms = -1;
     struct network_recv_context ctx = {
 	.sock	  = g_socket,
 	.flags	  = 0,
@@ -254,14 +956,38 @@ net_irc_listen(void)
     irc_init();
 
     do {
-	BZERO(recvbuf, RECVBUF_SIZE);
-	if ((bytes_received = net_recv(&ctx, recvbuf, RECVBUF_SIZE-1)) == -1) {
+	/*
+	 * Don't sleep past the point where the flood control lets the
+	 * next queued line go
+	 */
+	if ((wait_ms = net_send_wait_time()) >= 0 && wait_ms < 5000) {
+	    ctx.sec	 = wait_ms / 1000;
+	    ctx.microsec = (wait_ms % 1000) * 1000;
+	} else {
+	    ctx.sec	 = 5;
+	    ctx.microsec = 0;
+	}
+
+	/*
+	 * Read as much as fits after the partial line (if any) that's
+	 * held by the buffer
+	 */
+	if ((bytes_received = net_recv(&ctx, &rb.data[rb.len],
+	    size_to_int(rb.size - rb.len))) == -1) {
 	    goto out;
 	} else if (bytes_received > 0) {
-	    irc_handle_interpret_events(recvbuf, &message_concat, &state);
+	    rb.len += bytes_received;
+	    irc_handle_interpret_events(&rb);
 	} else {
 	    /*empty*/;
 	}
+
+	if (net_send_pending() > 0 && net_send_flush() == -1)
+	    goto out;
+	if ((depth = net_send_queue_depth()) != prev_depth) {
+	    prev_depth = depth;
+	    statusbar_update_display_beta();
+	}
     } while (g_on_air);
 
   out:
@@ -270,6 +996,7 @@ net_irc_listen(void)
 	g_on_air = false;
     }
     printtext(&ptext_ctx, "Disconnected");
+    net_send_queue_reset();
     net_ssl_close();
 #if defined(UNIX)
     close(g_socket);
@@ -278,6 +1005,5 @@ net_irc_listen(void)
     winsock_deinit();
 #endif
     irc_deinit();
-    free_not_null(recvbuf);
-    free_not_null(message_concat);
+    free(rb.data);
 }
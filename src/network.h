@@ -16,11 +16,16 @@ struct network_connect_context {
     char *username;
     char *rl_name;
     char *nickname;
+    bool  tls;
 };
 
 typedef PTR_ARGS_NONNULL int (*NET_SEND_FN)(const char *, ...);
 typedef PTR_ARGS_NONNULL int (*NET_RECV_FN)(struct network_recv_context *, char *, int);
 
+/* Writes to the transport. Returns the number of bytes written, 0 if
+   the write would block, or -1 on error. */
+typedef int (*NET_WRITE_FN)(const char *, int);
+
 extern NET_SEND_FN net_send;
 extern NET_RECV_FN net_recv;
 
@@ -32,14 +37,38 @@ extern volatile bool g_on_air;
 bool		 is_sasl_enabled(void);
 struct addrinfo *net_addr_resolve(const char *host, const char *port);
 void		 net_connect(const struct network_connect_context *);
+void		 net_connect_cancel(void);
+void		 net_connect_run(struct network_connect_context *);
 void		 net_irc_listen(void);
 
+unsigned long long net_monotonic_ms(void);
+
+int		net_vsend_queued(NET_WRITE_FN, const char *fmt, va_list);
+void		net_send_batch_begin(void);
+int		net_send_batch_end(void);
+int		net_send_flush(void);
+void		net_send_flood_control(long int burst, long int interval);
+size_t		net_send_pending(void);
+int		net_send_queue_depth(void);
+void		net_send_queue_reset(void);
+long int	net_send_wait_time(void);
+
 void	net_ssl_init(void);
 void	net_ssl_deinit(void);
 void	net_ssl_close(void);
-int	net_ssl_start(void);
+int	net_ssl_start(const char *host, const char *port);
 int	net_ssl_send(const char *fmt, ...);
 int	net_ssl_recv(struct network_recv_context *, char *, int);
 int	net_ssl_check_hostname(const char *, unsigned int);
+void	net_ssl_handshake_stats(unsigned long int *full, unsigned long int *resumed);
+const char *net_ssl_ktls_mode(void);
+
+#ifdef UNIT_TESTING
+struct ssl_session_st;
+
+char	*net_ssl_session_file(const char *host, const char *port);
+struct ssl_session_st *net_ssl_session_load(const char *path);
+void	 net_ssl_session_save(const char *path, struct ssl_session_st *);
+#endif
 
 #endif
@@ -29,10 +29,10 @@
 
 #include "common.h"
 
-#include <locale.h>
 #include <wctype.h>
 
 #include "assertAPI.h"
+#include "colorPairs.h"
 #include "config.h"
 #if defined(WIN32) && defined(PDC_EXP_EXTRAS)
 #include "curses-funcs.h" /* is_scrollok() */
@@ -46,23 +46,16 @@
 #include "strHand.h"
 #include "strdup_printf.h"
 #include "terminal.h"
+#include "textDecode.h"
 #include "theme.h"
 
 #define WADDCH(win, c)        ((void) waddch(win, c))
-#define WATTR_OFF(win, attrs) ((void) wattr_off(win, attrs, NULL))
-#define WATTR_ON(win, attrs)  ((void) wattr_on(win, attrs, NULL))
-#define WCOLOR_SET(win, cpn)  ((void) wcolor_set(win, cpn, NULL))
 
-#define STRLEN_CAST(string) strlen((char *) string)
+#define PUTS_RUN_SIZE 256
 
 /* Structure definitions
    ===================== */
 
-struct message_components {
-    char *text;
-    int   indent;
-};
-
 struct text_decoration_bools {
     bool is_blink;
     bool is_bold;
@@ -71,13 +64,48 @@ struct text_decoration_bools {
     bool is_underline;
 };
 
-struct case_default_context {
-    WINDOW    *win;
-    wchar_t    wc;
-    int        nextchar_empty;
-    int        indent;
-    int        max_lines;
-    ptrdiff_t  diff;
+/*
+ * A run of printable characters sharing the same attributes. Flushed
+ * with a single waddnwstr() call whenever the attributes change, a
+ * row ends or the run is full.
+ */
+struct puts_run {
+    WINDOW  *win;
+    wchar_t  buf[PUTS_RUN_SIZE];
+    int      len;
+};
+
+/*
+ * Interpreter state while parsing a line into spans. 'attrs' and the
+ * colors mirror what the text-decoration codes would have set on the
+ * window.
+ */
+struct parse_state {
+    struct text_decoration_bools booleans;
+#if defined(UNIX)
+    attr_t    attrs;
+#elif defined(WIN32)
+    chtype    attrs;
+#endif
+    short int fg;
+    short int bg;
+};
+
+/*
+ * A row of a line laid out for a certain window width. The offsets
+ * are into the displayed characters of the line, i.e. into 'wc_buf'
+ * after compact_spans().
+ */
+struct text_row {
+    int start;
+    int end;
+};
+
+struct text_layout {
+    int		    cols;
+    int		    indent;
+    int		    nrows;
+    struct text_row row[];
 };
 
 /* Objects with external linkage
@@ -102,6 +130,31 @@ static init_once_t puts_init_done       = ONCE_INITIALIZER;
 static HANDLE      vprinttext_mutex;
 #endif
 
+/*
+ * The line vprinttext() builds, and the timestamp it was built with.
+ * Guarded by vprinttext_mutex.
+ */
+static struct {
+    char	*buf;
+    size_t	 size;
+    size_t	 len;
+} out_line = { NULL, 0, 0 };
+
+static struct {
+    time_t		 second;
+    unsigned long int	 generation; /* of the theme snapshot */
+    char		 text[200];
+    int			 width;
+} ts_cache = { (time_t) -1, 0, "", 0 };
+
+/* Scratch buffers for parsing and output. Guarded by g_puts_mutex. */
+static wchar_t		*wc_buf	    = NULL;
+static size_t		 wc_size    = 0;
+static struct text_span	*span_buf   = NULL;
+static int		 span_size  = 0;
+static struct text_row	*row_buf    = NULL;
+static int		 row_size   = 0;
+
 static struct ptext_colorMap_tag {
     short int color;
 #if defined(UNIX)
@@ -144,6 +197,20 @@ handle_foo_situation(char **buffer, long int *i, long int *j,
     }
 }
 
+/**
+ * Helper function for squeeze_text_deco(): is 'cp' RRGGBB?
+ */
+static bool
+is_hex_rgb(const char *cp)
+{
+    for (int i = 0; i < 6; i++) {
+	if (!isxdigit((unsigned char) cp[i]))
+	    return false;
+    }
+
+    return true;
+}
+
 /**
  * Squeeze text-decoration from a buffer
  *
@@ -163,8 +230,8 @@ squeeze_text_deco(char *buffer)
 	return (buffer);
     }
 
-    reject = Strdup_printf(
-	"%c%c%c%c%c", BLINK, BOLD, NORMAL, REVERSE, UNDERLINE);
+    reject = Strdup_printf("%c%c%c%c%c%c",
+	BLINK, BOLD, HEX_COLOR, NORMAL, REVERSE, UNDERLINE);
 
     for (i = j = 0; buffer[i] != '\0'; i++) {
 	switch (buffer[i]) {
@@ -233,6 +300,13 @@ squeeze_text_deco(char *buffer)
 
 	    break;
 	} /* case COLOR */
+	case HEX_COLOR:
+	    if (is_hex_rgb(&buffer[i + 1])) {
+		i += 6;
+		if (buffer[i + 1] == ',' && is_hex_rgb(&buffer[i + 2]))
+		    i += 7;
+	    }
+	    break;
 	default:
 	    if (strchr(reject, buffer[i]) == NULL) {
 		buffer[j++] = buffer[i];
@@ -247,31 +321,6 @@ squeeze_text_deco(char *buffer)
     return (buffer);
 }
 
-/**
- * Search for a color pair with given foreground/background.
- *
- * @param fg Foreground
- * @param bg Background
- * @return A color pair number, or -1 if not found.
- */
-short int
-color_pair_find(short int fg, short int bg)
-{
-    const short int gipp1 = g_initialized_pairs + 1;
-    short int pnum; /* pair number */
-    short int x, y;
-
-    for (pnum = 1; pnum < gipp1; pnum++) {
-	if (pair_content(pnum, &x, &y) == ERR) {
-	    return -1;
-	} else if (x == fg && y == bg) { /* found match */
-	    return pnum;
-	}
-    }
-
-    return -1;
-}
-
 /**
  * Print an error message to the active window and free a
  * char-pointer.
@@ -319,235 +368,141 @@ puts_mutex_init(void)
     mutex_new(&g_puts_mutex);
 }
 
-/**
- * WIN32 specific: attempt to convert multibyte character string to
- * wide-character string by using UTF-8. The storage is obtained with
- * xcalloc().
- *
- * @param buf Buffer to convert.
- * @return A wide-character string, or NULL on error.
- */
-#if WIN32
-static wchar_t *
-windows_convert_to_utf8(const char *buf)
+static void
+puts_init(void)
 {
-    const int sz = (int) (strlen(buf) + 1);
-    wchar_t *out = xcalloc(sz, sizeof (wchar_t));
-
-    if (MultiByteToWideChar(CP_UTF8,MB_ERR_INVALID_CHARS,buf,-1,out,sz) > 0)
-	return out;
-    free(out);
-    return NULL;
-}
+#if defined(UNIX)
+    if ((errno = pthread_once(&puts_init_done, puts_mutex_init)) != 0) {
+	err_sys("pthread_once error");
+    }
+#elif defined(WIN32)
+    if ((errno = init_once(&puts_init_done, puts_mutex_init)) != 0) {
+	err_sys("init_once error");
+    }
 #endif
+}
 
 /**
- * Attempt convert multibyte character string to wide-character string
- * by using a specific codeset. The storage is dynamically allocated.
- *
- * @param buf     Buffer to convert
- * @param codeset Codeset to use
- * @return A wide-character string, or NULL on error.
+ * Lock the text buffers of the windows. vprinttext() changes them
+ * with this lock held, so lines got from them stay valid until
+ * printtext_unlock(). The lock is g_puts_mutex, which is recursive.
  */
-static wchar_t *
-try_convert_buf_with_cs(const char *buf, const char *codeset)
+void
+printtext_lock(void)
 {
-    char		*original_locale = NULL;
-    char		*tmp_locale	 = NULL;
-    const size_t	 CONVERT_FAILED	 = (size_t) -1;
-    const size_t	 sz		 = strlen(buf) + 1;
-    size_t		 bytes_convert	 = 0;
-    struct locale_info	*li		 = get_locale_info(LC_CTYPE);
-    wchar_t		*out		 = NULL;
-
-    if (li->lang_and_territory == NULL || li->codeset == NULL)
-	goto err;
-
-    original_locale = Strdup_printf("%s.%s",
-	li->lang_and_territory, li->codeset);
-    tmp_locale      = Strdup_printf("%s.%s", li->lang_and_territory, codeset);
-    out             = xcalloc(sz, sizeof (wchar_t));
-
-    if (setlocale(LC_CTYPE, tmp_locale) == NULL ||
-	(bytes_convert = xmbstowcs(out, buf, sz - 1)) == CONVERT_FAILED) {
-	if (setlocale(LC_CTYPE, original_locale) == NULL)
-	    err_log(EPERM, "In try_convert_buf_with_cs: "
-		"cannot restore original locale (%s)", original_locale);
-	goto err;
-    }
-
-    if (bytes_convert == sz - 1)
-	out[sz - 1] = 0L;
-
-    if (setlocale(LC_CTYPE, original_locale) == NULL)
-	err_log(EPERM, "In try_convert_buf_with_cs: "
-	    "cannot restore original locale (%s)", original_locale);
-    free_locale_info(li);
-    free_not_null(original_locale);
-    free_not_null(tmp_locale);
-    return out;
-
-  err:
-    free_locale_info(li);
-    free_not_null(original_locale);
-    free_not_null(tmp_locale);
-    free_not_null(out);
-    return NULL;
+    puts_init();
+    mutex_lock(&g_puts_mutex);
 }
 
-/**
- * Convert multibyte character string to wide-character string, using
- * different encodings. The storage is dynamically allocated.
- *
- * @param in_buf In buffer.
- * @return A wide-character string.
- */
-static wchar_t *
-perform_convert_buffer(const char **in_buf)
+void
+printtext_unlock(void)
 {
-    bool chars_lost = false;
-    const char *ar[] = {
-#if defined(UNIX)
-	"UTF-8",       "utf8",
-	"ISO-8859-1",  "ISO8859-1",  "iso88591",
-	"ISO-8859-15", "ISO8859-15", "iso885915",
-#elif defined(WIN32)
-	"65001", /* UTF-8 */
-	"28591", /* ISO 8859-1 Latin 1 */
-	"28605", /* ISO 8859-15 Latin 9 */
-#endif
-    };
-    const size_t	 CONVERT_FAILED = (size_t) -1;
-    const size_t	 ar_sz		= ARRAY_SIZE(ar);
-    mbstate_t		 ps;
-    size_t		 sz		= 0;
-    wchar_t		*out		= NULL;
-
-#if WIN32
-    if ((out = windows_convert_to_utf8(*in_buf)) != NULL)
-	return (out);
-#endif
-
-    for (const char **ar_p = &ar[0]; ar_p < &ar[ar_sz]; ar_p++) {
-	if ((out = try_convert_buf_with_cs(*in_buf, *ar_p)) != NULL) /*success*/
-	    return (out);
-    }
-
-    /* fallback solution... */
-    sz  = strlen(*in_buf) + 1;
-    out = xcalloc(sz, sizeof (wchar_t));
-
-    BZERO(&ps, sizeof (mbstate_t));
-
-    while (errno = 0, true) {
-	if (mbsrtowcs(&out[wcslen(out)], in_buf, (sz - wcslen(out)) - 1, &ps) ==
-	    CONVERT_FAILED && errno == EILSEQ) {
-	    chars_lost = true;
-	    (*in_buf)++;
-	} else
-	    break;
-    }
-
-    out[sz - 1] = 0L;
-    if (chars_lost)
-	err_log(EILSEQ, "In perform_convert_buffer: characters lost");
-    return (out);
+    mutex_unlock(&g_puts_mutex);
 }
 
 static void
-append_newline(wchar_t **wc_buf)
+replace_characters_with_space(wchar_t *wcs, const wchar_t *set)
 {
-    const size_t newsize = size_product(wcslen(*wc_buf) + sizeof "\n",
-					sizeof (wchar_t));
-
-    *wc_buf = xrealloc(*wc_buf, newsize);
+    wchar_t *wcp = NULL;
 
-    if ((errno = sw_wcscat(*wc_buf, L"\n", newsize)) != 0)
-	err_sys("printtext: append_newline");
+    while ((wcp = wcspbrk(wcs, set)) != NULL)
+	*wcp = L' ';
 }
 
-static void
-replace_characters_with_space(wchar_t *wc_buf, const wchar_t *set)
+/**
+ * Decode a buffer into 'wc_buf', leaving room for a trailing
+ * newline. Called with g_puts_mutex held.
+ *
+ * @param buf      Buffer to decode
+ * @param fallback Encoding used if the buffer isn't UTF-8
+ * @param used     If non-NULL: receives the encoding used
+ * @return The number of wide characters decoded
+ */
+static size_t
+decode_buffer(const char *buf, enum text_encoding fallback,
+	      enum text_encoding *used)
 {
-    wchar_t *wcp = NULL;
+    const size_t len = strlen(buf);
+    size_t wc_len;
 
-    while ((wcp = wcspbrk(wc_buf, set)) != NULL)
-	*wcp = L' ';
+    if (wc_size < len + 2) {
+	wc_size = len + 2;
+	free_not_null(wc_buf);
+	wc_buf = xcalloc(wc_size, sizeof (wchar_t));
+    }
+
+    wc_len = text_decode(buf, len, wc_buf, fallback, used);
+    replace_characters_with_space(wc_buf, L"\f\t\v");
+    return wc_len;
 }
 
 /**
  * Toggle blink ON/OFF. Don't actually use A_BLINK because it's
  * annoying.
  *
- * @param[in]     win      Target window.
- * @param[in,out] is_blink Is blink state.
+ * @param[in,out] st Parse state
  * @return Void
  */
 static void
-case_blink(WINDOW *win, bool *is_blink)
+case_blink(struct parse_state *st)
 {
-    if (!*is_blink) {
-	WATTR_ON(win, A_REVERSE);
-	*is_blink = true;
+    if (!st->booleans.is_blink) {
+	st->attrs |= A_REVERSE;
+	st->booleans.is_blink = true;
     } else {
-	WATTR_OFF(win, A_REVERSE);
-	*is_blink = false;
+	st->attrs &= ~A_REVERSE;
+	st->booleans.is_blink = false;
     }
 }
 
 /**
  * Toggle bold ON/OFF
  *
- * @param[in]     win     Target window
- * @param[in,out] is_bold Is bold state
+ * @param[in,out] st Parse state
  * @return Void
  */
 static void
-case_bold(WINDOW *win, bool *is_bold)
+case_bold(struct parse_state *st)
 {
-    if (!*is_bold) {
-	WATTR_ON(win, A_BOLD);
-	*is_bold = true;
+    if (!st->booleans.is_bold) {
+	st->attrs |= A_BOLD;
+	st->booleans.is_bold = true;
     } else {
-	WATTR_OFF(win, A_BOLD);
-	*is_bold = false;
+	st->attrs &= ~A_BOLD;
+	st->booleans.is_bold = false;
     }
 }
 
 /**
- * Convert a wide-character to a multibyte sequence. The storage for
- * the multibyte sequence is allocated on the heap and must be
- * free()'d.
- *
- * @param wc Wide-character
- * @return The result
+ * Write out a run
  */
-static unsigned char *
-convert_wc(wchar_t wc)
+static void
+run_flush(struct puts_run *run)
 {
-    mbstate_t ps;
-#ifdef HAVE_BCI
-    size_t bytes_written; /* not used */
-#endif
-    const size_t size = MB_LEN_MAX + 1;
-    unsigned char *mbs = xcalloc(size, 1);
-
-    BZERO(&ps, sizeof (mbstate_t));
-
-#ifdef HAVE_BCI
-    if ((errno = wcrtomb_s(&bytes_written, (char *) mbs, size, wc, &ps)) != 0) {
-	/* temporary error handling */
-	err_log(errno, "In convert_wc: wcrtomb_s");
-	return (mbs);
-    }
-#else
-    if (wcrtomb((char *) mbs, wc, &ps) == ((size_t) -1)) {
-	err_log(EILSEQ, "In convert_wc: wcrtomb");
-	return (mbs);
+    if (run->len > 0) {
+	(void) waddnwstr(run->win, run->buf, run->len);
+	run->len = 0;
     }
-#endif
+}
+
+/**
+ * Append a printable character to a run
+ */
+static SW_INLINE void
+run_add(struct puts_run *run, wchar_t wc)
+{
+    if (run->len == PUTS_RUN_SIZE)
+	run_flush(run);
+    run->buf[run->len++] = wc;
+}
 
-    return (mbs);
+/**
+ * Is wide-character an ASCII digit?
+ */
+static SW_INLINE bool
+wc_isdigit(wchar_t wc)
+{
+    return (wc >= L'0' && wc <= L'9');
 }
 
 typedef enum {
@@ -562,18 +517,13 @@ typedef enum {
 static cc_check_t
 check_for_part1(wchar_t **bufp, char *fg)
 {
-    unsigned char *mbs = NULL;
-
     if (!*++(*bufp))
 	return BUF_EOF;
-    mbs = convert_wc(**bufp);
-    if (STRLEN_CAST(mbs) != 1 || !sw_isdigit(*mbs)) {
+    if (!wc_isdigit(**bufp)) {
 	(*bufp)--;
-	free(mbs);
 	return STOP_INTERPRETING;
     }
-    sw_snprintf(fg, 2, "%c", *mbs);
-    free(mbs);
+    *fg = (char) **bufp;
     return GO_ON;
 }
 
@@ -583,23 +533,20 @@ check_for_part1(wchar_t **bufp, char *fg)
 static cc_check_t
 check_for_part2(wchar_t **bufp, char *fg, bool *has_comma)
 {
-    unsigned char *mbs = NULL;
+    const wchar_t wc = *++(*bufp);
 
-    if (!*++(*bufp))
+    if (!wc)
 	return BUF_EOF;
-    mbs = convert_wc(**bufp);
-    if (STRLEN_CAST(mbs) != 1 || (!sw_isdigit(*mbs) && *mbs != ',')) {
+    if (!wc_isdigit(wc) && wc != L',') {
 	(*bufp)--;
-	free(mbs);
 	return STOP_INTERPRETING;
     }
-    if (sw_isdigit(*mbs))
-	sw_snprintf(fg, 2, "%c", *mbs);
-    else if (*mbs == ',')
+    if (wc_isdigit(wc))
+	*fg = (char) wc;
+    else if (wc == L',')
 	*has_comma = true;
     else
 	sw_assert_not_reached();
-    free(mbs);
     return GO_ON;
 }
 
@@ -609,33 +556,23 @@ check_for_part2(wchar_t **bufp, char *fg, bool *has_comma)
 static cc_check_t
 check_for_part3(wchar_t **bufp, bool *has_comma, bool fg_complete, char *bg)
 {
-    unsigned char *mbs = NULL;
+    const wchar_t wc = *++(*bufp);
 
-    if (!*++(*bufp))
+    if (!wc)
 	return BUF_EOF;
-    mbs = convert_wc(**bufp);
-    if (STRLEN_CAST(mbs) != 1 || (*mbs != ',' && !sw_isdigit(*mbs))) {
-	(*bufp)--;
-	free(mbs);
-	return STOP_INTERPRETING;
-    } else if (*mbs == ',' && *has_comma) {
+    if ((wc != L',' && !wc_isdigit(wc)) ||
+	(wc == L',' && *has_comma) ||
+	(wc != L',' && fg_complete)) {
 	(*bufp)--;
-	free(mbs);
-	return STOP_INTERPRETING;
-    } else if (*mbs != ',' && fg_complete) {
-	(*bufp)--;
-	free(mbs);
 	return STOP_INTERPRETING;
     }
 
-    if (*mbs == ',')
+    if (wc == L',')
 	*has_comma = true;
-    else if (sw_isdigit(*mbs))
-	sw_snprintf(bg, 2, "%c", *mbs);
+    else if (wc_isdigit(wc))
+	*bg = (char) wc;
     else
 	sw_assert_not_reached();
-
-    free(mbs);
     return GO_ON;
 }
 
@@ -645,22 +582,16 @@ check_for_part3(wchar_t **bufp, bool *has_comma, bool fg_complete, char *bg)
 static cc_check_t
 check_for_part4(wchar_t **bufp, bool got_digit_bg, char *bg)
 {
-    unsigned char *mbs = NULL;
-
     if (!*++(*bufp))
 	return BUF_EOF;
-    mbs = convert_wc(**bufp);
-    if (STRLEN_CAST(mbs) != 1 || !sw_isdigit(*mbs)) {
+    if (!wc_isdigit(**bufp)) {
 	(*bufp)--;
-	free(mbs);
 	return STOP_INTERPRETING;
     } else if (got_digit_bg) {
-	sw_snprintf(++bg, 2, "%c", *mbs);
-	free(mbs);
+	bg[1] = (char) **bufp;
 	return STOP_INTERPRETING;
     }
-    sw_snprintf(bg, 2, "%c", *mbs);
-    free(mbs);
+    *bg = (char) **bufp;
     return GO_ON;
 }
 
@@ -670,86 +601,176 @@ check_for_part4(wchar_t **bufp, bool got_digit_bg, char *bg)
 static cc_check_t
 check_for_part5(wchar_t **bufp, char *bg)
 {
-    unsigned char *mbs = NULL;
-
     if (!*++(*bufp))
 	return BUF_EOF;
-    mbs = convert_wc(**bufp);
-    if (STRLEN_CAST(mbs) != 1 || !sw_isdigit(*mbs)) {
+    if (!wc_isdigit(**bufp)) {
 	(*bufp)--;
-	free(mbs);
 	return STOP_INTERPRETING;
     }
-    sw_snprintf(bg, 2, "%c", *mbs);
-    free(mbs);
+    *bg = (char) **bufp;
     return GO_ON;
 }
 
 /**
- * Set color for output in a window.
+ * Map a mIRC color number (0-99) to a color of the terminal
+ *
+ * @param[in]  num   Color number
+ * @param[out] attrs Attributes to display the color with
+ * @return The color
+ */
+static short int
+mirc_color(short int num, attr_t *attrs)
+{
+    bool bright = false;
+
+    if (num < (short int) ARRAY_SIZE(ptext_colorMap)) {
+	*attrs = ptext_colorMap[num].at;
+	return ptext_colorMap[num].color;
+    } else if (num < 99) {
+	const short int color = color_from_mirc(num, &bright);
+
+	*attrs = (bright ? A_BOLD : A_NORMAL);
+	return color;
+    }
+
+    /* 99: the default color */
+    *attrs = A_NORMAL;
+    return (theme_current()->term_use_default_colors ? -1 : COLOR_WHITE);
+}
+
+/**
+ * Get the background color number used if none is given: -1 for the
+ * default background of the terminal.
+ */
+static short int
+default_background(void)
+{
+    const struct theme_snapshot *theme = theme_current();
+
+    return (theme->term_use_default_colors ? -1 : theme->term_background);
+}
+
+/**
+ * Set color for output
  *
- * @param[in]  win      Window
- * @param[out] is_color Is color state
- * @param[in]  num1     Number for foreground
- * @param[in]  num2     Number for background
+ * @param[in,out] st    Parse state
+ * @param[in]     fg    Foreground color
+ * @param[in]     bg    Background color
+ * @param[in]     attrs Attributes of the foreground
  * @return Void
  */
 static void
-printtext_set_color(WINDOW *win, bool *is_color, short int num1, short int num2)
+set_color_pair(struct parse_state *st, short int fg, short int bg,
+	       attr_t attrs)
 {
-    const short int num_colorMap_entries =
-	(short int) ARRAY_SIZE(ptext_colorMap);
-    short int fg, bg, resolved_pair;
-#if defined(UNIX)
-    attr_t attr;
-#elif defined(WIN32)
-    chtype attr;
-#endif
+    st->attrs = attrs;
+    st->fg = fg;
+    st->bg = bg;
+    st->booleans.is_color = true;
+}
+
+/**
+ * Set color for output
+ *
+ * @param[in,out] st   Parse state
+ * @param[in]     num1 Number for foreground
+ * @param[in]     num2 Number for background
+ * @return Void
+ */
+static void
+printtext_set_color(struct parse_state *st, short int num1, short int num2)
+{
+    attr_t attrs, unused;
+    short int fg, bg;
 
     /* num1 shouldn't under any circumstances appear negative */
     sw_assert(num1 >= 0);
 
-    fg = ptext_colorMap[num1 % num_colorMap_entries].color;
-    bg = (num2 < 0 ? -1 : ptext_colorMap[num2 % num_colorMap_entries].color);
+    fg = mirc_color(num1, &attrs);
+    bg = (num2 < 0 ? -1 : mirc_color(num2, &unused));
+    set_color_pair(st, fg, bg, attrs);
+}
+
+/**
+ * Read a color given as RRGGBB
+ */
+static bool
+read_hex_rgb(const wchar_t *wcs, unsigned long int *rgb)
+{
+    *rgb = 0;
+
+    for (int i = 0; i < 6; i++) {
+	const wchar_t wc = wcs[i];
+
+	if (wc >= L'0' && wc <= L'9')
+	    *rgb = (*rgb << 4) | (wc - L'0');
+	else if (wc >= L'a' && wc <= L'f')
+	    *rgb = (*rgb << 4) | (wc - L'a' + 10);
+	else if (wc >= L'A' && wc <= L'F')
+	    *rgb = (*rgb << 4) | (wc - L'A' + 10);
+	else
+	    return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle and interpret hex color codes: ^DRRGGBB[,RRGGBB]
+ *
+ * @param st   Parse state
+ * @param bufp Buffer pointer
+ * @return Void
+ */
+static void
+case_hex_color(struct parse_state *st, wchar_t **bufp)
+{
+    attr_t unused;
+    bool bright = false;
+    short int fg, bg;
+    unsigned long int fg_rgb, bg_rgb;
+
+    if (st->booleans.is_color) {
+	st->fg = SPAN_NO_COLOR;
+	st->booleans.is_color = false;
+    }
 
-    if ((resolved_pair = color_pair_find(fg, bg)) == -1) {
-	WCOLOR_SET(win, 0);
-	*is_color = false;
+    if (!read_hex_rgb(*bufp + 1, &fg_rgb))
 	return;
+    *bufp += 6;
+
+    if ((*bufp)[1] == L',' && read_hex_rgb(*bufp + 2, &bg_rgb)) {
+	bg = color_from_rgb(bg_rgb, NULL);
+	*bufp += 7;
+    } else {
+	const short int num = default_background();
+
+	bg = (num < 0 ? -1 : mirc_color(num, &unused));
     }
 
-    attr = ptext_colorMap[num1 % num_colorMap_entries].at; /*attributes of fg*/
-    attr |= COLOR_PAIR(resolved_pair);
-    term_set_attr(win, attr);
-    *is_color = true;
+    fg = color_from_rgb(fg_rgb, &bright);
+    set_color_pair(st, fg, bg, bright ? A_BOLD : A_NORMAL);
 }
 
 /**
  * Handle and interpret color codes.
  *
- * @param win      Window
- * @param is_color Is color state
- * @param bufp     Buffer pointer
+ * @param st   Parse state
+ * @param bufp Buffer pointer
  * @return Void
  */
 static void
-case_color(WINDOW *win, bool *is_color, wchar_t **bufp)
+case_color(struct parse_state *st, wchar_t **bufp)
 {
     bool           has_comma = false;
     char           bg[10]    = { 0 };
     char           fg[10]    = { 0 };
     short int      num1      = -1;
     short int      num2      = -1;
-    struct integer_unparse_context unparse_ctx = {
-	.setting_name	  = "term_background",
-	.fallback_default = 1,	/* black */
-	.lo_limit	  = 0,
-	.hi_limit	  = 15,
-    };
 
-    if (*is_color) {
-	WCOLOR_SET(win, 0);
-	*is_color = false;
+    if (st->booleans.is_color) {
+	st->fg = SPAN_NO_COLOR;
+	st->booleans.is_color = false;
     }
 
 /***************************************************
@@ -828,16 +849,13 @@ case_color(WINDOW *win, bool *is_color, wchar_t **bufp)
 
   out:
     num1 = (short int) atoi(fg);
-    if (!isEmpty(bg)) {
+    if (!isEmpty(bg) && atoi(bg) != 99) {
 	num2 = (short int) atoi(bg);
-    } else if (isEmpty(bg) &&
-	       theme_bool_unparse("term_use_default_colors", true)) {
-	num2 = -1;
     } else {
-	num2 = (short int) theme_integer_unparse(&unparse_ctx);
+	num2 = default_background();
     }
 
-    printtext_set_color(win, is_color, num1, num2);
+    printtext_set_color(st, num1, num2);
 
     if (has_comma && !(bg[0]))
 	(*bufp)--;
@@ -862,38 +880,36 @@ text_decoration_bools_reset(struct text_decoration_bools *booleans)
 /**
  * Toggle reverse ON/OFF
  *
- * @param[in]     win        Target window
- * @param[in,out] is_reverse Is reverse state
+ * @param[in,out] st Parse state
  * @return Void
  */
 static void
-case_reverse(WINDOW *win, bool *is_reverse)
+case_reverse(struct parse_state *st)
 {
-    if (!*is_reverse) {
-	WATTR_ON(win, A_REVERSE);
-	*is_reverse = true;
+    if (!st->booleans.is_reverse) {
+	st->attrs |= A_REVERSE;
+	st->booleans.is_reverse = true;
     } else {
-	WATTR_OFF(win, A_REVERSE);
-	*is_reverse = false;
+	st->attrs &= ~A_REVERSE;
+	st->booleans.is_reverse = false;
     }
 }
 
 /**
  * Toggle underline ON/OFF
  *
- * @param[in]     win          Target window
- * @param[in,out] is_underline Is underline state
+ * @param[in,out] st Parse state
  * @return Void
  */
 static void
-case_underline(WINDOW *win, bool *is_underline)
+case_underline(struct parse_state *st)
 {
-    if (!*is_underline) {
-	WATTR_ON(win, A_UNDERLINE);
-	*is_underline = true;
+    if (!st->booleans.is_underline) {
+	st->attrs |= A_UNDERLINE;
+	st->booleans.is_underline = true;
     } else {
-	WATTR_OFF(win, A_UNDERLINE);
-	*is_underline = false;
+	st->attrs &= ~A_UNDERLINE;
+	st->booleans.is_underline = false;
     }
 }
 
@@ -901,127 +917,413 @@ case_underline(WINDOW *win, bool *is_underline)
  * Do indent
  */
 static void
-do_indent(WINDOW *win, const int indent, int *insert_count)
+do_indent(WINDOW *win, const int indent)
 {
-#if defined(UNIX)
     attr_t attrs;
-#elif defined(WIN32)
-    chtype attrs;
-#endif
     const chtype blank = ' ';
     int counter = 0;
+    short int pair;
 
     /* turn off all attributes during indentation */
-    attrs = win->_attrs;
-    term_set_attr(win, A_NORMAL);
+    (void) wattr_get(win, &attrs, &pair, NULL);
+    (void) wattr_set(win, A_NORMAL, 0, NULL);
 
-    while (counter++ != indent) {
+    while (counter++ != indent)
 	WADDCH(win, blank);
-	(*insert_count)++;
-    }
 
     /* restore attributes after indenting */
-    term_set_attr(win, attrs);
+    (void) wattr_set(win, attrs, pair, NULL);
 }
 
 /**
- * Start on a new row?
+ * Append a character to the spans in 'span_buf'
  */
-static bool
-start_on_a_new_row(const long int sum)
+static void
+add_to_spans(const struct parse_state *st, int offset, int *nspans)
 {
-    return (sum < (COLS - 1) ? false : true);
+    struct text_span *sp = (*nspans > 0 ? &span_buf[*nspans - 1] : NULL);
+
+    if (sp != NULL && sp->offset + sp->length == offset &&
+	sp->attrs == st->attrs && sp->fg == st->fg && sp->bg == st->bg) {
+	sp->length++;
+	return;
+    }
+
+    if (*nspans == span_size) {
+	span_size = (span_size > 0 ? span_size * 2 : 16);
+	span_buf = (span_buf != NULL
+	    ? xrealloc(span_buf, span_size * sizeof *span_buf)
+	    : xmalloc(span_size * sizeof *span_buf));
+    }
+
+    sp = &span_buf[(*nspans)++];
+    sp->offset = offset;
+    sp->length = 1;
+    sp->attrs  = st->attrs;
+    sp->fg     = st->fg;
+    sp->bg     = st->bg;
+}
+
+/**
+ * Get the color pair to draw a span with. Looking it up marks the
+ * pair as used, so pairs on the screen are the last to be redefined.
+ */
+static short int
+span_pair(const struct text_span *sp)
+{
+    short int pair;
+
+    if (sp->fg == SPAN_NO_COLOR)
+	return 0;
+    return ((pair = color_pair_get(sp->fg, sp->bg)) != -1 ? pair : 0);
+}
+
+/**
+ * Run the text-decoration interpreter over 'wc_buf' and store the
+ * result in 'span_buf'. Characters that aren't displayed (the codes
+ * themselves for example) are left out of the spans. Called with
+ * g_puts_mutex held.
+ *
+ * @return The number of spans
+ */
+static int
+parse_spans(void)
+{
+    int nspans = 0;
+    struct parse_state st;
+
+    text_decoration_bools_reset(&st.booleans);
+    st.attrs = A_NORMAL;
+    st.fg = SPAN_NO_COLOR;
+    st.bg = -1;
+
+    for (wchar_t *wcp = &wc_buf[0]; *wcp; wcp++) {
+	switch (*wcp) {
+	case BLINK:
+	    case_blink(&st);
+	    break;
+	case BOLD:
+	    case_bold(&st);
+	    break;
+	case COLOR:
+	    case_color(&st, &wcp);
+	    break;
+	case HEX_COLOR:
+	    case_hex_color(&st, &wcp);
+	    break;
+	case NORMAL:
+	    text_decoration_bools_reset(&st.booleans);
+	    st.attrs = A_NORMAL;
+	    st.fg = SPAN_NO_COLOR;
+	    break;
+	case REVERSE:
+	    case_reverse(&st);
+	    break;
+	case UNDERLINE:
+	    case_underline(&st);
+	    break;
+	default:
+	    if (iswprint(*wcp) || *wcp == L'\n')
+		add_to_spans(&st, (int) (wcp - &wc_buf[0]), &nspans);
+	    break;
+	}
+    }
+
+    return nspans;
+}
+
+/**
+ * Parse text into spans that can be stored alongside it, so that it
+ * can be redrawn without interpreting its text-decoration codes
+ * again.
+ *
+ * @param buf Text
+ * @return The parsed line. Free it with printtext_line_free().
+ */
+struct printtext_line *
+printtext_line_new(const char *buf)
+{
+    int nspans;
+    struct printtext_line *line;
+    enum text_encoding encoding;
+
+    if (buf == NULL)
+	err_exit(EINVAL, "printtext_line_new");
+
+    puts_init();
+    mutex_lock(&g_puts_mutex);
+    (void) decode_buffer(buf, config_current()->encoding,
+	&encoding);
+    nspans = parse_spans();
+    line = xmalloc(sizeof *line + nspans * sizeof line->span[0]);
+    line->encoding = encoding;
+    line->layout = NULL;
+    line->bytes = NULL;
+    line->nspans = nspans;
+    if (nspans > 0)
+	memcpy(line->span, span_buf, nspans * sizeof line->span[0]);
+    mutex_unlock(&g_puts_mutex);
+
+    return line;
+}
+
+/*
+ * Bytes allocated for a line, including its layout
+ */
+static size_t
+line_size(const struct printtext_line *line)
+{
+    size_t size = sizeof *line + line->nspans * sizeof line->span[0];
+
+    if (line->layout != NULL) {
+	size += sizeof *line->layout +
+	    line->layout->nrows * sizeof line->layout->row[0];
+    }
+    return size;
 }
 
 /**
- * Handles switch default in printtext_puts()
+ * Count the size of a line in '*bytes' for as long as it lives. When
+ * the line is laid out again, or freed, '*bytes' is adjusted.
  *
- * @param[in]     ctx          Context structure
- * @param[in,out] rep_count    "Represent" count
- * @param[out]    line_count   Line count
- * @param[out]    insert_count Insert count
+ * @param line  Line
+ * @param bytes Counter. Guarded by g_puts_mutex.
  * @return Void
  */
-static void
-case_default(struct case_default_context *ctx,
-	     int *rep_count, int *line_count, int *insert_count)
+void
+printtext_line_account(struct printtext_line *line, size_t *bytes)
 {
-    chtype c;
-    unsigned char *mbs, *p;
+    if (line == NULL)
+	return;
+    line->bytes = bytes;
+    *bytes += line_size(line);
+}
 
-    if (!iswprint(ctx->wc) && ctx->wc != L'\n') {
+void
+printtext_line_free(struct printtext_line *line)
+{
+    if (line == NULL)
 	return;
-    }
+    if (line->bytes != NULL)
+	*line->bytes -= line_size(line);
+    free_not_null(line->layout);
+    free(line);
+}
 
-    mbs = convert_wc(ctx->wc);
-    p = &mbs[0];
+/**
+ * Move the characters covered by spans to the start of 'wc_buf'.
+ * Called with g_puts_mutex held.
+ *
+ * @return The number of characters
+ */
+static int
+compact_spans(const struct text_span *span, int nspans)
+{
+    int len = 0;
 
-    if (is_scrollok(ctx->win)) {
-	const chtype new_line = '\n';
+    for (const struct text_span *sp = span; sp < &span[nspans]; sp++) {
+	if (sp->offset != len) {
+	    (void) wmemmove(&wc_buf[len], &wc_buf[sp->offset],
+		sp->length);
+	}
+	len += sp->length;
+    }
 
-	if (ctx->wc == L'\n') {
-	    WADDCH(ctx->win, new_line);
-	    *insert_count = 0;
+    wc_buf[len] = L'\0';
+    return len;
+}
 
-	    if (rep_count != NULL) {
-		(*rep_count)++;
-	    }
+/**
+ * Decode 'buf' into 'wc_buf' and leave only the displayed characters
+ * there. Called with g_puts_mutex held.
+ *
+ * @return The number of displayed characters
+ */
+static int
+prepare_line(const char *buf, const struct printtext_line *line,
+	     const struct text_span **span, int *nspans)
+{
+    if (line != NULL) {
+	(void) decode_buffer(buf, line->encoding, NULL);
+	*span = line->span;
+	*nspans = line->nspans;
+    } else {
+	(void) decode_buffer(buf, config_current()->encoding,
+	    NULL);
+	*nspans = parse_spans();
+	*span = span_buf;
+    }
 
-	    if (ctx->max_lines > 0) {
-		if (!( ++(*line_count) < ctx->max_lines )) {
-		    free(mbs);
-		    return;
-		}
-	    }
+    return compact_spans(*span, *nspans);
+}
 
-	    if (!ctx->nextchar_empty && ctx->indent > 0) {
-		do_indent(ctx->win, ctx->indent, insert_count);
-	    }
-	} else if (!start_on_a_new_row((*insert_count) + ctx->diff + 1)) {
-	    while ((c = *p++) != '\0') {
-		WADDCH(ctx->win, c);
-	    }
+/**
+ * Get the number of columns 'wc' occupies
+ */
+static SW_INLINE int
+char_width(wchar_t wc)
+{
+    const int width = wcwidth(wc);
 
-	    (*insert_count)++;
-	} else {
-	    WADDCH(ctx->win, new_line);
-	    *insert_count = 0;
+    return (width < 0 ? 1 : width);
+}
 
-	    if (rep_count != NULL) {
-		(*rep_count)++;
-	    }
+/**
+ * Append a row to 'row_buf'
+ */
+static void
+add_row(int start, int end, int *nrows)
+{
+    if (*nrows == row_size) {
+	row_size = (row_size > 0 ? row_size * 2 : 16);
+	row_buf = (row_buf != NULL
+	    ? xrealloc(row_buf, row_size * sizeof *row_buf)
+	    : xmalloc(row_size * sizeof *row_buf));
+    }
 
-	    if (ctx->max_lines > 0) {
-		if (!( ++(*line_count) < ctx->max_lines )) {
-		    free(mbs);
-		    return;
-		}
-	    }
+    row_buf[*nrows].start = start;
+    row_buf[*nrows].end = end;
+    (*nrows)++;
+}
 
-	    if (ctx->indent > 0) {
-		do_indent(ctx->win, ctx->indent, insert_count);
-	    }
+/**
+ * Get the number of columns occupied by the space at 'wc_buf[pos]'
+ * and the word following it
+ */
+static int
+word_width(int pos, int len)
+{
+    int width = char_width(wc_buf[pos]);
 
-#if 1
-	    if (ctx->diff && ctx->wc == L' ') {
-		free(mbs);
-		return;
-	    }
-#endif
+    for (int i = pos + 1; i < len && wc_buf[i] != L' ' && wc_buf[i] != L'\n';
+	 i++)
+	width += char_width(wc_buf[i]);
 
-	    while ((c = *p++) != '\0') {
-		WADDCH(ctx->win, c);
-	    }
+    return width;
+}
 
-	    (*insert_count)++;
-	}
-    } else { /* not scrollok */
-	while ((c = *p++) != '\0') {
-	    WADDCH(ctx->win, c);
+/**
+ * Lay out the 'len' displayed characters in 'wc_buf' in rows for a
+ * window that is 'cols' wide and store them in 'row_buf'. Rows are
+ * broken at spaces where possible, and a space that ends a row isn't
+ * displayed. Called with g_puts_mutex held.
+ *
+ * @return The number of rows
+ */
+static int
+layout_rows(int len, int indent, int cols)
+{
+    const int width = cols - 2; /* the last column is kept blank */
+    int col = 0;
+    int nrows = 0;
+    int start = 0;
+
+    for (int i = 0; i < len; i++) {
+	const wchar_t wc = wc_buf[i];
+	const int cw = char_width(wc);
+
+	if (wc == L'\n') {
+	    add_row(start, i, &nrows);
+	    start = i + 1;
+	    col = indent;
+	    continue;
+	} else if (i > start && wc == L' ' &&
+		   col + word_width(i, len) > width) {
+	    add_row(start, i, &nrows);
+	    start = i + 1;
+	    col = indent;
+	    continue;
+	} else if (i > start && col + cw > width) {
+	    add_row(start, i, &nrows);
+	    start = i;
+	    col = indent;
 	}
+
+	col += cw;
+    }
+
+    add_row(start, len, &nrows);
+    return nrows;
+}
+
+static SW_INLINE bool
+layout_is_cached(const struct printtext_line *line, int indent, int cols)
+{
+    return (line != NULL && line->layout != NULL &&
+	    line->layout->cols == cols && line->layout->indent == indent);
+}
+
+/**
+ * Get the rows of a line. They're computed once per window width and
+ * cached in 'line' (if it isn't NULL). Called with g_puts_mutex held
+ * and the line prepared by prepare_line().
+ */
+static const struct text_row *
+get_layout(struct printtext_line *line, int len, int indent, int cols,
+	   int *nrows)
+{
+    struct text_layout *layout = NULL;
+
+    if (layout_is_cached(line, indent, cols)) {
+	*nrows = line->layout->nrows;
+	return (&line->layout->row[0]);
+    }
+
+    *nrows = layout_rows(len, indent, cols);
+
+    if (line == NULL)
+	return (&row_buf[0]);
+
+    layout = xmalloc(sizeof *layout + *nrows * sizeof layout->row[0]);
+    layout->cols   = cols;
+    layout->indent = indent;
+    layout->nrows  = *nrows;
+    memcpy(layout->row, row_buf, *nrows * sizeof layout->row[0]);
+
+    if (line->bytes != NULL)
+	*line->bytes -= line_size(line);
+    free_not_null(line->layout);
+    line->layout = layout;
+    if (line->bytes != NULL)
+	*line->bytes += line_size(line);
+    return (&layout->row[0]);
+}
+
+/**
+ * Get the number of rows a line occupies in a window that is 'cols'
+ * wide. Once the line has been laid out for that width, this doesn't
+ * look at its text.
+ *
+ * @param line   'buf' parsed by printtext_line_new(), or NULL.
+ * @param buf    Text
+ * @param indent Indent of rows after the first one
+ * @param cols   Window width
+ * @return The number of rows
+ */
+int
+printtext_line_rows(struct printtext_line *line, const char *buf, int indent,
+		    int cols)
+{
+    const struct text_span *span = NULL;
+    int nrows = 0;
+    int nspans = 0;
+
+    if (buf == NULL)
+	err_exit(EINVAL, "printtext_line_rows");
+    else if (*buf == '\0')
+	return 0;
+
+    puts_init();
+    mutex_lock(&g_puts_mutex);
+    if (layout_is_cached(line, indent, cols)) {
+	nrows = line->layout->nrows;
+    } else {
+	(void) get_layout(line, prepare_line(buf, line, &span, &nspans),
+	    indent, cols, &nrows);
     }
+    mutex_unlock(&g_puts_mutex);
 
-    free(mbs);
+    return nrows;
 }
 
 /**
@@ -1030,7 +1332,10 @@ case_default(struct case_default_context *ctx,
  * @param[in]  pwin      Panel window where the output is to be displayed.
  * @param[in]  buf       A buffer that should contain the data to be written to
  *                       'pwin'.
+ * @param[in]  line      'buf' parsed by printtext_line_new(), or NULL. Its
+ *                       layout is cached in it.
  * @param[in]  indent    If >0 indent text with this number of blanks.
+ * @param[in]  first_row Start writing at this row of the text.
  * @param[in]  max_lines If >0 write at most this number of lines.
  * @param[out] rep_count "Represent count". How many actual lines does this
  *                       contribution represent in the output window?
@@ -1038,31 +1343,21 @@ case_default(struct case_default_context *ctx,
  * @return Void
  */
 void
-printtext_puts(WINDOW *pwin, const char *buf, int indent, int max_lines,
-	       int *rep_count)
+printtext_puts_line(WINDOW *pwin, const char *buf,
+		    struct printtext_line *line, int indent, int first_row,
+		    int max_lines, int *rep_count)
 {
-    const bool pwin_scrollable = is_scrollok(pwin);
-    int insert_count = 0;
-    int line_count = 0;
-    int max_lines_flagged = 0;
-    struct text_decoration_bools booleans = {
-	.is_blink     = false,
-	.is_bold      = false,
-	.is_color     = false,
-	.is_reverse   = false,
-	.is_underline = false,
-    };
-    wchar_t *wc_buf = NULL, *wc_bufp = NULL;
-
-#if defined(UNIX)
-    if ((errno = pthread_once(&puts_init_done, puts_mutex_init)) != 0) {
-	err_sys("pthread_once error");
-    }
-#elif defined(WIN32)
-    if ((errno = init_once(&puts_init_done, puts_mutex_init)) != 0) {
-	err_sys("init_once error");
-    }
-#endif
+    const chtype new_line = '\n';
+    const struct text_row *row = NULL;
+    const struct text_span *cur = NULL;
+    const struct text_span *sp = NULL;
+    const struct text_span *span = NULL;
+    int len = 0;
+    int nrows = 0;
+    int nspans = 0;
+    int nwritten = 0;
+    int offset = 0;
+    struct puts_run run;
 
     if (rep_count) {
 	*rep_count = 0;
@@ -1074,71 +1369,79 @@ printtext_puts(WINDOW *pwin, const char *buf, int indent, int max_lines,
 	return;
     }
 
+    puts_init();
     mutex_lock(&g_puts_mutex);
-    wc_buf = perform_convert_buffer(&buf);
-    if (pwin_scrollable)
-	append_newline(&wc_buf);
-    replace_characters_with_space(wc_buf, L"\f\t\v");
 
-    for (wc_bufp = &wc_buf[0], max_lines_flagged = 0;
-	 *wc_bufp && !max_lines_flagged;
-	 wc_bufp++) {
-	wchar_t wc = *wc_bufp;
+    len = prepare_line(buf, line, &span, &nspans);
+    run.win = pwin;
+    run.len = 0;
 
-	switch (wc) {
-	case BLINK:
-	    case_blink(pwin, &booleans.is_blink);
-	    break;
-	case BOLD:
-	    case_bold(pwin, &booleans.is_bold);
-	    break;
-	case COLOR:
-	    case_color(pwin, &booleans.is_color, &wc_bufp);
-	    break;
-	case NORMAL:
-	    text_decoration_bools_reset(&booleans);
-	    term_set_attr(pwin, A_NORMAL);
-	    break;
-	case REVERSE:
-	    case_reverse(pwin, &booleans.is_reverse);
-	    break;
-	case UNDERLINE:
-	    case_underline(pwin, &booleans.is_underline);
+    if (!is_scrollok(pwin)) {
+	for (sp = span; sp < &span[nspans]; sp++) {
+	    run_flush(&run);
+	    (void) wattr_set(pwin, sp->attrs, span_pair(sp), NULL);
+
+	    for (int i = offset; i < offset + sp->length; i++)
+		run_add(&run, wc_buf[i]);
+	    offset += sp->length;
+	}
+
+	goto out;
+    }
+
+    row = get_layout(line, len, indent, getmaxx(pwin), &nrows);
+    sp = span;
+
+    for (int r = (first_row > 0 ? first_row : 0); r < nrows; r++) {
+	if (max_lines > 0 && nwritten >= max_lines)
 	    break;
-	default:
-	{
-	    ptrdiff_t diff = 0;
-	    wchar_t *wcp = NULL;
 
-	    if (wc == L' ' && (wcp = wcschr(wc_bufp + 1, L' ')) != NULL) {
-		diff = wcp - wc_bufp;
+	if (r > 0 && indent > 0)
+	    do_indent(pwin, indent);
+
+	for (int i = row[r].start; i < row[r].end; i++) {
+	    while (i >= offset + sp->length) {
+		offset += sp->length;
+		sp++;
 	    }
 
-	    struct case_default_context def_ctx = {
-		.win		= pwin,
-		.wc		= wc,
-		.nextchar_empty = !wcscmp(wc_bufp + 1, L""),
-		.indent		= indent,
-		.max_lines	= max_lines,
-		.diff		= diff,
-	    };
+	    if (sp != cur) {
+		run_flush(&run);
+		(void) wattr_set(pwin, sp->attrs, span_pair(sp), NULL);
+		cur = sp;
+	    }
 
-	    case_default(&def_ctx, rep_count, &line_count, &insert_count);
-	    break;
-	} /* case default */
-	} /* switch block */
-	if (pwin_scrollable && max_lines > 0) {
-	    max_lines_flagged = line_count >= max_lines;
+	    run_add(&run, wc_buf[i]);
 	}
+
+	run_flush(&run);
+	WADDCH(pwin, new_line);
+	nwritten++;
+    }
+
+    if (rep_count) {
+	*rep_count = nwritten;
     }
 
-    free(wc_buf);
+  out:
+    run_flush(&run);
     term_set_attr(pwin, A_NORMAL);
-    update_panels();
-    doupdate();
+    term_request_update();
     mutex_unlock(&g_puts_mutex);
 }
 
+/**
+ * Output data to window
+ *
+ * @see printtext_puts_line()
+ */
+void
+printtext_puts(WINDOW *pwin, const char *buf, int indent, int max_lines,
+	       int *rep_count)
+{
+    printtext_puts_line(pwin, buf, NULL, indent, 0, max_lines, rep_count);
+}
+
 /**
  * Print formatted output in Curses windows
  *
@@ -1166,161 +1469,249 @@ vprinttext_mutex_init(void)
 }
 
 /**
- * Get multibyte string length
+ * Reserve space for 'len' more bytes (and a terminating null) in
+ * 'out_line'
  */
-static size_t
-get_mb_strlen(const char *s)
+static void
+out_line_reserve(size_t len)
 {
-    const size_t ERR_CASE1 = (size_t) -1;
-    const size_t ERR_CASE2 = (size_t) -2;
-    size_t idx = 0;
-    size_t len = 0;
+    size_t size = (out_line.size > 0 ? out_line.size : 256);
 
-    while (true) {
-	const size_t ret = mbrlen(&s[idx], MB_CUR_MAX, NULL);
+    if (out_line.len + len + 1 <= out_line.size)
+	return;
+    while (size < out_line.len + len + 1)
+	size *= 2;
+    out_line.buf = (out_line.buf != NULL ? xrealloc(out_line.buf, size) :
+	xmalloc(size));
+    out_line.size = size;
+}
 
-	if (ret == ERR_CASE1 || ret == ERR_CASE2) {
-	    return (strlen(s));
-	} else if (ret == 0) {
-	    break;
-	} else {
-	    idx += ret;
-	    len += 1;
+static void
+out_line_append(const char *s)
+{
+    const size_t len = strlen(s);
+
+    out_line_reserve(len);
+    memcpy(&out_line.buf[out_line.len], s, len + 1);
+    out_line.len += len;
+}
+
+static void
+out_line_vprintf(const char *fmt, va_list ap)
+{
+    int n;
+    va_list ap_copy;
+
+    out_line_reserve(0);
+
+    va_copy(ap_copy, ap);
+    n = vsnprintf(&out_line.buf[out_line.len], out_line.size - out_line.len,
+	fmt, ap_copy);
+    va_end(ap_copy);
+
+    if (n < 0) {
+	err_sys("vsnprintf() returned %d", n);
+    } else if (out_line.len + n + 1 > out_line.size) {
+	out_line_reserve((size_t) n);
+	va_copy(ap_copy, ap);
+	(void) vsnprintf(&out_line.buf[out_line.len],
+	    out_line.size - out_line.len, fmt, ap_copy);
+	va_end(ap_copy);
+    }
+
+    out_line.len += n;
+}
+
+/**
+ * Get the length of the text-decoration code at 'cp', or 0 if there
+ * is none
+ */
+static int
+deco_length(const char *cp)
+{
+    const char *start = cp;
+
+    switch (*cp) {
+    case BLINK:
+    case BOLD:
+    case NORMAL:
+    case REVERSE:
+    case UNDERLINE:
+	break;
+    case COLOR:
+	for (int i = 0; i < 2 && sw_isdigit(cp[1]); i++)
+	    cp++;
+	if (cp[1] == ',' && sw_isdigit(cp[2])) {
+	    cp++;
+	    for (int i = 0; i < 2 && sw_isdigit(cp[1]); i++)
+		cp++;
 	}
+	break;
+    case HEX_COLOR:
+	if (is_hex_rgb(&cp[1])) {
+	    cp += 6;
+	    if (cp[1] == ',' && is_hex_rgb(&cp[2]))
+		cp += 7;
+	}
+	break;
+    default:
+	return 0;
+    }
+
+    return (cp - start + 1);
+}
+
+/**
+ * Get the number of characters 's' occupies on screen, i.e. not
+ * counting text-decoration codes
+ */
+static int
+display_width(const char *s)
+{
+    const bool utf8 = text_is_utf8(s, strlen(s));
+    int width = 0;
+
+    for (const char *cp = s; *cp; cp++) {
+	const int n = deco_length(cp);
+
+	if (n > 0)
+	    cp += n - 1;
+	else if (!utf8 || (*cp & 0xC0) != 0x80) /* not a continuation byte */
+	    width++;
     }
 
-    return (len);
+    return width;
 }
 
 /**
- * Get message components
+ * Copy 's' to 'out' without its text-decoration codes. Unlike
+ * squeeze_text_deco() this doesn't allocate, so it can be used for
+ * every line printed.
+ *
+ * @param s   Text
+ * @param out Output buffer. At least as large as 's'.
+ * @return The length of the output
+ */
+size_t
+printtext_strip_deco(const char *s, char *out)
+{
+    char *op = out;
+
+    for (const char *cp = s; *cp; cp++) {
+	const int n = deco_length(cp);
+
+	if (n > 0)
+	    cp += n - 1;
+	else
+	    *op++ = *cp;
+    }
+
+    *op = '\0';
+    return (op - out);
+}
+
+/**
+ * Get the timestamp. It's formatted at most once a second (or when
+ * the theme changes).
+ */
+static const char *
+get_timestamp(int *width)
+{
+    const struct theme_snapshot *theme = theme_current();
+    time_t now = time(NULL);
+
+    if (now != ts_cache.second || theme->generation != ts_cache.generation) {
+	ts_cache.generation = theme->generation;
+	sw_strcpy(ts_cache.text, current_time(theme->time_format),
+	    sizeof ts_cache.text);
+	ts_cache.width = display_width(ts_cache.text);
+	ts_cache.second = now;
+    }
+
+    *width = ts_cache.width;
+    return (&ts_cache.text[0]);
+}
+
+/**
+ * Write a prefix component and a space to 'out_line'
+ *
+ * @return Its width on screen
+ */
+static int
+add_prefix(const char *component)
+{
+    out_line_append(component);
+    out_line_append(" ");
+    return display_width(component) + 1;
+}
+
+/**
+ * Build an output line in 'out_line': timestamp, specifiers and the
+ * formatted message. Called with vprinttext_mutex held.
  *
- * @param unproc_msg Unprocessed message
  * @param spec_type  "Specifier"
  * @param include_ts Include timestamp?
- * @return Message components
+ * @param fmt        Format of the message
+ * @param ap         va_list object
+ * @return The width of the prefix, i.e. the indent of the line
  */
-static struct message_components *
-get_processed_out_message(const char *unproc_msg,
-			  enum message_specifier_type spec_type,
-			  bool include_ts)
+static int
+build_out_line(enum message_specifier_type spec_type, bool include_ts,
+	       const char *fmt, va_list ap)
 {
-#define STRLEN_SQUEEZE(string) ((int) get_mb_strlen(squeeze_text_deco(string)))
-    struct message_components *pout = xcalloc(sizeof *pout, 1);
-    char *tmp = NULL;
+    int indent = 0;
 
-    pout->text = NULL;
-    pout->indent = 0;
+    out_line.len = 0;
+    out_line_reserve(0);
+    out_line.buf[0] = '\0';
 
     if (include_ts) {
-	char *ts = sw_strdup(current_time(Theme("time_format")));
+	int width = 0;
 
-	switch (spec_type) {
-	case TYPE_SPEC1:
-	    pout->text	 = Strdup_printf("%s %s %s", ts, THE_SPEC1, unproc_msg);
-	    tmp		 = Strdup_printf("%s %s ", ts, THE_SPEC1);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC2:
-	    pout->text	 = Strdup_printf("%s %s %s", ts, THE_SPEC2, unproc_msg);
-	    tmp		 = Strdup_printf("%s %s ", ts, THE_SPEC2);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC3:
-	    pout->text	 = Strdup_printf("%s %s %s", ts, THE_SPEC3, unproc_msg);
-	    tmp		 = Strdup_printf("%s %s ", ts, THE_SPEC3);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC1_SPEC2:
-	    pout->text = Strdup_printf("%s %s %s %s", ts, THE_SPEC1,
-				       THE_SPEC2, unproc_msg);
-	    tmp = Strdup_printf("%s %s %s ", ts, THE_SPEC1, THE_SPEC2);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC1_FAILURE:
-	    pout->text = Strdup_printf("%s %s %s %s", ts, THE_SPEC1,
-				       GFX_FAILURE, unproc_msg);
-	    tmp = Strdup_printf("%s %s %s ", ts, THE_SPEC1, GFX_FAILURE);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC1_SUCCESS:
-	    pout->text = Strdup_printf("%s %s %s %s", ts, THE_SPEC1,
-				       GFX_SUCCESS, unproc_msg);
-	    tmp = Strdup_printf("%s %s %s ", ts, THE_SPEC1, GFX_SUCCESS);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC1_WARN:
-	    pout->text = Strdup_printf("%s %s %s %s", ts, THE_SPEC1,
-				       GFX_WARN, unproc_msg);
-	    tmp = Strdup_printf("%s %s %s ", ts, THE_SPEC1, GFX_WARN);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC_NONE: default:
-	    pout->text	 = Strdup_printf("%s %s", ts, unproc_msg);
-	    tmp		 = Strdup_printf("%s ", ts);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	}
+	out_line_append(get_timestamp(&width));
+	out_line_append(" ");
+	indent += width + 1;
+    }
 
-	free(ts);
-    } else if (!include_ts) { /* the same but no timestamp */
-	switch (spec_type) {
-	case TYPE_SPEC1:
-	    pout->text   = Strdup_printf("%s %s", THE_SPEC1, unproc_msg);
-	    tmp          = Strdup_printf("%s ", THE_SPEC1);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC2:
-	    pout->text   = Strdup_printf("%s %s", THE_SPEC2, unproc_msg);
-	    tmp          = Strdup_printf("%s ", THE_SPEC2);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC3:
-	    pout->text   = Strdup_printf("%s %s", THE_SPEC3, unproc_msg);
-	    tmp          = Strdup_printf("%s ", THE_SPEC3);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC1_SPEC2:
-	    pout->text   = Strdup_printf("%s %s %s", THE_SPEC1, THE_SPEC2,
-					 unproc_msg);
-	    tmp          = Strdup_printf("%s %s ", THE_SPEC1, THE_SPEC2);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC1_FAILURE:
-	    pout->text   = Strdup_printf("%s %s %s", THE_SPEC1, GFX_FAILURE,
-					 unproc_msg);
-	    tmp          = Strdup_printf("%s %s ", THE_SPEC1, GFX_FAILURE);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC1_SUCCESS:
-	    pout->text   = Strdup_printf("%s %s %s", THE_SPEC1, GFX_SUCCESS,
-					 unproc_msg);
-	    tmp          = Strdup_printf("%s %s ", THE_SPEC1, GFX_SUCCESS);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC1_WARN:
-	    pout->text   = Strdup_printf("%s %s %s", THE_SPEC1, GFX_WARN,
-					 unproc_msg);
-	    tmp          = Strdup_printf("%s %s ", THE_SPEC1, GFX_WARN);
-	    pout->indent = STRLEN_SQUEEZE(tmp);
-	    break;
-	case TYPE_SPEC_NONE: default:
-	    pout->text   = sw_strdup(unproc_msg);
-	    pout->indent = 0;
-	    break;
-	}
-    } else {
-	sw_assert_not_reached();
+    switch (spec_type) {
+    case TYPE_SPEC1:
+	indent += add_prefix(THE_SPEC1);
+	break;
+    case TYPE_SPEC2:
+	indent += add_prefix(THE_SPEC2);
+	break;
+    case TYPE_SPEC3:
+	indent += add_prefix(THE_SPEC3);
+	break;
+    case TYPE_SPEC1_SPEC2:
+	indent += add_prefix(THE_SPEC1);
+	indent += add_prefix(THE_SPEC2);
+	break;
+    case TYPE_SPEC1_FAILURE:
+	indent += add_prefix(THE_SPEC1);
+	indent += add_prefix(GFX_FAILURE);
+	break;
+    case TYPE_SPEC1_SUCCESS:
+	indent += add_prefix(THE_SPEC1);
+	indent += add_prefix(GFX_SUCCESS);
+	break;
+    case TYPE_SPEC1_WARN:
+	indent += add_prefix(THE_SPEC1);
+	indent += add_prefix(GFX_WARN);
+	break;
+    case TYPE_SPEC_NONE:
+    default:
+	break;
     }
 
-    free_not_null(tmp);
-    sw_assert(pout->text != NULL);
+    out_line_vprintf(fmt, ap);
 
     if (g_no_colors) {
-	pout->text = squeeze_text_deco(pout->text);
+	(void) squeeze_text_deco(out_line.buf);
+	out_line.len = strlen(out_line.buf);
     }
 
-    return (pout);
+    return indent;
 }
 
 /**
@@ -1334,15 +1725,11 @@ get_processed_out_message(const char *unproc_msg,
 void
 vprinttext(struct printtext_context *ctx, const char *fmt, va_list ap)
 {
-    char *fmt_copy = NULL;
     const int tbszp1 = textBuf_size(ctx->window->buf) + 1;
-    struct integer_unparse_context unparse_ctx = {
-	.setting_name     = "textbuffer_size_absolute",
-	.fallback_default = 1000,
-	.lo_limit         = 350,
-	.hi_limit         = 4700,
-    };
-    struct message_components *pout = NULL;
+    int indent = 0;
+    struct printtext_line *line = NULL;
+    int (*ins_next)(PTEXTBUF, PTEXTBUF_ELMT, const char *, int) =
+	(ctx->unindexed ? textBuf_ins_next_unindexed : textBuf_ins_next);
 
 #if defined(UNIX)
     errno = pthread_once(&vprinttext_init_done, vprinttext_mutex_init);
@@ -1356,11 +1743,12 @@ vprinttext(struct printtext_context *ctx, const char *fmt, va_list ap)
 
     mutex_lock(&vprinttext_mutex);
 
-    fmt_copy = Strdup_vprintf(fmt, ap);
-    pout     = get_processed_out_message(fmt_copy, ctx->spec_type,
-					 ctx->include_ts);
+    indent = build_out_line(ctx->spec_type, ctx->include_ts, fmt, ap);
+    line = printtext_line_new(out_line.buf);
+
+    printtext_lock();
 
-    if (tbszp1 > config_integer_unparse(&unparse_ctx)) {
+    if (tbszp1 > config_current()->textbuffer_size_absolute) {
 	/* Buffer full. Remove head... */
 
 	if ((errno = textBuf_remove(ctx->window->buf,
@@ -1369,22 +1757,25 @@ vprinttext(struct printtext_context *ctx, const char *fmt, va_list ap)
     }
 
     if (textBuf_size(ctx->window->buf) == 0) {
-	if ((errno = textBuf_ins_next(ctx->window->buf, NULL, pout->text,
-	    pout->indent)) != 0)
+	if ((errno = ins_next(ctx->window->buf, NULL, out_line.buf,
+	    indent)) != 0)
 	    err_sys("textBuf_ins_next");
     } else {
-	if ((errno = textBuf_ins_next(ctx->window->buf,
-	    textBuf_tail(ctx->window->buf), pout->text, pout->indent)) != 0)
+	if ((errno = ins_next(ctx->window->buf,
+	    textBuf_tail(ctx->window->buf), out_line.buf, indent)) != 0)
 	    err_sys("textBuf_ins_next");
     }
 
-    if (! (ctx->window->scroll_mode))
-	printtext_puts(panel_window(ctx->window->pan), pout->text, pout->indent,
-		       -1, NULL);
+    textBuf_set_line(ctx->window->buf, textBuf_tail(ctx->window->buf), line);
+    window_enforce_budget();
 
-    free_not_null(fmt_copy);
-    free_not_null(pout->text);
-    free_not_null(pout);
+    if (ctx->window == g_active_window && !(ctx->window->scroll_mode))
+	printtext_puts_line(window_viewport(), out_line.buf, line, indent, 0,
+			    -1, NULL);
 
+    printtext_unlock();
     mutex_unlock(&vprinttext_mutex);
+
+    if (ctx->window != g_active_window)
+	window_add_unread(ctx->window);
 }
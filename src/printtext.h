@@ -2,6 +2,7 @@
 #define PRINTTEXT_H
 
 #include "mutex.h"
+#include "textDecode.h"
 #include "window.h"
 
 /* text decoration */
@@ -9,6 +10,7 @@ enum {
     BLINK     = '\035',
     BOLD      = '\002',
     COLOR     = '\003',
+    HEX_COLOR = '\004',
     NORMAL    = '\017',
     REVERSE   = '\026',
     UNDERLINE = '\037'
@@ -25,10 +27,46 @@ enum message_specifier_type {
     TYPE_SPEC_NONE
 };
 
+/* 'fg' of a span drawn with the default color pair */
+#define SPAN_NO_COLOR -2
+
+/*
+ * A run of characters with the same attributes. 'offset' and
+ * 'length' count wide characters of the decoded text. The colors are
+ * kept rather than a color pair, as the pair is only looked up when
+ * the span is drawn: pairs that aren't in use get redefined.
+ */
+struct text_span {
+    int		offset;
+    int		length;
+#if defined(UNIX)
+    attr_t	attrs;
+#elif defined(WIN32)
+    chtype	attrs;
+#endif
+    short int	fg;
+    short int	bg;
+};
+
+struct text_layout;
+
+/*
+ * A line of text parsed into spans. Stored alongside the text in the
+ * text buffer, together with how it was last laid out.
+ */
+struct printtext_line {
+    enum text_encoding	encoding;
+    struct text_layout *layout;
+    size_t	       *bytes;	/* where its size is counted, or NULL */
+    int			nspans;
+    struct text_span	span[];
+};
+
 struct printtext_context {
     PIRC_WINDOW			window;
     enum message_specifier_type spec_type;
     bool                        include_ts;
+    bool                        unindexed;  /* keep out of /lastlog */
 };
 
 #if defined(UNIX)
@@ -39,12 +77,20 @@ extern HANDLE g_puts_mutex;
 
 /*lint -printf(2, printtext, swirc_wprintw) */
 
-char		*squeeze_text_deco (char *buffer);
-short int	 color_pair_find   (short int fg, short int bg);
-void		 print_and_free    (const char *msg, char *cp);
-void		 printtext         (struct printtext_context *, const char *fmt, ...) PRINTFLIKE(2);
-void		 printtext_puts    (WINDOW *, const char *buf, int indent, int max_lines, int *rep_count);
-void		 swirc_wprintw     (WINDOW *, const char *fmt, ...) PRINTFLIKE(2);
-void		 vprinttext        (struct printtext_context *, const char *fmt, va_list);
+char		*squeeze_text_deco  (char *buffer);
+void		 print_and_free     (const char *msg, char *cp);
+void		 printtext_lock     (void);
+size_t		 printtext_strip_deco(const char *s, char *out);
+void		 printtext_unlock   (void);
+void		 printtext          (struct printtext_context *, const char *fmt, ...) PRINTFLIKE(2);
+void		 printtext_puts     (WINDOW *, const char *buf, int indent, int max_lines, int *rep_count);
+void		 printtext_puts_line(WINDOW *, const char *buf, struct printtext_line *, int indent, int first_row, int max_lines, int *rep_count);
+void		 swirc_wprintw      (WINDOW *, const char *fmt, ...) PRINTFLIKE(2);
+void		 vprinttext         (struct printtext_context *, const char *fmt, va_list);
+
+struct printtext_line	*printtext_line_new (const char *buf);
+void			 printtext_line_account(struct printtext_line *, size_t *bytes);
+void			 printtext_line_free(struct printtext_line *);
+int			 printtext_line_rows(struct printtext_line *, const char *buf, int indent, int cols);
 
 #endif
@@ -71,7 +71,6 @@ bool g_hist_prev = false;
 
 static PANEL				*readline_pan1       = NULL;
 static PANEL				*readline_pan2       = NULL;
-static bool				 disable_beeps       = false;
 static const int			 readline_buffersize = 2700;
 static enum readline_active_panel	 panel_state	     = PANEL1_ACTIVE;
 
@@ -157,8 +156,7 @@ write_cmdprompt(WINDOW *win, char *prompt, int size)
 	readline_error(0, "waddnstr");
     }
 
-    update_panels();
-    (void) doupdate();
+    term_request_update();
 }
 
 /**
@@ -202,8 +200,7 @@ compute_new_window_entry(volatile struct readline_session_context *ctx,
 	readline_waddnstr(ctx->act, str1, -1);
     }
 
-    update_panels();
-    (void) doupdate();
+    term_request_update();
 }
 
 /**
@@ -238,7 +235,7 @@ case_key_left(volatile struct readline_session_context *ctx)
     struct current_cursor_pos yx;
 
     if (ctx->bufpos == 0) {
-	if (!disable_beeps) {
+	if (!config_current()->disable_beeps) {
 	    term_beep();
 	}
 
@@ -256,8 +253,7 @@ case_key_left(volatile struct readline_session_context *ctx)
 	readline_error(EPERM, "wmove");
     }
 
-    update_panels();
-    (void) doupdate();
+    term_request_update();
 }
 
 /**
@@ -269,7 +265,7 @@ case_key_right(volatile struct readline_session_context *ctx)
     struct current_cursor_pos yx;
 
     if (!ctx->insert_mode) {
-	if (!disable_beeps) {
+	if (!config_current()->disable_beeps) {
 	    term_beep();
 	}
 
@@ -287,8 +283,7 @@ case_key_right(volatile struct readline_session_context *ctx)
 	readline_error(EPERM, "wmove");
     }
 
-    update_panels();
-    (void) doupdate();
+    term_request_update();
 }
 
 /**
@@ -300,7 +295,7 @@ case_key_backspace(volatile struct readline_session_context *ctx)
     struct current_cursor_pos yx;
 
     if (ctx->bufpos == 0) {
-	if (!disable_beeps) {
+	if (!config_current()->disable_beeps) {
 	    term_beep();
 	}
 
@@ -335,8 +330,7 @@ case_key_backspace(volatile struct readline_session_context *ctx)
 	}
     }
 
-    update_panels();
-    (void) doupdate();
+    term_request_update();
 }
 
 /**
@@ -349,7 +343,7 @@ case_key_dc(volatile struct readline_session_context *ctx)
     const int	 this_index = ctx->bufpos + 1;
 
     if (!ctx->insert_mode) {
-	if (!disable_beeps) {
+	if (!config_current()->disable_beeps) {
 	    term_beep();
 	}
 
@@ -366,8 +360,7 @@ case_key_dc(volatile struct readline_session_context *ctx)
 
     readline_winsnstr(ctx->act, &ctx->buffer[ctx->bufpos], -1);
 
-    update_panels();
-    (void) doupdate();
+    term_request_update();
 }
 
 /**
@@ -377,7 +370,7 @@ static void
 handle_key(volatile struct readline_session_context *ctx, wint_t wc)
 {
     if (ctx->no_bufspc) {
-	if (!disable_beeps) {
+	if (!config_current()->disable_beeps) {
 	    term_beep();
 	}
 
@@ -407,8 +400,7 @@ handle_key(volatile struct readline_session_context *ctx, wint_t wc)
 	readline_waddch(ctx->act, wc);
     }
 
-    update_panels();
-    (void) doupdate();
+    term_request_update();
 }
 
 /**
@@ -519,7 +511,14 @@ readline(const char *prompt)
 	if (*buf_p) {
 	    wc = *buf_p++;
 	} else if (wget_wch(ctx->act, &wc) == ERR) {
-	    (void) napms(sleep_time_milliseconds);
+	    int wait;
+
+	    mutex_lock(&g_puts_mutex);
+	    window_check_colors();
+	    term_flush_update(false);
+	    wait = term_update_wait(sleep_time_milliseconds);
+	    mutex_unlock(&g_puts_mutex);
+	    (void) napms(wait);
 	    continue;
 	}
 
@@ -616,6 +615,8 @@ readline(const char *prompt)
 	    break;
 	}
 
+	if (!*buf_p)
+	    term_flush_update(true);
 	mutex_unlock(&g_puts_mutex);
     } while (g_readline_loop);
 
@@ -657,8 +658,6 @@ readline_init(void)
 
     apply_readline_options(panel_window(readline_pan1));
     apply_readline_options(panel_window(readline_pan2));
-
-    disable_beeps = config_bool_unparse("disable_beeps", false);
 }
 
 /**
@@ -702,6 +701,5 @@ readline_top_panel(void)
 	sw_assert_not_reached();
     }
 
-    update_panels();
-    (void) doupdate();
+    term_request_update();
 }
@@ -0,0 +1,371 @@
+/* Name resolution with a TTL-bounded cache and a hosts file
+   Copyright (C) 2018 Markus Uhlin. All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   - Neither the name of the author nor the names of its contributors may be
+     used to endorse or promote products derived from this software without
+     specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+   BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+#include "common.h"
+
+#ifdef UNIX
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <netdb.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "errHand.h"
+#include "libUtils.h"
+#include "mutex.h"
+#include "nestHome.h"
+#include "network.h"
+#include "resolver.h"
+#include "strHand.h"
+#include "strdup_printf.h"
+
+/*
+ * Lookups are answered from, in order:
+ *   1. the hosts file (setting 'hosts_file', or 'hosts' in the home
+ *      directory), so that a name can be pinned or tests run offline,
+ *   2. the cache, whose entries live for 'dns_cache_ttl' seconds, and
+ *   3. getaddrinfo().
+ *
+ * The caller always gets a private copy of the list, which must be
+ * freed with resolver_free() (not freeaddrinfo()).
+ */
+
+struct resolver_entry {
+    char		*host;
+    char		*port;
+    struct addrinfo	*res;
+    unsigned long long	 expires;
+};
+
+static struct resolver_entry	cache[RESOLVER_CACHE_SIZE];
+static struct resolver_stats	stats = {
+    .hits      = 0,
+    .misses    = 0,
+    .overrides = 0,
+};
+
+#if defined(UNIX)
+static pthread_once_t	init_done = PTHREAD_ONCE_INIT;
+static pthread_mutex_t	cache_mutex;
+#elif defined(WIN32)
+static init_once_t	init_done = ONCE_INITIALIZER;
+static HANDLE		cache_mutex;
+#endif
+
+static void
+cache_mutex_init(void)
+{
+    mutex_new(&cache_mutex);
+}
+
+static void
+cache_lock(void)
+{
+#if defined(UNIX)
+    if ((errno = pthread_once(&init_done, cache_mutex_init)) != 0)
+	err_sys("pthread_once");
+#elif defined(WIN32)
+    if ((errno = init_once(&init_done, cache_mutex_init)) != 0)
+	err_sys("init_once");
+#endif
+    mutex_lock(&cache_mutex);
+}
+
+static void
+cache_unlock(void)
+{
+    mutex_unlock(&cache_mutex);
+}
+
+/*
+ * Copy an address list (or append a copy of it to '*tail')
+ */
+static struct addrinfo **
+addrinfo_copy(const struct addrinfo *src, struct addrinfo **tail)
+{
+    for (; src; src = src->ai_next) {
+	struct addrinfo *ai = xcalloc(sizeof *ai, 1);
+
+	ai->ai_flags	 = src->ai_flags;
+	ai->ai_family	 = src->ai_family;
+	ai->ai_socktype	 = src->ai_socktype;
+	ai->ai_protocol	 = src->ai_protocol;
+	ai->ai_addrlen	 = src->ai_addrlen;
+	ai->ai_addr	 = xmalloc(src->ai_addrlen);
+	memcpy(ai->ai_addr, src->ai_addr, src->ai_addrlen);
+	ai->ai_canonname = (src->ai_canonname ? sw_strdup(src->ai_canonname)
+			    : NULL);
+	ai->ai_next	 = NULL;
+
+	*tail = ai;
+	tail = &ai->ai_next;
+    }
+
+    return (tail);
+}
+
+/**
+ * Free a list returned by resolver_lookup()
+ */
+void
+resolver_free(struct addrinfo *res)
+{
+    struct addrinfo *next;
+
+    for (; res; res = next) {
+	next = res->ai_next;
+	free(res->ai_addr);
+	free_not_null(res->ai_canonname);
+	free(res);
+    }
+}
+
+static struct addrinfo *
+resolve(const char *host, const char *port, int flags)
+{
+    struct addrinfo hints = {
+	.ai_flags     = flags,
+	.ai_family    = AF_UNSPEC,
+	.ai_socktype  = SOCK_STREAM,
+	.ai_protocol  = 0,
+	.ai_addrlen   = 0,
+	.ai_addr      = NULL,
+	.ai_canonname = NULL,
+	.ai_next      = NULL,
+    };
+    struct addrinfo *res = NULL, *copy = NULL;
+
+    if (getaddrinfo(host, port, &hints, &res) != 0)
+	return (NULL);
+
+    (void) addrinfo_copy(res, &copy);
+    freeaddrinfo(res);
+    return (copy);
+}
+
+static char *
+get_hosts_file(void)
+{
+    if (!Strings_match(Config("hosts_file"), ""))
+	return sw_strdup(Config("hosts_file"));
+    else if (g_home_dir == NULL)
+	return NULL;
+#if defined(UNIX)
+    return Strdup_printf("%s/hosts", g_home_dir);
+#elif defined(WIN32)
+    return Strdup_printf("%s\\hosts", g_home_dir);
+#endif
+}
+
+/*
+ * Look the host up in the hosts file. Lines read "address name
+ * [aliases...]" and a '#' starts a comment. Every line that lists the
+ * name adds its address, in file order.
+ */
+static struct addrinfo *
+lookup_hosts_file(const char *host, const char *port)
+{
+    FILE *fp;
+    char *path;
+    char buf[1024] = "";
+    struct addrinfo *head = NULL, **tail = &head;
+
+    if ((path = get_hosts_file()) == NULL)
+	return (NULL);
+    else if ((fp = fopen(path, "r")) == NULL) {
+	free(path);
+	return (NULL);
+    }
+
+    while (fgets(buf, sizeof buf, fp) != NULL) {
+	char *addr, *name, *state = "";
+	char *cp;
+
+	if ((cp = strpbrk(buf, "#\r\n")) != NULL)
+	    *cp = '\0';
+	if ((addr = strtok_r(buf, " \t", &state)) == NULL)
+	    continue;
+
+	while ((name = strtok_r(NULL, " \t", &state)) != NULL) {
+	    if (Strings_match_ignore_case(name, host)) {
+		struct addrinfo *res;
+
+		if ((res = resolve(addr, port, AI_NUMERICHOST)) != NULL) {
+		    *tail = res;
+		    while (*tail)
+			tail = &(*tail)->ai_next;
+		} else {
+		    err_log(0, "%s: bogus address: %s", path, addr);
+		}
+		break;
+	    }
+	}
+    }
+
+    fclose(fp);
+    free(path);
+    return (head);
+}
+
+static long int
+get_ttl(void)
+{
+    return config_current()->dns_cache_ttl;
+}
+
+static void
+entry_clear(struct resolver_entry *entry)
+{
+    free_and_null(&entry->host);
+    free_and_null(&entry->port);
+    resolver_free(entry->res);
+    entry->res = NULL;
+    entry->expires = 0;
+}
+
+/*
+ * Return a copy of a fresh cache entry (if any). Called locked.
+ */
+static struct addrinfo *
+cache_get(const char *host, const char *port, unsigned long long now)
+{
+    struct resolver_entry *entry;
+    struct addrinfo *copy = NULL;
+
+    for (entry = &cache[0]; entry < &cache[ARRAY_SIZE(cache)]; entry++) {
+	if (entry->host == NULL)
+	    continue;
+	else if (entry->expires <= now)
+	    entry_clear(entry);
+	else if (Strings_match_ignore_case(entry->host, host) &&
+		 Strings_match(entry->port, port)) {
+	    (void) addrinfo_copy(entry->res, &copy);
+	    return (copy);
+	}
+    }
+
+    return (NULL);
+}
+
+/*
+ * Store a copy of 'res', replacing the entry that expires first. Called
+ * locked.
+ */
+static void
+cache_put(const char *host, const char *port, const struct addrinfo *res,
+	  unsigned long long expires)
+{
+    struct resolver_entry *entry, *victim = &cache[0];
+
+    for (entry = &cache[0]; entry < &cache[ARRAY_SIZE(cache)]; entry++) {
+	if (entry->host == NULL) {
+	    victim = entry;
+	    break;
+	} else if (entry->expires < victim->expires) {
+	    victim = entry;
+	}
+    }
+
+    entry_clear(victim);
+    victim->host    = sw_strdup(host);
+    victim->port    = sw_strdup(port);
+    victim->expires = expires;
+    (void) addrinfo_copy(res, &victim->res);
+}
+
+/**
+ * Resolve a host and port (numeric or service name) to a list of
+ * stream socket addresses of any family
+ *
+ * @return The list, or NULL if the name didn't resolve
+ */
+struct addrinfo *
+resolver_lookup(const char *host, const char *port)
+{
+    struct addrinfo *res;
+    unsigned long long now;
+    long int ttl;
+
+    if (host == NULL || port == NULL)
+	return (NULL);
+
+    if ((res = lookup_hosts_file(host, port)) != NULL) {
+	cache_lock();
+	stats.overrides++;
+	cache_unlock();
+	return (res);
+    }
+
+    ttl = get_ttl();
+    now = net_monotonic_ms();
+
+    cache_lock();
+    if (ttl > 0 && (res = cache_get(host, port, now)) != NULL) {
+	stats.hits++;
+	cache_unlock();
+	return (res);
+    }
+    stats.misses++;
+    cache_unlock();
+
+    /* Don't hold the lock during the (slow) lookup */
+    if ((res = resolve(host, port, AI_CANONNAME)) != NULL && ttl > 0) {
+	cache_lock();
+	cache_put(host, port, res, now + ttl * 1000ULL);
+	cache_unlock();
+    }
+
+    return (res);
+}
+
+/**
+ * Forget everything that's cached
+ */
+void
+resolver_flush(void)
+{
+    struct resolver_entry *entry;
+
+    cache_lock();
+    for (entry = &cache[0]; entry < &cache[ARRAY_SIZE(cache)]; entry++)
+	entry_clear(entry);
+    cache_unlock();
+}
+
+void
+resolver_get_stats(struct resolver_stats *out)
+{
+    cache_lock();
+    *out = stats;
+    cache_unlock();
+}
@@ -0,0 +1,19 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#define RESOLVER_CACHE_SIZE 16
+
+struct resolver_stats {
+    unsigned long int hits;
+    unsigned long int misses;
+    unsigned long int overrides;
+};
+
+/*lint -sem(resolver_lookup, r_null) */
+
+struct addrinfo	*resolver_lookup (const char *host, const char *port);
+void		 resolver_flush  (void);
+void		 resolver_free   (struct addrinfo *);
+void		 resolver_get_stats(struct resolver_stats *);
+
+#endif
@@ -0,0 +1,361 @@
+/* Disk-spilled scrollback
+   Copyright (C) 2018 Markus Uhlin. All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   - Neither the name of the author nor the names of its contributors may be
+     used to endorse or promote products derived from this software without
+     specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+   BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+#include "common.h"
+
+#if defined(UNIX)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "errHand.h"
+#include "libUtils.h"
+#include "scrollback.h"
+#include "strHand.h"
+#include "strdup_printf.h"
+
+#define SEGMENT_LINES 4096
+
+/*
+ * A segment file is a sequence of records: a header followed by the
+ * text of the line and its terminating null byte. Records aren't
+ * aligned, so headers are copied out of the mapping.
+ */
+struct record_header {
+    int32_t	indent;
+    uint32_t	len;		/* of the text, including the null byte */
+};
+
+struct scrollback {
+    char	*prefix;	/* path of the segment files, without number */
+    FILE	*fp;		/* the segment being written, or NULL */
+    int		 count;		/* number of lines */
+
+    int		 map_segno;	/* the mapped segment, or -1 */
+    int		 map_lines;
+    void	*map_addr;
+    size_t	 map_len;
+    uint32_t	 offset[SEGMENT_LINES]; /* of the records in the mapping */
+};
+
+/*
+ * The files of a window are named after the process and the window
+ * label. Characters that don't belong in a filename are hex-encoded,
+ * so different labels get different names.
+ */
+struct scrollback *
+scrollback_new(const char *dir, const char *label)
+{
+#if defined(UNIX)
+    static const char hexdigits[] = "0123456789abcdef";
+    struct scrollback *sb;
+    char *name, *cp;
+
+    if (dir == NULL || label == NULL)
+	return NULL;
+
+    name = cp = xmalloc(strlen(label) * 3 + 1);
+    for (const char *lp = label; *lp; lp++) {
+	const unsigned char c = *lp;
+
+	if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+	    (c >= '0' && c <= '9') || c == '-') {
+	    *cp++ = c;
+	} else {
+	    *cp++ = '_';
+	    *cp++ = hexdigits[c >> 4];
+	    *cp++ = hexdigits[c & 0xf];
+	}
+    }
+    *cp = '\0';
+
+    sb = xcalloc(sizeof *sb, 1);
+    sb->prefix = Strdup_printf("%s/%ld-%s.", dir, (long int) getpid(), name);
+    sb->fp = NULL;
+    sb->count = 0;
+    sb->map_segno = -1;
+    sb->map_lines = 0;
+    sb->map_addr = NULL;
+    sb->map_len = 0;
+    free(name);
+    return sb;
+#else
+    /* Not implemented for WIN32: trimmed lines are dropped */
+    (void) dir;
+    (void) label;
+    return NULL;
+#endif
+}
+
+#if defined(UNIX)
+static char *
+segment_path(const struct scrollback *sb, int segno)
+{
+    return Strdup_printf("%s%d", sb->prefix, segno);
+}
+
+static void
+unmap_segment(struct scrollback *sb)
+{
+    if (sb->map_addr != NULL)
+	(void) munmap(sb->map_addr, sb->map_len);
+    sb->map_segno = -1;
+    sb->map_lines = 0;
+    sb->map_addr = NULL;
+    sb->map_len = 0;
+}
+
+/*
+ * Map a segment and find its records. The segment that's being
+ * written is flushed first, and mapped again when it has grown.
+ */
+static int
+map_segment(struct scrollback *sb, int segno)
+{
+    char		*path;
+    int			 fd;
+    size_t		 off = 0;
+    struct record_header hdr;
+    struct stat		 st;
+    void		*addr;
+
+    unmap_segment(sb);
+
+    if (sb->fp != NULL && segno == sb->count / SEGMENT_LINES &&
+	fflush(sb->fp) != 0)
+	return errno;
+
+    path = segment_path(sb, segno);
+    fd = open(path, O_RDONLY);
+    free(path);
+
+    if (fd < 0)
+	return errno;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+	const int error = (errno != 0 ? errno : EIO);
+
+	(void) close(fd);
+	return error;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    (void) close(fd);
+
+    if (addr == MAP_FAILED)
+	return errno;
+
+    sb->map_segno = segno;
+    sb->map_addr = addr;
+    sb->map_len = st.st_size;
+
+    while (sb->map_lines < SEGMENT_LINES && off + sizeof hdr <= sb->map_len) {
+	const char *rec = (const char *) addr + off;
+
+	memcpy(&hdr, rec, sizeof hdr);
+	if (hdr.len == 0 || hdr.len > sb->map_len - off - sizeof hdr ||
+	    rec[sizeof hdr + hdr.len - 1] != '\0')
+	    break;
+	sb->offset[sb->map_lines++] = off;
+	off += sizeof hdr + hdr.len;
+    }
+
+    return 0;
+}
+#endif
+
+/*
+ * Unmap and remove the segment files
+ */
+void
+scrollback_destroy(struct scrollback *sb)
+{
+#if defined(UNIX)
+    if (sb == NULL)
+	return;
+
+    unmap_segment(sb);
+    if (sb->fp != NULL)
+	(void) fclose(sb->fp);
+
+    for (int segno = 0; segno <= sb->count / SEGMENT_LINES; segno++) {
+	char *path = segment_path(sb, segno);
+
+	(void) unlink(path);
+	free(path);
+    }
+
+    free(sb->prefix);
+    free(sb);
+#else
+    (void) sb;
+#endif
+}
+
+/*
+ * Append a line to the last segment, starting a new one when it's
+ * full
+ */
+int
+scrollback_append(struct scrollback *sb, const char *text, int indent)
+{
+#if defined(UNIX)
+    struct record_header hdr;
+
+    if (sb == NULL || text == NULL)
+	return EINVAL;
+
+    if (sb->fp == NULL) {
+	char *path = segment_path(sb, sb->count / SEGMENT_LINES);
+	const int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC,
+	    S_IRUSR | S_IWUSR);
+
+	free(path);
+	if (fd < 0)
+	    return errno;
+	if ((sb->fp = fdopen(fd, "wb")) == NULL) {
+	    const int error = errno;
+
+	    (void) close(fd);
+	    return error;
+	}
+    }
+
+    hdr.indent = indent;
+    hdr.len = strlen(text) + 1;
+
+    errno = 0;
+    if (fwrite(&hdr, sizeof hdr, 1, sb->fp) != 1 ||
+	fwrite(text, hdr.len, 1, sb->fp) != 1)
+	return (errno != 0 ? errno : EIO);
+
+    if (++(sb->count) % SEGMENT_LINES == 0) {
+	const int error = (fclose(sb->fp) != 0 ? errno : 0);
+
+	sb->fp = NULL;
+	return error;
+    }
+
+    return 0;
+#else
+    (void) sb;
+    (void) text;
+    (void) indent;
+    return ENOSYS;
+#endif
+}
+
+int
+scrollback_count(const struct scrollback *sb)
+{
+    return (sb != NULL ? sb->count : 0);
+}
+
+/*
+ * Get line 'n', counted from the first line that was appended. The
+ * text is in the mapping of its segment, and stays valid until a line
+ * of another segment is asked for.
+ */
+const char *
+scrollback_get(struct scrollback *sb, int n, int *indent)
+{
+#if defined(UNIX)
+    const int		 segno = n / SEGMENT_LINES;
+    const int		 k = n % SEGMENT_LINES;
+    const char		*rec;
+    struct record_header hdr;
+
+    if (sb == NULL || n < 0 || n >= sb->count)
+	return NULL;
+
+    if (segno != sb->map_segno || k >= sb->map_lines) {
+	if ((errno = map_segment(sb, segno)) != 0) {
+	    err_log(errno, "scrollback_get: %s%d", sb->prefix, segno);
+	    return NULL;
+	} else if (k >= sb->map_lines) {
+	    return NULL;
+	}
+    }
+
+    rec = (const char *) sb->map_addr + sb->offset[k];
+    memcpy(&hdr, rec, sizeof hdr);
+
+    if (indent)
+	*indent = hdr.indent;
+    return (rec + sizeof hdr);
+#else
+    (void) sb;
+    (void) n;
+    (void) indent;
+    return NULL;
+#endif
+}
+
+/*
+ * Remove segment files left behind by processes that have exited
+ * without cleaning up after themselves
+ */
+void
+scrollback_remove_stale(const char *dir)
+{
+#if defined(UNIX)
+    DIR *dirp;
+    struct dirent *dp;
+
+    if (dir == NULL || (dirp = opendir(dir)) == NULL)
+	return;
+
+    while ((dp = readdir(dirp)) != NULL) {
+	char *ep;
+	const long int pid = strtol(dp->d_name, &ep, 10);
+
+	if (ep == dp->d_name || *ep != '-' || pid <= 0)
+	    continue;
+	if (kill((pid_t) pid, 0) != 0 && errno == ESRCH) {
+	    char *path = Strdup_printf("%s/%s", dir, dp->d_name);
+
+	    (void) unlink(path);
+	    free(path);
+	}
+    }
+
+    (void) closedir(dirp);
+#else
+    (void) dir;
+#endif
+}
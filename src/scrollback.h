@@ -0,0 +1,21 @@
+#ifndef SCROLLBACK_H
+#define SCROLLBACK_H
+
+/*
+ * Lines trimmed from the head of a window's text buffer are appended
+ * to segment files on disk, and mapped back into memory one segment
+ * at a time when the window is scrolled that far back.
+ */
+struct scrollback;
+
+/*lint -sem(scrollback_new, r_null) */
+/*lint -sem(scrollback_get, r_null) */
+
+struct scrollback	*scrollback_new         (const char *dir, const char *label);
+void			 scrollback_destroy     (struct scrollback *);
+int			 scrollback_append      (struct scrollback *, const char *text, int indent);
+int			 scrollback_count       (const struct scrollback *);
+const char		*scrollback_get         (struct scrollback *, int n, int *indent);
+void			 scrollback_remove_stale(const char *dir);
+
+#endif
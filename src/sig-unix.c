@@ -6,7 +6,6 @@
 #include <time.h>
 
 #include "errHand.h"
-#include "network.h"		/* g_connection_in_progress */
 #include "readline.h"		/* MY_KEY_RESIZE */
 #include "sig.h"
 
@@ -49,7 +48,7 @@ signal_handler(int signum)
 
     switch (signum) {
     case SIGWINCH:
-	if (nanosleep(&ts, NULL) == 0 && !g_connection_in_progress)
+	if (nanosleep(&ts, NULL) == 0)
 	    (void) unget_wch(MY_KEY_RESIZE);
 	return;
     default:
@@ -33,9 +33,11 @@
 #include "curses-funcs.h" /* is_scrollok() */
 #endif
 
+#include "colorPairs.h"
 #include "cursesInit.h"
 #include "dataClassify.h"
 #include "irc.h"
+#include "network.h"
 #include "printtext.h"
 #include "statusbar.h"
 #include "strHand.h"
@@ -61,8 +63,8 @@ get_pair_num()
     short int fg, bg;
     short int pair_n;
 
-    fg = theme_color_unparse("statusbar_fg", COLOR_WHITE);
-    bg = theme_color_unparse("statusbar_bg", COLOR_BLACK);
+    fg = theme_current()->statusbar_fg;
+    bg = theme_current()->statusbar_bg;
 
     if ((pair_n = color_pair_find(fg, bg)) != -1) {
 	return pair_n;
@@ -115,7 +117,7 @@ get_chanmodes()
 
     if ((win = g_active_window) != NULL) {
 	if (Strings_match_ignore_case(win->label, g_status_window_label)) {
-	    sw_strcpy(buf, Theme("slogan"), sizeof buf);
+	    sw_strcpy(buf, theme_current()->slogan, sizeof buf);
 	} else if (is_irc_channel(win->label)) {
 	    (void) sw_strcpy(buf, win->label, sizeof buf);
 	    (void) sw_strcat(buf, "(", sizeof buf);
@@ -129,6 +131,47 @@ get_chanmodes()
     return (&buf[0]);
 }
 
+/*
+ * Lines held back by the flood control (if any)
+ */
+static char *
+get_sendq_depth()
+{
+    static char buf[100];
+    const int depth = net_send_queue_depth();
+
+    BZERO(buf, sizeof buf);
+
+    if (depth > 0) {
+	sw_snprintf(buf, sizeof buf, "%sSendQ: %d%s ",
+	    theme_current()->statusbar_leftBracket, depth,
+	    theme_current()->statusbar_rightBracket);
+    }
+
+    return (&buf[0]);
+}
+
+/*
+ * Windows with lines that haven't been seen
+ */
+static char *
+get_activity()
+{
+    static char buf[100];
+    char refnums[80];
+
+    BZERO(buf, sizeof buf);
+    window_list_unread(refnums, sizeof refnums);
+
+    if (*refnums) {
+	sw_snprintf(buf, sizeof buf, "%sAct: %s%s ",
+	    theme_current()->statusbar_leftBracket, refnums,
+	    theme_current()->statusbar_rightBracket);
+    }
+
+    return (&buf[0]);
+}
+
 void
 statusbar_update_display_beta(void)
 {
@@ -137,14 +180,16 @@ statusbar_update_display_beta(void)
     WINDOW     *win    = panel_window(statusbar_pan);
     chtype      blank  = ' ';
     short int   pair_n = get_pair_num();
-    const char *lb     = Theme("statusbar_leftBracket");
-    const char *rb     = Theme("statusbar_rightBracket");
+    const char *lb     = theme_current()->statusbar_leftBracket;
+    const char *rb     = theme_current()->statusbar_rightBracket;
     char       *out_s  = Strdup_printf(
-	"%s %s%d/%d%s %s%s%s %s%s%s %s",
-	Theme("statusbar_spec"),
+	"%s %s%d/%d%s %s%s%s %s%s%s %s%s%s",
+	theme_current()->statusbar_spec,
 	lb, g_active_window->refnum, g_ntotal_windows, rb,
 	lb, get_nick_and_server(), rb,
 	lb, get_chanmodes(), rb,
+	get_sendq_depth(),
+	get_activity(),
 	g_active_window->scroll_mode ? "-- MORE --" : "");
 
     WERASE(win);
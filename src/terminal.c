@@ -29,8 +29,10 @@
 
 #include "common.h"
 
+#include "config.h"
 #include "errHand.h"
 #include "main.h"
+#include "network.h"		/* net_monotonic_ms() */
 #include "readline.h"
 #include "statusbar.h"
 #include "terminal.h"
@@ -39,6 +41,34 @@
 
 static const short int TermMinimumRows = 6;
 static const short int TermMinimumCols = 12;
+static const int       TermMinimumWait = 10; /* ms */
+
+/*
+ * Refresh scheduler. Producers call term_request_update() instead of
+ * update_panels() and doupdate(): the first update of a frame is
+ * written to the terminal at once, the remaining ones are coalesced
+ * and flushed by term_flush_update() from the readline loop, which
+ * sleeps no longer than term_update_wait() between flushes. Guarded
+ * by g_puts_mutex.
+ */
+static bool			update_pending = false;
+static unsigned long long	last_frame_at  = 0;
+static unsigned int		frame_interval = 33;
+static struct term_refresh_stats refresh_stats = { 0, 0 };
+
+/**
+ * Write the virtual screen to the terminal
+ */
+static void
+do_frame(unsigned long long now)
+{
+    update_panels();
+    (void) doupdate();
+
+    update_pending = false;
+    last_frame_at = now;
+    refresh_stats.frames++;
+}
 
 void
 term_init(void)
@@ -47,6 +77,87 @@ term_init(void)
 		   g_swircVersion, g_swircYear, g_swircAuthor);
 }
 
+/**
+ * Read the frame rate setting. Called once the config is read.
+ */
+void
+term_refresh_init(void)
+{
+    frame_interval = 1000 / config_current()->frame_rate;
+}
+
+/**
+ * Request that the screen is updated. The update is performed at once
+ * if a frame is due, otherwise it's coalesced with the next frame.
+ */
+void
+term_request_update(void)
+{
+    const unsigned long long now = net_monotonic_ms();
+
+    if (now - last_frame_at >= frame_interval) {
+	do_frame(now);
+    } else {
+	if (update_pending)
+	    refresh_stats.coalesced++;
+	update_pending = true;
+    }
+}
+
+/**
+ * Flush a pending update
+ *
+ * @param immediate If true: don't wait for the frame to be due, and
+ *                  update the screen even if nothing is pending (used
+ *                  after keyboard input)
+ * @return Void
+ */
+void
+term_flush_update(bool immediate)
+{
+    const unsigned long long now = net_monotonic_ms();
+
+    if (immediate ||
+	(update_pending && now - last_frame_at >= frame_interval))
+	do_frame(now);
+}
+
+/**
+ * Get how long the readline loop may sleep before it flushes again:
+ * until a pending update is due, or a frame interval if none is
+ * pending (one may be requested meanwhile). Frame rates above 100 are
+ * only honored for the first update of a frame, since the loop doesn't
+ * sleep less than TermMinimumWait.
+ *
+ * @param max_ms Upper limit
+ * @return Milliseconds
+ */
+int
+term_update_wait(int max_ms)
+{
+    const unsigned long long now = net_monotonic_ms();
+    unsigned long long wait = frame_interval;
+
+    if (update_pending) {
+	wait = (now - last_frame_at >= frame_interval ? 0 :
+	    last_frame_at + frame_interval - now);
+    }
+
+    if (wait < (unsigned long long) TermMinimumWait)
+	wait = TermMinimumWait;
+    return (wait < (unsigned long long) max_ms ? (int) wait : max_ms);
+}
+
+/**
+ * Get the number of frames written to the terminal, and the number
+ * of updates that were coalesced with another one
+ */
+void
+term_get_refresh_stats(struct term_refresh_stats *stats)
+{
+    *stats = refresh_stats;
+}
+
 void
 term_deinit(void)
 {
@@ -143,8 +254,7 @@ term_resize_all(void)
     windows_recreate_all(rows, cols);
     readline_recreate(rows, cols);
 
-    update_panels();
-    (void) doupdate();
+    term_flush_update(true);
 }
 
 struct current_cursor_pos
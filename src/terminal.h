@@ -19,6 +19,11 @@ struct current_cursor_pos {
     int curx; /* col */
 };
 
+struct term_refresh_stats {
+    unsigned long int frames;
+    unsigned long int coalesced;
+};
+
 PANEL	*term_new_panel(int rows, int cols, int start_row, int start_col);
 PANEL	*term_resize_panel(PANEL *, struct term_window_size *);
 
@@ -26,8 +31,13 @@ struct current_cursor_pos term_get_pos(WINDOW *);
 
 void    term_beep(void);
 void    term_deinit(void);
+void    term_flush_update(bool immediate);
+void    term_get_refresh_stats(struct term_refresh_stats *);
 void    term_init(void);
+void    term_refresh_init(void);
 void    term_remove_panel(PANEL *);
+void    term_request_update(void);
 void    term_resize_all(void);
+int     term_update_wait(int max_ms);
 
 #endif
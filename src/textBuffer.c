@@ -1,11 +1,81 @@
-/* Text storage with help of a linked list algorithm. ISBN: 978-1-56592-453-6 */
+/* Text storage in a ring of fixed-size blocks
+
+   Each block holds TEXTBUF_BLOCK_LINES line records, and the text of
+   its lines in arena chunks that are freed together with the block.
+   Lines are added at the ends and removed from the ends, so all blocks
+   but the first and the last one are full, and a line is found by its
+   position without walking the buffer.
+
+   Lines removed from the head can be spilled to a scrollback store on
+   disk. They keep their line numbers, so a line that is scrolled to
+   is found whether it's in memory or not.
+
+   Blocks of a buffer with compression on are frozen when they get
+   cold: their lines are compressed with zlib, and their records and
+   arena are freed. The first block and the last TEXTBUF_HOT_BLOCKS
+   are never frozen, so the ends of the buffer are always in records,
+   and a block is thawed when it becomes the first or the last one.
+   Lines of frozen blocks are read through a small cache of
+   decompressed blocks, without thawing them. */
 
 #include "common.h"
+
+#include <zlib.h>
+
 #include "assertAPI.h"
 #include "errHand.h"
 #include "libUtils.h"
+#include "printtext.h"
+#include "scrollback.h"
 #include "strHand.h"
 #include "textBuffer.h"
+#include "textIndex.h"
+
+#define TEXTBUF_BLOCK_LINES	64
+#define TEXTBUF_ARENA_SIZE	8192
+#define TEXTBUF_HOT_BLOCKS	3
+#define TEXTBUF_CACHE_SIZE	4
+
+/* Bytes allocated for the records of a block */
+#define TEXTBUF_REC_BYTES	(TEXTBUF_BLOCK_LINES * sizeof (TEXTBUF_ELMT))
+
+struct textbuf_arena {
+    struct textbuf_arena	*next;
+    size_t			 size;
+    size_t			 used;
+    char			 data[];
+};
+
+struct textbuf_block {
+    int			 first;	/* slot of the first record in use */
+    int			 count;	/* number of records in use */
+    struct textbuf_arena *arena;
+    TEXTBUF_ELMT	*rec;	/* TEXTBUF_BLOCK_LINES records, or NULL */
+
+    /*
+     * While frozen: the lines, each an int indent, a byte that is 1
+     * if the line is indexed, and the text, compressed
+     */
+    unsigned long int	 serial; /* identifies it in the cache */
+    unsigned char	*zdata;
+    size_t		 zlen;
+    size_t		 rawlen;
+};
+
+/*
+ * Decompressed frozen blocks
+ */
+static struct textbuf_cache_entry {
+    unsigned long int	 serial; /* of the block, or 0 if unused */
+    unsigned int	 used;	 /* when it was last used */
+    char		*data;
+    const char		*text[TEXTBUF_BLOCK_LINES];
+    int			 indent[TEXTBUF_BLOCK_LINES];
+    bool		 indexed[TEXTBUF_BLOCK_LINES];
+} cache[TEXTBUF_CACHE_SIZE];
+
+static unsigned int	 cache_clock = 0;
+static unsigned long int last_serial = 0;
 
 PTEXTBUF
 textBuf_new(void)
@@ -16,56 +86,500 @@ textBuf_new(void)
     buf->head = NULL;
     buf->tail = NULL;
 
+    buf->blocks      = NULL;
+    buf->nblocks     = 0;
+    buf->first_block = 0;
+    buf->used_blocks = 0;
+
+    buf->bytes    = 0;
+    buf->trimmed  = 0;
+    buf->spill    = NULL;
+    buf->compress = false;
+    buf->index    = NULL;
+
     return buf;
 }
 
+static SW_INLINE struct textbuf_block *
+block_at(PTEXTBUF buf, int n)
+{
+    return (buf->blocks[(buf->first_block + n) % buf->nblocks]);
+}
+
+static void
+cache_drop(const struct textbuf_block *block)
+{
+    struct textbuf_cache_entry *entry;
+
+    if (block->serial == 0)
+	return;
+
+    for (entry = &cache[0]; entry < &cache[TEXTBUF_CACHE_SIZE]; entry++) {
+	if (entry->serial == block->serial) {
+	    free_and_null(&entry->data);
+	    entry->serial = 0;
+	    entry->used = 0;
+	}
+    }
+}
+
+/*
+ * Free the arena chunks of a block
+ */
+static void
+arena_free(PTEXTBUF buf, struct textbuf_block *block)
+{
+    struct textbuf_arena *arena, *next;
+
+    for (arena = block->arena; arena != NULL; arena = next) {
+	next = arena->next;
+	buf->bytes -= sizeof *arena + arena->size;
+	free(arena);
+    }
+    block->arena = NULL;
+}
+
+/*
+ * Free the records of a block and the parsed lines in them
+ */
+static void
+rec_free(PTEXTBUF buf, struct textbuf_block *block)
+{
+    for (int slot = block->first; slot < block->first + block->count; slot++)
+	printtext_line_free(block->rec[slot].line);
+    free(block->rec);
+    block->rec = NULL;
+    buf->bytes -= TEXTBUF_REC_BYTES;
+}
+
+static void
+block_free(PTEXTBUF buf, struct textbuf_block *block)
+{
+    if (block->rec != NULL)
+	rec_free(buf, block);
+    arena_free(buf, block);
+
+    cache_drop(block);
+    if (block->zdata != NULL) {
+	free(block->zdata);
+	buf->bytes -= block->zlen;
+    }
+    buf->bytes -= sizeof *block;
+    free(block);
+}
+
 void
 textBuf_destroy(PTEXTBUF buf)
 {
-    while (textBuf_size(buf) > 0) {
-	if ((errno = textBuf_remove(buf, textBuf_tail(buf))) != 0) {
-	    err_sys("textBuf_remove() returned %d", errno);
+    for (int n = 0; n < buf->used_blocks; n++)
+	block_free(buf, block_at(buf, n));
+
+    scrollback_destroy(buf->spill);
+    textIndex_destroy(buf->index);
+    free_not_null(buf->blocks);
+    free_not_null(buf);
+}
+
+/*
+ * Spill lines removed from the head of the buffer to 'spill', which
+ * is destroyed with the buffer. Passing NULL is ok.
+ */
+void
+textBuf_spill_to(PTEXTBUF buf, struct scrollback *spill)
+{
+    scrollback_destroy(buf->spill);
+    buf->spill = spill;
+}
+
+/*
+ * Turn compression of cold blocks on or off. Blocks that have been
+ * frozen stay frozen until they're thawed.
+ */
+void
+textBuf_set_compress(PTEXTBUF buf, bool on)
+{
+    buf->compress = on;
+}
+
+/*
+ * Turn the trigram index of the lines on or off. The lines already
+ * in the buffer are indexed too, but not the spilled ones.
+ */
+void
+textBuf_index_lines(PTEXTBUF buf, bool on)
+{
+    textIndex_destroy(buf->index);
+    buf->index = NULL;
+
+    if (!on)
+	return;
+
+    buf->index = textIndex_new();
+
+    for (int num = buf->trimmed; num < textBuf_end_num(buf); num++) {
+	PTEXTBUF_ELMT element;
+	TEXTBUF_ELMT scratch;
+
+	if ((element = textBuf_get_line(buf, num, &scratch)) != NULL) {
+	    textIndex_add(buf->index, num, (element->indexed ? element->text :
+		""));
 	}
     }
+}
 
-    free_not_null(buf);
+/*
+ * Bytes allocated by the buffer: its blocks with their records and
+ * arena chunks (used or not), the compressed lines of frozen blocks,
+ * the parsed lines, and the index.
+ */
+size_t
+textBuf_bytes(PTEXTBUF buf)
+{
+    return (buf->bytes + textIndex_bytes(buf->index));
 }
 
-int
-textBuf_ins_next(PTEXTBUF buf, PTEXTBUF_ELMT element,
-		 const char *text, int indent)
+/*
+ * Save a line that is about to be removed from the head. If that
+ * fails the older lines can't be numbered right anymore, so the
+ * scrollback store is dropped.
+ */
+static void
+spill_line(PTEXTBUF buf, PTEXTBUF_ELMT element)
+{
+    if (buf->spill == NULL)
+	return;
+    if ((errno = scrollback_append(buf->spill, element->text,
+	element->indent)) != 0) {
+	err_log(errno, "textBuf: scrollback_append");
+	scrollback_destroy(buf->spill);
+	buf->spill = NULL;
+    }
+}
+
+/*
+ * Make room for another block in the ring
+ */
+static void
+ring_grow(PTEXTBUF buf)
+{
+    const int nblocks = (buf->nblocks > 0 ? buf->nblocks * 2 : 8);
+    struct textbuf_block **blocks = xcalloc(nblocks, sizeof *blocks);
+
+    for (int n = 0; n < buf->used_blocks; n++)
+	blocks[n] = block_at(buf, n);
+
+    free_not_null(buf->blocks);
+    buf->bytes      += (nblocks - buf->nblocks) * sizeof *blocks;
+    buf->blocks      = blocks;
+    buf->nblocks     = nblocks;
+    buf->first_block = 0;
+}
+
+static struct textbuf_block *
+block_new(PTEXTBUF buf, int first)
+{
+    struct textbuf_block *block = xcalloc(sizeof *block, 1);
+
+    block->first = first;
+    block->count = 0;
+    block->arena = NULL;
+    block->rec   = xcalloc(TEXTBUF_BLOCK_LINES, sizeof *block->rec);
+    buf->bytes  += sizeof *block + TEXTBUF_REC_BYTES;
+    return block;
+}
+
+/*
+ * Copy 'text' into the arena of 'block'
+ */
+static char *
+arena_strdup(PTEXTBUF buf, struct textbuf_block *block, const char *text)
+{
+    const size_t len = strlen(text) + 1;
+    struct textbuf_arena *arena = block->arena;
+    char *cp;
+
+    if (arena == NULL || arena->size - arena->used < len) {
+	const size_t size = (len > TEXTBUF_ARENA_SIZE ? len :
+	    TEXTBUF_ARENA_SIZE);
+
+	arena = xmalloc(sizeof *arena + size);
+	arena->next = block->arena;
+	arena->size = size;
+	arena->used = 0;
+	block->arena = arena;
+	buf->bytes += sizeof *arena + size;
+    }
+
+    cp = &arena->data[arena->used];
+    memcpy(cp, text, len);
+    arena->used += len;
+    return cp;
+}
+
+static PTEXTBUF_ELMT
+record_init(PTEXTBUF buf, struct textbuf_block *block, int slot,
+	    const char *text, int indent)
+{
+    PTEXTBUF_ELMT element = &block->rec[slot];
+
+    element->text   = arena_strdup(buf, block, text);
+    element->indent = indent;
+    element->indexed = true;
+    element->line   = NULL;
+    element->prev   = NULL;
+    element->next   = NULL;
+    return element;
+}
+
+/*
+ * Add a line after the last one
+ */
+static PTEXTBUF_ELMT
+append(PTEXTBUF buf, const char *text, int indent)
+{
+    struct textbuf_block *block = (buf->used_blocks > 0 ?
+	block_at(buf, buf->used_blocks - 1) : NULL);
+
+    if (block == NULL || block->first + block->count == TEXTBUF_BLOCK_LINES) {
+	if (buf->used_blocks == buf->nblocks)
+	    ring_grow(buf);
+	block = block_new(buf, 0);
+	buf->blocks[(buf->first_block + buf->used_blocks) % buf->nblocks] =
+	    block;
+	buf->used_blocks++;
+    }
+
+    block->count++;
+    return record_init(buf, block, block->first + block->count - 1, text,
+	indent);
+}
+
+/*
+ * Add a line before the first one
+ */
+static PTEXTBUF_ELMT
+prepend(PTEXTBUF buf, const char *text, int indent)
+{
+    struct textbuf_block *block = (buf->used_blocks > 0 ?
+	block_at(buf, 0) : NULL);
+
+    if (block == NULL || block->first == 0) {
+	if (buf->used_blocks == buf->nblocks)
+	    ring_grow(buf);
+	block = block_new(buf, TEXTBUF_BLOCK_LINES);
+	buf->first_block = (buf->first_block + buf->nblocks - 1) %
+	    buf->nblocks;
+	buf->blocks[buf->first_block] = block;
+	buf->used_blocks++;
+    }
+
+    block->first--;
+    block->count++;
+    return record_init(buf, block, block->first, text, indent);
+}
+
+static SW_INLINE PTEXTBUF_ELMT
+first_rec(struct textbuf_block *block)
+{
+    if (block->rec == NULL || block->count == 0)
+	return NULL;
+    return (&block->rec[block->first]);
+}
+
+static SW_INLINE PTEXTBUF_ELMT
+last_rec(struct textbuf_block *block)
+{
+    if (block->rec == NULL || block->count == 0)
+	return NULL;
+    return (&block->rec[block->first + block->count - 1]);
+}
+
+/*
+ * Decompress the lines of a frozen block into 'raw', which must be
+ * 'block->rawlen' bytes
+ */
+static void
+block_decompress(const struct textbuf_block *block, char *raw)
+{
+    uLongf rawlen = block->rawlen;
+
+    if (uncompress((Bytef *) raw, &rawlen, block->zdata, block->zlen) !=
+	Z_OK || rawlen != block->rawlen)
+	err_quit("textBuf: cannot decompress block");
+}
+
+/*
+ * Compress the lines of block 'n' and free its records. Blocks that
+ * don't compress are left as they are.
+ */
+static void
+block_freeze(PTEXTBUF buf, int n)
+{
+    struct textbuf_block	*block = block_at(buf, n);
+    PTEXTBUF_ELMT		 element;
+    char			*raw, *cp;
+    size_t			 rawlen = 0;
+    uLongf			 zlen;
+
+    if (block->rec == NULL || block->count == 0)
+	return;
+
+    for (int slot = block->first; slot < block->first + block->count; slot++)
+	rawlen += sizeof (int) + 1 + strlen(block->rec[slot].text) + 1;
+
+    raw = cp = xmalloc(rawlen);
+    for (int slot = block->first; slot < block->first + block->count; slot++) {
+	const size_t len = strlen(block->rec[slot].text) + 1;
+
+	memcpy(cp, &block->rec[slot].indent, sizeof (int));
+	cp += sizeof (int);
+	*cp++ = (block->rec[slot].indexed ? 1 : 0);
+	memcpy(cp, block->rec[slot].text, len);
+	cp += len;
+    }
+
+    zlen = compressBound(rawlen);
+    block->zdata = xmalloc(zlen);
+
+    if (compress2(block->zdata, &zlen, (const Bytef *) raw, rawlen,
+	Z_BEST_SPEED) != Z_OK || zlen >= rawlen) {
+	free(raw);
+	free(block->zdata);
+	block->zdata = NULL;
+	return;
+    }
+
+    free(raw);
+    block->zdata  = xrealloc(block->zdata, zlen);
+    block->zlen   = zlen;
+    block->rawlen = rawlen;
+    block->serial = ++last_serial;
+    buf->bytes   += zlen;
+
+    if (n > 0 && (element = last_rec(block_at(buf, n - 1))) != NULL)
+	element->next = NULL;
+    if (n + 1 < buf->used_blocks &&
+	(element = first_rec(block_at(buf, n + 1))) != NULL)
+	element->prev = NULL;
+
+    rec_free(buf, block);
+    arena_free(buf, block);
+}
+
+/*
+ * Decompress the lines of block 'n' back into records
+ */
+static void
+block_thaw(PTEXTBUF buf, int n)
+{
+    struct textbuf_block	*block = block_at(buf, n);
+    PTEXTBUF_ELMT		 element, prev = NULL;
+    char			*raw, *cp;
+
+    if (block->rec != NULL)
+	return;
+
+    raw = cp = xmalloc(block->rawlen);
+    block_decompress(block, raw);
+    block->rec = xcalloc(TEXTBUF_BLOCK_LINES, sizeof *block->rec);
+    buf->bytes += TEXTBUF_REC_BYTES;
+
+    for (int slot = block->first; slot < block->first + block->count; slot++) {
+	int indent;
+	bool indexed;
+
+	memcpy(&indent, cp, sizeof indent);
+	cp += sizeof indent;
+	indexed = (*cp++ != 0);
+	element = record_init(buf, block, slot, cp, indent);
+	element->indexed = indexed;
+	cp += strlen(cp) + 1;
+
+	if ((element->prev = prev) != NULL)
+	    prev->next = element;
+	prev = element;
+    }
+
+    free(raw);
+
+    if (n > 0 && (element = last_rec(block_at(buf, n - 1))) != NULL) {
+	element->next = first_rec(block);
+	first_rec(block)->prev = element;
+    }
+    if (n + 1 < buf->used_blocks &&
+	(element = first_rec(block_at(buf, n + 1))) != NULL) {
+	element->prev = last_rec(block);
+	last_rec(block)->next = element;
+    }
+
+    cache_drop(block);
+    free(block->zdata);
+    block->zdata = NULL;
+    block->serial = 0;
+    buf->bytes -= block->zlen;
+    block->zlen = 0;
+}
+
+static int
+ins_next(PTEXTBUF buf, PTEXTBUF_ELMT element, const char *text, int indent,
+	 bool indexed)
 {
     PTEXTBUF_ELMT new_element;
 
     if (buf == NULL || text == NULL || (element == NULL && textBuf_size(buf) != 0)) {
 	return EINVAL;
+    } else if (element != NULL && element != buf->tail) {
+	return EINVAL;
     }
 
-    new_element         = xcalloc(sizeof *new_element, 1);
-    new_element->text   = sw_strdup(text);
-    new_element->indent = indent;
+    new_element = append(buf, text, indent);
+    new_element->indexed = indexed;
 
     if (textBuf_size(buf) == 0) {
-	buf->head       = new_element;
-	buf->head->prev = NULL;
-	buf->head->next = NULL;
-	buf->tail       = new_element;
+	buf->head = new_element;
+	buf->tail = new_element;
     } else {
-	sw_assert(element != NULL);
-	new_element->next = element->next;
-	new_element->prev = element;
-	if (element->next == NULL) {
-	    buf->tail = new_element;
-	} else {
-	    element->next->prev = new_element;
-	}
-	element->next = new_element;
+	new_element->prev = buf->tail;
+	buf->tail->next   = new_element;
+	buf->tail         = new_element;
     }
 
     (buf->size)++;
+    textIndex_add(buf->index, textBuf_end_num(buf) - 1, (indexed ? text :
+	""));
+
+    /* A block was started: freeze the one that just got cold */
+    if (buf->compress && block_at(buf, buf->used_blocks - 1)->count == 1 &&
+	buf->used_blocks >= TEXTBUF_HOT_BLOCKS + 2)
+	block_freeze(buf, buf->used_blocks - 1 - TEXTBUF_HOT_BLOCKS);
+
     return 0;
 }
 
+/*
+ * Lines can only be inserted at the ends of the buffer: after the
+ * last one (textBuf_ins_next) or before the first one
+ * (textBuf_ins_prev). EINVAL is returned for other positions.
+ */
+int
+textBuf_ins_next(PTEXTBUF buf, PTEXTBUF_ELMT element,
+		 const char *text, int indent)
+{
+    return ins_next(buf, element, text, indent, true);
+}
+
+/*
+ * Like textBuf_ins_next(), but the line is left out of the index, and
+ * its 'indexed' is false so that it's skipped by searches that don't
+ * use the index either
+ */
+int
+textBuf_ins_next_unindexed(PTEXTBUF buf, PTEXTBUF_ELMT element,
+			   const char *text, int indent)
+{
+    return ins_next(buf, element, text, indent, false);
+}
+
 int
 textBuf_ins_prev(PTEXTBUF buf, PTEXTBUF_ELMT element,
 		 const char *text, int indent)
@@ -74,78 +588,217 @@ textBuf_ins_prev(PTEXTBUF buf, PTEXTBUF_ELMT element,
 
     if (buf == NULL || text == NULL || (element == NULL && textBuf_size(buf) != 0)) {
 	return EINVAL;
+    } else if (element != NULL && element != buf->head) {
+	return EINVAL;
     }
 
-    new_element         = xcalloc(sizeof *new_element, 1);
-    new_element->text   = sw_strdup(text);
-    new_element->indent = indent;
+    new_element = prepend(buf, text, indent);
+
+    /* The lines get renumbered */
+    textBuf_index_lines(buf, false);
 
     if (textBuf_size(buf) == 0) {
-	buf->head       = new_element;
-	buf->head->prev = NULL;
-	buf->head->next = NULL;
-	buf->tail       = new_element;
+	buf->head = new_element;
+	buf->tail = new_element;
     } else {
-	sw_assert(element != NULL);
-	new_element->next = element;
-	new_element->prev = element->prev;
-	if (element->prev == NULL) {
-	    buf->head = new_element;
-	} else {
-	    element->prev->next = new_element;
-	}
-	element->prev = new_element;
+	new_element->next = buf->head;
+	buf->head->prev   = new_element;
+	buf->head         = new_element;
     }
 
     (buf->size)++;
     return 0;
 }
 
+/*
+ * Only the first and the last line can be removed. A block is freed
+ * when its last line is removed, and the block that takes its place
+ * at the end is thawed.
+ */
 int
 textBuf_remove(PTEXTBUF buf, PTEXTBUF_ELMT element)
 {
+    struct textbuf_block *block;
+
     if (buf == NULL || element == NULL || textBuf_size(buf) == 0) {
 	return EINVAL;
     }
 
     if (element == buf->head) {
-	buf->head = element->next;
+	block = block_at(buf, 0);
+	sw_assert(element == &block->rec[block->first]);
+
+	textIndex_remove(buf->index, buf->trimmed);
+	spill_line(buf, element);
+	buf->trimmed++;
+
+	block->first++;
+	block->count--;
+
+	if (block->count == 0) {
+	    buf->first_block = (buf->first_block + 1) % buf->nblocks;
+	    if (--(buf->used_blocks) > 0)
+		block_thaw(buf, 0);
+	} else {
+	    block = NULL;
+	}
+
+	buf->head = (buf->used_blocks > 0 ? first_rec(block_at(buf, 0)) :
+	    NULL);
 	if (buf->head == NULL) {
 	    buf->tail = NULL;
 	} else {
-	    element->next->prev = NULL;
+	    buf->head->prev = NULL;
 	}
-    } else {
-	element->prev->next = element->next;
-	if (element->next == NULL) {
-	    buf->tail = element->prev;
+    } else if (element == buf->tail) {
+	block = block_at(buf, buf->used_blocks - 1);
+	sw_assert(element == &block->rec[block->first + block->count - 1]);
+
+	textIndex_remove(buf->index, textBuf_end_num(buf) - 1);
+	block->count--;
+
+	if (block->count == 0) {
+	    if (--(buf->used_blocks) > 0)
+		block_thaw(buf, buf->used_blocks - 1);
 	} else {
-	    element->next->prev = element->prev;
+	    block = NULL;
 	}
+
+	buf->tail = last_rec(block_at(buf, buf->used_blocks - 1));
+	buf->tail->next = NULL;
+    } else {
+	return EINVAL;
     }
 
-    free_not_null(element->text);
-    free_not_null(element);
+    printtext_line_free(element->line);
+    element->line = NULL;
+    element->text = NULL;
+
+    if (block != NULL)
+	block_free(buf, block);
 
     (buf->size)--;
     return 0;
 }
 
+/*
+ * Attach the parsed form of the text to a line. It's freed with the
+ * line, and its size (which changes as it's laid out) is counted in
+ * the bytes of the buffer.
+ */
+void
+textBuf_set_line(PTEXTBUF buf, PTEXTBUF_ELMT element,
+		 struct printtext_line *line)
+{
+    sw_assert(element->line == NULL);
+    element->line = line;
+    printtext_line_account(line, &buf->bytes);
+}
+
+/*
+ * Lines of frozen blocks have no records, so NULL is returned for
+ * them. See textBuf_get_line().
+ */
 PTEXTBUF_ELMT
 textBuf_get_element_by_pos(PTEXTBUF buf, int pos)
 {
-    int			i;
-    PTEXTBUF_ELMT	element;
+    int			 n;
+    struct textbuf_block *block;
+
+    if (buf == NULL || pos < 0 || pos >= textBuf_size(buf)) {
+	return NULL;		/* Invalid args or no such element */
+    }
+
+    n = block_at(buf, 0)->first + pos;
+    block = block_at(buf, n / TEXTBUF_BLOCK_LINES);
+    return (block->rec != NULL ? &block->rec[n % TEXTBUF_BLOCK_LINES] :
+	    NULL);
+}
+
+/*
+ * Number of the first line that can still be got
+ */
+int
+textBuf_first_num(PTEXTBUF buf)
+{
+    return (buf->trimmed - scrollback_count(buf->spill));
+}
+
+/*
+ * Get a decompressed frozen block from the cache
+ */
+static struct textbuf_cache_entry *
+cache_lookup(const struct textbuf_block *block)
+{
+    struct textbuf_cache_entry *entry, *victim = &cache[0];
+    char *cp;
+
+    for (entry = &cache[0]; entry < &cache[TEXTBUF_CACHE_SIZE]; entry++) {
+	if (entry->serial == block->serial) {
+	    entry->used = ++cache_clock;
+	    return entry;
+	} else if (entry->used < victim->used) {
+	    victim = entry;
+	}
+    }
+
+    free_not_null(victim->data);
+    victim->data = cp = xmalloc(block->rawlen);
+    block_decompress(block, victim->data);
 
-    if (buf == NULL || pos < 0) {
-	return NULL;		/* Invalid args */
+    for (int k = 0; k < block->count; k++) {
+	memcpy(&victim->indent[k], cp, sizeof (int));
+	cp += sizeof (int);
+	victim->indexed[k] = (*cp++ != 0);
+	victim->text[k] = cp;
+	cp += strlen(cp) + 1;
     }
 
-    for (i = 0, element = textBuf_head(buf); element != NULL; i++, element = element->next) {
-	if (i == pos) {		/* Element found */
-	    return element;
+    victim->serial = block->serial;
+    victim->used = ++cache_clock;
+    return victim;
+}
+
+/*
+ * Get a line by its number. Lines that have been spilled to disk, or
+ * are in frozen blocks, are read into 'scratch', which is valid until
+ * the next such line is got. Their text must not be modified.
+ */
+PTEXTBUF_ELMT
+textBuf_get_line(PTEXTBUF buf, int num, PTEXTBUF_ELMT scratch)
+{
+    const char *text;
+    int n;
+    struct textbuf_block *block;
+
+    if (buf == NULL || num < textBuf_first_num(buf) ||
+	num >= textBuf_end_num(buf)) {
+	return NULL;
+    } else if (num < buf->trimmed) {
+	text = scrollback_get(buf->spill, num - textBuf_first_num(buf),
+	    &scratch->indent);
+	if (text == NULL)
+	    return NULL;
+	scratch->indexed = true;
+    } else {
+	n = block_at(buf, 0)->first + num - buf->trimmed;
+	block = block_at(buf, n / TEXTBUF_BLOCK_LINES);
+	n %= TEXTBUF_BLOCK_LINES;
+
+	if (block->rec != NULL) {
+	    return (&block->rec[n]);
+	} else {
+	    const struct textbuf_cache_entry *entry = cache_lookup(block);
+
+	    text = entry->text[n - block->first];
+	    scratch->indent = entry->indent[n - block->first];
+	    scratch->indexed = entry->indexed[n - block->first];
 	}
     }
 
-    return NULL;		/* No match found */
+    scratch->text = (char *) text;
+    scratch->line = NULL;
+    scratch->prev = NULL;
+    scratch->next = NULL;
+    return scratch;
 }
@@ -1,27 +1,53 @@
 #ifndef TEXTBUFFER_H
 #define TEXTBUFFER_H
 
+struct printtext_line;
+
 typedef struct tagTEXTBUF_ELMT {
     char	*text;
     int		 indent;
+    bool	 indexed;	/* searched by /lastlog */
+    struct printtext_line *line; /* pre-parsed text, or NULL */
     struct tagTEXTBUF_ELMT *prev;
     struct tagTEXTBUF_ELMT *next;
 } TEXTBUF_ELMT, *PTEXTBUF_ELMT;
 
+struct textbuf_block;
+struct scrollback;
+struct text_index;
+
 typedef struct tagTEXTBUF {
     int			size;
     PTEXTBUF_ELMT	head;
     PTEXTBUF_ELMT	tail;
+    struct textbuf_block **blocks; /* ring of blocks */
+    int			nblocks;
+    int			first_block;
+    int			used_blocks;
+    size_t		bytes;       /* allocated for the lines */
+    int			trimmed;     /* lines removed from the head */
+    struct scrollback	*spill;      /* where they went, or NULL */
+    bool		compress;    /* freeze cold blocks */
+    struct text_index	*index;      /* of the lines, or NULL */
 } TEXTBUF, *PTEXTBUF;
 
 /*lint -sem(textBuf_get_element_by_pos, r_null) */
+/*lint -sem(textBuf_get_line, r_null) */
 
 PTEXTBUF	textBuf_new                (void);
 PTEXTBUF_ELMT	textBuf_get_element_by_pos (PTEXTBUF, int pos);
+PTEXTBUF_ELMT	textBuf_get_line           (PTEXTBUF, int num, PTEXTBUF_ELMT scratch);
+int		textBuf_first_num          (PTEXTBUF);
 int		textBuf_ins_next           (PTEXTBUF, PTEXTBUF_ELMT, const char *text, int indent);
+int		textBuf_ins_next_unindexed (PTEXTBUF, PTEXTBUF_ELMT, const char *text, int indent);
 int		textBuf_ins_prev           (PTEXTBUF, PTEXTBUF_ELMT, const char *text, int indent);
 int		textBuf_remove             (PTEXTBUF, PTEXTBUF_ELMT);
+size_t		textBuf_bytes              (PTEXTBUF);
 void		textBuf_destroy            (PTEXTBUF);
+void		textBuf_index_lines        (PTEXTBUF, bool on);
+void		textBuf_set_compress       (PTEXTBUF, bool on);
+void		textBuf_set_line           (PTEXTBUF, PTEXTBUF_ELMT, struct printtext_line *);
+void		textBuf_spill_to           (PTEXTBUF, struct scrollback *);
 
 /* Inline function definitions
    =========================== */
@@ -32,6 +58,16 @@ textBuf_size(PTEXTBUF buf)
     return (buf->size);
 }
 
+/*
+ * Number of the line after the last one. Lines are numbered from the
+ * first one ever added to the buffer.
+ */
+static SW_INLINE int
+textBuf_end_num(PTEXTBUF buf)
+{
+    return (buf->trimmed + buf->size);
+}
+
 static SW_INLINE PTEXTBUF_ELMT
 textBuf_head(PTEXTBUF buf)
 {
@@ -0,0 +1,258 @@
+/* Decode received text to wide characters without the locale
+   Copyright (C) 2018 Markus Uhlin. All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   - Neither the name of the author nor the names of its contributors may be
+     used to endorse or promote products derived from this software without
+     specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+   BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+#include "common.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && \
+    defined(__SSE2__)
+#define HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#include <wchar.h> /* WCHAR_MAX */
+
+#include "assertAPI.h"
+#include "errHand.h"
+#include "strHand.h"
+#include "textDecode.h"
+
+/*
+ * A line is decoded as UTF-8 if it is valid UTF-8 (RFC 3629: no
+ * overlong forms, no surrogates, nothing above U+10FFFF) and as the
+ * fallback 8-bit encoding otherwise. Neither path consults the locale,
+ * allocates, or touches global state, so the listener and the main
+ * thread may decode concurrently.
+ *
+ * Where wchar_t is 16 bits (WIN32) code points above U+FFFF become
+ * surrogate pairs. Either way the output never needs more than len + 1
+ * wide characters.
+ */
+
+/* ISO-8859-15 differs from ISO-8859-1 in eight positions */
+static const unsigned short int latin9_a0[0x60] = {
+    0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x20AC, 0x00A5, 0x0160, 0x00A7,
+    0x0161, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF,
+    0x00B0, 0x00B1, 0x00B2, 0x00B3, 0x017D, 0x00B5, 0x00B6, 0x00B7,
+    0x017E, 0x00B9, 0x00BA, 0x00BB, 0x0152, 0x0153, 0x0178, 0x00BF,
+    0x00C0, 0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7,
+    0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD, 0x00CE, 0x00CF,
+    0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7,
+    0x00D8, 0x00D9, 0x00DA, 0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF,
+    0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7,
+    0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF,
+    0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7,
+    0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF,
+};
+
+/*
+ * Length of the run of ASCII bytes at the start of 'buf'
+ */
+static size_t
+ascii_run(const unsigned char *buf, size_t len)
+{
+    size_t i = 0;
+
+#if HAVE_SSE2
+    for (; i + 16 <= len; i += 16) {
+	const __m128i v = _mm_loadu_si128((const __m128i *) &buf[i]);
+	const int mask = _mm_movemask_epi8(v);
+
+	if (mask != 0)
+	    return (i + __builtin_ctz(mask));
+    }
+#endif
+
+    while (i < len && buf[i] < 0x80)
+	i++;
+    return (i);
+}
+
+/*
+ * Decode one multibyte UTF-8 sequence (the lead byte is >= 0x80).
+ *
+ * Returns its length, or 0 if it's invalid.
+ */
+static size_t
+utf8_sequence(const unsigned char *p, size_t avail, unsigned long int *cp)
+{
+    const unsigned char c = p[0];
+    unsigned long int min;
+    size_t n, i;
+
+    if (c >= 0xC2 && c <= 0xDF) {
+	n = 2, *cp = c & 0x1F, min = 0x80;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+	n = 3, *cp = c & 0x0F, min = 0x800;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+	n = 4, *cp = c & 0x07, min = 0x10000;
+    } else {
+	return 0;
+    }
+
+    if (avail < n)
+	return 0;
+
+    for (i = 1; i < n; i++) {
+	if ((p[i] & 0xC0) != 0x80)
+	    return 0;
+	*cp = (*cp << 6) | (p[i] & 0x3F);
+    }
+
+    if (*cp < min || *cp > 0x10FFFF || (*cp >= 0xD800 && *cp <= 0xDFFF))
+	return 0;
+    return n;
+}
+
+/**
+ * @return True if the buffer holds valid UTF-8
+ */
+bool
+text_is_utf8(const char *buf, size_t len)
+{
+    const unsigned char *p = (const unsigned char *) buf;
+    const unsigned char *end = p + len;
+    unsigned long int cp;
+    size_t n;
+
+    while (p < end) {
+	p += ascii_run(p, end - p);
+	if (p == end)
+	    break;
+	if ((n = utf8_sequence(p, end - p, &cp)) == 0)
+	    return false;
+	p += n;
+    }
+
+    return true;
+}
+
+static size_t
+decode_utf8(const unsigned char *p, size_t len, wchar_t *out)
+{
+    const unsigned char *end = p + len;
+    wchar_t *wp = out;
+    unsigned long int cp;
+    size_t n;
+
+    while (p < end) {
+	const size_t run = ascii_run(p, end - p);
+
+	for (n = 0; n < run; n++)
+	    *wp++ = p[n];
+	if ((p += run) == end)
+	    break;
+
+	n = utf8_sequence(p, end - p, &cp);
+	sw_assert(n != 0);
+	p += n;
+
+#if WCHAR_MAX <= 0xFFFF
+	if (cp > 0xFFFF) {
+	    cp -= 0x10000;
+	    *wp++ = (wchar_t) (0xD800 + (cp >> 10));
+	    *wp++ = (wchar_t) (0xDC00 + (cp & 0x3FF));
+	    continue;
+	}
+#endif
+	*wp++ = (wchar_t) cp;
+    }
+
+    *wp = L'\0';
+    return (wp - out);
+}
+
+static size_t
+decode_8bit(const unsigned char *p, size_t len, wchar_t *out,
+	    enum text_encoding enc)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+	if (enc == TEXT_ENC_ISO8859_15 && p[i] >= 0xA0)
+	    out[i] = latin9_a0[p[i] - 0xA0];
+	else
+	    out[i] = p[i];
+    }
+
+    out[len] = L'\0';
+    return (len);
+}
+
+/**
+ * Decode text to wide characters
+ *
+ * @param buf      Text to decode (needn't be NUL-terminated)
+ * @param len      Its length
+ * @param out      Output buffer. Must hold at least len + 1 wide
+ *                 characters.
+ * @param fallback Encoding used if the text isn't UTF-8
+ * @param used     If non-NULL: receives the encoding used
+ * @return The number of wide characters written (excluding the
+ *         terminating null)
+ */
+size_t
+text_decode(const char *buf, size_t len, wchar_t *out,
+	    enum text_encoding fallback, enum text_encoding *used)
+{
+    const unsigned char *p = (const unsigned char *) buf;
+
+    if (buf == NULL || out == NULL)
+	err_exit(EINVAL, "text_decode");
+
+    if (text_is_utf8(buf, len)) {
+	if (used)
+	    *used = TEXT_ENC_UTF8;
+	return decode_utf8(p, len, out);
+    }
+
+    if (fallback == TEXT_ENC_UTF8)
+	fallback = TEXT_ENC_ISO8859_1;
+    if (used)
+	*used = fallback;
+    return decode_8bit(p, len, out, fallback);
+}
+
+/**
+ * Map an encoding name (such as the 'encoding' setting) to an
+ * encoding. Unknown names map to ISO-8859-1.
+ */
+enum text_encoding
+text_encoding_by_name(const char *name)
+{
+    if (name == NULL)
+	return TEXT_ENC_ISO8859_1;
+    else if (Strings_match_ignore_case(name, "utf-8") ||
+	     Strings_match_ignore_case(name, "utf8"))
+	return TEXT_ENC_UTF8;
+    else if (Strings_match_ignore_case(name, "iso-8859-15") ||
+	     Strings_match_ignore_case(name, "iso8859-15") ||
+	     Strings_match_ignore_case(name, "latin9"))
+	return TEXT_ENC_ISO8859_15;
+    return TEXT_ENC_ISO8859_1;
+}
@@ -0,0 +1,18 @@
+#ifndef TEXT_DECODE_H
+#define TEXT_DECODE_H
+
+#include <wchar.h>
+
+enum text_encoding {
+    TEXT_ENC_UTF8,
+    TEXT_ENC_ISO8859_1,
+    TEXT_ENC_ISO8859_15
+};
+
+enum text_encoding	 text_encoding_by_name(const char *name);
+bool			 text_is_utf8        (const char *buf, size_t len);
+size_t			 text_decode         (const char *buf, size_t len, wchar_t *out,
+					      enum text_encoding fallback,
+					      enum text_encoding *used);
+
+#endif
@@ -0,0 +1,407 @@
+/* Trigram index of the lines of a text buffer
+   Copyright (C) 2018 Markus Uhlin. All rights reserved.
+
+   Redistribution and use in source and binary forms, with or without
+   modification, are permitted provided that the following conditions are met:
+
+   - Redistributions of source code must retain the above copyright notice,
+     this list of conditions and the following disclaimer.
+
+   - Redistributions in binary form must reproduce the above copyright notice,
+     this list of conditions and the following disclaimer in the documentation
+     and/or other materials provided with the distribution.
+
+   - Neither the name of the author nor the names of its contributors may be
+     used to endorse or promote products derived from this software without
+     specific prior written permission.
+
+   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+   AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+   IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+   ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS
+   BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+   CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+   SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+   INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+   CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+   ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+   POSSIBILITY OF SUCH DAMAGE. */
+
+#include "common.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include "assertAPI.h"
+#include "libUtils.h"
+#include "printtext.h"
+#include "textIndex.h"
+
+/*
+ * Lines are indexed in buckets of INDEX_BUCKET_LINES consecutive lines.
+ * Each trigram has a posting: the buckets with lines that have it, in
+ * ascending order. The buckets in use are bucket[start..len).
+ */
+struct posting {
+    uint32_t	 gram;		/* 0 if the slot is free */
+    int		 start;
+    int		 len;
+    int		 size;
+    int		*bucket;
+};
+
+struct text_index {
+    struct posting *slot;	/* open addressing, linear probing */
+    int		 bits;		/* there are 1 << bits slots */
+    int		 used;
+    int		 first;		/* number of the first line indexed */
+    int		 end;		/* and of the line after the last one */
+    size_t	 bytes;		/* of the postings */
+    char	*norm;		/* normalized text of the line */
+    size_t	 normsize;
+};
+
+#define INDEX_INITIAL_BITS 8
+#define INDEX_BUCKET_LINES 64
+
+#define foreach_gram(gram, cp, text) \
+	for (cp = text; \
+	     cp[0] != '\0' && cp[1] != '\0' && cp[2] != '\0' && \
+	     (gram = (uint32_t) (unsigned char) cp[0] << 16 | \
+		     (uint32_t) (unsigned char) cp[1] << 8 | \
+		     (unsigned char) cp[2], true); \
+	     cp++)
+
+struct text_index *
+textIndex_new(void)
+{
+    struct text_index *index = xcalloc(sizeof *index, 1);
+
+    index->bits = INDEX_INITIAL_BITS;
+    index->slot = xcalloc(1 << index->bits, sizeof *index->slot);
+    index->used = 0;
+    index->first = index->end = 0;
+    index->bytes = 0;
+    index->norm = NULL;
+    index->normsize = 0;
+    return index;
+}
+
+void
+textIndex_destroy(struct text_index *index)
+{
+    if (index == NULL)
+	return;
+
+    for (int i = 0; i < (1 << index->bits); i++)
+	free_not_null(index->slot[i].bucket);
+    free(index->slot);
+    free_not_null(index->norm);
+    free(index);
+}
+
+/*
+ * Strip the text-decoration codes of 'text' and fold ASCII letters to
+ * lower case. 'out' must be at least as large as 'text'.
+ */
+void
+textIndex_normalize(const char *text, char *out)
+{
+    (void) printtext_strip_deco(text, out);
+
+    for (char *cp = out; *cp; cp++) {
+	if (*cp >= 'A' && *cp <= 'Z')
+	    *cp += 'a' - 'A';
+    }
+}
+
+static SW_INLINE unsigned int
+slot_of(const struct text_index *index, uint32_t gram)
+{
+    return ((gram * 2654435761U) >> (32 - index->bits));
+}
+
+static struct posting *
+find_posting(const struct text_index *index, uint32_t gram)
+{
+    const unsigned int mask = (1U << index->bits) - 1;
+
+    for (unsigned int i = slot_of(index, gram);; i = (i + 1) & mask) {
+	if (index->slot[i].gram == gram)
+	    return (&index->slot[i]);
+	else if (index->slot[i].gram == 0)
+	    return NULL;
+    }
+}
+
+static void
+grow_table(struct text_index *index)
+{
+    struct posting *old = index->slot;
+    const int nold = 1 << index->bits;
+
+    index->bits++;
+    index->slot = xcalloc(1 << index->bits, sizeof *index->slot);
+
+    for (int n = 0; n < nold; n++) {
+	const unsigned int mask = (1U << index->bits) - 1;
+	unsigned int i;
+
+	if (old[n].gram == 0)
+	    continue;
+	for (i = slot_of(index, old[n].gram); index->slot[i].gram != 0;
+	     i = (i + 1) & mask)
+	    /* null */;
+	index->slot[i] = old[n];
+    }
+
+    free(old);
+}
+
+/*
+ * Get the posting of 'gram', adding it if it isn't there. Postings
+ * that become empty keep their slots.
+ */
+static struct posting *
+get_posting(struct text_index *index, uint32_t gram)
+{
+    const unsigned int mask = (1U << index->bits) - 1;
+    unsigned int i;
+    struct posting *posting;
+
+    if ((posting = find_posting(index, gram)) != NULL)
+	return posting;
+
+    if (2 * (index->used + 1) > (1 << index->bits)) {
+	grow_table(index);
+	return get_posting(index, gram);
+    }
+
+    for (i = slot_of(index, gram); index->slot[i].gram != 0;
+	 i = (i + 1) & mask)
+	/* null */;
+
+    posting = &index->slot[i];
+    posting->gram = gram;
+    posting->start = posting->len = posting->size = 0;
+    posting->bucket = NULL;
+    index->used++;
+    return posting;
+}
+
+static void
+posting_push(struct text_index *index, struct posting *posting, int bucket)
+{
+    if (posting->len == posting->size) {
+	if (posting->start > 0) {
+	    posting->len -= posting->start;
+	    memmove(posting->bucket, &posting->bucket[posting->start],
+		posting->len * sizeof posting->bucket[0]);
+	    posting->start = 0;
+	} else {
+	    const int size = (posting->size > 0 ? posting->size * 2 : 2);
+
+	    posting->bucket = (posting->bucket != NULL
+		? xrealloc(posting->bucket, size * sizeof posting->bucket[0])
+		: xmalloc(size * sizeof posting->bucket[0]));
+	    index->bytes += (size - posting->size) * sizeof posting->bucket[0];
+	    posting->size = size;
+	}
+    }
+
+    posting->bucket[posting->len++] = bucket;
+}
+
+static void
+normalize_line(struct text_index *index, const char *text)
+{
+    const size_t size = strlen(text) + 1;
+
+    if (size > index->normsize) {
+	free_not_null(index->norm);
+	index->norm = xmalloc(size);
+	index->normsize = size;
+    }
+
+    textIndex_normalize(text, index->norm);
+}
+
+/*
+ * Add the line after the last one indexed
+ */
+void
+textIndex_add(struct text_index *index, int num, const char *text)
+{
+    const char *cp;
+    const int bucket = num / INDEX_BUCKET_LINES;
+    uint32_t gram;
+
+    if (index == NULL)
+	return;
+    sw_assert(index->first == index->end || num == index->end);
+
+    if (index->first == index->end)
+	index->first = num;
+    index->end = num + 1;
+    normalize_line(index, text);
+
+    foreach_gram(gram, cp, index->norm) {
+	struct posting *posting = get_posting(index, gram);
+
+	if (posting->len > posting->start &&
+	    posting->bucket[posting->len - 1] == bucket)
+	    continue; /* another line of the bucket has it */
+	posting_push(index, posting, bucket);
+    }
+}
+
+/*
+ * Drop 'bucket' from the front or the back of all postings. It's done
+ * once a bucket has no lines left, so it adds up to a sweep of the
+ * table every INDEX_BUCKET_LINES lines.
+ */
+static void
+drop_bucket(struct text_index *index, int bucket, bool front)
+{
+    for (int i = 0; i < (1 << index->bits); i++) {
+	struct posting *posting = &index->slot[i];
+
+	if (posting->len == posting->start)
+	    continue;
+	else if (front && posting->bucket[posting->start] == bucket)
+	    posting->start++;
+	else if (!front && posting->bucket[posting->len - 1] == bucket)
+	    posting->len--;
+	else
+	    continue;
+
+	if (posting->len == posting->start) {
+	    index->bytes -= posting->size * sizeof posting->bucket[0];
+	    free(posting->bucket);
+	    posting->bucket = NULL;
+	    posting->start = posting->len = posting->size = 0;
+	}
+    }
+}
+
+/*
+ * Remove the first or the last line indexed
+ */
+void
+textIndex_remove(struct text_index *index, int num)
+{
+    if (index == NULL || index->first == index->end)
+	return;
+
+    if (num == index->first) {
+	index->first++;
+	if (index->first % INDEX_BUCKET_LINES == 0 ||
+	    index->first == index->end)
+	    drop_bucket(index, num / INDEX_BUCKET_LINES, true);
+    } else if (num == index->end - 1) {
+	index->end--;
+	if (num % INDEX_BUCKET_LINES == 0 || index->first == index->end)
+	    drop_bucket(index, num / INDEX_BUCKET_LINES, false);
+    }
+}
+
+static bool
+posting_has(const struct posting *posting, int bucket)
+{
+    int lo = posting->start, hi = posting->len - 1;
+
+    while (lo <= hi) {
+	const int mid = lo + (hi - lo) / 2;
+
+	if (posting->bucket[mid] == bucket)
+	    return true;
+	else if (posting->bucket[mid] < bucket)
+	    lo = mid + 1;
+	else
+	    hi = mid - 1;
+    }
+
+    return false;
+}
+
+/*
+ * Get the lines that may contain 'pattern', which must be normalized:
+ * the lines of the buckets that have all of its trigrams. They must
+ * still be searched for it. This only reads the index, so it can be
+ * done by several threads at once while nothing changes it.
+ *
+ * @return The number of lines, which are stored in '*nums' (free it)
+ *         in ascending order, or -1 if the pattern is too short for
+ *         the index to be used.
+ */
+int
+textIndex_candidates(const struct text_index *index, const char *pattern,
+		     int **nums)
+{
+    const char *cp;
+    const size_t ngrams = (strlen(pattern) >= 3 ? strlen(pattern) - 2 : 0);
+    int n = 0;
+    const struct posting **posting;
+    const struct posting *shortest = NULL;
+    size_t np = 0;
+    uint32_t gram;
+
+    *nums = NULL;
+
+    if (ngrams == 0)
+	return -1;
+    else if (index == NULL || index->first == index->end)
+	return 0;
+
+    posting = xcalloc(ngrams, sizeof *posting);
+
+    foreach_gram(gram, cp, pattern) {
+	const struct posting *p = find_posting(index, gram);
+
+	if (p == NULL || p->len == p->start) {
+	    free(posting);
+	    return 0;
+	}
+	if (shortest == NULL || p->len - p->start <
+	    shortest->len - shortest->start)
+	    shortest = p;
+	posting[np++] = p;
+    }
+
+    *nums = xmalloc((shortest->len - shortest->start) * INDEX_BUCKET_LINES *
+	sizeof **nums);
+
+    for (int i = shortest->start; i < shortest->len; i++) {
+	const int bucket = shortest->bucket[i];
+	int num, end;
+	size_t k;
+
+	for (k = 0; k < np; k++) {
+	    if (posting[k] != shortest && !posting_has(posting[k], bucket))
+		break;
+	}
+	if (k < np)
+	    continue;
+
+	num = bucket * INDEX_BUCKET_LINES;
+	end = num + INDEX_BUCKET_LINES;
+	if (num < index->first)
+	    num = index->first;
+	if (end > index->end)
+	    end = index->end;
+	while (num < end)
+	    (*nums)[n++] = num++;
+    }
+
+    free(posting);
+    return n;
+}
+
+size_t
+textIndex_bytes(const struct text_index *index)
+{
+    if (index == NULL)
+	return 0;
+    return (sizeof *index + ((size_t) 1 << index->bits) *
+	sizeof index->slot[0] + index->bytes + index->normsize);
+}
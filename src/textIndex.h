@@ -0,0 +1,20 @@
+#ifndef TEXT_INDEX_H
+#define TEXT_INDEX_H
+
+/*
+ * Trigram index of the lines of a text buffer. Lines are indexed by
+ * their number, with text-decoration codes stripped and ASCII letters
+ * folded to lower case. Lines must be added in ascending order, and
+ * removed from the front or the back.
+ */
+struct text_index;
+
+struct text_index	*textIndex_new       (void);
+void			 textIndex_destroy   (struct text_index *);
+void			 textIndex_add       (struct text_index *, int num, const char *text);
+void			 textIndex_remove    (struct text_index *, int num);
+int			 textIndex_candidates(const struct text_index *, const char *, int **);
+size_t			 textIndex_bytes     (const struct text_index *);
+void			 textIndex_normalize (const char *text, char *out);
+
+#endif
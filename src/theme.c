@@ -39,6 +39,7 @@
 #error "Cannot determine curses header file!"
 #endif
 
+#include "atomicPtr.h"
 #include "errHand.h"
 #include "interpreter.h"
 #include "libUtils.h"
@@ -59,6 +60,93 @@
 
 static PTHEME_HTBL_ENTRY hash_table[300];
 
+#define SNAPSHOT_STRING(name) { #name, offsetof(struct theme_snapshot, name) }
+
+static const struct {
+    const char	*item_name;
+    size_t	 offset;
+} snapshot_strings[] = {
+    SNAPSHOT_STRING(color3),
+    SNAPSHOT_STRING(color4),
+    SNAPSHOT_STRING(gfx_failure),
+    SNAPSHOT_STRING(gfx_success),
+    SNAPSHOT_STRING(gfx_warning),
+    SNAPSHOT_STRING(left_bracket),
+    SNAPSHOT_STRING(nick_s1),
+    SNAPSHOT_STRING(nick_s2),
+    SNAPSHOT_STRING(notice_color1),
+    SNAPSHOT_STRING(notice_color2),
+    SNAPSHOT_STRING(notice_inner_b1),
+    SNAPSHOT_STRING(notice_inner_b2),
+    SNAPSHOT_STRING(notice_lb),
+    SNAPSHOT_STRING(notice_rb),
+    SNAPSHOT_STRING(notice_sep),
+    SNAPSHOT_STRING(primary_color),
+    SNAPSHOT_STRING(right_bracket),
+    SNAPSHOT_STRING(secondary_color),
+    SNAPSHOT_STRING(slogan),
+    SNAPSHOT_STRING(specifier1),
+    SNAPSHOT_STRING(specifier2),
+    SNAPSHOT_STRING(specifier3),
+    SNAPSHOT_STRING(statusbar_leftBracket),
+    SNAPSHOT_STRING(statusbar_rightBracket),
+    SNAPSHOT_STRING(statusbar_spec),
+    SNAPSHOT_STRING(time_format),
+};
+
+/*
+ * Published snapshots. The newest is the current one. The older ones
+ * are kept until theme_deinit(), since their strings may still be
+ * waiting to be printed; reloads are rare, so that's bounded. Only the
+ * main thread publishes.
+ */
+struct published_snapshot {
+    struct theme_snapshot	 values;
+    struct published_snapshot	*older;
+};
+
+static ATOMIC_PTR(struct published_snapshot) current_snapshot = NULL;
+static unsigned long int last_generation = 0;
+
+/* Used before a theme has been read */
+static const struct theme_snapshot default_snapshot = {
+    .color3			= "",
+    .color4			= "",
+    .gfx_failure		= "",
+    .gfx_success		= "",
+    .gfx_warning		= "",
+    .left_bracket		= "",
+    .nick_s1			= "",
+    .nick_s2			= "",
+    .notice_color1		= "",
+    .notice_color2		= "",
+    .notice_inner_b1		= "",
+    .notice_inner_b2		= "",
+    .notice_lb			= "",
+    .notice_rb			= "",
+    .notice_sep			= "",
+    .primary_color		= "",
+    .right_bracket		= "",
+    .secondary_color		= "",
+    .slogan			= "",
+    .specifier1			= "",
+    .specifier2			= "",
+    .specifier3			= "",
+    .statusbar_leftBracket	= "",
+    .statusbar_rightBracket	= "",
+    .statusbar_spec		= "",
+    .time_format		= "",
+    .statusbar_bg		= COLOR_BLACK,
+    .statusbar_fg		= COLOR_WHITE,
+    .term_background		= 1,
+    .titlebar_bg		= COLOR_WHITE,
+    .titlebar_fg		= COLOR_BLACK,
+    .term_enable_colors		= true,
+    .term_use_default_colors	= true,
+};
+
+static bool reading_theme = false;
+
 static struct tagThemeDefValues {
     char		*item_name;
     enum setting_type	 type;
@@ -171,8 +259,8 @@ hUndef(PTHEME_HTBL_ENTRY entry)
     free_not_null(entry);
 }
 
-void
-theme_deinit(void)
+static void
+remove_all_items(void)
 {
     PTHEME_HTBL_ENTRY *entry_p;
     PTHEME_HTBL_ENTRY p, tmp;
@@ -185,6 +273,35 @@ theme_deinit(void)
     }
 }
 
+static void
+free_snapshot(struct published_snapshot *snap)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(snapshot_strings); i++) {
+	char **field = (char **) ((char *) &snap->values +
+	    snapshot_strings[i].offset);
+
+	free(*field);
+    }
+
+    free(snap);
+}
+
+void
+theme_deinit(void)
+{
+    struct published_snapshot *snap, *older;
+
+    remove_all_items();
+
+    snap = atomic_ptr_load(&current_snapshot);
+    atomic_ptr_store(&current_snapshot, NULL);
+
+    for (; snap != NULL; snap = older) {
+	older = snap->older;
+	free_snapshot(snap);
+    }
+}
+
 /*lint -sem(get_hash_table_entry, r_null) */
 static PTHEME_HTBL_ENTRY
 get_hash_table_entry(const char *name)
@@ -230,6 +347,8 @@ hInstall(const char *name, const char *value)
     hash_table[hashval] = item;
 }
 
+static void publish_snapshot(void);
+
 int
 theme_item_install(const char *name, const char *value)
 {
@@ -247,6 +366,9 @@ theme_item_install(const char *name, const char *value)
 	hInstall(name, value);
     }
 
+    if (!reading_theme)
+	publish_snapshot();
+
     return (0);
 }
 
@@ -376,6 +498,54 @@ theme_integer_unparse(struct integer_unparse_context *ctx)
     return (ctx->fallback_default);
 }
 
+/*
+ * Compile the items into a new snapshot and make it the current one
+ */
+static void
+publish_snapshot(void)
+{
+    struct published_snapshot *snap = xcalloc(sizeof *snap, 1);
+    struct theme_snapshot *v = &snap->values;
+    struct integer_unparse_context unparse_ctx = {
+	.setting_name	  = "term_background",
+	.fallback_default = 1,	/* black */
+	.lo_limit	  = 0,
+	.hi_limit	  = 15,
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(snapshot_strings); i++) {
+	const char **field = (const char **) ((char *) v +
+	    snapshot_strings[i].offset);
+
+	*field = sw_strdup(Theme(snapshot_strings[i].item_name));
+    }
+
+    v->statusbar_bg = theme_color_unparse("statusbar_bg", COLOR_BLACK);
+    v->statusbar_fg = theme_color_unparse("statusbar_fg", COLOR_WHITE);
+    v->term_background = (short int) theme_integer_unparse(&unparse_ctx);
+    v->titlebar_bg = theme_color_unparse("titlebar_bg", COLOR_WHITE);
+    v->titlebar_fg = theme_color_unparse("titlebar_fg", COLOR_BLACK);
+    v->term_enable_colors = theme_bool_unparse("term_enable_colors", true);
+    v->term_use_default_colors =
+	theme_bool_unparse("term_use_default_colors", true);
+
+    v->generation = ++last_generation;
+
+    snap->older = atomic_ptr_load(&current_snapshot);
+    atomic_ptr_store(&current_snapshot, snap);
+}
+
+/*
+ * Get the current theme snapshot
+ */
+const struct theme_snapshot *
+theme_current(void)
+{
+    const struct published_snapshot *snap = atomic_ptr_load(&current_snapshot);
+
+    return (snap != NULL ? &snap->values : &default_snapshot);
+}
+
 void
 theme_create(const char *path, const char *mode)
 {
@@ -449,6 +619,8 @@ theme_readit(const char *path, const char *mode)
     char      buf[3200] = "";
     long int  line_num  = 0;
 
+    reading_theme = true;
+
     while (BZERO(buf, sizeof buf), fgets(buf, sizeof buf, fp) != NULL) {
 	const char		*ccp = &buf[0];
 	char			*line;
@@ -473,6 +645,8 @@ theme_readit(const char *path, const char *mode)
     if (feof(fp)) {
 	fclose_ensure_success(fp);
 	init_missing_to_defs();
+	reading_theme = false;
+	publish_snapshot();
     } else if (ferror(fp)) {
 	err_quit("fgets returned NULL and the error indicator is set");
     } else {
@@ -480,3 +654,14 @@ theme_readit(const char *path, const char *mode)
 	abort();
     }
 }
+
+/*
+ * Switch to the theme in 'path'. Until it has been read, readers of
+ * theme_current() keep getting the old theme.
+ */
+void
+theme_reload(const char *path)
+{
+    remove_all_items();
+    theme_readit(path, "r");
+}
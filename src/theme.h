@@ -9,6 +9,48 @@ typedef struct tagTHEME_HTBL_ENTRY {
     struct tagTHEME_HTBL_ENTRY *next;
 } THEME_HTBL_ENTRY, *PTHEME_HTBL_ENTRY;
 
+/*
+ * The theme items used when printing, compiled when the theme is
+ * read. Switching theme publishes a new snapshot; published snapshots
+ * are never modified and stay valid until theme_deinit().
+ */
+struct theme_snapshot {
+    const char	*color3;
+    const char	*color4;
+    const char	*gfx_failure;
+    const char	*gfx_success;
+    const char	*gfx_warning;
+    const char	*left_bracket;
+    const char	*nick_s1;
+    const char	*nick_s2;
+    const char	*notice_color1;
+    const char	*notice_color2;
+    const char	*notice_inner_b1;
+    const char	*notice_inner_b2;
+    const char	*notice_lb;
+    const char	*notice_rb;
+    const char	*notice_sep;
+    const char	*primary_color;
+    const char	*right_bracket;
+    const char	*secondary_color;
+    const char	*slogan;
+    const char	*specifier1;
+    const char	*specifier2;
+    const char	*specifier3;
+    const char	*statusbar_leftBracket;
+    const char	*statusbar_rightBracket;
+    const char	*statusbar_spec;
+    const char	*time_format;
+    short int	 statusbar_bg;
+    short int	 statusbar_fg;
+    short int	 term_background;
+    short int	 titlebar_bg;
+    short int	 titlebar_fg;
+    bool	 term_enable_colors;
+    bool	 term_use_default_colors;
+    unsigned long int generation; /* of the snapshot, 0 for the defaults */
+};
+
 /*lint -sem(Theme_mod, r_null) */
 
 bool		 theme_bool_unparse    (const char *item_name, bool fallback_default);
@@ -23,18 +65,21 @@ void		 theme_deinit          (void);
 void		 theme_do_save         (const char *path, const char *mode);
 void		 theme_init            (void);
 void		 theme_readit          (const char *path, const char *mode);
+void		 theme_reload          (const char *path);
+
+const struct theme_snapshot *theme_current(void);
 
-#define COLOR1		Theme("primary_color")
-#define COLOR2		Theme("secondary_color")
-#define COLOR3		Theme("color3")
-#define COLOR4		Theme("color4")
-#define GFX_FAILURE	Theme("gfx_failure")
-#define GFX_SUCCESS	Theme("gfx_success")
-#define GFX_WARN	Theme("gfx_warning")
-#define LEFT_BRKT	Theme("left_bracket")
-#define RIGHT_BRKT	Theme("right_bracket")
-#define THE_SPEC1	Theme("specifier1")
-#define THE_SPEC2	Theme("specifier2")
-#define THE_SPEC3	Theme("specifier3")
+#define COLOR1		(theme_current()->primary_color)
+#define COLOR2		(theme_current()->secondary_color)
+#define COLOR3		(theme_current()->color3)
+#define COLOR4		(theme_current()->color4)
+#define GFX_FAILURE	(theme_current()->gfx_failure)
+#define GFX_SUCCESS	(theme_current()->gfx_success)
+#define GFX_WARN	(theme_current()->gfx_warning)
+#define LEFT_BRKT	(theme_current()->left_bracket)
+#define RIGHT_BRKT	(theme_current()->right_bracket)
+#define THE_SPEC1	(theme_current()->specifier1)
+#define THE_SPEC2	(theme_current()->specifier2)
+#define THE_SPEC3	(theme_current()->specifier3)
 
 #endif
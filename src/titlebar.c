@@ -35,6 +35,7 @@
 #include "curses-funcs.h"
 #endif
 
+#include "colorPairs.h"
 #include "printtext.h"
 #include "strdup_printf.h"
 #include "terminal.h"
@@ -57,8 +58,8 @@ get_pair_num()
     short int fg, bg;
     short int pair_n;
 
-    fg = theme_color_unparse("titlebar_fg", COLOR_BLACK);
-    bg = theme_color_unparse("titlebar_bg", COLOR_WHITE);
+    fg = theme_current()->titlebar_fg;
+    bg = theme_current()->titlebar_bg;
 
     if ((pair_n = color_pair_find(fg, bg)) != -1) {
 	return pair_n;
@@ -34,6 +34,7 @@
 #include "events/names.h"
 
 #include "assertAPI.h"
+#include "colorPairs.h"
 #include "config.h"
 #if defined(WIN32) && defined(PDC_EXP_EXTRAS)
 #include "curses-funcs.h"	/* is_scrollok() etc */
@@ -42,8 +43,10 @@
 #include "errHand.h"
 #include "io-loop.h"		/* get_prompt() */
 #include "libUtils.h"
+#include "nestHome.h"
 #include "printtext.h"		/* includes window.h */
 #include "readline.h"		/* readline_top_panel() */
+#include "scrollback.h"
 #include "statusbar.h"
 #include "strHand.h"
 #include "terminal.h"
@@ -54,17 +57,20 @@
 	     entry_p < &hash_table[ARRAY_SIZE(hash_table)]; \
 	     entry_p++)
 
-#define IS_AT_TOP (window->saved_size > 0 && \
-		   window->saved_size == window->scroll_count)
 #define SCROLL_OFFSET 6
 
+/*
+ * Windows aren't trimmed below this number of lines to fit in the
+ * scrollback budget
+ */
+#define BUDGET_MIN_LINES 100
+
 /* Structure definitions
    ===================== */
 
 struct hInstall_context {
     char	*label;
     char	*title;
-    PANEL	*pan;
     int		 refnum;
 };
 
@@ -81,6 +87,17 @@ int		g_ntotal_windows        = 0;
 
 static PIRC_WINDOW hash_table[200];
 
+/* Increased each time a window is activated */
+static unsigned int view_count = 0;
+
+/*
+ * The panel the active window is drawn in. Other windows only have
+ * their text buffers and are drawn when they're activated.
+ */
+static PANEL *viewport = NULL;
+
+static void	window_draw(PIRC_WINDOW, int rows);
+
 static unsigned int
 hash(const char *label)
 {
@@ -144,6 +161,30 @@ window_by_refnum(int refnum)
     return (NULL);
 }
 
+/*
+ * Make 'window' the active one and draw it in the viewport
+ */
+static void
+window_activate(PIRC_WINDOW window)
+{
+    WINDOW *pwin = readline_get_active_pwin();
+    char *prompt = NULL;
+
+    g_active_window = window;
+    window->unread = 0;
+    window->last_viewed = ++view_count;
+    titlebar(" %s ", (window->title != NULL) ? window->title : "");
+    window_draw(window, LINES - 3);
+    if (pwin) {
+	werase(pwin);
+	prompt = get_prompt();
+	waddnstr(pwin, prompt, -1);
+	free(prompt);
+    }
+    readline_top_panel();
+    (void) ungetch('\a');
+}
+
 int
 changeWindow_by_label(const char *label)
 {
@@ -153,25 +194,9 @@ changeWindow_by_label(const char *label)
 	return (ENOENT);	/* window not found */
     } else if (window == g_active_window) {
 	return (0);		/* window already active */
-    } else if (top_panel(window->pan) == ERR) {
-	return (EPERM);		/* top_panel() error */
-    } else {
-	WINDOW *pwin = readline_get_active_pwin();
-	char *prompt = NULL;
-
-	g_active_window = window;
-	titlebar(" %s ", (window->title != NULL) ? window->title : "");
-	statusbar_update_display_beta();
-	if (pwin) {
-	    werase(pwin);
-	    prompt = get_prompt();
-	    waddnstr(pwin, prompt, -1);
-	    free(prompt);
-	}
-	readline_top_panel();
-	(void) ungetch('\a');
     }
 
+    window_activate(window);
     return (0);
 }
 
@@ -184,25 +209,9 @@ changeWindow_by_refnum(int refnum)
 	return (ENOENT);
     } else if (window == g_active_window) {
 	return (0);
-    } else if (top_panel(window->pan) == ERR) {
-	return (EPERM);
-    } else {
-	WINDOW *pwin = readline_get_active_pwin();
-	char *prompt = NULL;
-
-	g_active_window = window;
-	titlebar(" %s ", (window->title != NULL) ? window->title : "");
-	statusbar_update_display_beta();
-	if (pwin) {
-	    werase(pwin);
-	    prompt = get_prompt();
-	    waddnstr(pwin, prompt, -1);
-	    free(prompt);
-	}
-	readline_top_panel();
-	(void) ungetch('\a');
     }
 
+    window_activate(window);
     return (0);
 }
 
@@ -225,9 +234,6 @@ hUndef(PIRC_WINDOW entry)
     free_and_null(& (entry->label));
     free_and_null(& (entry->title));
 
-    term_remove_panel(entry->pan);
-
-    entry->pan	  = NULL;
     entry->refnum = -1;
 
     textBuf_destroy(entry->buf);
@@ -301,13 +307,22 @@ hInstall(const struct hInstall_context *ctx)
 	((isNull(ctx->title) || isEmpty(ctx->title))
 	 ? NULL
 	 : sw_strdup(ctx->title));
-    entry->pan    = ctx->pan;
     entry->refnum = ctx->refnum;
     entry->buf    = textBuf_new();
+    entry->unread = 0;
+
+    entry->last_viewed = 0;
+    entry->evicted     = 0;
 
-    entry->saved_size	= 0;
-    entry->scroll_count = 0;
-    entry->scroll_mode	= false;
+    if (config_current()->scrollback_spill)
+	textBuf_spill_to(entry->buf,
+	    scrollback_new(g_scrollback_dir, ctx->label));
+    textBuf_set_compress(entry->buf, config_current()->scrollback_compress);
+    textBuf_index_lines(entry->buf, config_current()->scrollback_index);
+
+    entry->top_line    = 0;
+    entry->top_row     = 0;
+    entry->scroll_mode = false;
 
     for (n_ent = &entry->names_hash[0];
 	 n_ent < &entry->names_hash[NAMES_HASH_TABLE_SIZE];
@@ -350,29 +365,21 @@ int
 spawn_chat_window(const char *label, const char *title)
 {
     const int ntotalp1 = g_ntotal_windows + 1;
-    struct integer_unparse_context unparse_ctx = {
-	.setting_name	  = "max_chat_windows",
-	.fallback_default = 60,
-	.lo_limit	  = 10,
-	.hi_limit	  = 200,
-    };
 
     if (isNull(label) || isEmpty(label)) {
 	return (EINVAL);	/* a label is required */
     } else if (window_by_label(label) != NULL) {
 	return (0);		/* window already exists  --  reuse it */
-    } else if (ntotalp1 > config_integer_unparse(&unparse_ctx)) {
+    } else if (ntotalp1 > config_current()->max_chat_windows) {
 	return (ENOSPC);
     } else {
 	struct hInstall_context inst_ctx = {
 	    .label  = (char *) label,
 	    .title  = (char *) title,
-	    .pan    = term_new_panel(LINES - 2, 0, 1, 0),
 	    .refnum = g_ntotal_windows + 1,
 	};
 	PIRC_WINDOW entry = hInstall(&inst_ctx);
 
-	apply_window_options(panel_window(entry->pan));
 	errno = changeWindow_by_label(entry->label);
 	sw_assert_perror(errno);
     }
@@ -411,6 +418,9 @@ windowSystem_deinit(void)
 	    hUndef(p);
 	}
     }
+
+    term_remove_panel(viewport);
+    viewport = NULL;
 }
 
 void
@@ -425,6 +435,9 @@ windowSystem_init(void)
     g_status_window = g_active_window = NULL;
     g_ntotal_windows = 0;
 
+    viewport = term_new_panel(LINES - 2, 0, 1, 0);
+    apply_window_options(panel_window(viewport));
+
     if ((errno = spawn_chat_window(g_status_window_label, "")) != 0) {
 	err_sys("spawn_chat_window error");
     }
@@ -461,6 +474,98 @@ window_close_all_priv_conv(void)
     }
 }
 
+/*
+ * Get the number of bytes in the text buffers of all windows
+ */
+size_t
+window_scrollback_bytes(void)
+{
+    PIRC_WINDOW *entry_p;
+    PIRC_WINDOW	 window;
+    size_t	 total = 0;
+
+    foreach_hash_table_entry(entry_p) {
+	for (window = *entry_p; window != NULL; window = window->next)
+	    total += textBuf_bytes(window->buf);
+    }
+
+    return total;
+}
+
+/*
+ * Get the least recently viewed window that can be trimmed
+ */
+static PIRC_WINDOW
+least_recently_viewed(void)
+{
+    PIRC_WINDOW *entry_p;
+    PIRC_WINDOW	 lru = NULL;
+    PIRC_WINDOW	 window;
+
+    foreach_hash_table_entry(entry_p) {
+	for (window = *entry_p; window != NULL; window = window->next) {
+	    if (textBuf_size(window->buf) > BUDGET_MIN_LINES &&
+		(lru == NULL || window->last_viewed < lru->last_viewed))
+		lru = window;
+	}
+    }
+
+    return lru;
+}
+
+/*
+ * Trim the least recently viewed windows until the text buffers of
+ * all windows fit in the scrollback budget. The active window was
+ * viewed last, so it's trimmed last and keeps the deepest history.
+ * Trimmed lines are spilled like any other lines removed from the
+ * head of a buffer. Called with each line printed.
+ */
+void
+window_enforce_budget(void)
+{
+    const size_t budget =
+	(size_t) config_current()->scrollback_budget * 1024 * 1024;
+    size_t	 total = window_scrollback_bytes();
+    PIRC_WINDOW	 window;
+
+    while (total > budget && (window = least_recently_viewed()) != NULL) {
+	do {
+	    const size_t bytes = textBuf_bytes(window->buf);
+
+	    if ((errno = textBuf_remove(window->buf,
+		textBuf_head(window->buf))) != 0)
+		err_sys("textBuf_remove");
+	    total -= bytes - textBuf_bytes(window->buf);
+	    window->evicted++;
+	} while (total > budget &&
+		 textBuf_size(window->buf) > BUDGET_MIN_LINES);
+    }
+}
+
+#ifdef UNIT_TESTING
+/**
+ * Add a window without activating it, which would need a terminal.
+ * Only used by tests/test_window.c.
+ */
+PIRC_WINDOW
+window_new_for_testing(const char *label)
+{
+    struct hInstall_context inst_ctx = {
+	.label  = (char *) label,
+	.title  = NULL,
+	.refnum = g_ntotal_windows + 1,
+    };
+
+    return hInstall(&inst_ctx);
+}
+
+void
+window_free_for_testing(PIRC_WINDOW window)
+{
+    hUndef(window);
+}
+#endif
+
 void
 window_foreach_destroy_names(void)
 {
@@ -489,104 +594,255 @@ window_foreach_destroy_names(void)
     }
 }
 
+/*
+ * Get the number of display rows of line 'num' of the window, or -1
+ * if there's no such line. The row counts of lines in records are
+ * cached in them, so this doesn't lay out text that has been laid out
+ * before. Lines spilled to disk or in frozen blocks are laid out
+ * again.
+ */
+static int
+line_rows(PIRC_WINDOW window, int num, int cols)
+{
+    PTEXTBUF_ELMT	element;
+    TEXTBUF_ELMT	scratch;
+    int			nrows = -1;
+
+    printtext_lock();
+    if ((element = textBuf_get_line(window->buf, num, &scratch)) != NULL) {
+	nrows = printtext_line_rows(element->line, element->text,
+	    element->indent, cols);
+    }
+    printtext_unlock();
+
+    return nrows;
+}
+
+/*
+ * Move the position 'num', 'row' (a line and a row of it) up by at
+ * most 'rows' display rows. Returns the number of rows it was moved.
+ */
+static int
+move_up(PIRC_WINDOW window, int *num, int *row, int rows, int cols)
+{
+    const int	first = textBuf_first_num(window->buf);
+    int		moved = 0;
+
+    while (moved < rows) {
+	if (*row > 0) {
+	    const int n = (*row < rows - moved ? *row : rows - moved);
+
+	    *row  -= n;
+	    moved += n;
+	} else if (*num > first) {
+	    const int nrows = line_rows(window, *num - 1, cols);
+
+	    if (nrows < 0)
+		break;
+	    (*num)--;
+	    *row = nrows;
+	} else {
+	    break;
+	}
+    }
+
+    return moved;
+}
+
+/*
+ * Move the position down by at most 'rows' display rows, and return
+ * the number of rows it was moved. It can be moved to the end of the
+ * buffer: row 0 of the line after the last one.
+ */
+static int
+move_down(PIRC_WINDOW window, int *num, int *row, int rows, int cols)
+{
+    const int	end   = textBuf_end_num(window->buf);
+    int		moved = 0;
+
+    while (moved < rows && *num < end) {
+	const int nrows = line_rows(window, *num, cols);
+
+	if (nrows < 0)
+	    break;
+
+	if (*row + (rows - moved) < nrows) {
+	    *row += rows - moved;
+	    moved = rows;
+	} else {
+	    moved += nrows - *row;
+	    (*num)++;
+	    *row = 0;
+	}
+    }
+
+    return moved;
+}
+
+/*
+ * Keep the top of a window in scroll mode at a row that exists, after
+ * lines have been dropped from the buffer or the window was resized
+ */
+static void
+clamp_top(PIRC_WINDOW window, int cols)
+{
+    const int	first = textBuf_first_num(window->buf);
+    int		nrows;
+
+    if (window->top_line < first) {
+	window->top_line = first;
+	window->top_row  = 0;
+    } else if ((nrows = line_rows(window, window->top_line, cols)) >= 0 &&
+	       window->top_row >= nrows) {
+	window->top_row = (nrows > 0 ? nrows - 1 : 0);
+    }
+}
+
+/* color pairs recycled when the active window was last drawn */
+static unsigned long int drawn_recycled = 0;
+
+/*
+ * Redraw the window from row 'row' of line 'num'
+ */
 static void
-window_redraw(PIRC_WINDOW window, const int rows, const int pos,
-	      bool limit_output)
+window_redraw(PIRC_WINDOW window, const int rows, int num, int row)
 {
     PTEXTBUF_ELMT	 element   = NULL;
-    WINDOW		*pwin	   = panel_window(window->pan);
+    TEXTBUF_ELMT	 scratch;
+    WINDOW		*pwin	   = panel_window(viewport);
+    const int		 end	   = textBuf_end_num(window->buf);
     int			 i	   = 0;
     int			 rep_count = 0;
 
-    if (element = textBuf_get_element_by_pos(window->buf, pos < 0 ? 0 : pos),
-	!element) {
-	return; /* Nothing stored in the buffer */
-    }
-
 #if 1
     werase(pwin);
     update_panels();
 #endif
 
-    if (limit_output) {
-	while (element != NULL && i < rows) {
-	    printtext_puts(pwin, element->text, element->indent, rows - i,
-			   &rep_count);
-	    element = element->next;
-	    i += rep_count;
-	}
-    } else {
-	while (element != NULL && i < rows) {
-	    printtext_puts(pwin, element->text, element->indent, -1, NULL);
-	    element = element->next;
-	    i++;
-	}
+    printtext_lock();
+    while (num < end && i < rows) {
+	if ((element = textBuf_get_line(window->buf, num, &scratch)) == NULL)
+	    break;
+	printtext_puts_line(pwin, element->text, element->line,
+			    element->indent, row, rows - i, &rep_count);
+	num++;
+	row = 0;
+	i += rep_count;
+    }
+    printtext_unlock();
+
+    if (window == g_active_window) {
+	struct color_pairs_stats stats;
+
+	color_pairs_stats(&stats);
+	drawn_recycled = stats.recycled;
     }
 
     statusbar_update_display_beta();
     readline_top_panel();
 }
 
-/* textBuf_size(window->buf) - window->saved_size */
-void
-window_scroll_down(PIRC_WINDOW window)
+/*
+ * Draw a window in the viewport, where it was scrolled to (if it's in
+ * scroll mode). Scroll mode is left when the end of the buffer fits
+ * in the window.
+ */
+static void
+window_draw(PIRC_WINDOW window, int rows)
 {
-    const int HEIGHT = LINES - 3;
+    const int	cols = getmaxx(panel_window(viewport));
+    int		num, row;
 
-    if (! (window->scroll_mode)) {
-	if (!config_bool_unparse("disable_beeps", false))
-	    term_beep();
-	return;
-    }
+    if (window->scroll_mode) {
+	clamp_top(window, cols);
+	num = window->top_line;
+	row = window->top_row;
 
-    window->scroll_count -= SCROLL_OFFSET;
+	if (move_down(window, &num, &row, rows + 1, cols) > rows) {
+	    window_redraw(window, rows, window->top_line, window->top_row);
+	    return;
+	}
 
-    if (! (window->scroll_count > HEIGHT)) {
-	window->saved_size   = 0;
-	window->scroll_count = 0;
-	window->scroll_mode  = false;
-	window_redraw(window, HEIGHT, textBuf_size(window->buf) - HEIGHT,
-		      false);
-	return;
+	window->top_line    = 0;
+	window->top_row     = 0;
+	window->scroll_mode = false;
     }
 
-    window_redraw(window, HEIGHT, window->saved_size - window->scroll_count,
-		  false);
+    num = textBuf_end_num(window->buf);
+    row = 0;
+    (void) move_up(window, &num, &row, rows, cols);
+    window_redraw(window, rows, num, row);
 }
 
+/*
+ * Redraw the active window if color pairs have been redefined since
+ * it was drawn, as the text on the screen may have been using them.
+ * Called from the readline loop with g_puts_mutex held.
+ */
 void
-window_scroll_up(PIRC_WINDOW window)
+window_check_colors(void)
 {
-    const int MIN_SIZE = LINES - 3;
+    struct color_pairs_stats stats;
+
+    color_pairs_stats(&stats);
+    if (stats.recycled != drawn_recycled && g_active_window != NULL)
+	window_draw(g_active_window, LINES - 3);
+}
 
-    if (MIN_SIZE < 0 || !(textBuf_size(window->buf) > MIN_SIZE) || IS_AT_TOP) {
-	if (!config_bool_unparse("disable_beeps", false))
+/*
+ * While in scroll mode 'top_line' and 'top_row' are where the top of
+ * the window is. Lines are numbered from the first one ever added to
+ * the buffer, so the window stays put while new lines are added, and
+ * scrolling a step only looks at the lines it passes.
+ */
+void
+window_scroll_down(PIRC_WINDOW window)
+{
+    const int	HEIGHT = LINES - 3;
+    const int	cols   = getmaxx(panel_window(viewport));
+
+    if (! (window->scroll_mode)) {
+	if (!config_current()->disable_beeps)
 	    term_beep();
 	return;
     }
 
-    if (! (window->scroll_mode)) {
-	window->saved_size  = textBuf_size(window->buf);
-	window->scroll_mode = true;
-    }
+    clamp_top(window, cols);
+    (void) move_down(window, &window->top_line, &window->top_row,
+	SCROLL_OFFSET, cols);
+    window_draw(window, HEIGHT);
+}
 
-    if (window->scroll_count > window->saved_size) /* past top */
-	window->scroll_count = window->saved_size;
-    else {
-	if (window->scroll_count == 0) /* first page up */
-	    window->scroll_count += MIN_SIZE;
+void
+window_scroll_up(PIRC_WINDOW window)
+{
+    const int	HEIGHT = LINES - 3;
+    const int	cols   = getmaxx(panel_window(viewport));
+    int		num, row;
 
-	window->scroll_count += SCROLL_OFFSET;
+    if (window->scroll_mode) {
+	clamp_top(window, cols);
+	num = window->top_line;
+	row = window->top_row;
+    } else {
+	num = textBuf_end_num(window->buf);
+	row = 0;
+    }
 
-	if (window->scroll_count > window->saved_size)
-	    window->scroll_count = window->saved_size;
+    if (HEIGHT < 0 ||
+	(!(window->scroll_mode) &&
+	 move_up(window, &num, &row, HEIGHT, cols) < HEIGHT) ||
+	move_up(window, &num, &row, SCROLL_OFFSET, cols) == 0) {
+	/* at the top, or everything fits in the window */
+	if (!config_current()->disable_beeps)
+	    term_beep();
+	return;
     }
 
-    if (IS_AT_TOP)
-	window_redraw(window, MIN_SIZE, 0, true);
-    else
-	window_redraw(window, MIN_SIZE,
-	    window->saved_size - window->scroll_count, true);
+    window->top_line    = num;
+    window->top_row     = row;
+    window->scroll_mode = true;
+    window_redraw(window, HEIGHT, num, row);
 }
 
 void
@@ -609,8 +865,12 @@ window_select_prev(void)
     }
 }
 
-static void
-window_recreate(PIRC_WINDOW window, int rows, int cols)
+/*
+ * Only the viewport is resized, and only the active window redrawn.
+ * Other windows are laid out for the new size when they're activated.
+ */
+void
+windows_recreate_all(int rows, int cols)
 {
     struct term_window_size newsize;
 
@@ -619,38 +879,61 @@ window_recreate(PIRC_WINDOW window, int rows, int cols)
     newsize.start_row = 1;
     newsize.start_col = 0;
 
-    window->pan = term_resize_panel(window->pan, &newsize);
-    apply_window_options(panel_window(window->pan));
+    viewport = term_resize_panel(viewport, &newsize);
+    apply_window_options(panel_window(viewport));
 
-    const int HEIGHT = rows - 3;
-
-    if (window->scroll_mode) {
-	if (! (window->scroll_count > HEIGHT)) {
-	    window->saved_size   = 0;
-	    window->scroll_count = 0;
-	    window->scroll_mode  = false;
-	    window_redraw(window, HEIGHT, textBuf_size(window->buf) - HEIGHT,
-			  false);
-	} else {
-	    window_redraw(window, HEIGHT,
-		window->saved_size - window->scroll_count, true);
-	}
+    if (g_active_window != NULL)
+	window_draw(g_active_window, rows - 3);
+}
 
-	return;
-    }
+/*
+ * Get the window that the active window is drawn in
+ */
+WINDOW *
+window_viewport(void)
+{
+    return (viewport != NULL ? panel_window(viewport) : NULL);
+}
 
-    window_redraw(window, HEIGHT, textBuf_size(window->buf) - HEIGHT, false);
+/*
+ * Count a line printed to a window that isn't shown
+ */
+void
+window_add_unread(PIRC_WINDOW window)
+{
+    if (window->unread++ == 0)
+	statusbar_update_display_beta();
 }
 
+/*
+ * Write the refnums of the windows with unread lines, separated by
+ * commas, to 'buf'
+ */
 void
-windows_recreate_all(int rows, int cols)
+window_list_unread(char *buf, size_t size)
 {
     PIRC_WINDOW *entry_p;
     PIRC_WINDOW	 window;
+    bool	*unread = xcalloc(g_ntotal_windows + 1, sizeof *unread);
+
+    BZERO(buf, size);
 
     foreach_hash_table_entry(entry_p) {
 	for (window = *entry_p; window != NULL; window = window->next) {
-	    window_recreate(window, rows, cols);
+	    if (window->unread > 0 && window->refnum >= 1 &&
+		window->refnum <= g_ntotal_windows)
+		unread[window->refnum] = true;
 	}
     }
+
+    for (int refnum = 1; refnum <= g_ntotal_windows; refnum++) {
+	if (unread[refnum]) {
+	    char num[20];
+
+	    sw_snprintf(num, sizeof num, "%s%d", (*buf ? "," : ""), refnum);
+	    (void) sw_strcat(buf, num, size);
+	}
+    }
+
+    free(unread);
 }
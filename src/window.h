@@ -28,11 +28,13 @@ typedef struct tagNAMES {
 typedef struct tagIRC_WINDOW {
     char	*label;		/* Should not be case-sensitive */
     char	*title;
-    PANEL	*pan;
     int		 refnum;
     PTEXTBUF	 buf;
-    int		 saved_size;
-    int		 scroll_count;
+    int		 unread;	/* lines printed while not shown */
+    unsigned int last_viewed;	/* when it was last activated */
+    int		 evicted;	/* lines trimmed to fit in the budget */
+    int		 top_line;	/* in scroll mode: number of the top line */
+    int		 top_row;	/* ...and its row at the top */
     bool	 scroll_mode;
     PNAMES	 names_hash[NAMES_HASH_TABLE_SIZE];
     bool	 received_names;
@@ -67,11 +69,23 @@ void		new_window_title             (const char *label, const char *title);
 void		windowSystem_deinit          (void);
 void		windowSystem_init            (void);
 void		window_close_all_priv_conv   (void);
+void		window_enforce_budget        (void);
+void		window_add_unread            (PIRC_WINDOW);
+void		window_check_colors          (void);
 void		window_foreach_destroy_names (void);
+void		window_list_unread           (char *buf, size_t size);
 void		window_scroll_down           (PIRC_WINDOW);
 void		window_scroll_up             (PIRC_WINDOW);
 void		window_select_next           (void);
 void		window_select_prev           (void);
 void		windows_recreate_all         (int rows, int cols);
+size_t		window_scrollback_bytes      (void);
+
+#ifdef UNIT_TESTING
+PIRC_WINDOW	window_new_for_testing       (const char *label);
+void		window_free_for_testing      (PIRC_WINDOW);
+#endif
+
+WINDOW		*window_viewport(void);
 
 #endif
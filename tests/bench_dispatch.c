@@ -0,0 +1,66 @@
+/* Microbenchmark of the event dispatch: compares the linear search
+   that irc_search_and_route_event() used to do with the dispatch
+   tables. Build with 'make bench' and run ./bench_dispatch.run */
+
+#include "common.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include "irc.h"
+
+#define ITERATIONS 2000000
+
+/* Roughly what a NAMES/WHO/LIST flood looks like */
+static const char *commands[] = {
+    "353", "353", "353", "366",
+    "352", "352", "352", "315",
+    "322", "322", "322", "323",
+    "PRIVMSG", "PRIVMSG", "NOTICE", "JOIN", "PART", "QUIT", "PING",
+    "999", "WALLOPS",
+};
+
+static double
+elapsed(const struct timespec *start, const struct timespec *stop)
+{
+    return ((stop->tv_sec - start->tv_sec) * 1e9 +
+	    (stop->tv_nsec - start->tv_nsec));
+}
+
+static double
+run(bool (*lookup)(const char *), const char *label)
+{
+    struct timespec start, stop;
+    volatile int found = 0;
+    double ns;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long int i = 0; i < ITERATIONS; i++) {
+	if (lookup(commands[i % ARRAY_SIZE(commands)]))
+	    found++;
+    }
+    (void) clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    ns = elapsed(&start, &stop) / ITERATIONS;
+    printf("%-8s %8.2f ns/lookup (%d found)\n", label, ns, found);
+    return ns;
+}
+
+int
+main()
+{
+    double before, after;
+
+    for (size_t i = 0; i < ARRAY_SIZE(commands); i++) {
+	if (irc_event_exists(commands[i]) !=
+	    irc_event_exists_linear(commands[i])) {
+	    fprintf(stderr, "mismatch on %s\n", commands[i]);
+	    return EXIT_FAILURE;
+	}
+    }
+
+    before = run(irc_event_exists_linear, "linear");
+    after  = run(irc_event_exists, "table");
+    printf("speedup  %8.2fx\n", before / after);
+    return EXIT_SUCCESS;
+}
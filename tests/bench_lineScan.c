@@ -0,0 +1,120 @@
+/* Benchmark of the line scanner: replays a burst of server output
+   and reports lines/sec for each implementation. Build with 'make
+   bench' and run './bench_lineScan.run [capture]'. Without a
+   capture, a 50k-line /LIST burst is generated. */
+
+#include "common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "lineScan.h"
+
+#define LIST_LINES	50000
+#define ROUNDS		20
+
+static char	*burst;
+static size_t	 burst_len;
+
+static void
+generate_list_burst(void)
+{
+    const size_t size = LIST_LINES * 128;
+    size_t len = 0;
+
+    if ((burst = malloc(size)) == NULL)
+	abort();
+
+    for (int i = 0; i < LIST_LINES; i++) {
+	const int n = snprintf(&burst[len], size - len,
+	    ":irc.server.com 322 mynick #channel%d %d "
+	    ":[+nt] Topic of channel number %d\r\n", i, i % 500, i);
+
+	if (n < 0 || (size_t) n >= size - len)
+	    abort();
+	len += n;
+    }
+
+    burst_len = len;
+}
+
+static bool
+read_capture(const char *path)
+{
+    FILE *fp = NULL;
+    long int size = 0;
+
+    if ((fp = fopen(path, "rb")) == NULL || fseek(fp, 0, SEEK_END) != 0 ||
+	(size = ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET) != 0) {
+	if (fp)
+	    fclose(fp);
+	return false;
+    }
+
+    if ((burst = malloc(size)) == NULL ||
+	fread(burst, 1, size, fp) != (size_t) size) {
+	fclose(fp);
+	return false;
+    }
+
+    fclose(fp);
+    burst_len = size;
+    return true;
+}
+
+static void
+run(enum line_scan_impl impl)
+{
+    double secs;
+    long int lines = 0, trailing = 0;
+    struct timespec start, stop;
+
+    if (!line_scan_set_impl(impl))
+	return;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < ROUNDS; round++) {
+	const char *p = &burst[0];
+	const char *end = &burst[burst_len];
+
+	while (p < end) {
+	    struct line_scan ls;
+
+	    line_scan(p, end - p, &ls);
+	    if (ls.eol > 0)
+		lines++;
+	    if (ls.trailing != LINE_SCAN_NONE)
+		trailing++;
+	    p += ls.eol + 1;
+	}
+    }
+    (void) clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    secs = (stop.tv_sec - start.tv_sec) +
+	(stop.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-8s %12.0f lines/sec %9.1f MB/s (%ld lines, %ld trailing)\n",
+	line_scan_impl_name(), lines / secs,
+	burst_len * (double) ROUNDS / secs / 1e6, lines / ROUNDS,
+	trailing / ROUNDS);
+}
+
+int
+main(int argc, char *argv[])
+{
+    if (argc > 1) {
+	if (!read_capture(argv[1])) {
+	    fprintf(stderr, "%s: cannot read capture\n", argv[1]);
+	    return EXIT_FAILURE;
+	}
+    } else {
+	generate_list_burst();
+    }
+
+    printf("burst: %zu bytes\n", burst_len);
+    run(LINE_SCAN_SCALAR);
+    run(LINE_SCAN_SSE2);
+    run(LINE_SCAN_AVX2);
+    free(burst);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/* Benchmark of text decoding: decodes a mix of ASCII, UTF-8 and
+   Latin-1 lines with text_decode() and, for comparison, with the
+   setlocale() and mbstowcs() approach previously used by
+   printtext. Build with 'make bench' and run
+   './bench_textDecode.run'. */
+
+#include "common.h"
+
+#include <locale.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <wchar.h>
+
+#include "textDecode.h"
+
+#define ROUNDS 200000
+
+static const char *lines[] = {
+    "<nick> just a plain ASCII line of chat, like most of them are",
+    "<nick> r\xc3\xa4ksm\xc3\xb6rg\xc3\xa5s \xe2\x82\xac 42, "
+	"some UTF-8 text in the middle of a line",
+    "<nick> r\xe4ksm\xf6rg\xe5s \xa4 42, an old client still "
+	"sending Latin-1",
+};
+
+static double
+elapsed(const struct timespec *start)
+{
+    struct timespec stop;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &stop);
+    return (stop.tv_sec - start->tv_sec) +
+	(stop.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static size_t
+decode_with_locale(const char *buf, wchar_t *out, size_t size)
+{
+    static const char *codesets[] = {
+	"C.UTF-8", "en_US.UTF-8", "en_US.ISO-8859-1", "en_US.ISO-8859-15",
+    };
+    size_t n = (size_t) -1;
+
+    for (size_t i = 0; i < ARRAY_SIZE(codesets); i++) {
+	if (setlocale(LC_CTYPE, codesets[i]) == NULL)
+	    continue;
+	if ((n = mbstowcs(out, buf, size)) != (size_t) -1)
+	    break;
+    }
+
+    (void) setlocale(LC_CTYPE, "");
+    return n;
+}
+
+int
+main(void)
+{
+    double secs;
+    size_t chars = 0;
+    struct timespec start;
+    wchar_t out[256];
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < ROUNDS; round++) {
+	const char *line = lines[round % ARRAY_SIZE(lines)];
+
+	chars += text_decode(line, strlen(line), out, TEXT_ENC_ISO8859_1,
+	    NULL);
+    }
+    secs = elapsed(&start);
+    printf("%-12s %12.0f lines/sec (%zu chars)\n", "text_decode",
+	ROUNDS / secs, chars);
+
+    chars = 0;
+    (void) clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < ROUNDS; round++) {
+	const size_t n = decode_with_locale(lines[round % ARRAY_SIZE(lines)],
+	    out, ARRAY_SIZE(out));
+
+	if (n != (size_t) -1)
+	    chars += n;
+    }
+    secs = elapsed(&start);
+    printf("%-12s %12.0f lines/sec (%zu chars)\n", "setlocale",
+	ROUNDS / secs, chars);
+    return EXIT_SUCCESS;
+}
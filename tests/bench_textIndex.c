@@ -0,0 +1,144 @@
+/* Benchmark of the scrollback search: fills 200 text buffers with 1M
+   lines of chat in all, and reports the time it takes to look for a
+   pattern through the trigram indexes and with a linear scan. Build
+   with 'make bench' and run './bench_textIndex.run [pattern]'. */
+
+#include "common.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "textBuffer.h"
+#include "textIndex.h"
+
+#define WINDOWS		200
+#define LINES		5000 /* per window */
+#define ROUNDS		10
+
+static PTEXTBUF	 buf[WINDOWS];
+static char	 norm[512];
+
+static const char *words[] = {
+    "hello", "anyone", "know", "how", "to", "build", "this", "on",
+    "linux", "server", "channel", "topic", "again", "thanks", "lol",
+    "network", "config", "window", "later", "really",
+};
+
+static void
+fill_buffers(void)
+{
+    const int nwords = sizeof words / sizeof words[0];
+    char text[256];
+    unsigned int seed = 1;
+
+    for (int w = 0; w < WINDOWS; w++) {
+	buf[w] = textBuf_new();
+	textBuf_set_compress(buf[w], true);
+	textBuf_index_lines(buf[w], true);
+
+	for (int i = 0; i < LINES; i++) {
+	    int len = snprintf(text, sizeof text,
+		"[%02d:%02d] <\002nick%d\002> ", i / 60 % 24, i % 60, w);
+
+	    for (int k = 0; k < 8; k++) {
+		seed = seed * 1103515245U + 12345U;
+		len += snprintf(&text[len], sizeof text - len, "%s ",
+		    words[(seed >> 16) % nwords]);
+	    }
+	    if (textBuf_ins_next(buf[w], textBuf_tail(buf[w]), text, 0) != 0)
+		abort();
+	}
+    }
+}
+
+static bool
+matches(PTEXTBUF b, int num, const char *pattern)
+{
+    TEXTBUF_ELMT scratch;
+    PTEXTBUF_ELMT element;
+
+    if ((element = textBuf_get_line(b, num, &scratch)) == NULL)
+	return false;
+    textIndex_normalize(element->text, norm);
+    return (strstr(norm, pattern) != NULL);
+}
+
+static long int
+search_indexed(const char *pattern)
+{
+    long int found = 0;
+
+    for (int w = 0; w < WINDOWS; w++) {
+	int *nums = NULL;
+	const int n = textIndex_candidates(buf[w]->index, pattern, &nums);
+
+	for (int i = 0; i < n; i++) {
+	    if (matches(buf[w], nums[i], pattern))
+		found++;
+	}
+	free(nums);
+    }
+
+    return found;
+}
+
+static long int
+search_linear(const char *pattern)
+{
+    long int found = 0;
+
+    for (int w = 0; w < WINDOWS; w++) {
+	for (int num = textBuf_first_num(buf[w]);
+	     num < textBuf_end_num(buf[w]); num++) {
+	    if (matches(buf[w], num, pattern))
+		found++;
+	}
+    }
+
+    return found;
+}
+
+static void
+run(const char *name, long int (*search)(const char *), const char *pattern)
+{
+    double secs;
+    long int found = 0;
+    struct timespec start, stop;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < ROUNDS; round++)
+	found = search(pattern);
+    (void) clock_gettime(CLOCK_MONOTONIC, &stop);
+
+    secs = (stop.tv_sec - start.tv_sec) +
+	(stop.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%-8s %10.2f ms/search (%ld matches)\n", name,
+	secs * 1e3 / ROUNDS, found);
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *pattern = (argc > 1 ? argv[1] : "nick42> linux");
+    size_t bytes = 0;
+
+    if (strlen(pattern) >= sizeof norm)
+	return EXIT_FAILURE;
+    textIndex_normalize(pattern, norm);
+    pattern = strdup(norm);
+
+    fill_buffers();
+    for (int w = 0; w < WINDOWS; w++)
+	bytes += textBuf_bytes(buf[w]);
+    printf("%d lines in %d windows: %zu bytes\n", WINDOWS * LINES, WINDOWS,
+	bytes);
+
+    run("indexed", search_indexed, pattern);
+    run("linear", search_linear, pattern);
+
+    for (int w = 0; w < WINDOWS; w++)
+	textBuf_destroy(buf[w]);
+    free((char *) pattern);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "colorPairs.h"
+#include "curses-funcs.h"
+
+#define MAX_PAIRS 8 /* pair 0 and seven more */
+
+static struct {
+    short int fg;
+    short int bg;
+} defined[MAX_PAIRS];
+static int init_pair_calls;
+
+static int
+fake_init_pair(short int pair, short int fg, short int bg)
+{
+    if (pair <= 0 || pair >= MAX_PAIRS)
+	return ERR;
+    defined[pair].fg = fg;
+    defined[pair].bg = bg;
+    init_pair_calls++;
+    return OK;
+}
+
+static int
+setup(void **state)
+{
+    init_pair_calls = 0;
+    color_pairs_init(0, MAX_PAIRS, 256, fake_init_pair);
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    color_pairs_deinit();
+    return 0;
+}
+
+static void
+defines_pairs_once(void **state)
+{
+    short int pair;
+
+    assert_int_equal(color_pair_find(1, 2), -1);
+    pair = color_pair_get(1, 2);
+    assert_true(pair > 0);
+    assert_int_equal(defined[pair].fg, 1);
+    assert_int_equal(defined[pair].bg, 2);
+    assert_int_equal(color_pair_get(1, 2), pair);
+    assert_int_equal(color_pair_find(1, 2), pair);
+    assert_int_equal(init_pair_calls, 1);
+
+    /* the default background */
+    assert_int_not_equal(color_pair_get(1, -1), pair);
+}
+
+static void
+recycles_least_recently_used(void **state)
+{
+    struct color_pairs_stats stats;
+    short int first, pair;
+
+    first = color_pair_get(100, 0);
+    for (short int fg = 101; fg < 107; fg++)
+	assert_true(color_pair_get(fg, 0) > 0);
+
+    /* all pairs in use: touch the first one, then ask for a new one */
+    assert_int_equal(color_pair_get(100, 0), first);
+    pair = color_pair_get(200, 0);
+    assert_true(pair > 0);
+    assert_int_not_equal(pair, first);
+    assert_int_equal(color_pair_find(101, 0), -1);
+    assert_int_equal(color_pair_find(100, 0), first);
+    assert_int_equal(color_pair_find(200, 0), pair);
+
+    color_pairs_stats(&stats);
+    assert_int_equal(stats.allocs, 8);
+    assert_int_equal(stats.recycled, 1);
+    assert_int_equal(stats.hits, 1);
+}
+
+static void
+maps_extended_colors(void **state)
+{
+    bool bright;
+
+    assert_int_equal(color_from_mirc(16, &bright), 52);
+    assert_int_equal(color_from_mirc(52, NULL), 196);
+    assert_int_equal(color_from_mirc(98, NULL), 231);
+    assert_false(bright);
+    assert_int_equal(color_from_rgb(0xff0000, NULL), 196);
+    assert_int_equal(color_from_rgb(0x808080, NULL), 244);
+
+    /* 8-color terminal: nearest basic color */
+    color_pairs_init(0, MAX_PAIRS, 8, fake_init_pair);
+    assert_int_equal(color_from_mirc(52, &bright), COLOR_RED);
+    assert_true(bright);
+    assert_int_equal(color_from_rgb(0x000080, &bright), COLOR_BLUE);
+    assert_false(bright);
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test_setup_teardown(defines_pairs_once, setup, teardown),
+	cmocka_unit_test_setup_teardown(recycles_least_recently_used, setup,
+	    teardown),
+	cmocka_unit_test_setup_teardown(maps_extended_colors, setup, teardown),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
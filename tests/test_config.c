@@ -0,0 +1,122 @@
+#include "common.h"
+
+#include <pthread.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "config.h"
+
+static char path[] = "/tmp/swirc-test_config.XXXXXX";
+
+static int
+read_config(void **state)
+{
+    FILE *fp;
+    int fd;
+
+    if ((fd = mkstemp(path)) == -1 || (fp = fdopen(fd, "w")) == NULL)
+	return -1;
+    fputs("encoding = \"UTF-8\";\n"
+	"flood_burst = \"500\";\n"
+	"frame_rate = \"60\";\n"
+	"sasl = \"yes\";\n", fp);
+    fclose(fp);
+
+    config_init();
+    config_readit(path, "r");
+    return 0;
+}
+
+static int
+remove_config(void **state)
+{
+    config_deinit();
+    (void) remove(path);
+    return 0;
+}
+
+static void
+parses_settings(void **state)
+{
+    const struct config_snapshot *conf = config_current();
+
+    assert_int_equal(conf->encoding, TEXT_ENC_UTF8);
+    assert_int_equal(conf->frame_rate, 60);
+    assert_true(conf->sasl);
+    /* missing settings get their defaults */
+    assert_int_equal(conf->textbuffer_size_absolute, 1500);
+    assert_true(conf->ssl_verify_peer);
+}
+
+static void
+falls_back_when_out_of_range(void **state)
+{
+    assert_int_equal(config_current()->flood_burst, 5);
+}
+
+static void
+publishes_changes(void **state)
+{
+    const struct config_snapshot *old = config_current();
+
+    assert_int_equal(config_item_undef("sasl"), 0);
+    assert_int_equal(config_item_install("sasl", "no"), 0);
+    assert_false(config_current()->sasl);
+    assert_true(config_current() != old);
+
+    /* older snapshots stay valid, however many changes later */
+    for (int i = 0; i < 3; i++) {
+	assert_int_equal(config_item_undef("sasl"), 0);
+	assert_int_equal(config_item_install("sasl", "no"), 0);
+    }
+    assert_true(old->sasl);
+    assert_int_equal(old->frame_rate, 60);
+}
+
+static volatile bool publishing = true;
+
+static void *
+read_snapshots(void *arg)
+{
+    int *bad = arg;
+
+    while (publishing) {
+	const int rate = config_current()->frame_rate;
+
+	if (rate != 60 && rate != 61)
+	    (*bad)++;
+    }
+    return NULL;
+}
+
+static void
+reads_while_publishing(void **state)
+{
+    pthread_t reader;
+    int bad = 0;
+
+    assert_int_equal(pthread_create(&reader, NULL, read_snapshots, &bad), 0);
+    for (int i = 0; i < 1000; i++) {
+	assert_int_equal(config_item_undef("frame_rate"), 0);
+	assert_int_equal(config_item_install("frame_rate",
+	    i % 2 ? "60" : "61"), 0);
+    }
+    publishing = false;
+    assert_int_equal(pthread_join(reader, NULL), 0);
+
+    assert_int_equal(bad, 0);
+    assert_int_equal(config_current()->frame_rate, 60);
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(parses_settings),
+	cmocka_unit_test(falls_back_when_out_of_range),
+	cmocka_unit_test(publishes_changes),
+	cmocka_unit_test(reads_while_publishing),
+    };
+
+    return cmocka_run_group_tests(tests, read_config, remove_config);
+}
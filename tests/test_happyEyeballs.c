@@ -0,0 +1,184 @@
+#include "common.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+#include <cmocka.h>
+
+#include "happyEyeballs.h"
+
+struct candidate {
+    struct addrinfo		ai;
+    struct sockaddr_storage	addr;
+};
+
+static void
+make_candidate(struct candidate *c, int family, const char *addr,
+	       unsigned short int port, struct candidate *next)
+{
+    BZERO(c, sizeof *c);
+    c->ai.ai_family   = family;
+    c->ai.ai_socktype = SOCK_STREAM;
+    c->ai.ai_addr     = (struct sockaddr *) &c->addr;
+    c->ai.ai_next     = (next ? &next->ai : NULL);
+
+    if (family == AF_INET) {
+	struct sockaddr_in *sin = (struct sockaddr_in *) &c->addr;
+
+	sin->sin_family = AF_INET;
+	sin->sin_port	= htons(port);
+	assert_int_equal(inet_pton(AF_INET, addr, &sin->sin_addr), 1);
+	c->ai.ai_addrlen = sizeof *sin;
+    } else {
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *) &c->addr;
+
+	sin6->sin6_family = AF_INET6;
+	sin6->sin6_port	  = htons(port);
+	assert_int_equal(inet_pton(AF_INET6, addr, &sin6->sin6_addr), 1);
+	c->ai.ai_addrlen = sizeof *sin6;
+    }
+}
+
+/*
+ * Listen on an ephemeral loopback port
+ */
+static int
+listen_loopback(unsigned short int *port)
+{
+    struct sockaddr_in sin;
+    socklen_t len = sizeof sin;
+    int sock;
+
+    BZERO(&sin, sizeof sin);
+    sin.sin_family	= AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sin.sin_port	= 0;
+
+    assert_true((sock = socket(AF_INET, SOCK_STREAM, 0)) != -1);
+    assert_int_equal(bind(sock, (struct sockaddr *) &sin, sizeof sin), 0);
+    assert_int_equal(listen(sock, 5), 0);
+    assert_int_equal(getsockname(sock, (struct sockaddr *) &sin, &len), 0);
+    *port = ntohs(sin.sin_port);
+    return sock;
+}
+
+static enum he_state
+run(struct happy_eyeballs *he)
+{
+    while (he_step(he, 100) == HE_STATE_CONNECTING)
+	/* continue */;
+    return he->state;
+}
+
+static void
+interleaves_families(void **state)
+{
+    struct candidate c[4];
+    struct happy_eyeballs he;
+
+    make_candidate(&c[3], AF_INET, "192.0.2.2", 6667, NULL);
+    make_candidate(&c[2], AF_INET, "192.0.2.1", 6667, &c[3]);
+    make_candidate(&c[1], AF_INET6, "2001:db8::2", 6667, &c[2]);
+    make_candidate(&c[0], AF_INET6, "2001:db8::1", 6667, &c[1]);
+
+    he_init(&he, &c[0].ai, NULL, 1000);
+    assert_int_equal(he.n_candidates, 4);
+    assert_ptr_equal(he.candidate[0], &c[0].ai);
+    assert_ptr_equal(he.candidate[1], &c[2].ai);
+    assert_ptr_equal(he.candidate[2], &c[1].ai);
+    assert_ptr_equal(he.candidate[3], &c[3].ai);
+}
+
+static void
+drops_families_without_a_bind_address(void **state)
+{
+    struct candidate c[2], local;
+    struct happy_eyeballs he;
+
+    make_candidate(&c[1], AF_INET, "192.0.2.1", 6667, NULL);
+    make_candidate(&c[0], AF_INET6, "2001:db8::1", 6667, &c[1]);
+    make_candidate(&local, AF_INET, "127.0.0.1", 0, NULL);
+
+    he_init(&he, &c[0].ai, &local.ai, 1000);
+    assert_int_equal(he.n_candidates, 1);
+    assert_ptr_equal(he.candidate[0], &c[1].ai);
+}
+
+static void
+falls_back_past_a_dead_candidate(void **state)
+{
+    struct candidate c[2];
+    struct happy_eyeballs he;
+    unsigned short int port = 0;
+    const int listener = listen_loopback(&port);
+    unsigned long long start;
+
+    /* the documentation prefix is never reachable */
+    make_candidate(&c[1], AF_INET, "127.0.0.1", port, NULL);
+    make_candidate(&c[0], AF_INET6, "2001:db8::1", port, &c[1]);
+
+    start = net_monotonic_ms();
+    he_init(&he, &c[0].ai, NULL, 10000);
+    assert_int_equal(run(&he), HE_STATE_CONNECTED);
+    assert_ptr_equal(he.winner, &c[1].ai);
+    assert_true(net_monotonic_ms() - start < 2000);
+    assert_int_equal(he.n_attempts, 0);
+
+    close(he.sock);
+    close(listener);
+}
+
+static void
+fails_when_every_candidate_is_refused(void **state)
+{
+    struct candidate c;
+    struct happy_eyeballs he;
+    unsigned short int port = 0;
+
+    /* a port that was just released has nobody listening on it */
+    close(listen_loopback(&port));
+    make_candidate(&c, AF_INET, "127.0.0.1", port, NULL);
+
+    he_init(&he, &c.ai, NULL, 10000);
+    assert_int_equal(run(&he), HE_STATE_FAILED);
+    assert_int_equal(he.error, ECONNREFUSED);
+}
+
+static void
+gives_up_when_cancelled(void **state)
+{
+    struct candidate c;
+    struct happy_eyeballs he;
+    volatile bool cancel = false;
+
+    /* never answers, so only the flag ends the race */
+    make_candidate(&c, AF_INET, "192.0.2.1", 6667, NULL);
+
+    he_init(&he, &c.ai, NULL, 10000);
+    he.cancel = &cancel;
+    assert_int_equal(he_step(&he, 10), HE_STATE_CONNECTING);
+    cancel = true;
+    assert_int_equal(he_step(&he, 10), HE_STATE_FAILED);
+    assert_int_equal(he.error, ECANCELED);
+    assert_int_equal(he.n_attempts, 0);
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(interleaves_families),
+	cmocka_unit_test(drops_families_without_a_bind_address),
+	cmocka_unit_test(falls_back_past_a_dead_candidate),
+	cmocka_unit_test(fails_when_every_candidate_is_refused),
+	cmocka_unit_test(gives_up_when_cancelled),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,170 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "irc.h"
+#include "strHand.h"
+
+static char buf[IRC_MAX_MESSAGE] = "";
+static struct irc_message_compo compo;
+
+static bool
+slice_equal(const struct irc_slice *slice, const char *str)
+{
+    return (slice->len == strlen(str) &&
+	    strncmp(slice->str, str, slice->len) == 0);
+}
+
+static void
+parses_prefix(void **state)
+{
+    snprintf(buf, sizeof buf, ":nick!user@host PRIVMSG #chan :hello world");
+    assert_int_equal(irc_parse_message(buf, &compo), 0);
+    assert_string_equal(compo.prefix, ":nick!user@host");
+    assert_string_equal(compo.command, "PRIVMSG");
+    assert_string_equal(compo.params, "#chan :hello world");
+    assert_true(slice_equal(&compo.nick, "nick"));
+    assert_true(slice_equal(&compo.user, "user"));
+    assert_true(slice_equal(&compo.host, "host"));
+
+    snprintf(buf, sizeof buf, ":irc.server.com 001 me :Welcome");
+    assert_int_equal(irc_parse_message(buf, &compo), 0);
+    assert_true(slice_equal(&compo.nick, "irc.server.com"));
+    assert_int_equal(compo.user.len, 0);
+    assert_int_equal(compo.host.len, 0);
+}
+
+static void
+parses_params(void **state)
+{
+    snprintf(buf, sizeof buf, ":srv 352 me #c u h s n H :0 real name");
+    assert_int_equal(irc_parse_message(buf, &compo), 0);
+    assert_int_equal(compo.num_params, 8);
+    assert_true(compo.has_trailing);
+    assert_true(slice_equal(&compo.param[0], "me"));
+    assert_true(slice_equal(&compo.param[6], "H"));
+    assert_string_equal(compo.param[7].str, "0 real name");
+
+    snprintf(buf, sizeof buf, "PING irc.server.com");
+    assert_int_equal(irc_parse_message(buf, &compo), 0);
+    assert_null(compo.prefix);
+    assert_int_equal(compo.num_params, 1);
+    assert_false(compo.has_trailing);
+
+    snprintf(buf, sizeof buf, ":a!b@c QUIT");
+    assert_int_equal(irc_parse_message(buf, &compo), 0);
+    assert_string_equal(compo.params, "");
+    assert_int_equal(compo.num_params, 0);
+}
+
+static void
+handles_max_params(void **state)
+{
+    snprintf(buf, sizeof buf, "CMD a b c d e f g h i j k l m n o p q");
+    assert_int_equal(irc_parse_message(buf, &compo), 0);
+    assert_int_equal(compo.num_params, IRC_MAX_PARAMS);
+    assert_string_equal(compo.param[IRC_MAX_PARAMS - 1].str, "o p q");
+}
+
+static void
+rejects_malformed(void **state)
+{
+    snprintf(buf, sizeof buf, ":prefix.only");
+    assert_int_equal(irc_parse_message(buf, &compo), -1);
+
+    snprintf(buf, sizeof buf, ": PRIVMSG #chan :text");
+    assert_int_equal(irc_parse_message(buf, &compo), -1);
+
+    snprintf(buf, sizeof buf, "%s", "");
+    assert_int_equal(irc_parse_message(buf, &compo), -1);
+
+    snprintf(buf, sizeof buf, ":prefix :CMD a b");
+    assert_int_equal(irc_parse_message(buf, &compo), 0);
+    assert_int_equal(compo.num_params, 2);
+}
+
+static void
+copies_slices(void **state)
+{
+    char dest[4] = "";
+
+    snprintf(buf, sizeof buf, "JOIN #channel");
+    assert_int_equal(irc_parse_message(buf, &compo), 0);
+    assert_string_equal(irc_slice_copy(&compo.param[0], dest, sizeof dest),
+	"#ch");
+}
+
+static void
+looks_up_events(void **state)
+{
+    assert_true(irc_event_exists("PRIVMSG"));
+    assert_true(irc_event_exists("WALLOPS"));
+    assert_true(irc_event_exists("001"));
+    assert_true(irc_event_exists("907"));
+    assert_false(irc_event_exists("PRIVMS"));
+    assert_false(irc_event_exists("privmsg"));
+    assert_false(irc_event_exists("999"));
+    assert_false(irc_event_exists("0001"));
+    assert_false(irc_event_exists(""));
+}
+
+static void
+keeps_partial_lines(void **state)
+{
+    char data[16] = "";
+    struct irc_recvbuf rb = {
+	.data	    = data,
+	.size	    = sizeof data,
+	.len	    = 0,
+	.discarding = false,
+    };
+
+    rb.len = strlen(strcpy(data, "\r\n\r\nPRIV"));
+    irc_handle_interpret_events(&rb);
+    assert_int_equal(rb.len, 4);
+    assert_memory_equal(rb.data, "PRIV", 4);
+    assert_false(rb.discarding);
+}
+
+static void
+discards_overlong_lines(void **state)
+{
+    char data[8] = "";
+    struct irc_recvbuf rb = {
+	.data	    = data,
+	.size	    = sizeof data,
+	.len	    = 0,
+	.discarding = false,
+    };
+
+    memcpy(data, "01234567", sizeof data);
+    rb.len = sizeof data;
+    irc_handle_interpret_events(&rb);
+    assert_int_equal(rb.len, 0);
+    assert_true(rb.discarding);
+
+    memcpy(data, "89\r\nPRIV", sizeof data);
+    rb.len = sizeof data;
+    irc_handle_interpret_events(&rb);
+    assert_false(rb.discarding);
+    assert_int_equal(rb.len, 4);
+    assert_memory_equal(rb.data, "PRIV", 4);
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(parses_prefix),
+	cmocka_unit_test(parses_params),
+	cmocka_unit_test(handles_max_params),
+	cmocka_unit_test(rejects_malformed),
+	cmocka_unit_test(copies_slices),
+	cmocka_unit_test(looks_up_events),
+	cmocka_unit_test(keeps_partial_lines),
+	cmocka_unit_test(discards_overlong_lines),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,94 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "commands/lastlog.h"
+#include "config.h"
+#include "printtext.h"
+#include "textBuffer.h"
+#include "window.h"
+
+static PIRC_WINDOW window = NULL;
+
+static int
+setup(void **state)
+{
+    config_init();
+    config_item_install("scrollback_spill", "no");
+
+    window = window_new_for_testing("#lastlog");
+    window->scroll_mode = true; /* don't draw */
+    g_active_window = window;
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    g_active_window = NULL;
+    window_free_for_testing(window);
+    config_deinit();
+    return 0;
+}
+
+static void
+print_lines(void)
+{
+    struct printtext_context ctx = {
+	.window	    = window,
+	.spec_type  = TYPE_SPEC_NONE,
+	.include_ts = false,
+    };
+
+    for (int i = 0; i < 200; i++) {
+	if (i % 20 == 0)
+	    printtext(&ctx, "line %d mentions Needle", i);
+	else
+	    printtext(&ctx, "line %d is hay", i);
+    }
+}
+
+/*
+ * Run the search and get the number of lines it printed
+ */
+static int
+search(const char *data)
+{
+    const int size = textBuf_size(window->buf);
+
+    cmd_lastlog(data);
+    return (textBuf_size(window->buf) - size);
+}
+
+static void
+finds_the_same_lines_twice(void **state)
+{
+    print_lines();
+    assert_int_equal(search("needle"), 10);
+    assert_int_equal(search("needle"), 10);
+    assert_int_equal(search("-all needle"), 11); /* with the label */
+}
+
+static void
+finds_the_same_lines_twice_unindexed(void **state)
+{
+    textBuf_index_lines(window->buf, false);
+    assert_int_equal(search("needle"), 10);
+    assert_int_equal(search("needle"), 10);
+
+    /* and indexing them again leaves out the results */
+    textBuf_index_lines(window->buf, true);
+    assert_int_equal(search("needle"), 10);
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(finds_the_same_lines_twice),
+	cmocka_unit_test(finds_the_same_lines_twice_unindexed),
+    };
+
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,88 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "lineScan.h"
+
+static const enum line_scan_impl impls[] = {
+    LINE_SCAN_SCALAR,
+    LINE_SCAN_SSE2,
+    LINE_SCAN_AVX2,
+};
+
+static void
+scan(const char *buf, struct line_scan *ls)
+{
+    line_scan(buf, strlen(buf), ls);
+}
+
+static void
+finds_line_boundaries(void **state)
+{
+    struct line_scan ls;
+
+    for (size_t i = 0; i < ARRAY_SIZE(impls); i++) {
+	if (!line_scan_set_impl(impls[i]))
+	    continue;
+
+	scan("PING :irc.server.com\r\n", &ls);
+	assert_int_equal(ls.eol, 20);
+	assert_int_equal(ls.trailing, 4);
+
+	scan("no line feed here at all, just a long partial line", &ls);
+	assert_int_equal(ls.eol, 50);
+	assert_int_equal(ls.trailing, LINE_SCAN_NONE);
+
+	scan(":nick!user@host PRIVMSG #channel-with-a-long-name\n :x", &ls);
+	assert_int_equal(ls.eol, 49);
+	assert_int_equal(ls.trailing, LINE_SCAN_NONE);
+
+	scan("\r\n", &ls);
+	assert_int_equal(ls.eol, 0);
+    }
+}
+
+static void
+implementations_agree(void **state)
+{
+    static const char alphabet[] = "ab :\r\n";
+    char buf[300] = "";
+
+    srand(1);
+
+    for (int round = 0; round < 20000; round++) {
+	const size_t len = rand() % (sizeof buf - 1);
+	const int density = 4 + round % 64;
+	struct line_scan expected, ls;
+
+	for (size_t i = 0; i < len; i++) {
+	    /* Mostly plain text so that lines span several vectors */
+	    buf[i] = (rand() % density ? 'x' : alphabet[rand() %
+		(sizeof alphabet - 1)]);
+	}
+	buf[len] = '\0';
+
+	(void) line_scan_set_impl(LINE_SCAN_SCALAR);
+	line_scan(buf, len, &expected);
+
+	for (size_t i = 1; i < ARRAY_SIZE(impls); i++) {
+	    if (!line_scan_set_impl(impls[i]))
+		continue;
+	    line_scan(buf, len, &ls);
+	    assert_int_equal(ls.eol, expected.eol);
+	    assert_int_equal(ls.trailing, expected.trailing);
+	}
+    }
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(finds_line_boundaries),
+	cmocka_unit_test(implementations_agree),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
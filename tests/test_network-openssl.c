@@ -0,0 +1,172 @@
+#include "common.h"
+
+#include <sys/stat.h>
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cmocka.h>
+#include <openssl/ssl.h>
+
+#include "libUtils.h"
+#include "nestHome.h"
+#include "network.h"
+#include "strdup_printf.h"
+
+static char dir[] = "/tmp/swirc-test_session.XXXXXX";
+
+static int
+setup(void **state)
+{
+    if (mkdtemp(dir) == NULL)
+	return -1;
+    g_session_dir = dir;
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    g_session_dir = NULL;
+    return rmdir(dir);
+}
+
+static SSL_SESSION *
+new_session(long int age)
+{
+    static const unsigned char id[16] = "0123456789abcdef";
+    static const unsigned char key[48] = "master key";
+    static const unsigned char suite[2] = { 0xC0, 0x2F };
+    SSL_CTX *ctx = SSL_CTX_new(TLS_client_method());
+    SSL *ssl = SSL_new(ctx);
+    SSL_SESSION *sess = SSL_SESSION_new();
+
+    assert_non_null(sess);
+    assert_true(SSL_SESSION_set_protocol_version(sess, TLS1_2_VERSION));
+    /* ECDHE-RSA-AES128-GCM-SHA256 */
+    assert_true(SSL_SESSION_set_cipher(sess, SSL_CIPHER_find(ssl, suite)));
+    assert_true(SSL_SESSION_set1_id(sess, id, sizeof id));
+    assert_true(SSL_SESSION_set1_master_key(sess, key, sizeof key));
+    SSL_SESSION_set_time(sess, (long int) time(NULL) - age);
+    SSL_SESSION_set_timeout(sess, 300);
+
+    SSL_free(ssl);
+    SSL_CTX_free(ctx);
+    return sess;
+}
+
+static mode_t
+file_mode(const char *path)
+{
+    struct stat sb;
+
+    assert_int_equal(stat(path, &sb), 0);
+    return (sb.st_mode & 0777);
+}
+
+static void
+names_files_by_server(void **state)
+{
+    char *path, *expected;
+
+    path = net_ssl_session_file("irc.example.org", "6697");
+    expected = Strdup_printf("%s/irc.example.org_6697.pem", dir);
+    assert_string_equal(path, expected);
+    free(path);
+    free(expected);
+
+    /* nothing can escape the directory */
+    path = net_ssl_session_file("../x/y", "6697");
+    expected = Strdup_printf("%s/.._x_y_6697.pem", dir);
+    assert_string_equal(path, expected);
+    free(path);
+    free(expected);
+}
+
+static void
+saves_and_loads(void **state)
+{
+    char *path = net_ssl_session_file("irc.example.org", "6697");
+    SSL_SESSION *sess = new_session(0), *loaded;
+    unsigned int len;
+
+    net_ssl_session_save(path, sess);
+    assert_int_equal(file_mode(path), 0600);
+
+    assert_non_null(loaded = net_ssl_session_load(path));
+    assert_memory_equal(SSL_SESSION_get_id(loaded, &len), "0123456789abcdef",
+	16);
+    assert_int_equal(len, 16);
+
+    SSL_SESSION_free(loaded);
+    SSL_SESSION_free(sess);
+    assert_int_equal(remove(path), 0);
+    free(path);
+}
+
+static void
+restricts_an_existing_file(void **state)
+{
+    char *path = net_ssl_session_file("irc.example.org", "6697");
+    SSL_SESSION *sess = new_session(0);
+    FILE *fp;
+
+    assert_non_null(fp = fopen(path, "w"));
+    fclose(fp);
+    assert_int_equal(chmod(path, 0644), 0);
+
+    net_ssl_session_save(path, sess);
+    assert_int_equal(file_mode(path), 0600);
+
+    SSL_SESSION_free(sess);
+    assert_int_equal(remove(path), 0);
+    free(path);
+}
+
+static void
+removes_expired_sessions(void **state)
+{
+    char *path = net_ssl_session_file("irc.example.org", "6697");
+    SSL_SESSION *sess = new_session(600);
+
+    net_ssl_session_save(path, sess);
+    assert_null(net_ssl_session_load(path));
+    assert_int_equal(access(path, F_OK), -1);
+
+    SSL_SESSION_free(sess);
+    free(path);
+}
+
+static void
+ignores_bad_files(void **state)
+{
+    char *path = net_ssl_session_file("irc.example.org", "6697");
+    FILE *fp;
+
+    assert_null(net_ssl_session_load(path));
+
+    assert_non_null(fp = fopen(path, "w"));
+    fputs("-----BEGIN SSL SESSION PARAMETERS-----\ngarbage\n", fp);
+    fclose(fp);
+    assert_null(net_ssl_session_load(path));
+
+    assert_int_equal(remove(path), 0);
+    free(path);
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(names_files_by_server),
+	cmocka_unit_test(saves_and_loads),
+	cmocka_unit_test(restricts_an_existing_file),
+	cmocka_unit_test(removes_expired_sessions),
+	cmocka_unit_test(ignores_bad_files),
+    };
+
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,137 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "network.h"
+
+static char	written[1024] = "";
+static size_t	written_len = 0;
+static int	write_calls = 0;
+
+static int
+fake_write(const char *buf, int len)
+{
+    memcpy(&written[written_len], buf, len);
+    written_len += len;
+    write_calls++;
+    return len;
+}
+
+static int
+fake_send(const char *fmt, ...)
+{
+    int ret;
+    va_list ap;
+
+    va_start(ap, fmt);
+    ret = net_vsend_queued(fake_write, fmt, ap);
+    va_end(ap);
+
+    return ret;
+}
+
+static void
+reset(void)
+{
+    net_send_queue_reset();
+    net_send_flood_control(5, 2000);
+    BZERO(written, sizeof written);
+    written_len = 0;
+    write_calls = 0;
+}
+
+static void
+sends_lines_immediately(void **state)
+{
+    reset();
+    assert_int_equal(fake_send("NICK %s", "foo"), 10);
+    assert_int_equal(write_calls, 1);
+    assert_string_equal(written, "NICK foo\r\n");
+    assert_int_equal(net_send_pending(), 0);
+}
+
+static void
+coalesces_batched_lines(void **state)
+{
+    reset();
+    net_send_batch_begin();
+    (void) fake_send("JOIN #%s", "a");
+    net_send_batch_begin();
+    (void) fake_send("JOIN #%s", "b");
+    assert_int_equal(net_send_batch_end(), 0);
+    (void) fake_send("JOIN #%s", "c");
+    assert_int_equal(write_calls, 0);
+    assert_int_equal(net_send_pending(), 27);
+    assert_int_equal(net_send_batch_end(), 0);
+    assert_int_equal(write_calls, 1);
+    assert_string_equal(written, "JOIN #a\r\nJOIN #b\r\nJOIN #c\r\n");
+    assert_int_equal(net_send_pending(), 0);
+}
+
+static void
+throttles_beyond_the_burst(void **state)
+{
+    int i;
+
+    reset();
+    net_send_flood_control(3, 60000);
+    for (i = 0; i < 5; i++)
+	(void) fake_send("NOTICE #chan :%d", i);
+    assert_int_equal(write_calls, 3);
+    assert_int_equal(net_send_queue_depth(), 2);
+    assert_true(net_send_wait_time() > 0);
+    assert_int_equal(net_send_flush(), 0);
+    assert_int_equal(write_calls, 3);
+}
+
+static void
+urgent_lines_preempt_bulk(void **state)
+{
+    reset();
+    net_send_flood_control(2, 60000);
+    net_send_batch_begin();
+    (void) fake_send("PRIVMSG #chan :%s", "a");
+    (void) fake_send("PRIVMSG #chan :%s", "b");
+    (void) fake_send("MODE %s", "#chan");
+    (void) fake_send("PONG :%s", "irc.example.org");
+    assert_int_equal(net_send_batch_end(), 0);
+    assert_string_equal(written,
+	"PONG :irc.example.org\r\nMODE #chan\r\n");
+    assert_int_equal(net_send_queue_depth(), 2);
+
+    /* the bucket is empty but urgent lines go anyway */
+    (void) fake_send("PONG :%s", "irc.example.org");
+    assert_int_equal(net_send_queue_depth(), 2);
+    assert_int_equal(written_len, 58);
+}
+
+static void
+quit_bypasses_an_exhausted_bucket(void **state)
+{
+    int i;
+
+    reset();
+    net_send_flood_control(2, 60000);
+    for (i = 0; i < 4; i++)
+	(void) fake_send("PRIVMSG #chan :%d", i);
+    assert_int_equal(net_send_queue_depth(), 2);
+
+    (void) fake_send("QUIT :%s", "bye");
+    assert_int_equal(net_send_queue_depth(), 2);
+    assert_string_equal(&written[written_len - 11], "QUIT :bye\r\n");
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(sends_lines_immediately),
+	cmocka_unit_test(coalesces_batched_lines),
+	cmocka_unit_test(throttles_beyond_the_burst),
+	cmocka_unit_test(urgent_lines_preempt_bulk),
+	cmocka_unit_test(quit_bypasses_an_exhausted_bucket),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -73,6 +73,111 @@ test7_squeeze_text_deco(void **state)
     assert_string_equal(buf, "foobar");
 }
 
+static void
+test8_squeeze_text_deco(void **state)
+{
+    snprintf(buf, sizeof buf, "%cff8000foo%c00ff00,000000bar%cbaz", HEX_COLOR,
+	HEX_COLOR, HEX_COLOR);
+    squeeze_text_deco(buf);
+    assert_string_equal(buf, "foobarbaz");
+}
+
+static void
+test0_printtext_line_new(void **state)
+{
+    struct printtext_line *line;
+
+    snprintf(buf, sizeof buf, "foo %cbar%c %cbaz", BOLD, BOLD, UNDERLINE);
+    line = printtext_line_new(buf);
+    assert_int_equal(line->nspans, 4);
+    assert_int_equal(line->span[0].offset, 0);
+    assert_int_equal(line->span[0].length, 4);
+    assert_int_equal(line->span[0].attrs, A_NORMAL);
+    assert_int_equal(line->span[1].offset, 5);
+    assert_int_equal(line->span[1].length, 3);
+    assert_int_equal(line->span[1].attrs, A_BOLD);
+    assert_int_equal(line->span[2].offset, 9);
+    assert_int_equal(line->span[2].length, 1);
+    assert_int_equal(line->span[2].attrs, A_NORMAL);
+    assert_int_equal(line->span[3].offset, 11);
+    assert_int_equal(line->span[3].length, 3);
+    assert_int_equal(line->span[3].attrs, A_UNDERLINE);
+    printtext_line_free(line);
+}
+
+static void
+test1_printtext_line_new(void **state)
+{
+    struct printtext_line *line;
+
+    /* codes only */
+    snprintf(buf, sizeof buf, "%c%c%c", BOLD, REVERSE, NORMAL);
+    line = printtext_line_new(buf);
+    assert_int_equal(line->nspans, 0);
+    printtext_line_free(line);
+
+    /* a lone ^C without digits resets colors, but isn't displayed */
+    snprintf(buf, sizeof buf, "%c%ca%c,b", REVERSE, COLOR, COLOR);
+    line = printtext_line_new(buf);
+    assert_int_equal(line->nspans, 2);
+    assert_int_equal(line->span[0].offset, 2);
+    assert_int_equal(line->span[0].length, 1);
+    assert_int_equal(line->span[0].attrs, A_REVERSE);
+    assert_int_equal(line->span[1].offset, 4);
+    assert_int_equal(line->span[1].length, 2);
+    printtext_line_free(line);
+}
+
+static void
+test2_printtext_line_new(void **state)
+{
+    struct printtext_line *line;
+
+    /* colors are kept as such: no pair is defined while parsing */
+    snprintf(buf, sizeof buf, "%c4foo%c bar%c%cbaz", COLOR, COLOR, COLOR,
+	NORMAL);
+    line = printtext_line_new(buf);
+    assert_int_equal(line->nspans, 3);
+    assert_int_not_equal(line->span[0].fg, SPAN_NO_COLOR);
+    assert_int_equal(line->span[0].bg, -1);
+    assert_int_equal(line->span[0].length, 3);
+    assert_int_equal(line->span[1].fg, SPAN_NO_COLOR);
+    assert_int_equal(line->span[1].length, 4);
+    assert_int_equal(line->span[2].fg, SPAN_NO_COLOR);
+    printtext_line_free(line);
+}
+
+static void
+test0_printtext_line_rows(void **state)
+{
+    struct printtext_line *line;
+    struct text_layout *layout;
+
+    /* rows are 10 columns wide and broken at spaces */
+    snprintf(buf, sizeof buf, "aaaa %cbbbb%c cccc", BOLD, BOLD);
+    line = printtext_line_new(buf);
+    assert_int_equal(printtext_line_rows(line, buf, 2, 12), 2);
+    layout = line->layout;
+    assert_non_null(layout);
+    assert_int_equal(printtext_line_rows(line, buf, 2, 12), 2);
+    assert_ptr_equal(line->layout, layout);
+    assert_int_equal(printtext_line_rows(line, buf, 2, 40), 1);
+
+    /* words longer than a row are broken */
+    assert_int_equal(printtext_line_rows(NULL, "aaaaaaaaaaaaaaaaaaaa", 0, 12),
+	2);
+    printtext_line_free(line);
+}
+
+static void
+test1_printtext_line_rows(void **state)
+{
+    assert_int_equal(printtext_line_rows(NULL, "", 0, 80), 0);
+    snprintf(buf, sizeof buf, "%c%c", BOLD, BOLD);
+    assert_int_equal(printtext_line_rows(NULL, buf, 0, 80), 1);
+    assert_int_equal(printtext_line_rows(NULL, "foo\nbar", 0, 80), 2);
+}
+
 int
 main()
 {
@@ -85,6 +190,12 @@ main()
 	cmocka_unit_test(test5_squeeze_text_deco),
 	cmocka_unit_test(test6_squeeze_text_deco),
 	cmocka_unit_test(test7_squeeze_text_deco),
+	cmocka_unit_test(test8_squeeze_text_deco),
+	cmocka_unit_test(test0_printtext_line_new),
+	cmocka_unit_test(test1_printtext_line_new),
+	cmocka_unit_test(test2_printtext_line_new),
+	cmocka_unit_test(test0_printtext_line_rows),
+	cmocka_unit_test(test1_printtext_line_rows),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,134 @@
+#include "common.h"
+
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <cmocka.h>
+
+#include "config.h"
+#include "resolver.h"
+
+static char hosts_file[] = "/tmp/swirc-hosts.XXXXXX";
+
+static void
+set_config(const char *name, const char *value)
+{
+    (void) config_item_undef(name);
+    assert_int_equal(config_item_install(name, value), 0);
+}
+
+static int
+setup(void **state)
+{
+    static const char contents[] =
+	"# test hosts\n"
+	"::1         irc.test\n"
+	"127.0.0.1   irc.test alias.test   # both families\n"
+	"192.0.2.1   other.test\n";
+    int fd;
+
+    if ((fd = mkstemp(hosts_file)) == -1 ||
+	write(fd, contents, sizeof contents - 1) != sizeof contents - 1)
+	return -1;
+    (void) close(fd);
+
+    set_config("hosts_file", hosts_file);
+    set_config("dns_cache_ttl", "300");
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    resolver_flush();
+    (void) unlink(hosts_file);
+    return 0;
+}
+
+static void
+overrides_from_the_hosts_file(void **state)
+{
+    struct addrinfo *res = resolver_lookup("IRC.test", "6667");
+    const struct sockaddr_in6 *sin6;
+    const struct sockaddr_in *sin;
+
+    assert_non_null(res);
+    assert_int_equal(res->ai_family, AF_INET6);
+    sin6 = (const struct sockaddr_in6 *) res->ai_addr;
+    assert_int_equal(ntohs(sin6->sin6_port), 6667);
+
+    assert_non_null(res->ai_next);
+    assert_int_equal(res->ai_next->ai_family, AF_INET);
+    sin = (const struct sockaddr_in *) res->ai_next->ai_addr;
+    assert_int_equal(ntohl(sin->sin_addr.s_addr), INADDR_LOOPBACK);
+    assert_null(res->ai_next->ai_next);
+    resolver_free(res);
+
+    res = resolver_lookup("alias.test", "6697");
+    assert_non_null(res);
+    assert_int_equal(res->ai_family, AF_INET);
+    assert_null(res->ai_next);
+    resolver_free(res);
+}
+
+static void
+caches_lookups(void **state)
+{
+    struct resolver_stats before, after;
+    struct addrinfo *res;
+
+    resolver_flush();
+    resolver_get_stats(&before);
+
+    res = resolver_lookup("127.0.0.2", "6667");
+    assert_non_null(res);
+    resolver_free(res);
+    res = resolver_lookup("127.0.0.2", "6667");
+    assert_non_null(res);
+    resolver_free(res);
+
+    resolver_get_stats(&after);
+    assert_int_equal(after.misses - before.misses, 1);
+    assert_int_equal(after.hits - before.hits, 1);
+
+    /* other port, other entry */
+    res = resolver_lookup("127.0.0.2", "6697");
+    resolver_free(res);
+    resolver_get_stats(&after);
+    assert_int_equal(after.misses - before.misses, 2);
+}
+
+static void
+ttl_zero_disables_the_cache(void **state)
+{
+    struct resolver_stats before, after;
+
+    set_config("dns_cache_ttl", "0");
+    resolver_flush();
+    resolver_get_stats(&before);
+    resolver_free(resolver_lookup("127.0.0.3", "6667"));
+    resolver_free(resolver_lookup("127.0.0.3", "6667"));
+    resolver_get_stats(&after);
+    assert_int_equal(after.misses - before.misses, 2);
+    assert_int_equal(after.hits - before.hits, 0);
+    set_config("dns_cache_ttl", "300");
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(overrides_from_the_hosts_file),
+	cmocka_unit_test(caches_lookups),
+	cmocka_unit_test(ttl_zero_disables_the_cache),
+    };
+
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,139 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <dirent.h>
+#include <unistd.h>
+
+#include "scrollback.h"
+#include "textBuffer.h"
+
+static char dir[] = "/tmp/test_scrollback.XXXXXX";
+
+static int
+files_in_dir(void)
+{
+    DIR *dirp = opendir(dir);
+    struct dirent *dp;
+    int n = 0;
+
+    assert_non_null(dirp);
+    while ((dp = readdir(dirp)) != NULL) {
+	if (dp->d_name[0] != '.')
+	    n++;
+    }
+    closedir(dirp);
+    return n;
+}
+
+static void
+reads_back_across_segments(void **state)
+{
+    struct scrollback *sb = scrollback_new(dir, "#chan/x");
+    const char *text;
+    char expect[40];
+    int indent = -1;
+
+    assert_non_null(sb);
+    for (int i = 0; i < 10000; i++) {
+	snprintf(expect, sizeof expect, "line %d", i);
+	assert_int_equal(scrollback_append(sb, expect, i % 11), 0);
+    }
+    assert_int_equal(scrollback_count(sb), 10000);
+    assert_int_equal(files_in_dir(), 3);
+
+    /* out of order, and within the segment that's being written */
+    for (int i = 9999; i >= 0; i -= 997) {
+	snprintf(expect, sizeof expect, "line %d", i);
+	assert_non_null(text = scrollback_get(sb, i, &indent));
+	assert_string_equal(text, expect);
+	assert_int_equal(indent, i % 11);
+    }
+    assert_null(scrollback_get(sb, 10000, NULL));
+
+    /* the mapping of the last segment follows new lines */
+    assert_int_equal(scrollback_append(sb, "new line", 0), 0);
+    assert_string_equal(scrollback_get(sb, 10000, NULL), "new line");
+
+    scrollback_destroy(sb);
+    assert_int_equal(files_in_dir(), 0);
+}
+
+static void
+spills_trimmed_lines(void **state)
+{
+    PTEXTBUF buf = textBuf_new();
+    TEXTBUF_ELMT scratch;
+    PTEXTBUF_ELMT element;
+    char text[20];
+
+    textBuf_spill_to(buf, scrollback_new(dir, "#chan"));
+    for (int i = 0; i < 1000; i++) {
+	if (textBuf_size(buf) + 1 > 300)
+	    assert_int_equal(textBuf_remove(buf, textBuf_head(buf)), 0);
+	snprintf(text, sizeof text, "line %d", i);
+	assert_int_equal(textBuf_ins_next(buf, textBuf_tail(buf), text, 3),
+	    0);
+    }
+
+    assert_int_equal(textBuf_first_num(buf), 0);
+    assert_int_equal(textBuf_end_num(buf), 1000);
+
+    for (int num = 0; num < 1000; num++) {
+	snprintf(text, sizeof text, "line %d", num);
+	assert_non_null(element = textBuf_get_line(buf, num, &scratch));
+	assert_string_equal(element->text, text);
+	assert_int_equal(element->indent, 3);
+	assert_true(num >= 700 ? element != &scratch : element == &scratch);
+    }
+    assert_null(textBuf_get_line(buf, 1000, &scratch));
+
+    textBuf_destroy(buf);
+    assert_int_equal(files_in_dir(), 0);
+}
+
+static void
+drops_trimmed_lines_without_spill(void **state)
+{
+    PTEXTBUF buf = textBuf_new();
+    TEXTBUF_ELMT scratch;
+
+    for (int i = 0; i < 20; i++) {
+	assert_int_equal(textBuf_ins_next(buf, textBuf_tail(buf), "x", 0),
+	    0);
+    }
+    for (int i = 0; i < 5; i++)
+	assert_int_equal(textBuf_remove(buf, textBuf_head(buf)), 0);
+
+    assert_int_equal(textBuf_first_num(buf), 5);
+    assert_null(textBuf_get_line(buf, 4, &scratch));
+    assert_ptr_equal(textBuf_get_line(buf, 5, &scratch), textBuf_head(buf));
+    textBuf_destroy(buf);
+}
+
+static int
+setup(void **state)
+{
+    return (mkdtemp(dir) == NULL ? -1 : 0);
+}
+
+static int
+teardown(void **state)
+{
+    return rmdir(dir);
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(reads_back_across_segments),
+	cmocka_unit_test(spills_trimmed_lines),
+	cmocka_unit_test(drops_trimmed_lines_without_spill),
+    };
+
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,73 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "config.h"
+#include "terminal.h"
+
+static int
+setup(void **state)
+{
+    config_init();
+    config_item_install("frame_rate", "5"); /* a frame every 200 ms */
+    term_refresh_init();
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    config_deinit();
+    return 0;
+}
+
+static void
+coalesces_updates(void **state)
+{
+    struct term_refresh_stats before, after;
+
+    term_flush_update(true);
+    term_get_refresh_stats(&before);
+
+    /* the frame was just written, so these wait for the next one */
+    term_request_update();
+    term_request_update();
+    term_request_update();
+    term_flush_update(false);
+    term_get_refresh_stats(&after);
+    assert_int_equal(after.frames, before.frames);
+    assert_int_equal(after.coalesced, before.coalesced + 2);
+
+    term_flush_update(true);
+    term_get_refresh_stats(&after);
+    assert_int_equal(after.frames, before.frames + 1);
+}
+
+static void
+waits_for_the_next_frame(void **state)
+{
+    int wait;
+
+    /* nothing pending: a frame interval, within the limit */
+    term_flush_update(true);
+    assert_int_equal(term_update_wait(1000), 200);
+    assert_int_equal(term_update_wait(90), 90);
+
+    /* pending: until the frame is due */
+    term_request_update();
+    wait = term_update_wait(1000);
+    assert_true(wait > 100 && wait <= 200);
+    term_flush_update(true);
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(coalesces_updates),
+	cmocka_unit_test(waits_for_the_next_frame),
+    };
+
+    return cmocka_run_group_tests(tests, setup, teardown);
+}
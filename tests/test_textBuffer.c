@@ -0,0 +1,252 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "libUtils.h"
+#include "printtext.h"
+#include "textBuffer.h"
+
+static void
+check_positions(PTEXTBUF buf, int first_num)
+{
+    PTEXTBUF_ELMT element = textBuf_head(buf);
+    char text[20];
+
+    for (int pos = 0; pos < textBuf_size(buf); pos++) {
+	snprintf(text, sizeof text, "line %d", first_num + pos);
+	assert_ptr_equal(textBuf_get_element_by_pos(buf, pos), element);
+	assert_string_equal(element->text, text);
+	element = element->next;
+    }
+
+    assert_null(element);
+    assert_null(textBuf_get_element_by_pos(buf, textBuf_size(buf)));
+}
+
+static void
+trims_the_head(void **state)
+{
+    PTEXTBUF buf = textBuf_new();
+    char text[20];
+
+    for (int i = 0; i < 1000; i++) {
+	if (textBuf_size(buf) + 1 > 300)
+	    assert_int_equal(textBuf_remove(buf, textBuf_head(buf)), 0);
+	snprintf(text, sizeof text, "line %d", i);
+	assert_int_equal(textBuf_ins_next(buf, textBuf_tail(buf), text, i % 7),
+	    0);
+    }
+
+    assert_int_equal(textBuf_size(buf), 300);
+    assert_int_equal(textBuf_tail(buf)->indent, 999 % 7);
+    assert_null(textBuf_head(buf)->prev);
+    check_positions(buf, 700);
+    textBuf_destroy(buf);
+}
+
+static void
+inserts_at_both_ends(void **state)
+{
+    PTEXTBUF buf = textBuf_new();
+    char text[20];
+
+    assert_int_equal(textBuf_ins_prev(buf, NULL, "line 100", 0), 0);
+    for (int i = 101; i < 230; i++) {
+	snprintf(text, sizeof text, "line %d", i);
+	assert_int_equal(textBuf_ins_next(buf, textBuf_tail(buf), text, 0),
+	    0);
+    }
+    for (int i = 99; i >= 0; i--) {
+	snprintf(text, sizeof text, "line %d", i);
+	assert_int_equal(textBuf_ins_prev(buf, textBuf_head(buf), text, 0),
+	    0);
+    }
+
+    check_positions(buf, 0);
+    assert_ptr_equal(textBuf_tail(buf)->prev,
+	textBuf_get_element_by_pos(buf, 228));
+
+    /* only the ends */
+    assert_int_equal(textBuf_ins_next(buf, textBuf_head(buf), "x", 0),
+	EINVAL);
+    assert_int_equal(textBuf_remove(buf, textBuf_get_element_by_pos(buf,
+	5)), EINVAL);
+
+    while (textBuf_size(buf) > 50)
+	assert_int_equal(textBuf_remove(buf, textBuf_tail(buf)), 0);
+    check_positions(buf, 0);
+    textBuf_destroy(buf);
+}
+
+static void
+stores_long_lines(void **state)
+{
+    PTEXTBUF buf = textBuf_new();
+    char *text = xmalloc(20000);
+
+    memset(text, 'x', 19999);
+    text[19999] = '\0';
+    assert_int_equal(textBuf_ins_next(buf, NULL, "short", 0), 0);
+    assert_int_equal(textBuf_ins_next(buf, textBuf_tail(buf), text, 0), 0);
+    assert_string_equal(textBuf_tail(buf)->text, text);
+    assert_string_equal(textBuf_head(buf)->text, "short");
+    free(text);
+    textBuf_destroy(buf);
+}
+
+static void
+accounts_bytes(void **state)
+{
+    PTEXTBUF buf = textBuf_new();
+    const size_t block = 64 * sizeof (TEXTBUF_ELMT) + 8192;
+    struct printtext_line *line;
+    size_t one, bytes;
+
+    assert_int_equal(textBuf_bytes(buf), 0);
+    assert_int_equal(textBuf_ins_next(buf, NULL, "abc", 0), 0);
+    one = textBuf_bytes(buf);
+    /* the records of the block and an arena chunk */
+    assert_true(one > block);
+
+    /* the rest of the block goes into what's allocated */
+    for (int i = 1; i < 64; i++) {
+	assert_int_equal(textBuf_ins_next(buf, textBuf_tail(buf), "hello",
+	    0), 0);
+    }
+    assert_int_equal(textBuf_bytes(buf), one);
+
+    assert_int_equal(textBuf_ins_next(buf, textBuf_tail(buf), "hello world",
+	0), 0);
+    assert_true(textBuf_bytes(buf) > one + block);
+
+    /* parsed lines count, and so do their layouts */
+    bytes = textBuf_bytes(buf);
+    line = printtext_line_new("hello world");
+    textBuf_set_line(buf, textBuf_tail(buf), line);
+    assert_true(textBuf_bytes(buf) > bytes);
+    bytes = textBuf_bytes(buf);
+    assert_true(printtext_line_rows(line, "hello world", 0, 6) > 1);
+    assert_true(textBuf_bytes(buf) > bytes);
+
+    /* removing the line frees its block */
+    assert_int_equal(textBuf_remove(buf, textBuf_tail(buf)), 0);
+    assert_int_equal(textBuf_bytes(buf), one);
+    while (textBuf_size(buf) > 0)
+	assert_int_equal(textBuf_remove(buf, textBuf_head(buf)), 0);
+    assert_true(textBuf_bytes(buf) < one - block);
+    textBuf_destroy(buf);
+}
+
+static void
+check_lines(PTEXTBUF buf, int first_num)
+{
+    TEXTBUF_ELMT scratch;
+    PTEXTBUF_ELMT element;
+    char text[64];
+
+    for (int num = first_num; num < textBuf_end_num(buf); num++) {
+	snprintf(text, sizeof text, "line %d: chat text compresses well",
+	    num);
+	assert_non_null(element = textBuf_get_line(buf, num, &scratch));
+	assert_string_equal(element->text, text);
+	assert_int_equal(element->indent, num % 7);
+    }
+}
+
+static void
+compresses_cold_blocks(void **state)
+{
+    PTEXTBUF buf = textBuf_new();
+    PTEXTBUF plain = textBuf_new();
+    char text[64];
+
+    textBuf_set_compress(buf, true);
+    for (int i = 0; i < 2000; i++) {
+	snprintf(text, sizeof text, "line %d: chat text compresses well", i);
+	assert_int_equal(textBuf_ins_next(buf, textBuf_tail(buf), text, i % 7),
+	    0);
+	assert_int_equal(textBuf_ins_next(plain, textBuf_tail(plain), text,
+	    i % 7), 0);
+    }
+
+    assert_true(textBuf_bytes(buf) * 3 < textBuf_bytes(plain));
+    check_lines(buf, 0);
+    assert_null(textBuf_get_element_by_pos(buf, 1000));
+    assert_non_null(textBuf_get_element_by_pos(buf, 10));
+    assert_non_null(textBuf_get_element_by_pos(buf, 1990));
+
+    /* trimming thaws the blocks that become the first one */
+    for (int i = 0; i < 1500; i++)
+	assert_int_equal(textBuf_remove(buf, textBuf_head(buf)), 0);
+    assert_int_equal(textBuf_size(buf), 500);
+    assert_null(textBuf_head(buf)->prev);
+    assert_string_equal(textBuf_head(buf)->next->text,
+	"line 1501: chat text compresses well");
+    check_lines(buf, 1500);
+
+    /* ...and so does removing the last lines */
+    while (textBuf_size(buf) > 1)
+	assert_int_equal(textBuf_remove(buf, textBuf_tail(buf)), 0);
+    assert_ptr_equal(textBuf_head(buf), textBuf_tail(buf));
+    assert_string_equal(textBuf_head(buf)->text,
+	"line 1500: chat text compresses well");
+
+    /* what's left is allocated like in a buffer that never froze */
+    for (int i = 0; i < 1500; i++)
+	assert_int_equal(textBuf_remove(plain, textBuf_head(plain)), 0);
+    while (textBuf_size(plain) > 1)
+	assert_int_equal(textBuf_remove(plain, textBuf_tail(plain)), 0);
+    assert_int_equal(textBuf_bytes(buf), textBuf_bytes(plain));
+
+    textBuf_destroy(buf);
+    textBuf_destroy(plain);
+}
+
+static void
+keeps_lines_unindexed(void **state)
+{
+    PTEXTBUF buf = textBuf_new();
+    TEXTBUF_ELMT scratch;
+    PTEXTBUF_ELMT element;
+    char text[64];
+
+    textBuf_set_compress(buf, true);
+    for (int i = 0; i < 1000; i++) {
+	snprintf(text, sizeof text, "line %d: chat text compresses well", i);
+	assert_int_equal((i % 3 ? textBuf_ins_next : textBuf_ins_next_unindexed)
+	    (buf, textBuf_tail(buf), text, 0), 0);
+    }
+
+    /* in records and frozen blocks alike */
+    assert_null(textBuf_get_element_by_pos(buf, 500));
+    for (int num = 0; num < 1000; num++) {
+	assert_non_null(element = textBuf_get_line(buf, num, &scratch));
+	assert_int_equal(element->indexed, num % 3 != 0);
+    }
+
+    /* ...and in thawed ones */
+    for (int i = 0; i < 600; i++)
+	assert_int_equal(textBuf_remove(buf, textBuf_head(buf)), 0);
+    assert_non_null(textBuf_get_element_by_pos(buf, 0));
+    assert_false(textBuf_get_element_by_pos(buf, 0)->indexed);
+    assert_true(textBuf_get_element_by_pos(buf, 1)->indexed);
+
+    textBuf_destroy(buf);
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(trims_the_head),
+	cmocka_unit_test(inserts_at_both_ends),
+	cmocka_unit_test(stores_long_lines),
+	cmocka_unit_test(accounts_bytes),
+	cmocka_unit_test(compresses_cold_blocks),
+	cmocka_unit_test(keeps_lines_unindexed),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
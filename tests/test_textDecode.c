@@ -0,0 +1,129 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "textDecode.h"
+
+static wchar_t out[1024];
+
+static size_t
+decode(const char *s, enum text_encoding fallback, enum text_encoding *used)
+{
+    return text_decode(s, strlen(s), out, fallback, used);
+}
+
+static void
+decodes_ascii(void **state)
+{
+    enum text_encoding used;
+
+    assert_int_equal(decode("PRIVMSG #chan :hello", TEXT_ENC_ISO8859_1,
+	&used), 20);
+    assert_int_equal(used, TEXT_ENC_UTF8);
+    assert_true(wcscmp(out, L"PRIVMSG #chan :hello") == 0);
+    assert_int_equal(decode("", TEXT_ENC_ISO8859_1, NULL), 0);
+    assert_int_equal(out[0], L'\0');
+}
+
+static void
+decodes_utf8(void **state)
+{
+    enum text_encoding used;
+
+    /* U+00E5, U+20AC and U+1F600 */
+    assert_int_equal(decode("\xc3\xa5 \xe2\x82\xac \xf0\x9f\x98\x80",
+	TEXT_ENC_ISO8859_1, &used), WCHAR_MAX > 0xFFFF ? 5 : 6);
+    assert_int_equal(used, TEXT_ENC_UTF8);
+    assert_int_equal(out[0], 0xE5);
+    assert_int_equal(out[2], 0x20AC);
+    if (WCHAR_MAX > 0xFFFF)
+	assert_int_equal(out[4], 0x1F600);
+}
+
+static void
+rejects_invalid_utf8(void **state)
+{
+    static const char *invalid[] = {
+	"\xc0\xaf",		/* overlong '/' */
+	"\xe0\x80\xaf",		/* overlong '/' */
+	"\xed\xa0\x80",		/* surrogate */
+	"\xf4\x90\x80\x80",	/* above U+10FFFF */
+	"\xf5\x80\x80\x80",	/* invalid lead byte */
+	"abc\xe2\x82",		/* truncated */
+	"\x80",			/* stray continuation byte */
+	"caf\xe9",		/* Latin-1 */
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(invalid); i++)
+	assert_false(text_is_utf8(invalid[i], strlen(invalid[i])));
+}
+
+static void
+falls_back_to_latin(void **state)
+{
+    enum text_encoding used;
+
+    assert_int_equal(decode("caf\xe9 \xa4", TEXT_ENC_ISO8859_1, &used), 6);
+    assert_int_equal(used, TEXT_ENC_ISO8859_1);
+    assert_int_equal(out[3], 0xE9);
+    assert_int_equal(out[5], 0xA4);
+
+    assert_int_equal(decode("caf\xe9 \xa4", TEXT_ENC_ISO8859_15, &used), 6);
+    assert_int_equal(used, TEXT_ENC_ISO8859_15);
+    assert_int_equal(out[3], 0xE9);
+    assert_int_equal(out[5], 0x20AC);
+
+    /* one bad byte makes the whole line Latin */
+    assert_int_equal(decode("\xc3\xa5\xff", TEXT_ENC_UTF8, &used), 3);
+    assert_int_equal(used, TEXT_ENC_ISO8859_1);
+    assert_int_equal(out[0], 0xC3);
+}
+
+/*
+ * Multibyte characters at every offset around the 16-byte blocks
+ */
+static void
+handles_block_boundaries(void **state)
+{
+    char buf[64];
+
+    for (size_t pos = 0; pos < 40; pos++) {
+	memset(buf, 'x', sizeof buf);
+	memcpy(&buf[pos], "\xe2\x82\xac", 3);
+	buf[48] = '\0';
+
+	assert_int_equal(decode(buf, TEXT_ENC_ISO8859_1, NULL), 46);
+	assert_int_equal(out[pos], 0x20AC);
+	assert_int_equal(out[pos + 1], L'x');
+
+	buf[pos + 1] = 'x'; /* now invalid: Latin-1 */
+	assert_int_equal(decode(buf, TEXT_ENC_ISO8859_1, NULL), 48);
+	assert_int_equal(out[pos], 0xE2);
+	assert_int_equal(out[pos + 2], 0xAC);
+    }
+}
+
+static void
+maps_encoding_names(void **state)
+{
+    assert_int_equal(text_encoding_by_name("UTF-8"), TEXT_ENC_UTF8);
+    assert_int_equal(text_encoding_by_name("iso-8859-15"), TEXT_ENC_ISO8859_15);
+    assert_int_equal(text_encoding_by_name("iso-8859-1"), TEXT_ENC_ISO8859_1);
+    assert_int_equal(text_encoding_by_name("bogus"), TEXT_ENC_ISO8859_1);
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(decodes_ascii),
+	cmocka_unit_test(decodes_utf8),
+	cmocka_unit_test(rejects_invalid_utf8),
+	cmocka_unit_test(falls_back_to_latin),
+	cmocka_unit_test(handles_block_boundaries),
+	cmocka_unit_test(maps_encoding_names),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,128 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "printtext.h"
+#include "textBuffer.h"
+#include "textIndex.h"
+
+static void
+normalizes_text(void **state)
+{
+    char text[] = "\002Hello\017, \00304,01WoRLD\003!";
+    char out[sizeof text];
+
+    textIndex_normalize(text, out);
+    assert_string_equal(out, "hello, world!");
+}
+
+static void
+finds_candidates(void **state)
+{
+    struct text_index *index = textIndex_new();
+    struct text_index *empty = textIndex_new();
+    int *nums = NULL;
+
+    textIndex_add(index, 0, "the quick brown fox");
+    textIndex_add(index, 1, "jumps over");
+    textIndex_add(index, 2, "the \002LAZY\002 dog");
+    textIndex_add(index, 3, "and the brown dog");
+
+    /* all lines of the bucket are candidates */
+    assert_int_equal(textIndex_candidates(index, "lazy dog", &nums), 4);
+    assert_int_equal(nums[0], 0);
+    assert_int_equal(nums[3], 3);
+    free(nums);
+
+    assert_int_equal(textIndex_candidates(index, "cat", &nums), 0);
+    assert_null(nums);
+    assert_int_equal(textIndex_candidates(index, "ox", &nums), -1);
+
+    /* from the front and the back */
+    textIndex_remove(index, 0);
+    textIndex_remove(index, 3);
+    assert_int_equal(textIndex_candidates(index, "brown", &nums), 2);
+    assert_int_equal(nums[0], 1);
+    assert_int_equal(nums[1], 2);
+    free(nums);
+
+    textIndex_remove(index, 1);
+    textIndex_remove(index, 2);
+    assert_int_equal(textIndex_candidates(index, "the", &nums), 0);
+    assert_int_equal(textIndex_bytes(index), textIndex_bytes(empty) +
+	strlen("the quick brown fox") + 1);
+
+    textIndex_destroy(index);
+    textIndex_destroy(empty);
+}
+
+static void
+grows_with_many_lines(void **state)
+{
+    struct text_index *index = textIndex_new();
+    char text[40];
+    int *nums = NULL;
+    size_t bytes = textIndex_bytes(index);
+
+    for (int i = 0; i < 20000; i++) {
+	snprintf(text, sizeof text, "message %05d", i);
+	textIndex_add(index, i, text);
+    }
+    assert_true(textIndex_bytes(index) > bytes);
+
+    assert_int_equal(textIndex_candidates(index, "message 12345", &nums), 64);
+    assert_true(nums[0] <= 12345 && nums[63] >= 12345);
+    free(nums);
+    assert_int_equal(textIndex_candidates(index, "ssa", &nums), 20000);
+    free(nums);
+
+    textIndex_destroy(index);
+}
+
+static void
+follows_the_text_buffer(void **state)
+{
+    PTEXTBUF buf = textBuf_new();
+    char text[40];
+    int *nums = NULL;
+
+    textBuf_index_lines(buf, true);
+    for (int i = 0; i < 500; i++) {
+	snprintf(text, sizeof text, "line %d %s", i,
+	    (i % 100 == 0 ? "needle" : "hay"));
+	assert_int_equal(textBuf_ins_next(buf, textBuf_tail(buf), text, 0),
+	    0);
+    }
+
+    assert_int_equal(textIndex_candidates(buf->index, "needle", &nums),
+	5 * 64);
+    assert_int_equal(nums[0], 0);
+    free(nums);
+
+    /* trimmed lines leave the index */
+    while (textBuf_first_num(buf) <= 200)
+	assert_int_equal(textBuf_remove(buf, textBuf_head(buf)), 0);
+    assert_int_equal(textIndex_candidates(buf->index, "needle", &nums),
+	3 * 64 - 9);
+    assert_int_equal(nums[0], 201);
+    assert_int_equal(nums[3 * 64 - 10], 447);
+    free(nums);
+
+    textBuf_destroy(buf);
+}
+
+int
+main(void)
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(normalizes_text),
+	cmocka_unit_test(finds_candidates),
+	cmocka_unit_test(grows_with_many_lines),
+	cmocka_unit_test(follows_the_text_buffer),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,90 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "curses-funcs.h"
+#include "theme.h"
+
+static char path1[] = "/tmp/swirc-test_theme.XXXXXX";
+static char path2[] = "/tmp/swirc-test_theme.XXXXXX";
+
+static int
+write_theme(char *path, const char *contents)
+{
+    FILE *fp;
+    int fd;
+
+    if ((fd = mkstemp(path)) == -1 || (fp = fdopen(fd, "w")) == NULL)
+	return -1;
+    fputs(contents, fp);
+    fclose(fp);
+    return 0;
+}
+
+static int
+read_theme(void **state)
+{
+    if (write_theme(path1, "specifier1 = \"[-]\";\n"
+	    "term_background = \"99\";\n"
+	    "term_use_default_colors = \"no\";\n"
+	    "titlebar_fg = \"red\";\n") != 0 ||
+	write_theme(path2, "specifier1 = \"[*]\";\n") != 0)
+	return -1;
+
+    theme_init();
+    theme_readit(path1, "r");
+    return 0;
+}
+
+static int
+remove_themes(void **state)
+{
+    theme_deinit();
+    (void) remove(path1);
+    (void) remove(path2);
+    return 0;
+}
+
+static void
+compiles_items(void **state)
+{
+    const struct theme_snapshot *theme = theme_current();
+
+    assert_string_equal(theme->specifier1, "[-]");
+    assert_string_equal(THE_SPEC1, "[-]");
+    assert_false(theme->term_use_default_colors);
+    assert_int_equal(theme->titlebar_fg, COLOR_RED);
+    /* out of range */
+    assert_int_equal(theme->term_background, 1);
+    /* missing items get their defaults */
+    assert_string_equal(theme->statusbar_spec, "[-]");
+}
+
+static void
+reload_swaps_snapshots(void **state)
+{
+    const struct theme_snapshot *old = theme_current();
+
+    theme_reload(path2);
+    assert_true(theme_current() != old);
+    assert_true(theme_current()->generation > old->generation);
+    assert_string_equal(THE_SPEC1, "[*]");
+    assert_true(theme_current()->term_use_default_colors);
+
+    /* older snapshots stay valid, however many reloads later */
+    theme_reload(path1);
+    theme_reload(path2);
+    assert_string_equal(old->specifier1, "[-]");
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(compiles_items),
+	cmocka_unit_test(reload_swaps_snapshots),
+    };
+
+    return cmocka_run_group_tests(tests, read_theme, remove_themes);
+}
@@ -0,0 +1,106 @@
+#include "common.h"
+
+#include <setjmp.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "config.h"
+#include "libUtils.h"
+#include "textBuffer.h"
+#include "window.h"
+
+static int
+setup(void **state)
+{
+    config_init();
+    config_item_install("scrollback_budget", "1"); /* MB */
+    config_item_install("scrollback_compress", "no");
+    config_item_install("scrollback_index", "no");
+    config_item_install("scrollback_spill", "no");
+    return 0;
+}
+
+static int
+teardown(void **state)
+{
+    config_deinit();
+    return 0;
+}
+
+static PIRC_WINDOW
+new_window(const char *label, unsigned int last_viewed, int lines,
+	   size_t len)
+{
+    PIRC_WINDOW window = window_new_for_testing(label);
+    char *text = xmalloc(len + 1);
+
+    memset(text, 'x', len);
+    text[len] = '\0';
+    for (int i = 0; i < lines; i++) {
+	assert_int_equal(textBuf_ins_next(window->buf,
+	    textBuf_tail(window->buf), text, 0), 0);
+    }
+    free(text);
+
+    window->last_viewed = last_viewed;
+    return window;
+}
+
+static void
+evicts_least_recently_viewed_first(void **state)
+{
+    PIRC_WINDOW a = new_window("#a", 1, 150, 200);
+    PIRC_WINDOW b = new_window("#b", 3, 4000, 200);
+    PIRC_WINDOW c = new_window("#c", 2, 3000, 200);
+    int evicted;
+
+    window_enforce_budget();
+    assert_true(window_scrollback_bytes() <= 1024 * 1024);
+
+    /* 'a' and then 'c' go down to the floor before 'b' is touched */
+    assert_int_equal(textBuf_size(a->buf), 100);
+    assert_int_equal(a->evicted, 50);
+    assert_int_equal(textBuf_size(c->buf), 100);
+    assert_int_equal(c->evicted, 2900);
+    assert_true(b->evicted > 0);
+    assert_int_equal(textBuf_size(b->buf), 4000 - b->evicted);
+
+    /* within the budget nothing more goes */
+    evicted = b->evicted;
+    window_enforce_budget();
+    assert_int_equal(b->evicted, evicted);
+
+    window_free_for_testing(a);
+    window_free_for_testing(b);
+    window_free_for_testing(c);
+}
+
+static void
+keeps_the_floor_over_budget(void **state)
+{
+    PIRC_WINDOW a = new_window("#a", 1, 150, 8000);
+    PIRC_WINDOW b = new_window("#b", 2, 150, 8000);
+
+    window_enforce_budget();
+
+    /* still over budget, but no window goes below 100 lines */
+    assert_true(window_scrollback_bytes() > 1024 * 1024);
+    assert_int_equal(textBuf_size(a->buf), 100);
+    assert_int_equal(a->evicted, 50);
+    assert_int_equal(textBuf_size(b->buf), 100);
+    assert_int_equal(b->evicted, 50);
+
+    window_free_for_testing(a);
+    window_free_for_testing(b);
+}
+
+int
+main()
+{
+    const struct CMUnitTest tests[] = {
+	cmocka_unit_test(evicts_least_recently_viewed_first),
+	cmocka_unit_test(keeps_the_floor_over_budget),
+    };
+
+    return cmocka_run_group_tests(tests, setup, teardown);
+}